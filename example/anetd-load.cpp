@@ -0,0 +1,457 @@
+/*
+ * HTTP Load Generator for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * anetd-load - a HTTP load generator
+ *
+ * Runs -c concurrent requests against one URL, spread over -t threads that each run their own IO Service, for -d seconds or -n requests.
+ *
+ * Without -R every connection sends its next request as soon as the previous one completes (closed loop), so the load goes down when the
+ * server slows down. With -R the requests are sent at a fixed total rate (open loop): each connection has a schedule of send times, and the
+ * latency of a request is measured from the time it was scheduled to be sent, not from when it was actually sent. A server that stalls then
+ * shows the delay it caused every request queued behind the stall, instead of hiding it (coordinated omission). The latency measured from the
+ * actual send time is reported as well.
+ *
+ * The http_engine class closes the connection after every response, so each request is made on a new connection, and the latency includes
+ * the connect (and TLS handshake).
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// Boost
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/program_options.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/smart_ptr/detail/atomic_count.hpp>
+#include <boost/thread.hpp>
+
+#include "anetd/anetd.hpp"
+#include "anetd/LogClass.hpp"
+
+using namespace DynamX::anetd;
+using namespace DynamX::Logging;
+
+/* a Log-Linear Latency Histogram, in microseconds
+ *
+ * Values below 128 have a bucket each. Above that every power of two is split into 64 buckets, so a value is recorded with a error of at
+ * most 1/64 (reported at the middle of its bucket, so within 0.8%) at any magnitude, in a fixed 30 KB of counters.
+ */
+class latency_histogram
+{
+public:
+	enum {
+		SUBBITS = 6,
+		SUBCOUNT = 1 << SUBBITS,
+		LINEAR = 2 * SUBCOUNT,
+		BUCKETS = LINEAR + (64 - SUBBITS - 1) * SUBCOUNT
+	};
+	latency_histogram() : counts(BUCKETS, 0), total(0), sum(0), sumsquares(0), minimum(0), maximum(0)
+	{
+	}
+	void record(boost::uint64_t value) {
+		this->counts[index(value)]++;
+		if (this->total == 0 || value < this->minimum)
+			this->minimum = value;
+		if (value > this->maximum)
+			this->maximum = value;
+		this->total++;
+		this->sum += value;
+		this->sumsquares += static_cast<double>(value) * value;
+	}
+	void merge(const latency_histogram &other) {
+		if (other.total == 0)
+			return;
+		for (size_t i = 0; i < BUCKETS; i++)
+			this->counts[i] += other.counts[i];
+		if (this->total == 0 || other.minimum < this->minimum)
+			this->minimum = other.minimum;
+		this->maximum = std::max(this->maximum, other.maximum);
+		this->total += other.total;
+		this->sum += other.sum;
+		this->sumsquares += other.sumsquares;
+	}
+	boost::uint64_t count() const {
+		return this->total;
+	}
+	boost::uint64_t min() const {
+		return this->minimum;
+	}
+	boost::uint64_t max() const {
+		return this->maximum;
+	}
+	double mean() const {
+		return this->total ? this->sum / this->total : 0;
+	}
+	double stddev() const {
+		if (this->total < 2)
+			return 0;
+		double m = this->mean();
+		return std::sqrt(std::max(0.0, this->sumsquares / this->total - m * m));
+	}
+	/* the value at or below which pct percent of the recorded values are */
+	double percentile(double pct) const {
+		if (this->total == 0)
+			return 0;
+		boost::uint64_t rank = static_cast<boost::uint64_t>(std::ceil(pct / 100 * this->total));
+		if (rank < 1)
+			rank = 1;
+		boost::uint64_t seen = 0;
+		for (size_t i = 0; i < BUCKETS; i++) {
+			seen += this->counts[i];
+			if (seen >= rank)
+				return std::min(std::max(middle(i), static_cast<double>(this->minimum)), static_cast<double>(this->maximum));
+		}
+		return this->maximum;
+	}
+private:
+	static size_t index(boost::uint64_t value) {
+		if (value < LINEAR)
+			return static_cast<size_t>(value);
+		unsigned int msb = 63 - __builtin_clzll(value);
+		unsigned int shift = msb - SUBBITS;
+		return LINEAR + (shift - 1) * SUBCOUNT + static_cast<size_t>((value >> shift) - SUBCOUNT);
+	}
+	static double middle(size_t index) {
+		if (index < LINEAR)
+			return index;
+		unsigned int shift = (index - LINEAR) / SUBCOUNT + 1;
+		boost::uint64_t low = static_cast<boost::uint64_t>((index - LINEAR) % SUBCOUNT + SUBCOUNT) << shift;
+		return low + ((static_cast<boost::uint64_t>(1) << shift) - 1) / 2.0;
+	}
+	std::vector<boost::uint64_t> counts;
+	boost::uint64_t total;
+	double sum;
+	double sumsquares;
+	boost::uint64_t minimum;
+	boost::uint64_t maximum;
+};
+
+/* a http_response class that counts the body (getProgress() does that) but never stores or copies it */
+class discard_response : public http_response
+{
+protected:
+	void onData(const char *, size_t) {
+	}
+};
+
+struct load_config {
+	std::string url;
+	std::vector<std::pair<std::string, std::string> > headers;
+	unsigned int connections;
+	unsigned int threads;
+	boost::posix_time::time_duration duration;
+	boost::uint64_t requests;
+	double rate;
+	boost::posix_time::time_duration timeout;
+};
+
+struct load_stats {
+	load_stats() : completed(0), bytes(0), failed(0) {}
+	void merge(const load_stats &other) {
+		this->latency.merge(other.latency);
+		this->uncorrected.merge(other.uncorrected);
+		this->completed += other.completed;
+		this->bytes += other.bytes;
+		this->failed += other.failed;
+		for (std::map<std::string, boost::uint64_t>::const_iterator e = other.errors.begin(); e != other.errors.end(); ++e)
+			this->errors[e->first] += e->second;
+	}
+	latency_histogram latency;
+	latency_histogram uncorrected;
+	boost::uint64_t completed;
+	boost::uint64_t bytes;
+	boost::uint64_t failed;
+	std::map<std::string, boost::uint64_t> errors;
+};
+
+class load_thread;
+
+/* one concurrent request slot */
+class load_connection
+{
+public:
+	load_connection(load_thread &mythread, boost::asio::io_service &io, const load_config &config, boost::posix_time::time_duration myinterval,
+			boost::posix_time::ptime firstsend);
+	void start();
+	void stop();
+private:
+	void send(const boost::system::error_code &err);
+	void done(const boost::system::error_code &err, http_response *res);
+	void handle_timeout(const boost::system::error_code &err, unsigned int mygeneration);
+	load_thread &thread;
+	boost::asio::io_service &io;
+	http_engine engine;
+	discard_response response;
+	const std::string &url;
+	boost::asio::deadline_timer sendtimer;
+	boost::asio::deadline_timer timeouttimer;
+	boost::posix_time::time_duration interval;
+	boost::posix_time::time_duration timeout;
+	boost::posix_time::ptime scheduled;
+	boost::posix_time::ptime sent;
+	unsigned int generation;
+	bool busy;
+	bool timedout;
+	bool stopping;
+};
+
+/* a thread running a share of the connections on its own IO Service */
+class load_thread
+{
+public:
+	load_thread(const load_config &myconfig, boost::detail::atomic_count &myissued, unsigned int connections, unsigned int first,
+			boost::posix_time::ptime start) :
+			config(myconfig), issued(myissued), stoptimer(io), active(0)
+	{
+		/* the connections share the rate equally, and are staggered so the requests are spread evenly over time */
+		boost::posix_time::time_duration interval;
+		if (this->config.rate > 0)
+			interval = boost::posix_time::microseconds(static_cast<boost::int64_t>(1e6 * this->config.connections / this->config.rate));
+		for (unsigned int i = 0; i < connections; i++)
+			this->connections.push_back(boost::shared_ptr<load_connection>(new load_connection(*this, this->io, this->config, interval,
+					start + interval * (first + i) / this->config.connections)));
+		if (!this->config.duration.is_special()) {
+			this->stoptimer.expires_at(start + this->config.duration);
+			this->stoptimer.async_wait(boost::bind(&load_thread::stop, this, boost::asio::placeholders::error));
+		}
+	}
+	void run() {
+		for (std::vector<boost::shared_ptr<load_connection> >::iterator c = this->connections.begin(); c != this->connections.end(); ++c)
+			(*c)->start();
+		this->io.run();
+	}
+	/* claim the next request, false once the request count is reached */
+	bool claim() {
+		return this->config.requests == 0 || static_cast<boost::uint64_t>(++this->issued) <= this->config.requests;
+	}
+	void started() {
+		this->active++;
+	}
+	void finished() {
+		/* the duration timer is the only other work, so the thread stops once the last connection is done */
+		if (--this->active == 0)
+			this->stoptimer.cancel();
+	}
+	void stop(const boost::system::error_code &err) {
+		if (err)
+			return;
+		for (std::vector<boost::shared_ptr<load_connection> >::iterator c = this->connections.begin(); c != this->connections.end(); ++c)
+			(*c)->stop();
+	}
+	load_stats stats;
+private:
+	const load_config &config;
+	boost::detail::atomic_count &issued;
+	boost::asio::io_service io;
+	std::vector<boost::shared_ptr<load_connection> > connections;
+	boost::asio::deadline_timer stoptimer;
+	unsigned int active;
+};
+
+load_connection::load_connection(load_thread &mythread, boost::asio::io_service &myio, const load_config &config,
+		boost::posix_time::time_duration myinterval, boost::posix_time::ptime firstsend) :
+		thread(mythread), io(myio), engine(&myio, &myio), url(config.url), sendtimer(myio), timeouttimer(myio), interval(myinterval),
+		timeout(config.timeout), scheduled(firstsend), generation(0), busy(false), timedout(false), stopping(false)
+{
+	for (std::vector<std::pair<std::string, std::string> >::const_iterator h = config.headers.begin(); h != config.headers.end(); ++h)
+		this->response.setHeader(h->first, h->second);
+}
+
+void load_connection::start() {
+	this->thread.started();
+	this->sendtimer.expires_at(this->scheduled);
+	this->sendtimer.async_wait(boost::bind(&load_connection::send, this, boost::asio::placeholders::error));
+}
+
+void load_connection::stop() {
+	this->stopping = true;
+	this->sendtimer.cancel();
+	if (this->busy)
+		this->engine.cancel();
+}
+
+void load_connection::send(const boost::system::error_code &err) {
+	if (err || this->stopping || !this->thread.claim())
+		return this->thread.finished();
+	this->sent = boost::posix_time::microsec_clock::universal_time();
+	/* in closed loop mode the request is due the moment it is sent */
+	if (this->interval.ticks() == 0)
+		this->scheduled = this->sent;
+	this->response.reset();
+	this->response.setURL(this->url);
+	this->busy = true;
+	this->timedout = false;
+	this->generation++;
+	if (!this->timeout.is_special()) {
+		this->timeouttimer.expires_from_now(this->timeout);
+		this->timeouttimer.async_wait(boost::bind(&load_connection::handle_timeout, this, boost::asio::placeholders::error, this->generation));
+	}
+	this->engine.start(&this->response, boost::bind(&load_connection::done, this, _1, _2));
+}
+
+void load_connection::handle_timeout(const boost::system::error_code &err, unsigned int mygeneration) {
+	if (err || !this->busy || mygeneration != this->generation)
+		return;
+	this->timedout = true;
+	this->engine.cancel();
+}
+
+void load_connection::done(const boost::system::error_code &err, http_response *res) {
+	boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+	this->busy = false;
+	this->timeouttimer.cancel();
+	load_stats &stats = this->thread.stats;
+	/* requests cut off by the end of the run are not counted, as they never had the chance to complete */
+	if (this->stopping && !this->timedout && err == boost::asio::error::operation_aborted)
+		return this->thread.finished();
+	stats.completed++;
+	stats.bytes += res->getProgress();
+	stats.latency.record(std::max<boost::int64_t>(0, (now - this->scheduled).total_microseconds()));
+	stats.uncorrected.record(std::max<boost::int64_t>(0, (now - this->sent).total_microseconds()));
+	if (err) {
+		stats.failed++;
+		stats.errors[this->timedout ? std::string("timeout") : err.message()]++;
+	} else if (res->getStatus() < 200 || res->getStatus() > 399) {
+		stats.failed++;
+		stats.errors[boost::str(boost::format("HTTP %1% %2%") % res->getStatus() % res->getDescription())]++;
+	}
+	if (this->interval.ticks() > 0)
+		this->scheduled += this->interval;
+	if (this->stopping)
+		return this->thread.finished();
+	/* the engine is still unwinding from this callback (and a cancel from the timeout may still be queued for it), so the next request
+	 * is always started from the IO Service */
+	this->sendtimer.expires_at(this->interval.ticks() > 0 ? this->scheduled : now);
+	this->sendtimer.async_wait(boost::bind(&load_connection::send, this, boost::asio::placeholders::error));
+}
+
+static void print_latency(const char *title, const latency_histogram &latency) {
+	std::cout << title << std::endl;
+	std::cout << boost::format("    mean %1$10.3f ms   stdev %2$10.3f ms   min %3$10.3f ms   max %4$10.3f ms\n") % (latency.mean() / 1000)
+			% (latency.stddev() / 1000) % (latency.min() / 1000.0) % (latency.max() / 1000.0);
+	static const double percentiles[] = { 50, 75, 90, 99, 99.9, 99.99, 99.999, 100 };
+	for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++)
+		std::cout << boost::format("    %1$8g%% %2$12.3f ms\n") % percentiles[i] % (latency.percentile(percentiles[i]) / 1000);
+}
+
+// Application entry point.
+int
+main (int argc, char *argv[])
+{
+	namespace po = boost::program_options;
+	load_config config;
+	double duration;
+	double timeout;
+	std::vector<std::string> headers;
+	po::options_description options("Usage: anetd-load [options] url\n\nOptions");
+	options.add_options()
+		("help,h", "show this help")
+		("connections,c", po::value<unsigned int>(&config.connections)->default_value(10), "number of concurrent requests (each request is made on a new connection)")
+		("threads,t", po::value<unsigned int>(&config.threads)->default_value(2), "number of threads")
+		("duration,d", po::value<double>(&duration)->default_value(10), "seconds to run for, 0 to run until -n requests are done")
+		("requests,n", po::value<boost::uint64_t>(&config.requests)->default_value(0), "number of requests to send, 0 for no limit")
+		("rate,R", po::value<double>(&config.rate)->default_value(0), "total requests per second, 0 to send as fast as the server answers")
+		("timeout,T", po::value<double>(&timeout)->default_value(0), "seconds before a request is cancelled, 0 for no timeout")
+		("header,H", po::value<std::vector<std::string> >(&headers), "header to send, as \"Name: value\"")
+		("verbose,v", "log errors of the requests");
+	po::options_description hidden;
+	hidden.add_options()
+		("url", po::value<std::string>(&config.url));
+	po::options_description all;
+	all.add(options).add(hidden);
+	po::positional_options_description positional;
+	positional.add("url", 1);
+	po::variables_map vm;
+	try {
+		po::store(po::command_line_parser(argc, argv).options(all).positional(positional).run(), vm);
+		po::notify(vm);
+	} catch (std::exception &e) {
+		std::cerr << e.what() << std::endl << options << std::endl;
+		return 2;
+	}
+	if (vm.count("help")) {
+		std::cout << options << std::endl;
+		return 0;
+	}
+	if (config.url.empty() || config.connections == 0 || config.threads == 0 || (duration <= 0 && config.requests == 0)) {
+		std::cerr << "A URL, at least one connection and thread, and a duration or request count are needed" << std::endl << options << std::endl;
+		return 2;
+	}
+	for (std::vector<std::string>::iterator h = headers.begin(); h != headers.end(); ++h) {
+		std::string::size_type colon = h->find(':');
+		if (colon == std::string::npos) {
+			std::cerr << "Invalid header " << *h << std::endl;
+			return 2;
+		}
+		std::string::size_type value = h->find_first_not_of(' ', colon + 1);
+		config.headers.push_back(std::make_pair(h->substr(0, colon), value == std::string::npos ? std::string() : h->substr(value)));
+	}
+	config.threads = std::min(config.threads, config.connections);
+	config.duration = duration > 0 ? boost::posix_time::microseconds(static_cast<boost::int64_t>(duration * 1e6)) : boost::posix_time::time_duration(boost::posix_time::not_a_date_time);
+	config.timeout = timeout > 0 ? boost::posix_time::microseconds(static_cast<boost::int64_t>(timeout * 1e6)) : boost::posix_time::time_duration(boost::posix_time::not_a_date_time);
+
+	/* a overloaded server makes every request fail, which is counted, not logged */
+	Log::Create("", true, vm.count("verbose") ? LogLevel_Error : LogLevel_None);
+
+	if (config.rate > 0)
+		std::cout << boost::format("Sending %1% requests/s to %2% for %3%, %4% connections on %5% threads\n") % config.rate % config.url
+				% (config.requests ? boost::str(boost::format("%1% requests") % config.requests) : boost::str(boost::format("%1% s") % duration))
+				% config.connections % config.threads;
+	else
+		std::cout << boost::format("Sending requests to %1% as fast as possible for %2%, %3% connections on %4% threads\n") % config.url
+				% (config.requests ? boost::str(boost::format("%1% requests") % config.requests) : boost::str(boost::format("%1% s") % duration))
+				% config.connections % config.threads;
+
+	boost::detail::atomic_count issued(0);
+	boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+	std::vector<boost::shared_ptr<load_thread> > workers;
+	for (unsigned int i = 0, first = 0; i < config.threads; i++) {
+		unsigned int connections = config.connections / config.threads + (i < config.connections % config.threads ? 1 : 0);
+		workers.push_back(boost::shared_ptr<load_thread>(new load_thread(config, issued, connections, first, start)));
+		first += connections;
+	}
+	boost::thread_group threads;
+	for (std::vector<boost::shared_ptr<load_thread> >::iterator w = workers.begin(); w != workers.end(); ++w)
+		threads.create_thread(boost::bind(&load_thread::run, w->get()));
+	threads.join_all();
+	double elapsed = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+
+	load_stats stats;
+	for (std::vector<boost::shared_ptr<load_thread> >::iterator w = workers.begin(); w != workers.end(); ++w)
+		stats.merge((*w)->stats);
+
+	print_latency(config.rate > 0 ? "Latency (from the scheduled send time)" : "Latency", stats.latency);
+	if (config.rate > 0)
+		print_latency("Latency (from the actual send time, not corrected for coordinated omission)", stats.uncorrected);
+	std::cout << boost::format("%1% requests in %2$.2f s, %3$.2f MB read\n") % stats.completed % elapsed % (stats.bytes / 1e6);
+	if (stats.failed > 0) {
+		std::cout << boost::format("%1% failed requests:\n") % stats.failed;
+		for (std::map<std::string, boost::uint64_t>::iterator e = stats.errors.begin(); e != stats.errors.end(); ++e)
+			std::cout << boost::format("    %1$10d  %2%\n") % e->second % e->first;
+	}
+	std::cout << boost::format("Requests/s: %1$10.2f\n") % (elapsed > 0 ? stats.completed / elapsed : 0);
+	std::cout << boost::format("Transfer/s: %1$10.2f MB\n") % (elapsed > 0 ? stats.bytes / 1e6 / elapsed : 0);
+	return stats.completed > 0 && stats.failed < stats.completed ? 0 : 1;
+}
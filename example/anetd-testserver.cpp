@@ -0,0 +1,214 @@
+/*
+ * HTTP Test Server for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * anetd-testserver - a minimal HTTP/1.1 server to run anetd-load against on the loopback interface
+ *
+ * Answers every GET with a body of -s bytes, or of N bytes for /size/N, and closes the connection after the response. /sleep/MS holds
+ * the response for MS milliseconds. With --stall-after the server stops answering once that many requests have arrived, and answers
+ * everything that arrived in the meantime --stall milliseconds later, which is what a garbage collection pause or a blocked disk looks
+ * like to a client. Running anetd-load with -R against a stall shows how much of it the corrected latency reports:
+ *
+ *	anetd-testserver -p 18080 --stall-after 50 --stall 1500 &
+ *	anetd-load -R 20 -c 1 -d 10 http://127.0.0.1:18080/
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+// Boost
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/program_options.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+using boost::asio::ip::tcp;
+
+struct server_config {
+	unsigned short port;
+	unsigned int threads;
+	size_t size;
+	boost::uint64_t stallafter;
+	boost::posix_time::time_duration stall;
+};
+
+class test_server;
+
+/* one request, on its own connection */
+class test_connection : public boost::enable_shared_from_this<test_connection>
+{
+public:
+	test_connection(boost::asio::io_service &io, test_server &myserver) : socket(io), timer(io), server(myserver)
+	{
+	}
+	tcp::socket socket;
+	void start();
+private:
+	void handle_read(const boost::system::error_code &err, size_t len);
+	void respond(const boost::system::error_code &err);
+	void handle_write(const boost::system::error_code &err, size_t len);
+	boost::asio::deadline_timer timer;
+	test_server &server;
+	boost::asio::streambuf request;
+	std::string path;
+	std::string response;
+};
+
+class test_server
+{
+public:
+	test_server(boost::asio::io_service &myio, const server_config &myconfig) :
+			io(myio), config(myconfig), acceptor(myio, tcp::endpoint(boost::asio::ip::address_v4::loopback(), myconfig.port)), requests(0)
+	{
+		this->accept();
+	}
+	/* when the response to a request that just arrived is due, not_a_date_time for at once */
+	boost::posix_time::ptime arrived() {
+		boost::mutex::scoped_lock lock(this->SLock);
+		boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+		if (++this->requests == this->config.stallafter && this->config.stall.ticks() > 0) {
+			this->stalluntil = now + this->config.stall;
+			std::cout << boost::format("Stalling for %1% ms after %2% requests\n") % this->config.stall.total_milliseconds() % this->requests << std::flush;
+		}
+		if (!this->stalluntil.is_special() && now < this->stalluntil)
+			return this->stalluntil;
+		return boost::posix_time::ptime(boost::posix_time::not_a_date_time);
+	}
+	size_t bodySize() const {
+		return this->config.size;
+	}
+private:
+	void accept() {
+		boost::shared_ptr<test_connection> connection(new test_connection(this->io, *this));
+		this->acceptor.async_accept(connection->socket, boost::bind(&test_server::handle_accept, this, connection, boost::asio::placeholders::error));
+	}
+	void handle_accept(boost::shared_ptr<test_connection> connection, const boost::system::error_code &err) {
+		if (!err)
+			connection->start();
+		else if (err == boost::asio::error::operation_aborted)
+			return;
+		this->accept();
+	}
+	boost::asio::io_service &io;
+	const server_config &config;
+	tcp::acceptor acceptor;
+	boost::mutex SLock;
+	boost::uint64_t requests;
+	boost::posix_time::ptime stalluntil;
+};
+
+void test_connection::start() {
+	boost::asio::async_read_until(this->socket, this->request, "\r\n\r\n", boost::bind(&test_connection::handle_read, shared_from_this(),
+			boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+}
+
+void test_connection::handle_read(const boost::system::error_code &err, size_t) {
+	if (err)
+		return;
+	std::istream stream(&this->request);
+	std::string method;
+	stream >> method >> this->path;
+	boost::posix_time::ptime due = this->server.arrived();
+	if (this->path.compare(0, 7, "/sleep/") == 0) {
+		try {
+			boost::posix_time::ptime slept = boost::posix_time::microsec_clock::universal_time()
+					+ boost::posix_time::milliseconds(boost::lexical_cast<long>(this->path.substr(7)));
+			if (due.is_special() || slept > due)
+				due = slept;
+		} catch (boost::bad_lexical_cast &) {
+		}
+	}
+	if (due.is_special())
+		return this->respond(boost::system::error_code());
+	this->timer.expires_at(due);
+	this->timer.async_wait(boost::bind(&test_connection::respond, shared_from_this(), boost::asio::placeholders::error));
+}
+
+void test_connection::respond(const boost::system::error_code &err) {
+	if (err)
+		return;
+	size_t size = this->server.bodySize();
+	if (this->path.compare(0, 6, "/size/") == 0) {
+		try {
+			size = boost::lexical_cast<size_t>(this->path.substr(6));
+		} catch (boost::bad_lexical_cast &) {
+		}
+	}
+	this->response = boost::str(boost::format("HTTP/1.1 200 OK\r\nContent-Length: %1%\r\nContent-Type: application/octet-stream\r\nConnection: close\r\n\r\n") % size);
+	this->response.append(size, 'x');
+	boost::asio::async_write(this->socket, boost::asio::buffer(this->response), boost::bind(&test_connection::handle_write, shared_from_this(),
+			boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+}
+
+void test_connection::handle_write(const boost::system::error_code &, size_t) {
+	boost::system::error_code ignored;
+	this->socket.shutdown(tcp::socket::shutdown_both, ignored);
+}
+
+// Application entry point.
+int
+main (int argc, char *argv[])
+{
+	namespace po = boost::program_options;
+	server_config config;
+	unsigned int stall;
+	po::options_description options("Usage: anetd-testserver [options]\n\nOptions");
+	options.add_options()
+		("help,h", "show this help")
+		("port,p", po::value<unsigned short>(&config.port)->default_value(18080), "port to listen on, on 127.0.0.1")
+		("threads,t", po::value<unsigned int>(&config.threads)->default_value(1), "number of threads")
+		("size,s", po::value<size_t>(&config.size)->default_value(100), "body size in bytes, for paths other than /size/N")
+		("stall-after", po::value<boost::uint64_t>(&config.stallafter)->default_value(0), "stall once this many requests have arrived, 0 never to stall")
+		("stall", po::value<unsigned int>(&stall)->default_value(1500), "milliseconds to stall for");
+	po::variables_map vm;
+	try {
+		po::store(po::parse_command_line(argc, argv, options), vm);
+		po::notify(vm);
+	} catch (std::exception &e) {
+		std::cerr << e.what() << std::endl << options << std::endl;
+		return 2;
+	}
+	if (vm.count("help")) {
+		std::cout << options << std::endl;
+		return 0;
+	}
+	config.stall = boost::posix_time::milliseconds(stall);
+	config.threads = std::max(config.threads, 1u);
+
+	boost::asio::io_service io;
+	try {
+		test_server server(io, config);
+		std::cout << boost::format("Listening on 127.0.0.1:%1%\n") % config.port << std::flush;
+		boost::thread_group threads;
+		for (unsigned int i = 0; i < config.threads; i++)
+			threads.create_thread(boost::bind(&boost::asio::io_service::run, &io));
+		threads.join_all();
+	} catch (std::exception &e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
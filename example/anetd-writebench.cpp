@@ -0,0 +1,148 @@
+/*
+ * File Writer Benchmark for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * anetd-writebench - measures how fast the http_file_writer backends write a response body to disk
+ *
+ * Writes -m MB to a file in -o, in chunks of -c bytes as the http_engine hands them to http_response_file, through each backend in turn,
+ * and prints the median wall clock throughput and CPU time of -r runs. The "ofstream" backend is what http_response_file did
+ * before http_file_writer: copy each chunk into a string, write it to a ofstream and flush.
+ *
+ *	anetd-writebench -o /var/tmp -c 2048
+ *	anetd-writebench -o /var/tmp -c 16384
+ */
+
+#include <sys/resource.h>
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Boost
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include "anetd/http_file_writer.hpp"
+
+using namespace DynamX::anetd;
+
+static double cpu_seconds() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+/* writes the file once, false if a write failed */
+static bool write_file(const std::string &backend, const std::string &path, const std::string &chunk, boost::uint64_t total) {
+	if (backend == "ofstream") {
+		boost::filesystem::ofstream file(path);
+		for (boost::uint64_t done = 0; done < total; done += chunk.length()) {
+			std::string copy(chunk);
+			file << copy;
+			file.flush();
+		}
+		return file.good();
+	}
+	boost::scoped_ptr<http_file_writer> writer(http_file_writer::create(backend == "posix" ? http_file_writer::BACKEND_POSIX
+			: http_file_writer::BACKEND_URING));
+	if (!writer->open(path))
+		return false;
+	for (boost::uint64_t done = 0; done < total; done += chunk.length())
+		if (!writer->write(chunk.data(), chunk.length()))
+			return false;
+	return writer->close();
+}
+
+// Application entry point.
+int
+main (int argc, char *argv[])
+{
+	namespace po = boost::program_options;
+	std::string directory;
+	size_t chunksize;
+	unsigned int megabytes;
+	unsigned int runs;
+	std::vector<std::string> backends;
+	po::options_description options("Usage: anetd-writebench [options]\n\nOptions");
+	options.add_options()
+		("help,h", "show this help")
+		("output,o", po::value<std::string>(&directory)->default_value("."), "directory to write the file in")
+		("chunk,c", po::value<size_t>(&chunksize)->default_value(2048), "bytes per write, as read from the socket")
+		("megabytes,m", po::value<unsigned int>(&megabytes)->default_value(512), "MB to write per run")
+		("runs,r", po::value<unsigned int>(&runs)->default_value(3), "runs per backend")
+		("backend,b", po::value<std::vector<std::string> >(&backends), "backend to measure: ofstream, posix or uring. Default all of them");
+	po::variables_map vm;
+	try {
+		po::store(po::parse_command_line(argc, argv, options), vm);
+		po::notify(vm);
+	} catch (std::exception &e) {
+		std::cerr << e.what() << std::endl << options << std::endl;
+		return 2;
+	}
+	if (vm.count("help")) {
+		std::cout << options << std::endl;
+		return 0;
+	}
+	if (chunksize == 0 || megabytes == 0 || runs == 0) {
+		std::cerr << "The chunk size, size and runs must be at least 1" << std::endl << options << std::endl;
+		return 2;
+	}
+	if (backends.empty()) {
+		backends.push_back("ofstream");
+		backends.push_back("posix");
+		backends.push_back("uring");
+	}
+
+	std::string chunk(chunksize, 'x');
+	boost::uint64_t total = static_cast<boost::uint64_t>(megabytes) << 20;
+	std::string path = directory + "/anetd-writebench.tmp";
+	std::cout << boost::format("Writing %1% MB in %2% byte chunks to %3%, median of %4% runs\n") % megabytes % chunksize % directory % runs;
+	if (!http_file_writer::hasUring())
+		std::cout << "io_uring is not available, the uring backend falls back to POSIX writes" << std::endl;
+	for (std::vector<std::string>::iterator backend = backends.begin(); backend != backends.end(); ++backend) {
+		if (*backend != "ofstream" && *backend != "posix" && *backend != "uring") {
+			std::cerr << "Unknown backend " << *backend << std::endl;
+			return 2;
+		}
+		std::vector<double> walls, cpus;
+		for (unsigned int run = 0; run < runs; run++) {
+			boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+			double startcpu = cpu_seconds();
+			bool written = write_file(*backend, path, chunk, total);
+			double wall = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+			double used = cpu_seconds() - startcpu;
+			std::remove(path.c_str());
+			if (!written) {
+				std::cerr << "Writing " << path << " failed" << std::endl;
+				return 1;
+			}
+			walls.push_back(wall);
+			cpus.push_back(used);
+		}
+		std::sort(walls.begin(), walls.end());
+		std::sort(cpus.begin(), cpus.end());
+		std::cout << boost::format("%1$-10s %2$10.0f MB/s %3$10.3f s CPU\n") % *backend % (megabytes / walls[runs / 2]) % cpus[runs / 2];
+	}
+	return 0;
+}
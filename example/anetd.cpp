@@ -18,143 +18,283 @@
  *
  */
 
+/*
+ * anetd - a concurrent bulk downloader
+ *
+ * Reads URLs, one per line, from a file or stdin and downloads them with a limited number of concurrent transfers, either to files
+ * (named after the URL, in the output directory) or into memory. Shows the aggregate progress while running, and at exit prints a
+ * throughput and latency summary and writes a tab separated result line per URL:
+ *
+ *	url	status	bytes	seconds	error
+ *
+ * The exit status is 0 if every URL returned a 2xx status, 1 otherwise.
+ */
+
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <string>
+#include <vector>
 
 // Boost
+#include <boost/algorithm/string/trim.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
-#include <boost/lexical_cast.hpp>
+#include <boost/program_options.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include "anetd/anetd.hpp"
+#include "anetd/http_pool.hpp"
 #include "anetd/LogClass.hpp"
 
 using namespace DynamX::anetd;
 using namespace DynamX::Logging;
 
-class printer
+class downloader
 {
-
 public:
-  printer (boost::asio::io_service & io) :
-    timer1_ (io, boost::posix_time::seconds (1)),
-    count_ (0)
-  {
-
-    timer1_.async_wait (boost::bind (&printer::print1, this));
-
-
-  }
-
-
-   ~printer ()
-  {
-
-    LogDebug(boost::str(boost::format("Final count is %1%") % count_));
-
-  }
-
-
-  void print1 ()
-  {
-
-    if (count_ < 20)
-
-      {
-
-	LogDebug(boost::str(boost::format("Timer 1: %1%") % count_));
-
-	++count_;
-
-
-	timer1_.expires_at (timer1_.expires_at () +
-			    boost::posix_time::seconds (1));
-
-	timer1_.
-	  async_wait (boost::bind (&printer::print1, this));
-
-      }
-
-  }
-
-
+	downloader(boost::asio::io_service &myio, unsigned int myjobs, bool mymemory, bool myquiet) :
+			io(myio), engines(&myio, &myio), jobs(myjobs), memory(mymemory), quiet(myquiet), timer(myio), next(0), finished(0), failed(0),
+			completedbytes(0), lastbytes(0)
+	{
+	}
+	void setRetryPolicy(boost::shared_ptr<http_retry_policy> policy) {
+		this->retrypolicy = policy;
+	}
+	void add(const std::string &url) {
+		result r;
+		r.url = url;
+		r.status = 0;
+		r.bytes = 0;
+		r.seconds = 0;
+		this->results.push_back(r);
+	}
+	size_t size() const {
+		return this->results.size();
+	}
+	void run() {
+		this->starttime = boost::posix_time::microsec_clock::universal_time();
+		this->lasttime = this->starttime;
+		for (unsigned int i = 0; i < this->jobs; i++)
+			this->start_next();
+		if (!this->quiet) {
+			this->timer.expires_from_now(boost::posix_time::seconds(1));
+			this->timer.async_wait(boost::bind(&downloader::progress, this, boost::asio::placeholders::error));
+		}
+		this->io.run();
+		this->endtime = boost::posix_time::microsec_clock::universal_time();
+		if (!this->quiet)
+			this->print_progress(true);
+	}
+	void summary(std::ostream &out) {
+		double elapsed = (this->endtime - this->starttime).total_microseconds() / 1e6;
+		std::vector<double> latencies;
+		for (std::vector<result>::iterator r = this->results.begin(); r != this->results.end(); ++r)
+			latencies.push_back(r->seconds);
+		std::sort(latencies.begin(), latencies.end());
+		out << boost::format("%1% URLs in %2$.2f s: %3% ok, %4% failed\n") % this->results.size() % elapsed % (this->results.size() - this->failed) % this->failed;
+		out << boost::format("%1$.1f MB received, %2$.2f MB/s, %3$.1f requests/s\n") % (this->completedbytes / 1e6)
+				% (elapsed > 0 ? this->completedbytes / 1e6 / elapsed : 0) % (elapsed > 0 ? this->results.size() / elapsed : 0);
+		if (!latencies.empty())
+			out << boost::format("latency (ms): min %1$.1f  p50 %2$.1f  p90 %3$.1f  p99 %4$.1f  max %5$.1f\n") % (latencies.front() * 1000)
+					% (percentile(latencies, 50) * 1000) % (percentile(latencies, 90) * 1000) % (percentile(latencies, 99) * 1000) % (latencies.back() * 1000);
+	}
+	bool write_results(const std::string &filename) {
+		std::ofstream out(filename.c_str());
+		if (!out)
+			return false;
+		out << "url\tstatus\tbytes\tseconds\terror\n";
+		for (std::vector<result>::iterator r = this->results.begin(); r != this->results.end(); ++r)
+			out << r->url << '\t' << r->status << '\t' << r->bytes << '\t' << boost::format("%1$.6f") % r->seconds << '\t' << r->error << '\n';
+		return out.good();
+	}
+	size_t getFailed() const {
+		return this->failed;
+	}
 private:
-
-  boost::asio::deadline_timer timer1_;
-
-
-  int count_;
-
+	struct result {
+		std::string url;
+		int status;
+		size_t bytes;
+		double seconds;
+		std::string error;
+	};
+	struct transfer {
+		size_t index;
+		boost::shared_ptr<http_engine> engine;
+		boost::shared_ptr<http_response> response;
+		boost::posix_time::ptime start;
+	};
+	typedef std::list<boost::shared_ptr<transfer> > t_transfers;
+	static double percentile(const std::vector<double> &sorted, double pct) {
+		size_t index = static_cast<size_t>(pct / 100 * (sorted.size() - 1) + 0.5);
+		return sorted[std::min(index, sorted.size() - 1)];
+	}
+	void start_next() {
+		if (this->next >= this->results.size())
+			return;
+		boost::shared_ptr<transfer> t(new transfer());
+		t->index = this->next++;
+		t->engine = this->engines.acquire();
+		if (this->memory)
+			t->response = this->responses.acquire();
+		else
+			t->response = this->files.acquire();
+		t->engine->setRetryPolicy(this->retrypolicy);
+		t->response->setURL(this->results[t->index].url);
+		t->start = boost::posix_time::microsec_clock::universal_time();
+		t->engine->start(t->response.get(), boost::bind(&downloader::done, this, this->active.insert(this->active.end(), t), _1, _2));
+	}
+	void done(t_transfers::iterator it, const boost::system::error_code &err, http_response *res) {
+		boost::shared_ptr<transfer> t = *it;
+		this->active.erase(it);
+		result &r = this->results[t->index];
+		r.seconds = (boost::posix_time::microsec_clock::universal_time() - t->start).total_microseconds() / 1e6;
+		r.status = res->getStatus();
+		r.bytes = res->getProgress();
+		if (err)
+			r.error = err.message();
+		else if (r.status < 200 || r.status > 299)
+			r.error = res->getDescription();
+		if (!r.error.empty())
+			this->failed++;
+		this->completedbytes += r.bytes;
+		this->finished++;
+		/* the engine is still unwinding from this callback, so it goes back to its pool once the callback returns */
+		this->io.post(boost::bind(&downloader::release, t));
+		this->start_next();
+		if (this->active.empty())
+			this->timer.cancel();
+	}
+	static void release(boost::shared_ptr<transfer>) {
+	}
+	void progress(const boost::system::error_code &err) {
+		if (err || this->active.empty())
+			return;
+		this->print_progress(false);
+		this->timer.expires_from_now(boost::posix_time::seconds(1));
+		this->timer.async_wait(boost::bind(&downloader::progress, this, boost::asio::placeholders::error));
+	}
+	void print_progress(bool last) {
+		boost::uint64_t bytes = this->completedbytes;
+		for (t_transfers::iterator t = this->active.begin(); t != this->active.end(); ++t)
+			bytes += (*t)->response->getProgress();
+		boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+		double interval = (now - this->lasttime).total_microseconds() / 1e6;
+		double rate = interval > 0 ? (bytes - this->lastbytes) / 1e6 / interval : 0;
+		if (last) {
+			double elapsed = (now - this->starttime).total_microseconds() / 1e6;
+			rate = elapsed > 0 ? bytes / 1e6 / elapsed : 0;
+		}
+		this->lasttime = now;
+		this->lastbytes = bytes;
+		std::cerr << boost::format("%1%[%2%/%3% done, %4% active, %5% failed] %6$.1f MB, %7$.2f MB/s") % (isatty(2) ? "\r" : "")
+				% this->finished % this->results.size() % this->active.size() % this->failed % (bytes / 1e6) % rate;
+		if (last || !isatty(2))
+			std::cerr << std::endl;
+	}
+	boost::asio::io_service &io;
+	http_engine_pool engines;
+	http_response_pool responses;
+	http_pool<http_response_file> files;
+	boost::shared_ptr<http_retry_policy> retrypolicy;
+	unsigned int jobs;
+	bool memory;
+	bool quiet;
+	boost::asio::deadline_timer timer;
+	std::vector<result> results;
+	t_transfers active;
+	size_t next;
+	size_t finished;
+	size_t failed;
+	boost::uint64_t completedbytes;
+	boost::uint64_t lastbytes;
+	boost::posix_time::ptime starttime;
+	boost::posix_time::ptime lasttime;
+	boost::posix_time::ptime endtime;
 };
 
-void HTTPCallback(http_response *response) {
-	LogDebug(response->getStatus());
+static bool read_urls(std::istream &in, downloader &d) {
+	std::string line;
+	while (std::getline(in, line)) {
+		boost::algorithm::trim(line);
+		if (line.empty() || line[0] == '#')
+			continue;
+		d.add(line);
+	}
+	return !in.bad();
 }
 
-		class MyLogImpl : public i_LogImpl
-		{
-public:
-			friend class Log;
-
-			MyLogImpl( std::string const& _filename, bool const _bConsoleOutput, LogLevel const _saveLevel): i_LogImpl(_filename,_bConsoleOutput,_saveLevel ) {
-				std::cout << "start" << std::endl;
-			};
-			~MyLogImpl() {};
-			private:
-			void Write( LogLevel _level, std::string message ) { std::cout << message << std::endl; };
-			void SetLoggingState( LogLevel _saveLevel) {}
-			void SetLogFileName( std::string _filename ){}
-
-			LogLevel m_saveLevel;
-			bool m_bConsoleOutput;
-		};
-
 // Application entry point.
 int
 main (int argc, char *argv[])
 {
-
-  //Log::SetLoggingClass(new MyLogImpl("", true, LogLevel_Error));
-  Log::Create("", true, LogLevel_Debug);
-
-
-
-  // Initialize default settings.
-  //std::string server = "https://www.google.com/search";
-  //server = "http://10.1.1.1/Services.asp";
-  std::string server = "http://weather.yahooapis.com/forecastrss?w=2502265&u=c";
-
-  boost::asio::io_service io;
-  printer p(io);
-
-
-  // Ask for the server URL if one wasn't read from command line arguments.
-  if (server.empty ())
-
-    {
-
-      std::cout << boost::this_thread::get_id() << " " << "Please, specify the server URL: ";
-
-      std::cin >> server;
-
-    }
-
-
-  boost::shared_ptr < http_engine > transmitter_block;
-  http_response_file response;
-  response.setHTTPAuth("User", "password");
-  response.setURL(server);
-  // Initialize the transmitter block.
-  transmitter_block =
-    boost::shared_ptr < http_engine > (new http_engine (&io));
-  transmitter_block->setProxyAuth("User", "password");
-  transmitter_block->setCallback(boost::bind(HTTPCallback, _1));
-  transmitter_block->Starttransfer (&response);
-
-  io.run();
-  transmitter_block->Status.wait();
-  std::cout << transmitter_block->Status.get()->getStatus() << std::endl;
-  std::cout << transmitter_block->Status.get()->getDescription() << std::endl;
-
-
-  return 0;
-
+	namespace po = boost::program_options;
+	unsigned int jobs;
+	unsigned int retries;
+	std::string input;
+	std::string output;
+	std::string resultfile;
+	po::options_description options("Usage: anetd [options] [url-file]\nDownloads the URLs listed in url-file (or stdin), one per line\n\nOptions");
+	options.add_options()
+		("help,h", "show this help")
+		("jobs,j", po::value<unsigned int>(&jobs)->default_value(4), "number of concurrent transfers")
+		("input,i", po::value<std::string>(&input)->default_value("-"), "file with the URLs to download, - for stdin")
+		("output,o", po::value<std::string>(&output)->default_value("."), "directory to save the files in")
+		("memory,m", "keep the bodies in memory instead of saving them")
+		("results,r", po::value<std::string>(&resultfile)->default_value("anetd-results.tsv"), "file to write the result of each URL to")
+		("retries,R", po::value<unsigned int>(&retries)->default_value(0), "number of retries of a failed transfer")
+		("quiet,q", "do not show progress")
+		("verbose,v", "log debug messages");
+	po::positional_options_description positional;
+	positional.add("input", 1);
+	po::variables_map vm;
+	try {
+		po::store(po::command_line_parser(argc, argv).options(options).positional(positional).run(), vm);
+		po::notify(vm);
+	} catch (std::exception &e) {
+		std::cerr << e.what() << std::endl << options << std::endl;
+		return 2;
+	}
+	if (vm.count("help")) {
+		std::cout << options << std::endl;
+		return 0;
+	}
+	if (jobs == 0)
+		jobs = 1;
+
+	Log::Create("", true, vm.count("verbose") ? LogLevel_Debug : LogLevel_Error);
+
+	boost::asio::io_service io;
+	downloader d(io, jobs, vm.count("memory") > 0, vm.count("quiet") > 0);
+	if (retries > 0)
+		d.setRetryPolicy(boost::shared_ptr<http_retry_policy>(new http_retry_policy(retries)));
+
+	if (input == "-") {
+		read_urls(std::cin, d);
+	} else {
+		std::ifstream in(input.c_str());
+		if (!in || !read_urls(in, d)) {
+			std::cerr << "Could not read " << input << std::endl;
+			return 2;
+		}
+	}
+	/* the result file is relative to where we were started, the downloads go to the output directory */
+	if (!resultfile.empty() && resultfile[0] != '/') {
+		char cwd[4096];
+		if (getcwd(cwd, sizeof(cwd)))
+			resultfile = std::string(cwd) + "/" + resultfile;
+	}
+	if (!vm.count("memory") && chdir(output.c_str()) != 0) {
+		std::cerr << "Could not change to " << output << std::endl;
+		return 2;
+	}
+
+	d.run();
+	d.summary(std::cout);
+	if (!d.write_results(resultfile))
+		std::cerr << "Could not write " << resultfile << std::endl;
+
+	return d.getFailed() > 0 ? 1 : 0;
 }
@@ -31,6 +31,8 @@
 
 #include <string>
 #include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/thread.hpp>
 
 namespace DynamX {
 	namespace Logging {
@@ -101,6 +103,14 @@ namespace DynamX {
 				 */
 				static LogLevel GetLoggingState();
 
+				/**
+				 * \brief Check if messages of a level will be written
+				 * The Log macros check this before formatting a message, so disabled levels cost no formatting or allocations.
+				 * \param _level the LogLevel of the message
+				 * \return true if a log exists and the level is enabled
+				 */
+				static bool IsEnabled( LogLevel _level );
+
 				/**
 				 * \brief Change the log file name.  This will start a new log file (or potentially start appending
 				 * information to an existing one.  Developers might want to use this function, together with a timer
@@ -151,28 +161,29 @@ namespace DynamX {
 		/*! \def LogDebug()
 		 * \relates LogClass
 		 * Log a Message at LogDebug Level
+		 * The message is only formatted if the level is enabled, see Log::IsEnabled()
 		 */
-#define LogDebug(Y)   Log::Write(LogLevel_Debug, LogFormat(Y))
+#define LogDebug(Y) do { if (Log::IsEnabled(LogLevel_Debug)) Log::Write(LogLevel_Debug, LogFormat(Y)); } while (0)
 		/*! \def LogInfo()
 		 * \relates LogClass
 		 * Log a Message at LogInfo level
 		 */
-#define LogInfo(Y) Log::Write(LogLevel_Info, LogFormat(Y))
+#define LogInfo(Y) do { if (Log::IsEnabled(LogLevel_Info)) Log::Write(LogLevel_Info, LogFormat(Y)); } while (0)
 		/*! \def LogWarn()
 		 * \relates LogClass
 		 * Log a Message at the Warn Level
 		 */
-#define LogWarn(Y)  Log::Write(LogLevel_Warning, LogFormat(Y))
+#define LogWarn(Y) do { if (Log::IsEnabled(LogLevel_Warning)) Log::Write(LogLevel_Warning, LogFormat(Y)); } while (0)
 		/*! \def LogError()
 		 * \relates LogClass
 		 * Log a Message at the LogError Level
 		 */
-#define LogError(Y) Log::Write(LogLevel_Error, LogFormat(Y))
+#define LogError(Y) do { if (Log::IsEnabled(LogLevel_Error)) Log::Write(LogLevel_Error, LogFormat(Y)); } while (0)
 		/*! \def LogFatal()
 		 * Log a Message at the LogFatal Level
 		 * \relates LogClass
 		 */
-#define LogFatal(Y) Log::Write(LogLevel_Fatal, LogFormat(Y))
+#define LogFatal(Y) do { if (Log::IsEnabled(LogLevel_Fatal)) Log::Write(LogLevel_Fatal, LogFormat(Y)); } while (0)
 
 	}
 }
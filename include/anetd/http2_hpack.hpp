@@ -0,0 +1,224 @@
+#ifndef HTTP2_HPACK_HPP
+#define HTTP2_HPACK_HPP
+/*
+ * HPACK Header Compression for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <boost/cstdint.hpp>
+
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+/** @file */
+
+namespace DynamX {
+namespace anetd {
+
+/*! \brief a Header Field, as a Name and Value */
+typedef std::pair<std::string, std::string> http2_header;
+/*! \brief a List of Header Fields, in the order they are sent */
+typedef std::vector<http2_header> http2_header_list;
+
+/*! \brief the Dynamic Table of a HPACK Context
+ *
+ * Holds the header fields added by the header blocks sent in one direction of a HTTP/2 connection (RFC 7541 section 2.3.2). The table is shared by
+ * all the streams of the connection, so a header that was sent once (eg, a cookie or the authority) is sent as a single index afterwards. Each entry
+ * counts its name and value plus 32 bytes towards the size of the table, and the oldest entries are evicted when the size goes over the maximum.
+ */
+class http2_hpack_table
+{
+public:
+	/*! \brief Constructor
+	 *
+	 * @param[in] maxsize the maximum size of the table, in bytes
+	 */
+	explicit http2_hpack_table(size_t maxsize = 4096);
+	/*! \brief Add a Header Field to the Table
+	 *
+	 * A field larger than the table empties it, and is not added.
+	 *
+	 * @param[in] name the name of the field
+	 * @param[in] value the value of the field
+	 */
+	void add(const std::string &name, const std::string &value);
+	/*! \brief set the Maximum Size of the Table
+	 *
+	 * Evicts the oldest entries till the table fits.
+	 *
+	 * @param[in] maxsize the maximum size, in bytes
+	 */
+	void setMaxSize(size_t maxsize);
+	/*! \brief get the Maximum Size of the Table
+	 *
+	 * @return the maximum size, in bytes
+	 */
+	size_t getMaxSize() const;
+	/*! \brief get the Size of the Table
+	 *
+	 * @return the size of the entries, in bytes
+	 */
+	size_t getSize() const;
+	/*! \brief get the Number of Entries
+	 *
+	 * @return the number of entries
+	 */
+	size_t count() const;
+	/*! \brief get a Entry
+	 *
+	 * @param[in] index the position of the entry, 0 is the newest
+	 * @return the entry
+	 */
+	const http2_header &get(size_t index) const;
+	/*! \brief get the Size a Entry counts towards the Table
+	 *
+	 * @param[in] name the name of the field
+	 * @param[in] value the value of the field
+	 * @return the size in bytes
+	 */
+	static size_t entrySize(const std::string &name, const std::string &value);
+private:
+	void evict(size_t maxsize);
+	std::deque<http2_header> entries;
+	size_t size;
+	size_t maxsize;
+};
+
+/*! \brief a HPACK Encoder
+ *
+ * Encodes the header lists of the requests sent on a HTTP/2 connection into header blocks (RFC 7541). Fields found in the static or dynamic table are
+ * sent as a index. Other fields are added to the dynamic table so they are indexed the next time, except for credentials (authorization, proxy-authorization and
+ * cookie), which are sent as never indexed literals so they can not be recovered by a attacker probing the compression. Strings are Huffman coded when that
+ * makes them shorter.
+ *
+ * One encoder belongs to one connection. Not ThreadSafe.
+ */
+class http2_hpack_encoder
+{
+public:
+	/*! \brief Constructor
+	 *
+	 * @param[in] maxsize the size of the dynamic table. The peer can lower it with setMaxTableSize()
+	 */
+	explicit http2_hpack_encoder(size_t maxsize = 4096);
+	/*! \brief Encode a Header List
+	 *
+	 * @param[in] headers the header fields, with names in lower case
+	 * @param[out] block the header block is appended here
+	 */
+	void encode(const http2_header_list &headers, std::string &block);
+	/*! \brief set the Size of the Dynamic Table
+	 *
+	 * Called when the peer changes SETTINGS_HEADER_TABLE_SIZE. The size used is never more than the size the encoder was created with, and a change is
+	 * signalled to the peer at the start of the next header block.
+	 *
+	 * @param[in] maxsize the table size the peer allows, in bytes
+	 */
+	void setMaxTableSize(size_t maxsize);
+	/*! \brief get the Dynamic Table
+	 *
+	 * @return the table
+	 */
+	const http2_hpack_table &getTable() const;
+private:
+	void encodeString(const std::string &value, std::string &block);
+	http2_hpack_table table;
+	size_t limit;
+	size_t pendingsize;
+	bool sizechanged;
+};
+
+/*! \brief a HPACK Decoder
+ *
+ * Decodes the header blocks of the responses received on a HTTP/2 connection (RFC 7541). Every header block of the connection must be decoded, in the
+ * order they were received, as each one can change the dynamic table the next one refers to.
+ *
+ * One decoder belongs to one connection. Not ThreadSafe.
+ */
+class http2_hpack_decoder
+{
+public:
+	/*! \brief Constructor
+	 *
+	 * @param[in] maxsize the largest dynamic table the peer may use, as sent in SETTINGS_HEADER_TABLE_SIZE
+	 */
+	explicit http2_hpack_decoder(size_t maxsize = 4096);
+	/*! \brief Decode a Header Block
+	 *
+	 * @param[in] data the header block, with the fragments of all its CONTINUATION frames joined
+	 * @param[in] len the length of the block
+	 * @param[out] headers the decoded header fields are appended here
+	 * @return false if the block is malformed, which is a COMPRESSION_ERROR of the connection
+	 */
+	bool decode(const char *data, size_t len, http2_header_list &headers);
+	/*! \brief get the Dynamic Table
+	 *
+	 * @return the table
+	 */
+	const http2_hpack_table &getTable() const;
+private:
+	bool decodeString(const unsigned char *&position, const unsigned char *end, std::string &value);
+	bool lookup(size_t index, http2_header &header) const;
+	http2_hpack_table table;
+	size_t limit;
+};
+
+/*! \brief Encode a Integer with a Prefix
+ *
+ * @param[in] value the integer
+ * @param[in] prefix the number of bits of the first byte the integer starts in
+ * @param[in] flags the bits of the first byte above the prefix
+ * @param[out] out the encoded integer is appended here
+ */
+void http2_hpack_encode_integer(boost::uint64_t value, unsigned int prefix, unsigned char flags, std::string &out);
+/*! \brief Decode a Integer with a Prefix
+ *
+ * @param[in,out] position the first byte of the integer, moved past it
+ * @param[in] end the end of the data
+ * @param[in] prefix the number of bits of the first byte the integer starts in
+ * @param[out] value the integer
+ * @return false if the integer is truncated or too large
+ */
+bool http2_hpack_decode_integer(const unsigned char *&position, const unsigned char *end, unsigned int prefix, boost::uint64_t &value);
+/*! \brief get the Huffman coded Length of a String
+ *
+ * @param[in] value the string
+ * @return the length in bytes
+ */
+size_t http2_huffman_length(const std::string &value);
+/*! \brief Huffman code a String
+ *
+ * @param[in] value the string
+ * @param[out] out the coded string is appended here
+ */
+void http2_huffman_encode(const std::string &value, std::string &out);
+/*! \brief Decode a Huffman coded String
+ *
+ * @param[in] data the coded string
+ * @param[in] len the length of the coded string
+ * @param[out] out the decoded string is appended here
+ * @return false if the string is malformed
+ */
+bool http2_huffman_decode(const unsigned char *data, size_t len, std::string &out);
+
+}
+}
+
+#endif // HTTP2_HPACK_HPP
@@ -0,0 +1,325 @@
+#ifndef HTTP2_SESSION_HPP
+#define HTTP2_SESSION_HPP
+/*
+ * HTTP/2 Transport for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/system/error_code.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <deque>
+#include <map>
+#include <string>
+
+#include "http2_hpack.hpp"
+#include "http_buffer_pool.hpp"
+#include "http_rate_limit.hpp"
+#include "http_response.hpp"
+#include "http_socket_tuning.hpp"
+
+/** @file */
+
+namespace DynamX {
+namespace anetd {
+
+namespace http2_errc {
+/*! \brief the HTTP/2 Error Codes
+ *
+ * The codes of RFC 7540 section 7, as sent in RST_STREAM and GOAWAY frames. A request that fails because the server reset its stream or the connection
+ * completes with one of these in the http2_category().
+ */
+enum errors {
+	no_error = 0,			/**< graceful shutdown */
+	protocol_error = 1,		/**< the peer broke the protocol */
+	internal_error = 2,		/**< the peer had a internal error */
+	flow_control_error = 3,		/**< the peer broke the flow control rules */
+	settings_timeout = 4,		/**< SETTINGS were not acknowledged in time */
+	stream_closed = 5,		/**< a frame was received for a closed stream */
+	frame_size_error = 6,		/**< a frame had a invalid size */
+	refused_stream = 7,		/**< the stream was refused before any processing */
+	cancel = 8,			/**< the stream is no longer needed */
+	compression_error = 9,		/**< the header compression context broke */
+	connect_error = 10,		/**< a CONNECT tunnel was reset */
+	enhance_your_calm = 11,		/**< the peer thinks we are generating excessive load */
+	inadequate_security = 12,	/**< the TLS connection does not meet the security requirements */
+	http_1_1_required = 13		/**< the server wants HTTP/1.1 for this request, or does not speak HTTP/2 at all */
+};
+/*! \brief make a error_code from a HTTP/2 Error Code
+ *
+ * @param[in] e the error code
+ * @return the error_code in the http2_category()
+ */
+boost::system::error_code make_error_code(errors e);
+}
+
+/*! \brief get the Category of the HTTP/2 Error Codes
+ *
+ * @return the category
+ */
+const boost::system::error_category &http2_category();
+
+/*! \brief a HTTP/2 Connection that Multiplexes Requests
+ *
+ * Where the http_engine class makes one connection per request, a http2_session sends all its requests as concurrent streams of one HTTP/2 connection
+ * (RFC 7540), so hundreds of requests to one origin share a single TCP connection, TLS handshake and congestion window. Each stream delivers its response to a
+ * http_response class exactly as the http_engine class does, so all the response classes (memory, files, pipelines) work with either transport.
+ *
+ * A session talks to one origin, set by the URL of the first request: https URLs negotiate HTTP/2 with ALPN during the TLS handshake, and http URLs use HTTP/2
+ * over plain TCP with prior knowledge (h2c), so the server must be known to speak it. Requests for other origins fail with
+ * boost::system::errc::invalid_argument. A server that does not select h2 in ALPN fails the requests with http2_errc::http_1_1_required, so the application
+ * can fall back to a http_engine.
+ *
+ * The connection is made when the first request is started, and requests beyond the number of concurrent streams the server allows are queued till a
+ * stream closes. The connection stays open when it is idle, so the next request does not pay for a new handshake, and keeps the transport IO Service
+ * from running out of work till the server closes it or close() is called. If the server closes the connection (or sends GOAWAY) while requests are queued, or refuses a stream before processing it, those requests are
+ * sent again on a new connection.
+ *
+ * Headers are compressed with HPACK, with one dynamic table per direction shared by all the streams of the connection. The receive window of each stream
+ * provides the backpressure of the http_response::ready() function: while a response is not ready, its stream gets no WINDOW_UPDATE, so the server stops
+ * sending on that stream while the other streams carry on.
+ *
+ * Redirects are not followed, the 3xx response is delivered as it is. Certificates are not verified, like the http_engine class. Proxies are not supported.
+ *
+ * All network operations run on the transport IO Service, which can be run by any number of threads as the session serialises its work on a strand. The
+ * completion functions are called on the transport IO Service. start(), cancel() and close() are ThreadSafe. The session must not be destroyed while requests
+ * are outstanding.
+ */
+class http2_session
+{
+public:
+	/*! \brief Typedef of the Completion Function
+	 *
+	 * Called when a request finishes. The error_code is set if the request failed before a complete response was received.
+	 */
+	typedef boost::function<void (const boost::system::error_code &, http_response *)> t_completionFunc;
+	/*! \brief Constructor
+	 *
+	 * @param[in] transport the IO Service that the connection runs on
+	 */
+	explicit http2_session(boost::asio::io_service *transport);
+	/*! \brief Destructor
+	 *
+	 * Closes the connection.
+	 */
+	~http2_session();
+	/*! \brief Start a GET Request
+	 *
+	 * Sends a GET request for the URL set on the http_response class as a new stream.
+	 *
+	 * @param[in] response the http_response class that will contain the results
+	 * @param[in] handler the function to call when the request finishes
+	 * @return false if the URL is not a http or https URL
+	 */
+	bool start(http_response *response, t_completionFunc handler);
+	/*! \brief Start a Request
+	 *
+	 * @param[in] response the http_response class that will contain the results
+	 * @param[in] method the HTTP method
+	 * @param[in] body the body to send, sent with the flow control of the stream
+	 * @param[in] handler the function to call when the request finishes
+	 * @return false if the URL is not a http or https URL
+	 */
+	bool start(http_response *response, const std::string &method, const std::string &body, t_completionFunc handler);
+	/*! \brief Cancel a Request
+	 *
+	 * Resets the stream of the request, which completes with boost::asio::error::operation_aborted.
+	 *
+	 * @param[in] response the http_response class of the request
+	 */
+	void cancel(http_response *response);
+	/*! \brief Close the Connection
+	 *
+	 * Sends GOAWAY and closes the connection. Requests that have not completed finish with boost::asio::error::operation_aborted. A later start() makes a new connection.
+	 */
+	void close();
+	/*! \brief set the Receive Windows
+	 *
+	 * Sets how much data the server can send before it has to wait for a WINDOW_UPDATE, on each stream and on the whole connection. Larger windows let a download
+	 * fill a long, fast path. Takes effect with the next connection.
+	 *
+	 * @param[in] streamwindow the window of each stream, in bytes (default 1 MB)
+	 * @param[in] connectionwindow the window of the connection, in bytes (default 16 MB)
+	 * @return false if a window is not between 65535 and 2^31-1 bytes
+	 */
+	bool setWindowSize(size_t streamwindow, size_t connectionwindow);
+	/*! \brief set the Socket Tuning Profiles
+	 *
+	 * @param[in] tuning the tuning profiles. Passing a empty pointer restores the default profile
+	 * @return a bool indicating success
+	 */
+	bool setSocketTuning(boost::shared_ptr<http_socket_tuning> tuning);
+	/*! \brief set the Bandwidth Limiter
+	 *
+	 * The receive limits of the limiter (global, and for the host of the session) apply to the connection, so they are shared by all its streams.
+	 *
+	 * @param[in] limiter the limiter. Passing a empty pointer restores the default limiter
+	 * @return a bool indicating success
+	 */
+	bool setRateLimiter(boost::shared_ptr<http_rate_limiter> limiter);
+	/*! \brief get the Number of open Streams
+	 *
+	 * @return the number of requests sent and not yet complete
+	 */
+	size_t getActiveStreams();
+	/*! \brief get the Number of queued Requests
+	 *
+	 * @return the number of requests waiting for the connection or for a free stream
+	 */
+	size_t getQueuedRequests();
+	/*! \brief get the Number of Connections made
+	 *
+	 * @return the number of connections this session has opened
+	 */
+	size_t getConnections();
+private:
+	struct stream {
+		boost::uint32_t id;
+		http_response *response;
+		t_completionFunc handler;
+		std::string scheme;
+		std::string host;
+		std::string port;
+		std::string authority;
+		std::string path;
+		std::string method;
+		std::string body;
+		size_t bodysent;
+		boost::int64_t sendwindow;
+		boost::int64_t recvwindow;
+		size_t credit;
+		size_t received;
+		bool headers;
+		bool haslength;
+		bool paused;
+	};
+	typedef boost::shared_ptr<stream> t_stream;
+	enum connection_state { IDLE, CONNECTING, OPEN, CLOSING };
+	typedef boost::function<void (const boost::system::error_code &, size_t)> t_ioFunc;
+
+	void enqueue(t_stream s);
+	void dispatch();
+	void connect();
+	void handle_resolve(unsigned int mygeneration, const boost::system::error_code &err, boost::asio::ip::tcp::resolver::iterator endpoint);
+	void handle_connect(unsigned int mygeneration, const boost::system::error_code &err, boost::asio::ip::tcp::resolver::iterator endpoint);
+	void handle_handshake(unsigned int mygeneration, const boost::system::error_code &err);
+	void open();
+	void open_stream(t_stream s);
+	void send_body(t_stream s);
+	void send_frame(boost::uint8_t type, boost::uint8_t flags, boost::uint32_t streamid, const char *payload, size_t len);
+	void send_window_update(boost::uint32_t streamid, size_t increment);
+	void send_goaway(http2_errc::errors code);
+	void flush();
+	void handle_write(unsigned int mygeneration, const boost::system::error_code &err);
+	void start_read();
+	void handle_rate_timer(unsigned int mygeneration, const boost::system::error_code &err);
+	void handle_read(unsigned int mygeneration, const boost::system::error_code &err, size_t len);
+	bool handle_frame(boost::uint8_t type, boost::uint8_t flags, boost::uint32_t streamid, const char *payload, size_t len);
+	bool handle_data(boost::uint8_t flags, boost::uint32_t streamid, const char *payload, size_t len);
+	bool handle_headers(boost::uint8_t flags, boost::uint32_t streamid, const char *payload, size_t len);
+	bool handle_header_block();
+	bool handle_settings(boost::uint8_t flags, const char *payload, size_t len);
+	bool handle_goaway(const char *payload, size_t len);
+	bool handle_window_update(boost::uint32_t streamid, const char *payload, size_t len);
+	void replenish(t_stream s);
+	void schedule_resume(t_stream s);
+	void resume(t_stream s);
+	void end_stream(t_stream s);
+	void reset_stream(t_stream s, http2_errc::errors code);
+	void requeue(t_stream s);
+	void connection_error(http2_errc::errors code);
+	void connection_lost(const boost::system::error_code &err);
+	void disconnect();
+	void finish(t_stream s, const boost::system::error_code &err);
+	void complete(t_stream s, const boost::system::error_code &err);
+	void do_cancel(http_response *response);
+	void do_close();
+	void update_counts();
+	t_stream find(boost::uint32_t streamid);
+	void async_sockwrite(const std::string &data, t_ioFunc handler);
+	void async_sockread(char *data, size_t size, t_ioFunc handler);
+
+	boost::asio::io_service &transport;
+	boost::asio::io_service::strand strand;
+	boost::asio::ip::tcp::resolver resolver;
+	boost::asio::ip::tcp::socket socket;
+	boost::asio::deadline_timer ratetimer;
+	boost::asio::ssl::context ctx;
+	boost::scoped_ptr<boost::asio::ssl::stream<boost::asio::ip::tcp::socket> > sslsocket;
+	boost::shared_ptr<http_socket_tuning> sockettuning;
+	boost::shared_ptr<http_rate_limiter> ratelimiter;
+	boost::shared_ptr<http_buffer_pool> bufferpool;
+	connection_state state;
+	unsigned int generation;
+	bool tls;
+	std::string scheme;
+	std::string host;
+	std::string port;
+	std::string authority;
+
+	boost::scoped_ptr<http2_hpack_encoder> encoder;
+	boost::scoped_ptr<http2_hpack_decoder> decoder;
+	std::map<boost::uint32_t, t_stream> streams;
+	std::deque<t_stream> queue;
+	boost::uint32_t nextstreamid;
+	bool goaway;
+
+	size_t maxstreams;
+	boost::int64_t peerwindow;
+	size_t peermaxframe;
+	boost::int64_t sendwindow;
+	boost::int64_t recvwindow;
+	size_t credit;
+	size_t streamwindow;
+	size_t connectionwindow;
+
+	char *readbuffer;
+	unsigned int readclass;
+	size_t readsize;
+	size_t readfill;
+	std::string writing;
+	std::string queued;
+	bool writeactive;
+	std::string headerblock;
+	boost::uint32_t headerstream;
+	bool headerend;
+
+	boost::mutex SLock;
+	size_t activecount;
+	size_t queuedcount;
+	size_t connections;
+};
+
+}
+}
+
+namespace boost {
+namespace system {
+template <> struct is_error_code_enum<DynamX::anetd::http2_errc::errors> {
+	static const bool value = true;
+};
+}
+}
+
+#endif // HTTP2_SESSION_HPP
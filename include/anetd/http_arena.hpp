@@ -0,0 +1,163 @@
+#ifndef HTTP_ARENA_HPP
+#define HTTP_ARENA_HPP
+/*
+ * Per Transfer Arena Allocator for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <boost/type_traits/alignment_of.hpp>
+
+#include <cstddef>
+#include <new>
+#include <string>
+
+/** @file */
+
+namespace DynamX {
+namespace anetd {
+
+/*! \brief a Monotonic Arena for the transient data of a Transfer
+ *
+ * Memory is handed out by bumping a pointer through a list of blocks, and is never freed individually. release() rewinds the arena in one go,
+ * and keeps the blocks, so a arena that is reused for one transfer after another stops calling malloc once it has grown to fit a transfer.
+ *
+ * The http_engine class owns one arena, which holds the URL parts, request target and header cache key of the current transfer.
+ * Not ThreadSafe, a arena belongs to a single transfer.
+ */
+class http_arena
+{
+public:
+	/*! \brief Constructor
+	 *
+	 * No memory is allocated until the first allocation.
+	 *
+	 * @param[in] blocksize the size of the blocks the arena grows by
+	 */
+	explicit http_arena(size_t blocksize = 4096);
+	/*! \brief Destructor
+	 *
+	 * Frees all the blocks.
+	 */
+	~http_arena();
+	/*! \brief Allocate Memory from the Arena
+	 *
+	 * @param[in] size the number of bytes
+	 * @param[in] align the required alignment, a power of two
+	 * @return a pointer to the memory, valid till release() is called
+	 */
+	void *allocate(size_t size, size_t align = sizeof(void *));
+	/*! \brief Release all Allocations at once
+	 *
+	 * Anything allocated from the arena must no longer be used after this call. The blocks are kept for reuse.
+	 */
+	void release();
+	/*! \brief get the number of bytes allocated since the last release()
+	 *
+	 * @return the bytes in use, including alignment padding
+	 */
+	size_t getUsed() const;
+	/*! \brief get the total size of the blocks held by the Arena
+	 *
+	 * @return the capacity in bytes
+	 */
+	size_t getCapacity() const;
+private:
+	struct block {
+		block *next;
+		size_t size;
+	};
+	static char *data(block *b);
+	http_arena(const http_arena &);
+	http_arena &operator=(const http_arena &);
+	block *head;
+	block *current;
+	char *ptr;
+	char *end;
+	size_t blocksize;
+	size_t used;
+	size_t capacity;
+};
+
+/*! \brief a STL Allocator that allocates from a http_arena
+ *
+ * Deallocation does nothing, the memory is reclaimed when the arena is released. A default constructed allocator has no arena and uses
+ * the heap, as some containers construct temporary copies with a default allocator.
+ */
+template <typename T>
+class http_arena_allocator
+{
+public:
+	typedef T value_type;
+	typedef T *pointer;
+	typedef const T *const_pointer;
+	typedef T &reference;
+	typedef const T &const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+	template <typename U> struct rebind {
+		typedef http_arena_allocator<U> other;
+	};
+	http_arena_allocator() : arena(NULL) { }
+	explicit http_arena_allocator(http_arena *arena) : arena(arena) { }
+	template <typename U> http_arena_allocator(const http_arena_allocator<U> &other) : arena(other.arena) { }
+	pointer allocate(size_type n, const void * = 0) {
+		if (!this->arena)
+			return static_cast<pointer>(::operator new(n * sizeof(T)));
+		return static_cast<pointer>(this->arena->allocate(n * sizeof(T), boost::alignment_of<T>::value));
+	}
+	void deallocate(pointer p, size_type) {
+		if (!this->arena)
+			::operator delete(p);
+	}
+	size_type max_size() const {
+		return static_cast<size_type>(-1) / sizeof(T);
+	}
+	void construct(pointer p, const T &value) {
+		new (static_cast<void *>(p)) T(value);
+	}
+	void destroy(pointer p) {
+		p->~T();
+	}
+	pointer address(reference r) const {
+		return &r;
+	}
+	const_pointer address(const_reference r) const {
+		return &r;
+	}
+	http_arena *arena;
+};
+
+template <typename T, typename U>
+inline bool operator==(const http_arena_allocator<T> &a, const http_arena_allocator<U> &b) {
+	return a.arena == b.arena;
+}
+
+template <typename T, typename U>
+inline bool operator!=(const http_arena_allocator<T> &a, const http_arena_allocator<U> &b) {
+	return a.arena != b.arena;
+}
+
+/*! \brief a String allocated from a http_arena
+ *
+ */
+typedef std::basic_string<char, std::char_traits<char>, http_arena_allocator<char> > http_arena_string;
+
+}
+}
+
+#endif // HTTP_ARENA_HPP
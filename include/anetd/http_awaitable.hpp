@@ -0,0 +1,95 @@
+#ifndef HTTP_AWAITABLE_HPP
+#define HTTP_AWAITABLE_HPP
+/*
+ * C++20 Coroutine interface for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <utility>
+#include <boost/shared_ptr.hpp>
+#include "http_engine.hpp"
+#include "http_response.hpp"
+
+/** @file */
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT) && (BOOST_VERSION >= 107000)
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+namespace DynamX {
+namespace anetd {
+
+/*! \brief a Client for C++20 Coroutines
+ *
+ * The http_client class lets a coroutine wait for a transfer with co_await. The transfer runs on the asynchronous operations of the IO Service passed
+ * to the constructor, so no thread is started for it, and the coroutine is resumed on its own executor when the transfer finishes.
+ *
+ * \code
+ *	boost::asio::awaitable<void> download(http_client &client) {
+ *		http_response response;
+ *		http_response *res = co_await client.fetch("http://www.example.com/", response);
+ *		std::cout << res->getStatus() << std::endl;
+ *	}
+ * \endcode
+ *
+ * If the transfer fails before a response is received, co_await throws a boost::system::system_error. With Boost 1.77 and newer, the transfer is
+ * cancelled when the coroutine's cancellation slot is emitted (for example by a awaitable operator|| timeout).
+ *
+ * Only available when compiled as C++20 with coroutine support.
+ */
+class http_client
+{
+public:
+	/*! \brief Constructor
+	 *
+	 * @param[in] io the IO Service that transfers run on. The application must call run() on it.
+	 */
+	explicit http_client(boost::asio::io_service &io) : io(io) { }
+	/*! \brief Fetch a URL into a http_response
+	 *
+	 * @param[in] url the URL to download
+	 * @param[in] sink the http_response class that will contain the results. It must stay valid until the coroutine resumes.
+	 * @return a awaitable that completes with a pointer to sink
+	 */
+	boost::asio::awaitable<http_response *> fetch(std::string url, http_response &sink) {
+		boost::shared_ptr<http_engine> engine(new http_engine(&this->io, &this->io));
+		sink.setURL(url);
+		http_response *res = co_await engine->async_fetch(&sink, boost::asio::use_awaitable);
+		co_return res;
+	}
+	/*! \brief Fetch a URL with a prepared http_engine
+	 *
+	 * Use this to send a request with a custom method or body. The engine must have been constructed with the same transport IO Service.
+	 *
+	 * @param[in] engine the http_engine to run the transfer on
+	 * @param[in] sink the http_response class that will contain the results. The URL must already be set
+	 * @return a awaitable that completes with a pointer to sink
+	 */
+	boost::asio::awaitable<http_response *> fetch(boost::shared_ptr<http_engine> engine, http_response &sink) {
+		http_response *res = co_await engine->async_fetch(&sink, boost::asio::use_awaitable);
+		co_return res;
+	}
+private:
+	boost::asio::io_service &io;
+};
+
+}
+}
+#endif
+
+#endif // HTTP_AWAITABLE_HPP
@@ -0,0 +1,146 @@
+#ifndef HTTP_BODY_HPP
+#define HTTP_BODY_HPP
+/*
+ * Response Body Storage for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <sys/uio.h>
+#include <boost/asio/buffer.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+#include <vector>
+
+#include "http_buffer_pool.hpp"
+
+/** @file */
+
+namespace DynamX {
+namespace anetd {
+
+/*! \brief a Chain of Buffers holding a Body
+ *
+ * Stores a body as a chain of blocks that are never moved or copied once written, so appending never reallocates. When the size of the body is
+ * known up front (eg, from the Content-Length header), reserve() sets aside one block of that size and the body ends up in a single buffer. When it
+ * is not, the blocks are taken from a http_buffer_pool, starting at 4 KB and doubling up to 256 KB, so a small body wastes little memory and a large
+ * one needs few blocks.
+ *
+ * The body can be handed on without a copy as a sequence of asio buffers (see buffers()) or iovecs (see iovecs()), eg to write it to a socket or
+ * file with a single gather write. str() joins the blocks into a string for code that needs one.
+ *
+ * Not ThreadSafe.
+ */
+class http_body
+{
+public:
+	/*! \brief Limits */
+	enum {
+		MAXRESERVE = 64 << 20	/**< the largest size reserve() sets aside in one block. Bodies announced as larger are chained, so a bogus length can not make us allocate it all up front */
+	};
+	/*! \brief Constructor
+	 *
+	 * @param[in] pool the pool the blocks are taken from. Defaults to the shared pool
+	 */
+	explicit http_body(boost::shared_ptr<http_buffer_pool> pool = boost::shared_ptr<http_buffer_pool>());
+	/*! \brief Destructor
+	 *
+	 * Returns the blocks to the pool.
+	 */
+	~http_body();
+	/*! \brief Reserve Space for the Body
+	 *
+	 * Makes sure the body can grow to size bytes without another block. Does nothing if it already can, or if size is larger than MAXRESERVE.
+	 *
+	 * @param[in] size the expected size of the whole body
+	 */
+	void reserve(size_t size);
+	/*! \brief Append Data to the Body
+	 *
+	 * @param[in] data the data
+	 * @param[in] len the length of the data
+	 */
+	void append(const char *data, size_t len);
+	/*! \brief Empty the Body
+	 *
+	 * Returns the blocks to the pool, where the next body can take them back without allocating.
+	 */
+	void clear();
+	/*! \brief get the Size of the Body
+	 *
+	 * @return the size in bytes
+	 */
+	size_t size() const;
+	/*! \brief check if the Body is empty
+	 *
+	 * @return true if no data has been appended
+	 */
+	bool empty() const;
+	/*! \brief get the Number of Buffers the Body is in
+	 *
+	 * @return the number of blocks holding data
+	 */
+	size_t count() const;
+	/*! \brief get the Body as asio Buffers
+	 *
+	 * The buffers point into the body, and are valid till it is changed.
+	 *
+	 * @param[out] out the buffers are appended here, in order
+	 */
+	void buffers(std::vector<boost::asio::const_buffer> &out) const;
+	/*! \brief get the Body as iovecs
+	 *
+	 * The iovecs point into the body, and are valid till it is changed. Pass them to writev() or a io_uring write.
+	 *
+	 * @param[out] out the iovecs are appended here, in order
+	 */
+	void iovecs(std::vector<struct iovec> &out) const;
+	/*! \brief get the Body as a String
+	 *
+	 * Joins the blocks into a string, with one allocation.
+	 *
+	 * @return the body
+	 */
+	std::string str() const;
+	/*! \brief copy the Body into a String
+	 *
+	 * Like str(), but reuses the capacity of a existing string.
+	 *
+	 * @param[out] out the string to replace with the body
+	 */
+	void copy(std::string &out) const;
+private:
+	struct block {
+		char *data;
+		size_t capacity;
+		size_t used;
+		int sizeclass;	/* the class in the pool, or -1 if the block was allocated on its own by reserve() */
+	};
+	void add(size_t capacity);
+	void release(block &b);
+	boost::shared_ptr<http_buffer_pool> pool;
+	std::vector<block> chain;
+	size_t length;
+	http_body(const http_body &);
+	http_body &operator=(const http_body &);
+};
+
+}
+}
+
+#endif // HTTP_BODY_HPP
@@ -0,0 +1,123 @@
+#ifndef HTTP_BUFFER_POOL_HPP
+#define HTTP_BUFFER_POOL_HPP
+/*
+ * Receive Buffer Pool for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <vector>
+
+/** @file */
+
+namespace DynamX {
+namespace anetd {
+
+/*! \brief a Pool of Receive Buffers in Size Classes
+ *
+ * The http_engine class reads responses into buffers taken from this pool. Buffers come in size classes that double from 4 KB to 256 KB, and a
+ * buffer that is released goes back on the free list of its class, so transfers reuse buffers instead of allocating them.
+ *
+ * Free buffers are kept up to a total size (8 MB by default), buffers released beyond that are freed. All http_engine classes share the pool
+ * returned by getDefault(). ThreadSafe.
+ */
+class http_buffer_pool
+{
+public:
+	/*! \brief the Size Classes */
+	enum {
+		MINSIZE = 4096,		/**< the smallest buffer */
+		MAXSIZE = 262144,	/**< the largest buffer */
+		CLASSES = 7		/**< the number of size classes */
+	};
+	/*! \brief Constructor
+	 *
+	 * @param[in] maxidle the total size of the free buffers kept, in bytes
+	 */
+	explicit http_buffer_pool(size_t maxidle = 8 << 20);
+	/*! \brief Destructor
+	 *
+	 * Frees the free buffers. Buffers still in use must not be released to the pool afterwards.
+	 */
+	~http_buffer_pool();
+	/*! \brief get the shared Pool
+	 *
+	 * @return the pool shared by all http_engine classes
+	 */
+	static boost::shared_ptr<http_buffer_pool> getDefault();
+	/*! \brief get the Size Class of a Size
+	 *
+	 * @param[in] size the size needed
+	 * @return the smallest class that holds size, or the largest class
+	 */
+	static unsigned int sizeClass(size_t size);
+	/*! \brief get the Size of a Size Class
+	 *
+	 * @param[in] sizeclass the class
+	 * @return the size of the buffers in the class
+	 */
+	static size_t classSize(unsigned int sizeclass);
+	/*! \brief Take a Buffer from the Pool
+	 *
+	 * @param[in] sizeclass the size class of the buffer
+	 * @return the buffer, of classSize(sizeclass) bytes
+	 */
+	char *acquire(unsigned int sizeclass);
+	/*! \brief Return a Buffer to the Pool
+	 *
+	 * @param[in] buffer a buffer from acquire()
+	 * @param[in] sizeclass the size class it was acquired with
+	 */
+	void release(char *buffer, unsigned int sizeclass);
+	/*! \brief set the Total Size of the Free Buffers kept
+	 *
+	 * @param[in] maxidle the size in bytes
+	 */
+	void setMaxIdle(size_t maxidle);
+	/*! \brief get the Total Size of the Free Buffers
+	 *
+	 * @return the size in bytes
+	 */
+	size_t getIdle();
+	/*! \brief get the Number of Buffers handed out from the Free Lists
+	 *
+	 * @return the number of acquires that did not allocate
+	 */
+	boost::uint64_t getHits();
+	/*! \brief get the Number of Buffers allocated
+	 *
+	 * @return the number of acquires that allocated a new buffer
+	 */
+	boost::uint64_t getMisses();
+private:
+	void trim();
+	boost::mutex BLock;
+	std::vector<char *> freelist[CLASSES];
+	size_t maxidle;
+	size_t idle;
+	boost::uint64_t hits;
+	boost::uint64_t misses;
+};
+
+}
+}
+
+#endif // HTTP_BUFFER_POOL_HPP
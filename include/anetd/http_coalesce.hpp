@@ -0,0 +1,177 @@
+#ifndef HTTP_COALESCE_HPP
+#define HTTP_COALESCE_HPP
+/*
+ * Request Coalescing for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <boost/asio.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/future.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "http_engine.hpp"
+#include "http_pool.hpp"
+#include "http_response.hpp"
+
+/** @file */
+
+namespace DynamX {
+namespace anetd {
+
+/*! \brief Coalesce identical concurrent Requests into one Transfer
+ *
+ * When several parts of a application ask for the same URL at about the same time (eg, configuration fetched by every component at startup),
+ * only the first request is sent. The requests that arrive while it is in flight attach to it, and when it completes every one of them gets
+ * the same http_response, body and all, through its own completion handler or future. The body is received and stored once, however many
+ * requests share it.
+ *
+ * Requests are identical when they have the same method, the same URL and the same request headers, so a request never gets a response
+ * fetched with another callers credentials or cookies. Headers that do not change the response, like a per-request trace id, can be left
+ * out of the comparison with setIgnoredHeaders(). The headers of the first request are the ones sent. If the server answers with a Vary
+ * header naming a ignored header on which a attached request differs from the first one, that request is sent again on its own, so nobody
+ * gets a response meant for different headers.
+ *
+ * Only GET and HEAD requests are coalesced. Other methods are passed through, each as a transfer of its own.
+ *
+ * Requests are only coalesced while in flight, the coalescer does not cache: a request made after the transfer completed starts a new one.
+ *
+ * \code
+ *	boost::asio::io_service io;
+ *	http_coalescer coalescer(&io);
+ *	coalescer.fetch("http://www.example.com/config", handler);
+ *	boost::shared_future<boost::shared_ptr<http_response> > config = coalescer.fetch("http://www.example.com/config");
+ * \endcode
+ *
+ * ThreadSafe. The coalescer can be destroyed while transfers are in flight, they complete and call their handlers regardless.
+ */
+class http_coalescer
+{
+public:
+	/*! \brief Typedef of the Request Headers */
+	typedef std::map<std::string, std::string> t_headers;
+	/*! \brief Typedef of the Completion Handler
+	 *
+	 * Called with the error of the transfer (see http_engine::t_completionFunc) and the response shared by all the coalesced requests, which must
+	 * not be changed. The handlers run on the transport thread, one after the other, and must not block.
+	 */
+	typedef boost::function<void (const boost::system::error_code &, boost::shared_ptr<http_response>)> t_sharedFunc;
+	/*! \brief Typedef of the Future of a Request
+	 *
+	 * Holds the shared response, or a boost::system::system_error if the transfer failed.
+	 */
+	typedef boost::shared_future<boost::shared_ptr<http_response> > t_future;
+	/*! \brief Constructor
+	 *
+	 * No headers are ignored by default.
+	 *
+	 * @param[in] io the IO Service the transfers run and complete on
+	 * @param[in] maxidle the maximum number of idle engines to keep
+	 */
+	explicit http_coalescer(boost::asio::io_service *io, size_t maxidle = 64);
+	/*! \brief Request a URL
+	 *
+	 * @param[in] url the URL
+	 * @param[in] handler the function to call when the transfer completes or fails
+	 * @param[in] headers the headers to send
+	 * @param[in] method the method, only GET and HEAD are coalesced
+	 * @return true if the request attached to a transfer already in flight
+	 */
+	bool fetch(const std::string &url, t_sharedFunc handler, const t_headers &headers = t_headers(), const std::string &method = "GET");
+	/*! \brief Request a URL
+	 *
+	 * @param[in] url the URL
+	 * @param[in] headers the headers to send
+	 * @param[in] method the method, only GET and HEAD are coalesced
+	 * @return the future of the response
+	 */
+	t_future fetch(const std::string &url, const t_headers &headers = t_headers(), const std::string &method = "GET");
+	/*! \brief set the Ignored Headers
+	 *
+	 * Requests are only coalesced if they have the same values for all their headers (a header that is missing only matches a header that is
+	 * missing) but these. Only ignore headers the server does not answer differently on. Applies to the requests made after the call.
+	 *
+	 * @param[in] headers the header names, case-insensitive
+	 */
+	void setIgnoredHeaders(const std::vector<std::string> &headers);
+	/*! \brief get the Number of Transfers in Flight
+	 *
+	 * @return the transfers that requests can attach to
+	 */
+	size_t getInFlight();
+	/*! \brief get the Number of Requests
+	 *
+	 * @return the requests made to the coalescer
+	 */
+	boost::uint64_t getRequests();
+	/*! \brief get the Number of Coalesced Requests
+	 *
+	 * @return the requests that attached to a transfer in flight instead of starting their own
+	 */
+	boost::uint64_t getCoalesced();
+	/*! \brief get the Number of Requests sent again due to Vary
+	 *
+	 * @return the attached requests that had to be sent on their own because the response varies on a header they differ in
+	 */
+	boost::uint64_t getResent();
+private:
+	struct waiter {
+		t_sharedFunc handler;
+		t_headers headers;
+	};
+	struct flight {
+		std::string key;
+		std::string url;
+		std::string method;
+		t_headers headers;
+		std::vector<waiter> waiters;
+	};
+	/* the state the transfers in flight need, so they can outlive the coalescer */
+	struct coalescer_state {
+		coalescer_state(boost::asio::io_service *io, size_t maxidle);
+		boost::asio::io_service *io;
+		http_engine_pool engines;
+		boost::mutex CLock;
+		std::set<std::string> ignored;
+		std::map<std::string, boost::shared_ptr<flight> > flights;
+		boost::uint64_t requests;
+		boost::uint64_t coalesced;
+		boost::uint64_t resent;
+	};
+	static bool submit(boost::shared_ptr<coalescer_state> state, const std::string &url, const waiter &w, const std::string &method);
+	static void finished(boost::shared_ptr<coalescer_state> state, boost::shared_ptr<flight> f, boost::shared_ptr<http_engine> engine,
+			boost::shared_ptr<http_response> response, const boost::system::error_code &err);
+	static void release(boost::shared_ptr<http_engine> engine);
+	static void resolve(boost::shared_ptr<boost::promise<boost::shared_ptr<http_response> > > promise, const boost::system::error_code &err,
+			boost::shared_ptr<http_response> response);
+	boost::shared_ptr<coalescer_state> state;
+	http_coalescer(const http_coalescer &);
+	http_coalescer &operator=(const http_coalescer &);
+};
+
+}
+}
+
+#endif // HTTP_COALESCE_HPP
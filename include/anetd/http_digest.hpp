@@ -0,0 +1,142 @@
+#ifndef HTTP_DIGEST_HPP
+#define HTTP_DIGEST_HPP
+/*
+ * Body Digests for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <boost/system/error_code.hpp>
+
+#include <string>
+
+/** @file */
+
+namespace DynamX {
+namespace anetd {
+
+namespace http_digest_errc {
+/*! \brief the Errors of a Digest Check
+ *
+ * A transfer whose body does not match the digest it was checked against completes with this error in the http_digest_category().
+ */
+enum errors {
+	mismatch = 1	/**< the digest of the body is not the one expected */
+};
+/*! \brief make a error_code from a Digest Error
+ *
+ * @param[in] e the error
+ * @return the error_code in the http_digest_category()
+ */
+boost::system::error_code make_error_code(errors e);
+}
+
+/*! \brief get the Category of the Digest Errors
+ *
+ * @return the category
+ */
+const boost::system::error_category &http_digest_category();
+
+/*! \brief a Hash computed over a Body as it streams in
+ *
+ * Attached to a response with http_response::addDigest(), a digest is updated with every slice of the body as the transport hands it over, so
+ * the checksum of a large download is ready the moment the last byte arrives, without reading the body back from memory or disk.
+ *
+ * SHA-256 and MD5 are computed by OpenSSL. CRC32C (the Castagnoli CRC used by iSCSI, ext4 and cloud object stores) uses the SSE4.2 crc32
+ * instruction where the CPU has it, and tables otherwise.
+ *
+ * Not ThreadSafe, a digest belongs to a single response.
+ */
+class http_digest
+{
+public:
+	/*! \brief the Hash Algorithms */
+	enum algorithm {
+		SHA256,		/**< SHA-256, 32 bytes */
+		MD5,		/**< MD5, 16 bytes */
+		CRC32C		/**< CRC-32C, 4 bytes in network byte order */
+	};
+	/*! \brief Create a Digest
+	 *
+	 * @param[in] alg the algorithm
+	 * @return the digest, owned by the caller
+	 */
+	static http_digest *create(algorithm alg);
+	/*! \brief Default Deconstructor
+	 *
+	 */
+	virtual ~http_digest();
+	/*! \brief Add Data to the Digest
+	 *
+	 * @param[in] data the data
+	 * @param[in] len the length of data
+	 */
+	virtual void update(const char *data, size_t len) = 0;
+	/*! \brief get the Digest of the Data added so far
+	 *
+	 * @return the digest, as raw bytes
+	 */
+	virtual std::string final() = 0;
+	/*! \brief Start over with no Data
+	 *
+	 */
+	virtual void restart() = 0;
+	/*! \brief get the Algorithm
+	 *
+	 * @return the algorithm
+	 */
+	virtual algorithm getAlgorithm() const = 0;
+	/*! \brief get the Name of a Algorithm
+	 *
+	 * @param[in] alg the algorithm
+	 * @return the name used in the Digest and Content-Digest headers, eg "sha-256"
+	 */
+	static const char *getName(algorithm alg);
+	/*! \brief encode a Digest as Hex
+	 *
+	 * @param[in] raw the digest
+	 * @return the digest in lower case hex
+	 */
+	static std::string toHex(const std::string &raw);
+	/*! \brief decode a Hex Digest
+	 *
+	 * @param[in] hex the digest in hex, in either case
+	 * @param[out] raw the digest
+	 * @return false if hex is not valid hex
+	 */
+	static bool fromHex(const std::string &hex, std::string &raw);
+	/*! \brief decode a Base64 Digest
+	 *
+	 * @param[in] base64 the digest in base64, as sent in the Digest, Content-Digest and Content-MD5 headers
+	 * @param[out] raw the digest
+	 * @return false if base64 is not valid base64
+	 */
+	static bool fromBase64(const std::string &base64, std::string &raw);
+};
+
+}
+}
+
+namespace boost {
+namespace system {
+template <> struct is_error_code_enum<DynamX::anetd::http_digest_errc::errors> {
+	static const bool value = true;
+};
+}
+}
+
+#endif // HTTP_DIGEST_HPP
@@ -19,12 +19,16 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  *
  */
+/* <utility> has to come before boost::asio for its coroutine support on some compilers */
+#include <utility>
 #include <boost/algorithm/string.hpp>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/regex.hpp>
 #include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/date_time.hpp>
 #include <boost/thread.hpp>
 
@@ -36,6 +40,15 @@
 #include <vector>
 
 
+#include "http_arena.hpp"
+#include "http_buffer_pool.hpp"
+#include "http_request.hpp"
+#include "http_executor.hpp"
+#include "http_hedge.hpp"
+#include "http_proxy.hpp"
+#include "http_rate_limit.hpp"
+#include "http_retry.hpp"
+#include "http_socket_tuning.hpp"
 #include "http_response.hpp"
 
 /** @file */
@@ -161,10 +174,20 @@ namespace DynamX {
 				/*! \brief Constructor
 				 *
 				 * Create and Initialize the http_engine classes. Takes one paramaters.
+				 * Transfers run on a IO Service private to this class, on a new thread started by Starttransfer()
 				 *
 				 * @param[in] postback this is the IO Service to use to post the callback on (the callback will run on threads that are calling the run() method on this IO Service
 				 */
 				http_engine(boost::asio::io_service *postback);
+				/*! \brief Constructor for transfers on a existing IO Service
+				 *
+				 * Create and Initialize the http_engine classes. All network operations of a transfer run asynchronously on the transport IO Service,
+				 * so no thread is started for a transfer. The application must call run() on the transport IO Service.
+				 *
+				 * @param[in] postback this is the IO Service to use to post the callback on (the callback will run on threads that are calling the run() method on this IO Service
+				 * @param[in] transport this is the IO Service that the transfers run on
+				 */
+				http_engine(boost::asio::io_service *postback, boost::asio::io_service *transport);
 				/*! \brief Destructor
 				 *
 				 * Destruct the http_engine Class
@@ -172,16 +195,17 @@ namespace DynamX {
 				~http_engine();
 				/*! \brief Reset the Requests to prepare for a new transfer
 				 *
-				 * Resets the Class back to defaults to prepare for a new HTTP transfer
-				 * New Transfers will use the existing http_response class passed in the constructor
+				 * Resets the Class back to defaults to prepare for a new HTTP transfer, keeping the buffers it has allocated.
+				 * The http_response class of the last transfer is reset as well
 				 */
 				void reset();
 				/*! \brief Start the Transfer from a URL
 				 *
-				 * Starts a new transfer (in a new Thread) from the passed URL.
+				 * Starts a new transfer from the URL set on the http_response class. If the http_engine uses its private IO Service, the transfer
+				 * runs on a new Thread, otherwise it runs on the threads calling run() on the transport IO Service.
 				 * The URL can be either a http or https site
 				 *
-				 * @param[in] url a string containing the full URL of the resource to be downloaded
+				 * @param[in] myresponse the http_response class that will contain the results
 				 * \return Success or Failure of starting the transfer.
 				 */
 				bool Starttransfer(http_response *myresponse);
@@ -191,14 +215,48 @@ namespace DynamX {
 				 * a pointer to the http_response class that was passed in the http_engine::http_engine constructor
 				 */
 				typedef boost::function<void (http_response *)> t_callbackFunc;
+				/*! \brief Typedef of the Completion Function
+				 *
+				 * This is the typedef of the Function called by start() when a transfer finishes. The error_code is set if the transfer
+				 * failed before a response was received.
+				 */
+				typedef boost::function<void (const boost::system::error_code &, http_response *)> t_completionFunc;
 				/*! \brief Set a Callback Function
 				 *
 				 * This sets a Callback Function that will be called when the request completes (regardless of success or failure)
-				 * The Callback Function will be executed on any thread that is calling boost::asio::io_service::run() on the postback IO service passed in the http_engine::http_engine constructor
+				 * The Callback Function will be executed on any thread that is calling boost::asio::io_service::run() on the postback IO service passed in the http_engine::http_engine constructor, unless a different executor is set with setCompletionExecutor()
 				 *
 				 * @param[in] func The Function to call when the request has completed. Function Signature must match the http_engine::t_callbackFunc typedef
 				 */
 				bool setCallback(t_callbackFunc); /**< a Member Function. Details */
+				/*! \brief Set the Executor that runs the Callback Function
+				 *
+				 * Chooses how completed transfers are delivered to the Callback Function: inline on the transport thread (http_executor_inline),
+				 * on a IO Service (http_executor_postback, the default, using the postback IO Service), serialized on a strand (http_executor_strand),
+				 * on a pool of threads (http_executor_pool) or in batches (http_executor_batch). One executor can be shared by many http_engine classes.
+				 *
+				 * @param[in] executor the executor to use. Passing a empty pointer restores the default
+				 */
+				bool setCompletionExecutor(boost::shared_ptr<http_completion_executor> executor);
+				/*! \brief Set the Policy for Hedged Requests
+				 *
+				 * With a hedge policy, a GET or HEAD request without a body that has not received the first byte of its response within the hedge delay
+				 * is sent again on a second connection, and the first to respond wins. The other request is cancelled, and the transfer completes once both have stopped.
+				 * The second request uses a http_engine and http_response private to this class, and the response is only handed to the http_response class
+				 * of the transfer if the hedge wins, so the http_response class only ever sees one response. See http_hedge_policy.
+				 *
+				 * @param[in] policy the hedge policy, which can be shared between http_engine classes. Passing a empty pointer disables hedging
+				 */
+				bool setHedgePolicy(boost::shared_ptr<http_hedge_policy> policy);
+				/*! \brief Set the Policy for Retrying failed Transfers
+				 *
+				 * With a retry policy, a transfer that fails with a connect failure, a connection reset or a temporary error status (502, 503 or 504 by default) is sent again
+				 * after a backoff delay, and only completes once it succeeds, fails permanently or runs out of retries. Before a retry the http_response class is reset, keeping its URL.
+				 * Requests with a body are only retried if the body can be rewound. See http_retry_policy.
+				 *
+				 * @param[in] policy the retry policy, which should be shared between http_engine classes so they share its budget. Passing a empty pointer disables retries
+				 */
+				bool setRetryPolicy(boost::shared_ptr<http_retry_policy> policy);
 				/*! \brief a Boost::unique_future to indicate when the request has completed.
 				 *
 				 * a boost::unique_future to indicate when the request has completed. Applications can poll the unique_future to see when the request is finished, and then use the .get() function to retrieve
@@ -206,6 +264,42 @@ namespace DynamX {
 				 */
 				boost::unique_future<http_response*> Status;
 
+				/*! \brief Start a Asynchronous Transfer
+				 *
+				 * Starts a transfer on the transport IO Service without starting a thread. The Completion Function is called on a transport thread when the transfer
+				 * finishes. Starttransfer() and async_fetch() are implemented on top of this function.
+				 *
+				 * @param[in] myresponse the http_response class that will contain the results
+				 * @param[in] handler the Function to call when the transfer finishes
+				 */
+				void start(http_response *myresponse, t_completionFunc handler);
+
+				/*! \brief Cancel a running Transfer
+				 *
+				 * Cancels all outstanding network operations of the transfer. The transfer finishes with boost::asio::error::operation_aborted.
+				 * ThreadSafe: the cancel runs on the strand of the transfer, like its other handlers, so the transport IO Service can be run by several threads.
+				 */
+				void cancel();
+
+#if (BOOST_VERSION >= 107000) && defined(BOOST_ASIO_HAS_MOVE)
+				/*! \brief Start a Asynchronous Transfer with a boost::asio Completion Token
+				 *
+				 * Starts a transfer and completes it using any boost::asio Completion Token, for example a callback, boost::asio::use_future or
+				 * (with C++20 coroutines) boost::asio::use_awaitable. The completion is delivered on the executor associated with the token. If the
+				 * token has a cancellation slot (Boost 1.77 and newer) emitting a cancellation calls cancel().
+				 *
+				 * \code
+				 *	http_response *res = co_await engine.async_fetch(&response, boost::asio::use_awaitable);
+				 * \endcode
+				 *
+				 * @param[in] myresponse the http_response class that will contain the results
+				 * @param[in] token the Completion Token, with a signature of void (boost::system::error_code, http_response *)
+				 */
+				template <typename CompletionToken>
+				BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void (boost::system::error_code, http_response *))
+				async_fetch(http_response *myresponse, BOOST_ASIO_MOVE_ARG(CompletionToken) token);
+#endif
+
 				/*! \brief set the Username and Password to use to authenticate to a HTTP Proxy
 				 *
 				 * sets the username and password to use to authenticate to a HTTP Proxy
@@ -215,6 +309,84 @@ namespace DynamX {
 				 * @return a bool indicating success or failure
 				 */
 				bool setProxyAuth(std::string username, std::string password);
+				/*! \brief Set the Resolver that picks the Proxy Server of each Request
+				 *
+				 * By default the resolver built from the http_proxy, https_proxy and no_proxy environment variables is used (see http_proxy_resolver::getDefault()).
+				 * Credentials set with setProxyAuth() take precedence over credentials in the proxy URL.
+				 *
+				 * @param[in] resolver the proxy resolver, which can be shared between http_engine classes. Passing a empty pointer restores the default resolver
+				 * @return a bool indicating success or failure
+				 */
+				bool setProxyResolver(boost::shared_ptr<http_proxy_resolver> resolver);
+				/*! \brief Set the Socket Tuning Profiles
+				 *
+				 * The profile of the host the socket connects to is applied to every new socket, before connecting. Without tuning profiles
+				 * the default http_socket_profile is used, which sets TCP_NODELAY only.
+				 *
+				 * @param[in] tuning the tuning profiles, which can be shared between http_engine classes. Passing a empty pointer restores the default profile
+				 * @return a bool indicating success or failure
+				 */
+				bool setSocketTuning(boost::shared_ptr<http_socket_tuning> tuning);
+				/*! \brief Set the Bandwidth Limiter
+				 *
+				 * The global and per host limits of the limiter apply to this transfer, shared with all the other transfers that use the
+				 * same limiter. Without a limiter the default one (see http_rate_limiter::getDefault()) is used.
+				 *
+				 * @param[in] limiter the limiter, which can be shared between http_engine classes. Passing a empty pointer restores the default limiter
+				 * @return a bool indicating success or failure
+				 */
+				bool setRateLimiter(boost::shared_ptr<http_rate_limiter> limiter);
+				/*! \brief Set the Bandwidth Limit of this Transfer
+				 *
+				 * Limits this transfer on its own, on top of the limits of the http_rate_limiter. Reads and writes are sized to the tokens
+				 * available and wait on a timer when there are none, so a limited transfer never blocks a thread. Can be called at any time,
+				 * the new rate applies from the next read or write.
+				 * 	ThreadSafe
+				 *
+				 * @param[in] dir http_rate_limiter::RECEIVE to limit the response, http_rate_limiter::SEND to limit the request body
+				 * @param[in] rate the rate in bytes per second, 0 for unlimited
+				 * @param[in] burst the burst size in bytes, 0 for the default
+				 * @return a bool indicating success or failure
+				 */
+				bool setRateLimit(http_rate_limiter::direction dir, boost::uint64_t rate, size_t burst = 0);
+				/*! \brief Set the Pool the Receive Buffers are taken from
+				 *
+				 * By default all http_engine classes share the pool returned by http_buffer_pool::getDefault(). Engines that run on the same
+				 * thread can be given a pool of their own, so taking and returning buffers never touches a lock another thread uses
+				 * (see http_sharded_client). The pool is kept when the engine is recycled by a http_engine_pool. Must not be called during a transfer.
+				 *
+				 * @param[in] pool the pool. Passing a empty pointer restores the default pool
+				 * @return a bool indicating success or failure
+				 */
+				bool setBufferPool(boost::shared_ptr<http_buffer_pool> pool);
+
+				/*! \brief set the HTTP Method to use for the request
+				 *
+				 * sets the HTTP Method (eg "POST" or "PUT") to use for the next transfer. Defaults to "GET" after a reset()
+				 *
+				 * @param method the method to use
+				 * @return a bool indicating success or failure
+				 */
+				bool setMethod(std::string method);
+
+				/*! \brief set the Body to send with the request
+				 *
+				 * sets a in memory Body to send with the next transfer (eg, for a POST request)
+				 *
+				 * @param body the body to send
+				 * @return a bool indicating success or failure
+				 */
+				bool setBody(std::string body);
+
+				/*! \brief set the Body Source to send with the request
+				 *
+				 * sets a http_request_body to stream the Body of the next transfer from. The body is read as it is sent, so memory use does not depend on
+				 * the size of the body. Bodies of unknown size are sent with chunked Transfer-Encoding, and file bodies are sent with sendfile() on plain http connections.
+				 *
+				 * @param body the http_request_body to read the body from
+				 * @return a bool indicating success or failure
+				 */
+				bool setBody(boost::shared_ptr<http_request_body> body);
 
 				/*! \brief Return if the Transfer has completed (does not indicate errors though)
 				 *
@@ -229,23 +401,69 @@ namespace DynamX {
 				class server_connection_exception: public std::exception { };
 				class policy_file_request_exception: public std::exception { };
 				private:
-				size_t socksend(std::string data);
-				size_t sockget(char *data, size_t size);
+				enum parse_result { PARSE_MORE, PARSE_DONE, PARSE_REDIRECT, PARSE_FAILED };
+				typedef boost::function<void (const boost::system::error_code &, size_t)> t_ioFunc;
+				void async_sockwrite(const std::vector<boost::asio::const_buffer> &data, t_ioFunc handler);
+				void async_sockread(char *data, size_t size, t_ioFunc handler);
 #if BOOST_VERSION > 104700
 				bool verify_callback(bool preverified, boost::asio::ssl::verify_context &vctx);
 #endif
 				bool parse_status(int status);
-				bool parse_header();
+				bool is_eof(const boost::system::error_code &err);
+
+				void async_send();
+				void handle_resolve(const boost::system::error_code &err, boost::asio::ip::tcp::resolver::iterator endpoint);
+				void handle_connect(const boost::system::error_code &err, boost::asio::ip::tcp::resolver::iterator endpoint);
+				void handle_proxy_connect(const boost::system::error_code &err);
+				void handle_proxy_response(const boost::system::error_code &err);
+				void handle_handshake(const boost::system::error_code &err);
+				void send_request();
+				void write_request();
+				void handle_write_request(const boost::system::error_code &err, size_t len);
+				void send_body();
+				void body_ended(boost::uint64_t remaining);
+				void handle_write_body(const boost::system::error_code &err, size_t len);
+				void start_read();
+				void throttled_read();
+				void handle_read(const boost::system::error_code &err, size_t len);
+				void read_more();
+				void body_done();
+				bool throttle(http_rate_limiter::direction dir, size_t &size, http_response::t_resumeFunc next);
+				void handle_rate_timer(const boost::system::error_code &err, http_response::t_resumeFunc next);
+				void account(http_rate_limiter::direction dir, size_t bytes);
+				void size_buffer();
+				void release_buffer();
+				void wait_response(http_response::t_resumeFunc next);
+				void resume(http_response::t_resumeFunc next, boost::shared_ptr<boost::asio::io_service::work> work);
+				parse_result parse(const char *data, size_t len);
+				parse_result parse_headers();
+				void finish(const boost::system::error_code &err);
+				void deliver(const boost::system::error_code &err);
+				void complete(const boost::system::error_code &err);
+				void begin();
+				bool schedule_retry(const boost::system::error_code &err);
+				void handle_retry_timer(const boost::system::error_code &err);
+				void handle_hedge_timer(const boost::system::error_code &err, unsigned int generation);
+				bool hedge_claim();
+				bool hedge_settle(http_engine *engine, const boost::system::error_code &err, boost::system::error_code &result);
+				void abort();
+				void do_cancel();
+				void transfer_done(boost::shared_ptr<boost::promise<http_response *> > promise, const boost::system::error_code &err, http_response *res);
+				void run();
+				std::string headerblock(const std::string &hostname);
+				std::string proxyauthorization();
 
-				bool send();
-				bool receive();
 				void disconnect();
+				void save_session();
+				void tune_socket(boost::asio::ip::tcp::socket &mysocket, const boost::asio::ip::tcp::endpoint &myendpoint);
 				void callback(http_response *res);
 				void clear();
-				http_response *connect();
+				void recycle();
+				friend class http_engine_pool;
 
 				std::string method;
 				std::string host;
+				std::string hostname;
 				std::string url;
 				std::string targeturl;
 				std::string version;
@@ -253,23 +471,152 @@ namespace DynamX {
 				std::string description;
 				std::map<std::string, std::string> arguments;
 				std::pair<std::string, std::string> proxyauth;
-				std::string body;
+				boost::shared_ptr<http_proxy_resolver> proxyresolver;
+				const http_proxy_resolver::proxy *proxyserver;
+				boost::shared_ptr<http_request_body> body;
+				std::vector<char> sendbuffer;
+				std::string chunkheader;
+				bool bodydone;
+				boost::uint64_t bodysent;
+				http_request request;
 				http_response *response;
 				t_callbackFunc CallbackFunction;
-				enum http_response_parser_state { ANETD_VERSION, ANETD_STATUS, ANETD_DESCRIPTION, ANETD_HEADER_KEY, ANETD_HEADER_VALUE, ANETD_BODY, ANETD_OK };
+				t_completionFunc CompletionFunction;
+				enum http_response_parser_state { ANETD_VERSION, ANETD_STATUS, ANETD_DESCRIPTION, ANETD_HEADER_KEY, ANETD_HEADER_VALUE, ANETD_BODY, ANETD_CHUNK_SIZE, ANETD_CHUNK_DATA, ANETD_CHUNK_END, ANETD_CHUNK_TRAILER, ANETD_OK };
 				enum http_proxy_enum { NONE, HTTP_PROXY, HTTPS_PROXY};
 				enum http_type_enum { PLAIN_HTTP, SSL_HTTPS};
 				int redirtimes;
+				bool connected;
+				bool cancelled;
+
+				http_response_parser_state parser_state;
+				std::string rversion;
+				int rstatus;
+				std::string rdescription;
+				std::string temp;
+				size_t bodyreceived;
+				size_t chunkremaining;
+				boost::shared_ptr<http_buffer_pool> bufferpool;
+				char *recvbuffer;
+				unsigned int recvclass;
+				size_t recvsize;
+				size_t lastread;
+				boost::system::error_code bodyresult;
+				unsigned int fullreads;
+				unsigned int shortreads;
+				std::string proxycmd;
+				boost::asio::streambuf proxyresponse;
 
 				http_proxy_enum http_proxy;
 				http_type_enum http_type;
 				boost::asio::io_service io;
+				boost::thread transferthread;
+				boost::asio::io_service &transport;
+				/* the handlers of a transfer, and cancel(), run on this, so a transport IO Service run by several threads never runs two of them at once */
+				boost::asio::io_service::strand strand;
+				boost::asio::ip::tcp::resolver resolver;
 				boost::asio::ip::tcp::socket socket;
 				boost::asio::ssl::context ctx;
-				boost::asio::ssl::stream<boost::asio::ip::tcp::socket> sslsocket;
+				boost::scoped_ptr<boost::asio::ssl::stream<boost::asio::ip::tcp::socket> > sslsocket;
+				std::map<std::string, SSL_SESSION *> sslsessions;
+				boost::shared_ptr<http_socket_tuning> sockettuning;
+				http_socket_profile socketprofile;
 				boost::asio::io_service *postbackio;
+				boost::shared_ptr<http_completion_executor> executor;
+				boost::shared_ptr<http_completion_executor> defaultexecutor;
+				http_arena arena;
+
+				boost::shared_ptr<http_hedge_policy> hedgepolicy;
+				boost::asio::deadline_timer hedgetimer;
+				boost::scoped_ptr<http_engine> hedgeengine;
+				boost::scoped_ptr<http_response> hedgeresponse;
+				http_engine *hedgeprimary;
+				http_engine *hedgewinner;
+				boost::mutex HLock;
+				unsigned int hedgegeneration;
+				int hedgerunning;
+				bool hedged;
+				bool hedgeresultset;
+				boost::system::error_code hedgeresult;
+				bool firstbyte;
+				boost::posix_time::ptime starttime;
+
+				boost::shared_ptr<http_retry_policy> retrypolicy;
+				boost::asio::deadline_timer retrytimer;
+				unsigned int retryattempt;
+				bool cancelrequested;
+
+				boost::shared_ptr<http_rate_limiter> ratelimiter;
+				boost::shared_ptr<http_token_bucket> transferlimit[2];
+				boost::asio::deadline_timer ratetimer;
+				size_t requestsent;
 		};
 
+#if (BOOST_VERSION >= 107000) && defined(BOOST_ASIO_HAS_MOVE)
+		namespace detail {
+			/* holds a (possibly move only) completion handler so it can be stored in a t_completionFunc, and
+			 * delivers the result on the handlers associated executor */
+			template <typename Handler>
+			class fetch_handler
+			{
+				public:
+					explicit fetch_handler(Handler &handler, boost::asio::io_service &transport) :
+						state(new fetch_state(handler, transport)) { }
+					void operator()(const boost::system::error_code &err, http_response *res) {
+						boost::shared_ptr<fetch_state> mystate = this->state;
+#if BOOST_VERSION >= 107700
+						boost::asio::get_associated_cancellation_slot(mystate->handler).clear();
+#endif
+						boost::asio::dispatch(mystate->work.get_executor(), invoker(mystate, err, res));
+					}
+				private:
+					struct fetch_state {
+						fetch_state(Handler &myhandler, boost::asio::io_service &transport) :
+							handler(std::move(myhandler)), work(boost::asio::get_associated_executor(this->handler, transport.get_executor())) { }
+						Handler handler;
+						boost::asio::executor_work_guard<typename boost::asio::associated_executor<Handler, boost::asio::io_service::executor_type>::type> work;
+					};
+					struct invoker {
+						invoker(boost::shared_ptr<fetch_state> mystate, const boost::system::error_code &myerr, http_response *myres) :
+							state(mystate), err(myerr), res(myres) { }
+						void operator()() {
+							Handler handler(std::move(this->state->handler));
+							this->state->work.reset();
+							handler(this->err, this->res);
+						}
+						boost::shared_ptr<fetch_state> state;
+						boost::system::error_code err;
+						http_response *res;
+					};
+					boost::shared_ptr<fetch_state> state;
+			};
+
+			struct initiate_fetch
+			{
+				explicit initiate_fetch(http_engine *myengine, boost::asio::io_service &mytransport) : engine(myengine), transport(mytransport) { }
+				template <typename Handler>
+				void operator()(BOOST_ASIO_MOVE_ARG(Handler) handler, http_response *myresponse) const {
+					typedef typename std::decay<Handler>::type handler_type;
+					handler_type myhandler(BOOST_ASIO_MOVE_CAST(Handler)(handler));
+#if BOOST_VERSION >= 107700
+					boost::asio::cancellation_slot slot = boost::asio::get_associated_cancellation_slot(myhandler);
+					if (slot.is_connected())
+						slot.assign(boost::bind(&http_engine::cancel, this->engine));
+#endif
+					this->engine->start(myresponse, fetch_handler<handler_type>(myhandler, this->transport));
+				}
+				http_engine *engine;
+				boost::asio::io_service &transport;
+			};
+		}
+
+		template <typename CompletionToken>
+		BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void (boost::system::error_code, http_response *))
+		http_engine::async_fetch(http_response *myresponse, BOOST_ASIO_MOVE_ARG(CompletionToken) token) {
+			return boost::asio::async_initiate<CompletionToken, void (boost::system::error_code, http_response *)>(
+					detail::initiate_fetch(this, this->transport), token, myresponse);
+		}
+#endif
 
 	}
 }
@@ -0,0 +1,184 @@
+#ifndef HTTP_EXECUTOR_HPP
+#define HTTP_EXECUTOR_HPP
+/*
+ * Completion Executor classes for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <utility>
+#include <vector>
+
+/** @file */
+
+namespace DynamX {
+namespace anetd {
+
+class http_response;
+
+/*! \brief Base Class that delivers the Callback of a completed Transfer
+ *
+ * The http_engine class hands every completed transfer to a http_completion_executor, which decides on which thread (and how) the Callback Function
+ * set with http_engine::setCallback() is run. By default the http_engine class uses a http_executor_postback on the postback IO Service passed to its constructor.
+ *
+ * One executor can be shared by many http_engine classes. Classes that need to deliver completions in another way should inherit this class as the base class.
+ */
+class http_completion_executor
+{
+public:
+	/*! \brief Typedef of the Callback Function
+	 *
+	 * Same as http_engine::t_callbackFunc
+	 */
+	typedef boost::function<void (http_response *)> t_callbackFunc;
+	/*! \brief Default Deconstructor
+	 *
+	 */
+	virtual ~http_completion_executor();
+	/*! \brief Deliver a completed Transfer
+	 *
+	 * Called by the http_engine class on a transport thread when a transfer completes.
+	 *
+	 * @param[in] func the Callback Function to run
+	 * @param[in] res the http_response class with the results of the transfer
+	 */
+	virtual void complete(t_callbackFunc func, http_response *res) = 0;
+};
+
+/*! \brief Run the Callback directly on the transport thread
+ *
+ * The Callback Function runs inline on the thread that finished the transfer, without any posting overhead. The Callback must not block,
+ * as that stalls every other transfer on the same transport IO Service.
+ */
+class http_executor_inline : public http_completion_executor
+{
+public:
+	void complete(t_callbackFunc func, http_response *res);
+};
+
+/*! \brief Post the Callback to a IO Service
+ *
+ * This is the default executor. The Callback Function runs on any thread calling run() on the IO Service.
+ */
+class http_executor_postback : public http_completion_executor
+{
+public:
+	/*! \brief Constructor
+	 *
+	 * @param[in] io the IO Service to post the Callbacks on
+	 */
+	http_executor_postback(boost::asio::io_service *io);
+	void complete(t_callbackFunc func, http_response *res);
+private:
+	boost::asio::io_service *io;
+};
+
+/*! \brief Post the Callback to a Strand
+ *
+ * The Callback Functions run on the threads calling run() on the IO Service, but never concurrently with each other, so they do not need their own locking.
+ */
+class http_executor_strand : public http_completion_executor
+{
+public:
+	/*! \brief Constructor
+	 *
+	 * @param[in] io the IO Service the strand runs on
+	 */
+	http_executor_strand(boost::asio::io_service *io);
+	void complete(t_callbackFunc func, http_response *res);
+	/*! \brief get the Strand
+	 *
+	 * Applications can post their own work to the strand to serialize it with the Callbacks
+	 *
+	 * @return the strand used for the Callbacks
+	 */
+	boost::asio::io_service::strand &getStrand();
+private:
+	boost::asio::io_service::strand strand;
+};
+
+/*! \brief Post the Callback to a Pool of Threads
+ *
+ * The executor owns a IO Service and a number of threads that run it. Callbacks are spread over the threads, so slow Callbacks do not hold up each other.
+ */
+class http_executor_pool : public http_completion_executor
+{
+public:
+	/*! \brief Constructor
+	 *
+	 * Starts the pool threads.
+	 *
+	 * @param[in] threads the number of threads in the pool
+	 */
+	http_executor_pool(size_t threads);
+	/*! \brief Destructor
+	 *
+	 * Runs the outstanding Callbacks and stops the pool threads.
+	 */
+	~http_executor_pool();
+	void complete(t_callbackFunc func, http_response *res);
+private:
+	boost::asio::io_service io;
+	boost::scoped_ptr<boost::asio::io_service::work> work;
+	boost::thread_group threads;
+};
+
+/*! \brief Deliver Callbacks in Batches
+ *
+ * Completed transfers are queued, and a single post to the IO Service delivers everything queued since the last one. At high completion
+ * rates this replaces one post per transfer with one post per wakeup.
+ *
+ * For every response in the batch, the Callback Function set on its http_engine is called first, then the Batch Function is called once with the whole batch.
+ *
+ * If several threads run the IO Service, two batches can be delivered at the same time, so a Batch Function that keeps state must lock it.
+ */
+class http_executor_batch : public http_completion_executor
+{
+public:
+	/*! \brief Typedef of the Batch Function
+	 *
+	 * The Batch Function is called with all the responses completed since the previous batch, in completion order.
+	 */
+	typedef boost::function<void (const std::vector<http_response *> &)> t_batchFunc;
+	/*! \brief Constructor
+	 *
+	 * @param[in] io the IO Service to deliver the batches on
+	 * @param[in] func the Batch Function
+	 * @param[in] maxbatch the largest number of responses to deliver in one call, 0 for no limit
+	 */
+	http_executor_batch(boost::asio::io_service *io, t_batchFunc func, size_t maxbatch = 0);
+	void complete(t_callbackFunc func, http_response *res);
+private:
+	void drain();
+	boost::asio::io_service *io;
+	t_batchFunc BatchFunction;
+	size_t maxbatch;
+	boost::mutex QLock;
+	std::vector<std::pair<t_callbackFunc, http_response *> > queue;
+	std::vector<std::pair<t_callbackFunc, http_response *> > spare;
+	bool scheduled;
+};
+
+}
+}
+
+#endif // HTTP_EXECUTOR_HPP
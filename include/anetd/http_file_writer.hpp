@@ -0,0 +1,122 @@
+#ifndef HTTP_FILE_WRITER_HPP
+#define HTTP_FILE_WRITER_HPP
+/*
+ * File Writers for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <string>
+
+/** @file */
+
+namespace DynamX {
+namespace anetd {
+
+/*! \brief Writes the Body of a Response to a File
+ *
+ * The http_response_file class writes the body through a http_file_writer, so the way data reaches the disk can be chosen at runtime:
+ *
+ * \li BACKEND_POSIX copies the body into a 64 KB buffer, and writes it with a write() system call once it is full
+ * \li BACKEND_URING copies the body into a few buffers registered with a io_uring instance of the writer, and submits a buffer once it is full.
+ * Several writes are submitted, and their completions reaped, with a single system call, and the kernel does not have to map the buffers for each write.
+ * The file is complete once close() returns. Needs Linux 5.6 or newer
+ * \li BACKEND_AUTO uses io_uring when the kernel supports it, and POSIX writes otherwise
+ *
+ * The default backend is BACKEND_AUTO, or the value of the ANETD_IO_BACKEND environment variable ("posix", "uring" or "auto"), and can be changed
+ * with setDefaultBackend(). When io_uring is asked for but not available (an old kernel, or io_uring disabled by a seccomp filter or the
+ * kernel.io_uring_disabled sysctl) the writer falls back to POSIX writes.
+ *
+ * Not ThreadSafe, a writer belongs to a single response.
+ */
+class http_file_writer
+{
+public:
+	/*! \brief the Ways of writing a File
+	 *
+	 */
+	enum backend {
+		BACKEND_AUTO,	/**< io_uring if the kernel supports it, otherwise POSIX */
+		BACKEND_POSIX,	/**< a write() system call per 64 KB */
+		BACKEND_URING	/**< batched writes from registered buffers, through io_uring */
+	};
+	/*! \brief Create a Writer
+	 *
+	 * @param[in] backend the backend to use. BACKEND_AUTO uses the default backend
+	 * @return the writer, owned by the caller
+	 */
+	static http_file_writer *create(backend backend = BACKEND_AUTO);
+	/*! \brief check if the Kernel supports io_uring
+	 *
+	 * The kernel is probed once, the result is cached.
+	 *
+	 * @return true if io_uring writers can be created
+	 */
+	static bool hasUring();
+	/*! \brief set the Default Backend
+	 *
+	 * Used by writers created afterwards with BACKEND_AUTO.
+	 *
+	 * @param[in] backend the default backend
+	 */
+	static void setDefaultBackend(backend backend);
+	/*! \brief get the Default Backend
+	 *
+	 * @return the backend used for BACKEND_AUTO, after resolving BACKEND_AUTO itself to what the kernel supports
+	 */
+	static backend getDefaultBackend();
+	/*! \brief Default Deconstructor
+	 *
+	 * Closes the file if it is still open.
+	 */
+	virtual ~http_file_writer();
+	/*! \brief Create a File and open it for Writing
+	 *
+	 * A existing file is truncated.
+	 *
+	 * @param[in] path the path of the file
+	 * @return false if the file could not be opened
+	 */
+	virtual bool open(const std::string &path) = 0;
+	/*! \brief Append Data to the File
+	 *
+	 * @param[in] data the data
+	 * @param[in] len the length of data
+	 * @return false if a write failed. The error is also reported by close()
+	 */
+	virtual bool write(const char *data, size_t len) = 0;
+	/*! \brief Write all outstanding Data and close the File
+	 *
+	 * @return false if any write failed
+	 */
+	virtual bool close() = 0;
+	/*! \brief check if a File is open
+	 *
+	 * @return true if a file is open
+	 */
+	virtual bool isOpen() const = 0;
+	/*! \brief get the Backend of this Writer
+	 *
+	 * @return BACKEND_POSIX or BACKEND_URING
+	 */
+	virtual backend getBackend() const = 0;
+};
+
+}
+}
+
+#endif // HTTP_FILE_WRITER_HPP
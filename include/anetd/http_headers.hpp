@@ -0,0 +1,227 @@
+#ifndef HTTP_HEADERS_HPP
+#define HTTP_HEADERS_HPP
+/*
+ * HTTP Header Table class for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <boost/cstdint.hpp>
+
+#include <string>
+#include <vector>
+
+/** @file */
+
+namespace DynamX {
+namespace anetd {
+
+/*! \brief a Compact Table of HTTP Headers
+ *
+ * The http_headers class stores the headers of a HTTP message as a flat list of entries. The names and values of all headers are kept in a single
+ * contiguous arena, and the entries only hold offsets into it, so a table that is cleared and reused does not allocate memory once it has grown to fit.
+ *
+ * Common header names are interned to a small integer id (see http_headers::header_id) with a static perfect hash, so looking up a well known header
+ * is a integer compare instead of a string compare. All lookups by name are ASCII case-insensitive, as required by RFC 7230.
+ *
+ * Duplicate headers (eg, Set-Cookie) are all kept, in the order they were received. Lookups return the first one.
+ */
+class http_headers
+{
+public:
+	/*! \brief Ids of the interned Header Names
+	 *
+	 * Headers with a name that is not in this list have the id Unknown.
+	 */
+	enum header_id {
+		Unknown = 0,
+		Accept,
+		Accept_Encoding,
+		Accept_Ranges,
+		Age,
+		Allow,
+		Alt_Svc,
+		Authorization,
+		Cache_Control,
+		Connection,
+		Content_Disposition,
+		Content_Encoding,
+		Content_Language,
+		Content_Length,
+		Content_Location,
+		Content_MD5,
+		Content_Range,
+		Content_Type,
+		Cookie,
+		Date,
+		Digest,
+		ETag,
+		Expires,
+		Host,
+		Keep_Alive,
+		Last_Modified,
+		Link,
+		Location,
+		Pragma,
+		Proxy_Authenticate,
+		Proxy_Authorization,
+		Proxy_Connection,
+		Retry_After,
+		Server,
+		Set_Cookie,
+		Strict_Transport_Security,
+		Trailer,
+		Transfer_Encoding,
+		Upgrade,
+		User_Agent,
+		Vary,
+		Via,
+		WWW_Authenticate,
+		X_Powered_By,
+		Max_Header_Id
+	};
+	/*! \brief Default Constructor
+	 *
+	 */
+	http_headers();
+	/*! \brief Remove all Headers
+	 *
+	 * The memory used by the table is kept, so it can be reused without allocating.
+	 */
+	void clear();
+	/*! \brief Intern a Header Name
+	 *
+	 * @param[in] name the header name, in any case
+	 * @param[in] len the length of name
+	 * @return the id of the header, or Unknown if the name is not interned
+	 */
+	static header_id lookup(const char *name, size_t len);
+	/*! \brief get the canonical Name of a interned Header
+	 *
+	 * @param[in] id the header id
+	 * @return the name of the header, or a empty string for Unknown
+	 */
+	static const char *name(header_id id);
+	/*! \brief Add a Header to the Table
+	 *
+	 * @param[in] name the header name
+	 * @param[in] value the header value
+	 */
+	void add(const std::string &name, const std::string &value);
+	/*! \brief Start parsing a new Header
+	 *
+	 * Headers can be built up in place as they are parsed, without first collecting them in temporary strings. A header is started with begin(), its name
+	 * and value are appended in as many pieces as needed, and it is added to the table by commit().
+	 */
+	void begin();
+	/*! \brief Append part of the Name of the Header being parsed
+	 *
+	 * @param[in] data the characters to append
+	 * @param[in] len the number of characters
+	 */
+	void appendName(const char *data, size_t len);
+	/*! \brief Append part of the Value of the Header being parsed
+	 *
+	 * Leading whitespace of the value is skipped.
+	 *
+	 * @param[in] data the characters to append
+	 * @param[in] len the number of characters
+	 */
+	void appendValue(const char *data, size_t len);
+	/*! \brief Drop the Header being parsed
+	 *
+	 * Used when a malformed header line has to be skipped.
+	 */
+	void discard();
+	/*! \brief Check if a Header is being parsed
+	 *
+	 * @return true if a name has been appended since the last begin(), commit() or discard()
+	 */
+	bool isParsing() const;
+	/*! \brief Add the Header being parsed to the Table
+	 *
+	 * Trailing whitespace is trimmed from the value, and the name is interned.
+	 */
+	void commit();
+	/*! \brief get the number of Headers in the Table
+	 *
+	 * @return the number of headers
+	 */
+	size_t size() const;
+	/*! \brief get the id of a Header
+	 *
+	 * @param[in] index the position of the header in the table
+	 * @return the id of the header
+	 */
+	header_id getId(size_t index) const;
+	/*! \brief get the Name of a Header
+	 *
+	 * @param[in] index the position of the header in the table
+	 * @return the name, as it was received
+	 */
+	std::string getName(size_t index) const;
+	/*! \brief get the Value of a Header
+	 *
+	 * @param[in] index the position of the header in the table
+	 * @return the value
+	 */
+	std::string getValue(size_t index) const;
+	/*! \brief Find a interned Header without copying its Value
+	 *
+	 * @param[in] id the header id
+	 * @param[out] value set to the start of the value. Only valid till the table is modified
+	 * @param[out] len set to the length of the value
+	 * @return true if the header exists
+	 */
+	bool find(header_id id, const char *&value, size_t &len) const;
+	/*! \brief get the Value of a interned Header
+	 *
+	 * @param[in] id the header id
+	 * @param[out] value the value of the header
+	 * @return true if the header exists
+	 */
+	bool get(header_id id, std::string &value) const;
+	/*! \brief get the Value of a Header by Name
+	 *
+	 * @param[in] name the header name, in any case
+	 * @param[out] value the value of the header
+	 * @return true if the header exists
+	 */
+	bool get(const std::string &name, std::string &value) const;
+	/*! \brief Check if a Header exists
+	 *
+	 * @param[in] id the header id
+	 * @return true if the header exists
+	 */
+	bool has(header_id id) const;
+private:
+	struct entry {
+		boost::uint16_t id;
+		boost::uint32_t name;
+		boost::uint32_t namelen;
+		boost::uint32_t value;
+		boost::uint32_t valuelen;
+	};
+	std::vector<entry> entries;
+	std::string arena;
+	entry pending;
+};
+
+}
+}
+
+#endif // HTTP_HEADERS_HPP
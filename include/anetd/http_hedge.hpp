@@ -0,0 +1,159 @@
+#ifndef HTTP_HEDGE_HPP
+#define HTTP_HEDGE_HPP
+/*
+ * Hedged Request Policy for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <deque>
+#include <list>
+#include <map>
+#include <string>
+
+/** @file */
+
+namespace DynamX {
+namespace anetd {
+
+/*! \brief Policy for Hedged Requests
+ *
+ * When a http_engine class has a hedge policy set (see http_engine::setHedgePolicy()), a GET or HEAD request without a body that has not received
+ * the first byte of its response within the hedge delay is sent a second time, on a new connection. Whichever request receives the first byte of its response first
+ * wins, the other one is cancelled. This cuts the tail latency caused by slow connects or a slow server behind a load balancer.
+ *
+ * The hedge delay is either fixed, or a percentile of the time to first byte seen for the same host (for example the 95th percentile, so only the slowest 5% of
+ * requests are hedged). A budget caps the extra load: every eligible request earns a fraction of a token, every hedge costs a whole token, and a hedge is only sent
+ * if a token is available. With the default budget of 0.1, at most about 10% of the requests are hedged.
+ *
+ * One policy can be shared by many http_engine classes, and then learns latencies and spends its budget across all of them. ThreadSafe.
+ */
+class http_hedge_policy
+{
+public:
+	/*! \brief Constructor
+	 *
+	 * @param[in] delay the hedge delay, used till enough samples of a host are known when a percentile is set
+	 * @param[in] budget the number of hedge tokens each eligible request earns
+	 * @param[in] burst the maximum number of tokens that can be saved up
+	 */
+	explicit http_hedge_policy(boost::posix_time::time_duration delay = boost::posix_time::milliseconds(100), double budget = 0.1, double burst = 10);
+	/*! \brief set the fixed Hedge Delay
+	 *
+	 * @param[in] delay the time to wait for the first byte before hedging. A delay that is not positive disables the fixed delay, so requests are only hedged after a percentile is learned
+	 */
+	void setDelay(boost::posix_time::time_duration delay);
+	/*! \brief Hedge at a Percentile of the Time to First Byte of each Host
+	 *
+	 * @param[in] percentile the percentile to use, between 0 and 100. 0 disables the percentile and uses the fixed delay
+	 * @param[in] minsamples the number of samples of a host needed before the percentile is used
+	 * @param[in] window the number of recent samples kept per host
+	 */
+	void setPercentile(double percentile, size_t minsamples = 20, size_t window = 128);
+	/*! \brief set the maximum Number of Hosts to keep Samples for
+	 *
+	 * The samples of the host that was recorded least recently are dropped to make room for a new host, so a process that talks to many
+	 * hosts does not grow the policy without bound. Hosts that are dropped use the fixed delay till they have enough samples again.
+	 *
+	 * @param[in] maxhosts the maximum number of hosts, at least 1. The default is 1024
+	 */
+	void setMaxHosts(size_t maxhosts);
+	/*! \brief set the Hedge Budget
+	 *
+	 * @param[in] budget the number of hedge tokens each eligible request earns
+	 * @param[in] burst the maximum number of tokens that can be saved up
+	 */
+	void setBudget(double budget, double burst);
+	/*! \brief get the Hedge Delay for a Host
+	 *
+	 * @param[in] host the host, as protocol://hostname:port
+	 * @return the delay. Not positive if the request should not be hedged
+	 */
+	boost::posix_time::time_duration getDelay(const std::string &host);
+	/*! \brief Count a eligible Request
+	 *
+	 * Called by the http_engine class for every request that can be hedged. Adds to the budget.
+	 */
+	void request();
+	/*! \brief Take a Token from the Budget
+	 *
+	 * Called by the http_engine class before it sends a hedge.
+	 *
+	 * @return true if the hedge can be sent
+	 */
+	bool acquire();
+	/*! \brief Record the Time to First Byte of a Request
+	 *
+	 * Called by the http_engine class when the first byte of a response is received, by the original request or its hedge.
+	 *
+	 * @param[in] host the host, as protocol://hostname:port
+	 * @param[in] latency the time from starting the original request to the first byte of the response
+	 * @param[in] hedgewon true if the hedge won
+	 */
+	void record(const std::string &host, boost::posix_time::time_duration latency, bool hedgewon);
+	/*! \brief get the Number of eligible Requests
+	 *
+	 * @return the number of requests that could have been hedged
+	 */
+	boost::uint64_t getRequests();
+	/*! \brief get the Number of Hedges sent
+	 *
+	 * @return the number of hedges
+	 */
+	boost::uint64_t getHedges();
+	/*! \brief get the Number of Hedges that won
+	 *
+	 * @return the number of hedges that received the first byte before the original request
+	 */
+	boost::uint64_t getHedgeWins();
+	/*! \brief get the Number of Hedges not sent due to the Budget
+	 *
+	 * @return the number of hedges denied
+	 */
+	boost::uint64_t getDenied();
+private:
+	void prune();
+	boost::mutex HLock;
+	boost::posix_time::time_duration delay;
+	double percentile;
+	size_t minsamples;
+	size_t window;
+	double budget;
+	double burst;
+	double tokens;
+	struct host_samples {
+		std::deque<boost::int64_t> latencies;
+		std::list<std::string>::iterator recent;
+	};
+	/* the hosts by how recently they were recorded, most recent first */
+	std::list<std::string> recent;
+	std::map<std::string, host_samples> samples;
+	size_t maxhosts;
+	boost::uint64_t requests;
+	boost::uint64_t hedges;
+	boost::uint64_t hedgewins;
+	boost::uint64_t denied;
+};
+
+}
+}
+
+#endif // HTTP_HEDGE_HPP
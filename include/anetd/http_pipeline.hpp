@@ -0,0 +1,172 @@
+#ifndef HTTP_PIPELINE_HPP
+#define HTTP_PIPELINE_HPP
+/*
+ * Post-Processing Pipeline classes for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/smart_ptr/detail/atomic_count.hpp>
+
+#include <deque>
+#include <string>
+#include <vector>
+#include "http_response.hpp"
+
+/** @file */
+
+namespace DynamX {
+namespace anetd {
+
+/*! \brief a Work Stealing Thread Pool for Post-Processing Transfers
+ *
+ * Each thread in the pool has its own queue of tasks. Tasks are spread over the queues as they are submitted, and a thread that runs out of work
+ * steals the oldest task from another threads queue, so a few slow transfers do not leave the other threads idle.
+ *
+ * One pool is usually shared by all the http_response_pipeline classes of a application.
+ */
+class http_pipeline_pool
+{
+public:
+	/*! \brief Typedef of a Task run on the Pool
+	 *
+	 */
+	typedef boost::function<void ()> t_taskFunc;
+	/*! \brief Constructor
+	 *
+	 * Starts the pool threads.
+	 *
+	 * @param[in] threads the number of threads in the pool. 0 uses the number of CPU cores
+	 */
+	http_pipeline_pool(size_t threads = 0);
+	/*! \brief Destructor
+	 *
+	 * Runs the outstanding tasks and stops the pool threads.
+	 */
+	~http_pipeline_pool();
+	/*! \brief Queue a Task on the Pool
+	 *
+	 * ThreadSafe
+	 *
+	 * @param[in] task the task to run
+	 */
+	void submit(t_taskFunc task);
+	/*! \brief get the number of threads in the Pool
+	 *
+	 * @return the number of threads
+	 */
+	size_t getThreads();
+private:
+	struct worker {
+		boost::mutex QLock;
+		std::deque<t_taskFunc> tasks;
+	};
+	void run(size_t id);
+	bool take(size_t id, t_taskFunc &task);
+	std::vector<boost::shared_ptr<worker> > workers;
+	boost::thread_group threads;
+	boost::detail::atomic_count next;
+	boost::mutex WLock;
+	boost::condition_variable wakeup;
+	size_t pending;
+	bool stopping;
+};
+
+/*! \brief a http_response Class that decodes the Body while it downloads
+ *
+ * Body chunks are handed to a http_pipeline_pool as they arrive from the server, and run through a list of decode stages (for example a
+ * decompressor followed by a XML parser) on the pool threads, so decoding overlaps the download instead of starting after the last byte arrives.
+ * The output of the last stage is appended to the body returned by getBody().
+ *
+ * Chunks of one transfer are always processed in order and never concurrently, so stages can keep their own state between calls. Chunks of different transfers
+ * are processed in parallel.
+ *
+ * If the stages fall behind and more than maxbuffered bytes are waiting, the http_engine stops reading from the socket until the pipeline has caught up,
+ * so a slow decoder applies backpressure to the server instead of buffering the whole download. The transfer completes (and the Callback Function is
+ * called) only after the last stage has processed the end of the body.
+ *
+ * A stage that throws fails the transfer with boost::system::errc::bad_message. The rest of the body is dropped, and the engine stops reading from
+ * the socket.
+ */
+class http_response_pipeline : public http_response
+{
+public:
+	/*! \brief Typedef of a Decode Stage
+	 *
+	 * A Decode Stage transforms data in place. It is called once for every chunk of the body in order with last set to false, and a final time with
+	 * last set to true (where data may be empty) so it can emit anything it has buffered. A stage can clear data to pass nothing on to the next stage.
+	 */
+	typedef boost::function<void (std::string &data, bool last)> t_stageFunc;
+	/*! \brief Constructor
+	 *
+	 * @param[in] pool the pool to run the stages on
+	 * @param[in] maxbuffered the number of bytes that can be waiting for the stages before reading from the socket is paused
+	 */
+	http_response_pipeline(boost::shared_ptr<http_pipeline_pool> pool, size_t maxbuffered = 1048576);
+	/*! \brief Destructor
+	 *
+	 * Waits for the stages to finish with any chunks that are still queued
+	 */
+	~http_response_pipeline();
+	/*! \brief Add a Decode Stage to the end of the Pipeline
+	 *
+	 * Stages must be added before the transfer is started.
+	 *
+	 * @param[in] stage the decode stage
+	 */
+	void addStage(t_stageFunc stage);
+	void reset();
+	/*! \brief get the Current Progress of the Transfer
+	 *
+	 *  returns the number of body bytes received from the server so far, including bytes still waiting for the stages
+	 *  Calling this function anytime during the transfer is ThreadSafe
+	 *
+	 * @return the amount of data currently downloaded.
+	 */
+	size_t getProgress();
+protected:
+	void setBody(std::string Body);
+	void setBody(char c);
+	void onData(const char *data, size_t len);
+	void completed();
+	bool ready(t_resumeFunc resume);
+private:
+	void process();
+	void schedule();
+	boost::shared_ptr<http_pipeline_pool> pool;
+	std::vector<t_stageFunc> stages;
+	boost::mutex PLock;
+	boost::condition_variable idle;
+	std::deque<std::string> chunks;
+	size_t buffered;
+	size_t maxbuffered;
+	size_t received;
+	bool running;
+	bool last;
+	bool done;
+	bool failed;
+	t_resumeFunc ResumeFunction;
+};
+
+}
+}
+
+#endif // HTTP_PIPELINE_HPP
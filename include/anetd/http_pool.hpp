@@ -0,0 +1,340 @@
+#ifndef HTTP_POOL_HPP
+#define HTTP_POOL_HPP
+/*
+ * Object Pools for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <boost/asio.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include <exception>
+#include <vector>
+
+#include "http_buffer_pool.hpp"
+#include "http_response.hpp"
+
+/** @file */
+
+namespace DynamX {
+namespace anetd {
+
+class http_engine;
+
+/*! \brief a Pool of reusable Objects
+ *
+ * Hands out objects that have been reset and are ready to use, and takes them back when the last boost::shared_ptr to them is released.
+ * Objects are reset when they come back to the pool, so the memory they have grown into (buffers, header tables, the transfer arena) is kept
+ * for the next user instead of being freed and allocated again. At most the idle limit of objects is kept, the rest are deleted.
+ *
+ * Objects can outlive the pool. They are deleted when they are released after the pool has been destroyed.
+ *
+ * For http_response and classes derived from it the default create and recycle functions (new T() and T::recycle()) are enough, see
+ * http_response_pool. http_engine classes need a IO Service, see http_engine_pool.
+ *
+ * ThreadSafe.
+ */
+template <typename T>
+class http_pool
+{
+public:
+	/*! \brief Typedef of the Create Function
+	 *
+	 * Called when the pool is empty, to create a new object.
+	 */
+	typedef boost::function<T *()> t_createFunc;
+	/*! \brief Typedef of the Recycle Function
+	 *
+	 * Called when a object comes back to the pool, to reset it for the next user.
+	 */
+	typedef boost::function<void (T *)> t_recycleFunc;
+	/*! \brief Constructor
+	 *
+	 * @param[in] maxidle the maximum number of idle objects to keep
+	 * @param[in] create the function to create new objects. Defaults to new T()
+	 * @param[in] recycle the function to reset objects coming back to the pool. Defaults to calling T::recycle()
+	 */
+	explicit http_pool(size_t maxidle = 64, t_createFunc create = &http_pool::create_object, t_recycleFunc recycle = &http_pool::recycle_object) :
+			state(new pool_state(maxidle, create, recycle)) { }
+	/*! \brief Destructor
+	 *
+	 * Deletes the idle objects. Objects still in use are deleted when they are released.
+	 */
+	~http_pool() {
+		boost::interprocess::scoped_lock<boost::mutex> lock(this->state->PLock);
+		for (typename std::vector<T *>::iterator it = this->state->idle.begin(); it != this->state->idle.end(); ++it)
+			delete *it;
+		this->state->idle.clear();
+	}
+	/*! \brief get a Object from the Pool
+	 *
+	 * Returns a idle object if there is one, or creates a new one. The object goes back to the pool when the last copy of the returned pointer is released.
+	 *
+	 * @return the object
+	 */
+	boost::shared_ptr<T> acquire() {
+		T *obj = NULL;
+		{
+			boost::interprocess::scoped_lock<boost::mutex> lock(this->state->PLock);
+			if (!this->state->idle.empty()) {
+				obj = this->state->idle.back();
+				this->state->idle.pop_back();
+				this->state->hits++;
+			} else {
+				this->state->misses++;
+			}
+			if (++this->state->inuse > this->state->highwater)
+				this->state->highwater = this->state->inuse;
+		}
+		if (!obj) {
+			try {
+				obj = this->state->create();
+			} catch (...) {
+				boost::interprocess::scoped_lock<boost::mutex> lock(this->state->PLock);
+				this->state->inuse--;
+				throw;
+			}
+		}
+		return boost::shared_ptr<T>(obj, releaser(this->state));
+	}
+	/*! \brief Fill the Pool
+	 *
+	 * Creates idle objects till the pool holds at least count idle objects (limited by the idle limit), so the first users do not pay for creating them.
+	 *
+	 * @param[in] count the number of idle objects wanted
+	 */
+	void reserve(size_t count) {
+		while (true) {
+			{
+				boost::interprocess::scoped_lock<boost::mutex> lock(this->state->PLock);
+				if (this->state->idle.size() >= count || this->state->idle.size() >= this->state->maxidle)
+					return;
+			}
+			T *obj = this->state->create();
+			boost::interprocess::scoped_lock<boost::mutex> lock(this->state->PLock);
+			this->state->idle.push_back(obj);
+			if (this->state->idle.size() > this->state->idlehighwater)
+				this->state->idlehighwater = this->state->idle.size();
+		}
+	}
+	/*! \brief set the maximum Number of idle Objects to keep
+	 *
+	 * Idle objects above the new limit are deleted.
+	 *
+	 * @param[in] maxidle the maximum number of idle objects
+	 */
+	void setMaxIdle(size_t maxidle) {
+		std::vector<T *> drop;
+		{
+			boost::interprocess::scoped_lock<boost::mutex> lock(this->state->PLock);
+			this->state->maxidle = maxidle;
+			while (this->state->idle.size() > maxidle) {
+				drop.push_back(this->state->idle.back());
+				this->state->idle.pop_back();
+			}
+		}
+		for (typename std::vector<T *>::iterator it = drop.begin(); it != drop.end(); ++it)
+			delete *it;
+	}
+	/*! \brief get the maximum Number of idle Objects
+	 *
+	 * @return the idle limit
+	 */
+	size_t getMaxIdle() {
+		boost::interprocess::scoped_lock<boost::mutex> lock(this->state->PLock);
+		return this->state->maxidle;
+	}
+	/*! \brief get the Size of the Pool
+	 *
+	 * @return the number of objects owned by the pool, idle and in use
+	 */
+	size_t getSize() {
+		boost::interprocess::scoped_lock<boost::mutex> lock(this->state->PLock);
+		return this->state->idle.size() + this->state->inuse;
+	}
+	/*! \brief get the Number of idle Objects
+	 *
+	 * @return the number of objects waiting in the pool
+	 */
+	size_t getIdle() {
+		boost::interprocess::scoped_lock<boost::mutex> lock(this->state->PLock);
+		return this->state->idle.size();
+	}
+	/*! \brief get the Number of Objects in use
+	 *
+	 * @return the number of objects handed out and not yet released
+	 */
+	size_t getInUse() {
+		boost::interprocess::scoped_lock<boost::mutex> lock(this->state->PLock);
+		return this->state->inuse;
+	}
+	/*! \brief get the High-Water Mark of Objects in use
+	 *
+	 * @return the largest number of objects that were in use at the same time
+	 */
+	size_t getHighWater() {
+		boost::interprocess::scoped_lock<boost::mutex> lock(this->state->PLock);
+		return this->state->highwater;
+	}
+	/*! \brief get the High-Water Mark of idle Objects
+	 *
+	 * @return the largest number of objects that were idle at the same time
+	 */
+	size_t getIdleHighWater() {
+		boost::interprocess::scoped_lock<boost::mutex> lock(this->state->PLock);
+		return this->state->idlehighwater;
+	}
+	/*! \brief get the Number of acquire() calls served from the Pool
+	 *
+	 * @return the number of hits
+	 */
+	boost::uint64_t getHits() {
+		boost::interprocess::scoped_lock<boost::mutex> lock(this->state->PLock);
+		return this->state->hits;
+	}
+	/*! \brief get the Number of acquire() calls that created a new Object
+	 *
+	 * @return the number of misses
+	 */
+	boost::uint64_t getMisses() {
+		boost::interprocess::scoped_lock<boost::mutex> lock(this->state->PLock);
+		return this->state->misses;
+	}
+	/*! \brief get the Hit Rate of the Pool
+	 *
+	 * @return the fraction of acquire() calls served from the pool, between 0 and 1
+	 */
+	double getHitRate() {
+		boost::interprocess::scoped_lock<boost::mutex> lock(this->state->PLock);
+		boost::uint64_t total = this->state->hits + this->state->misses;
+		return total ? static_cast<double>(this->state->hits) / total : 0.0;
+	}
+	/*! \brief Clear the Hit and Miss Counters and the High-Water Marks
+	 *
+	 */
+	void resetStats() {
+		boost::interprocess::scoped_lock<boost::mutex> lock(this->state->PLock);
+		this->state->hits = 0;
+		this->state->misses = 0;
+		this->state->highwater = this->state->inuse;
+		this->state->idlehighwater = this->state->idle.size();
+	}
+private:
+	static T *create_object() {
+		return new T();
+	}
+	static void recycle_object(T *obj) {
+		obj->recycle();
+	}
+	struct pool_state {
+		pool_state(size_t mymaxidle, t_createFunc mycreate, t_recycleFunc myrecycle) :
+				create(mycreate), recycle(myrecycle), maxidle(mymaxidle), inuse(0), highwater(0), idlehighwater(0), hits(0), misses(0) { }
+		boost::mutex PLock;
+		t_createFunc create;
+		t_recycleFunc recycle;
+		std::vector<T *> idle;
+		size_t maxidle;
+		size_t inuse;
+		size_t highwater;
+		size_t idlehighwater;
+		boost::uint64_t hits;
+		boost::uint64_t misses;
+	};
+	/* the deleter of the handed out pointers. Only holds a weak reference, so objects can outlive the pool */
+	struct releaser {
+		explicit releaser(boost::shared_ptr<pool_state> mystate) : state(mystate) { }
+		void operator()(T *obj) {
+			boost::shared_ptr<pool_state> mystate = this->state.lock();
+			if (!mystate) {
+				delete obj;
+				return;
+			}
+			/* reset outside the lock, it can take a while (eg, joining a transfer thread) */
+			try {
+				mystate->recycle(obj);
+			} catch (std::exception &) {
+				boost::interprocess::scoped_lock<boost::mutex> lock(mystate->PLock);
+				mystate->inuse--;
+				delete obj;
+				return;
+			}
+			boost::interprocess::scoped_lock<boost::mutex> lock(mystate->PLock);
+			mystate->inuse--;
+			if (mystate->idle.size() < mystate->maxidle) {
+				mystate->idle.push_back(obj);
+				if (mystate->idle.size() > mystate->idlehighwater)
+					mystate->idlehighwater = mystate->idle.size();
+			} else {
+				delete obj;
+			}
+		}
+		boost::weak_ptr<pool_state> state;
+	};
+	http_pool(const http_pool &);
+	http_pool &operator=(const http_pool &);
+	boost::shared_ptr<pool_state> state;
+};
+
+/*! \brief a Pool of http_response Classes
+ *
+ * Responses are cleared with http_response::recycle() when they are released, down to the headers and credentials the last user set, but keep the
+ * capacity of their body and header table. Use http_pool directly for classes derived from http_response.
+ */
+typedef http_pool<http_response> http_response_pool;
+
+/*! \brief a Pool of http_engine Classes
+ *
+ * Creating a http_engine sets up a IO Service, socket and SSL context. For many short transfers, take the engines from a pool instead.
+ * Engines are reset when they are released: they forget the http_response of their last transfer, their Callback Function,
+ * Completion Executor and proxy credentials, and keep their buffers and transfer arena. A engine must not be released while its transfer is running.
+ *
+ * \code
+ *	http_engine_pool engines(&io, &io);
+ *	http_response_pool responses;
+ *	boost::shared_ptr<http_engine> engine = engines.acquire();
+ *	boost::shared_ptr<http_response> response = responses.acquire();
+ *	response->setURL("http://www.example.com/");
+ *	engine->async_fetch(response.get(), handler);
+ * \endcode
+ */
+class http_engine_pool : public http_pool<http_engine>
+{
+public:
+	/*! \brief Constructor
+	 *
+	 * @param[in] postback the IO Service the engines post their callbacks on, see http_engine::http_engine
+	 * @param[in] transport the IO Service the transfers run on. If NULL, every engine uses its private IO Service and thread
+	 * @param[in] maxidle the maximum number of idle engines to keep
+	 * @param[in] buffers the pool the engines take their receive buffers from, see http_engine::setBufferPool(). Defaults to the shared pool
+	 */
+	http_engine_pool(boost::asio::io_service *postback, boost::asio::io_service *transport = NULL, size_t maxidle = 64,
+			boost::shared_ptr<http_buffer_pool> buffers = boost::shared_ptr<http_buffer_pool>());
+private:
+	static http_engine *create(boost::asio::io_service *postback, boost::asio::io_service *transport, boost::shared_ptr<http_buffer_pool> buffers);
+	static void recycle(http_engine *engine);
+};
+
+}
+}
+
+#endif // HTTP_POOL_HPP
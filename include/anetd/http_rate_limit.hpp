@@ -0,0 +1,201 @@
+#ifndef HTTP_RATE_LIMIT_HPP
+#define HTTP_RATE_LIMIT_HPP
+/*
+ * Bandwidth Limits for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <map>
+#include <string>
+
+/** @file */
+
+namespace DynamX {
+namespace anetd {
+
+/*! \brief a Token Bucket
+ *
+ * Limits a flow of data to a rate in bytes per second. The bucket fills with tokens at the rate, up to the burst size, and every byte sent or
+ * received takes a token. A transfer asks for the tokens available before each read or write, and sizes the read or write to them, so a limited
+ * transfer makes smaller reads instead of stalling for long. When the bucket is empty, available() says how long to wait, and the transfer waits on a
+ * timer, never by blocking a thread.
+ *
+ * Bytes are taken after they have been transferred, as a read can return less than was asked for, so the bucket can go into debt by up to one read.
+ * The debt is paid off by the following waits, which keeps the long term rate exact.
+ *
+ * A rate of 0 is unlimited. The rate can be changed at any time and applies to the next read or write. ThreadSafe.
+ */
+class http_token_bucket
+{
+public:
+	/*! \brief Constructor
+	 *
+	 * @param[in] rate the rate in bytes per second, 0 for unlimited
+	 * @param[in] burst the most bytes that can be sent at once after a idle period, 0 for the default (an eighth of a second at the rate, at least 16 KB)
+	 */
+	explicit http_token_bucket(boost::uint64_t rate = 0, size_t burst = 0);
+	/*! \brief set the Rate
+	 *
+	 * @param[in] rate the rate in bytes per second, 0 for unlimited
+	 * @param[in] burst the most bytes that can be sent at once after a idle period, 0 for the default
+	 */
+	void setRate(boost::uint64_t rate, size_t burst = 0);
+	/*! \brief Reset the Bucket to how it was constructed
+	 *
+	 * Unlimited, with nothing taken from it. Lets a recycled http_engine keep its buckets.
+	 */
+	void reset();
+	/*! \brief get the Rate
+	 *
+	 * @return the rate in bytes per second, 0 if unlimited
+	 */
+	boost::uint64_t getRate();
+	/*! \brief get the Burst Size
+	 *
+	 * @return the burst size in bytes
+	 */
+	size_t getBurst();
+	/*! \brief get the Tokens available
+	 *
+	 * @param[in] need the fewest bytes worth transferring. Less are never granted, to avoid tiny reads
+	 * @param[out] wait if no tokens are granted, how long till they are. Never more than MAXWAIT, so a rate change is noticed quickly
+	 * @return the number of bytes that can be transferred now, or 0 to wait
+	 */
+	size_t available(size_t need, boost::posix_time::time_duration &wait);
+	/*! \brief take Tokens for transferred Bytes
+	 *
+	 * @param[in] bytes the number of bytes transferred
+	 */
+	void consume(size_t bytes);
+	/*! \brief get the Number of Bytes taken
+	 *
+	 * @return the bytes taken from this bucket since it was created or reset
+	 */
+	boost::uint64_t getConsumed();
+	enum {
+		MINBURST = 16384,	/**< the smallest burst size */
+		MAXWAIT = 100		/**< the longest wait available() asks for, in milliseconds */
+	};
+private:
+	void refill(const boost::posix_time::ptime &now);
+	boost::mutex BLock;
+	boost::uint64_t rate;
+	size_t burst;
+	double tokens;
+	boost::posix_time::ptime last;
+	boost::uint64_t consumed;
+};
+
+/*! \brief Bandwidth Limits shared by Transfers
+ *
+ * Holds a global limit that all the transfers using this class share, and limits for hosts that all the transfers to that host share. Each limit is
+ * a pair of http_token_bucket classes, one for the data received and one for the data sent, so a bulk upload can be capped without slowing down the
+ * downloads. A transfer also has its own limits (see http_engine::setRateLimit()), and is held to the lowest of all the limits that apply to it.
+ *
+ * The http_engine and http2_session classes use the default limiter (see getDefault()) unless they are given another one, and it is unlimited till a
+ * rate is set on it. To cap bulk traffic while interactive traffic stays fast, give the bulk transfers a limiter of their own with
+ * http_engine::setRateLimiter().
+ *
+ * Hosts are matched by host name, case-insensitively. Rate changes apply to the transfers in progress. ThreadSafe.
+ */
+class http_rate_limiter
+{
+public:
+	/*! \brief the Direction of the Data */
+	enum direction {
+		RECEIVE = 0,	/**< the data received, ie the response */
+		SEND = 1	/**< the data sent, ie the request and its body */
+	};
+	/*! \brief Constructor
+	 *
+	 * Creates a limiter without any limits.
+	 */
+	http_rate_limiter();
+	/*! \brief get the Default Limiter
+	 *
+	 * @return the limiter used by transfers that have not been given one
+	 */
+	static boost::shared_ptr<http_rate_limiter> getDefault();
+	/*! \brief set the Global Rate
+	 *
+	 * @param[in] dir the direction
+	 * @param[in] rate the rate in bytes per second shared by all the transfers using this limiter, 0 for unlimited
+	 * @param[in] burst the burst size in bytes, 0 for the default
+	 */
+	void setRate(direction dir, boost::uint64_t rate, size_t burst = 0);
+	/*! \brief get the Global Rate
+	 *
+	 * @param[in] dir the direction
+	 * @return the rate in bytes per second, 0 if unlimited
+	 */
+	boost::uint64_t getRate(direction dir);
+	/*! \brief set the Rate of a Host
+	 *
+	 * @param[in] host the host name
+	 * @param[in] dir the direction
+	 * @param[in] rate the rate in bytes per second shared by all the transfers to the host, 0 for unlimited
+	 * @param[in] burst the burst size in bytes, 0 for the default
+	 */
+	void setHostRate(const std::string &host, direction dir, boost::uint64_t rate, size_t burst = 0);
+	/*! \brief get the Rate of a Host
+	 *
+	 * @param[in] host the host name
+	 * @param[in] dir the direction
+	 * @return the rate in bytes per second, 0 if unlimited
+	 */
+	boost::uint64_t getHostRate(const std::string &host, direction dir);
+	/*! \brief remove the Rates of a Host
+	 *
+	 * @param[in] host the host name
+	 * @return false if the host had no rates
+	 */
+	bool removeHost(const std::string &host);
+	/*! \brief get the Tokens available to a Transfer
+	 *
+	 * Checks the global bucket and the bucket of the host. See http_token_bucket::available().
+	 *
+	 * @param[in] host the host of the transfer
+	 * @param[in] dir the direction
+	 * @param[in] need the fewest bytes worth transferring
+	 * @param[out] wait if no tokens are granted, how long till they are
+	 * @return the number of bytes that can be transferred now, or 0 to wait
+	 */
+	size_t available(const std::string &host, direction dir, size_t need, boost::posix_time::time_duration &wait);
+	/*! \brief take Tokens for transferred Bytes
+	 *
+	 * @param[in] host the host of the transfer
+	 * @param[in] dir the direction
+	 * @param[in] bytes the number of bytes transferred
+	 */
+	void consume(const std::string &host, direction dir, size_t bytes);
+private:
+	boost::shared_ptr<http_token_bucket> getHost(const std::string &host, direction dir);
+	boost::mutex RLock;
+	http_token_bucket global[2];
+	std::map<std::string, boost::shared_ptr<http_token_bucket> > hosts[2];
+};
+
+}
+}
+
+#endif // HTTP_RATE_LIMIT_HPP
@@ -0,0 +1,315 @@
+#ifndef HTTP_REQUEST_HPP
+#define HTTP_REQUEST_HPP
+/*
+ * http_request serializer class for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <boost/asio/buffer.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <string>
+#include <vector>
+
+/** @file */
+
+namespace DynamX {
+namespace anetd {
+
+/*! \brief Base Class for the Body of a HTTP Request (eg, POST or PUT)
+ *
+ * The http_engine class pulls the body from a http_request_body when sending a request, so the body does not have to be held in memory.
+ * If the size of the body is known, it is sent with a Content-Length header, otherwise it is sent with chunked Transfer-Encoding.
+ *
+ * Classes that need to provide the body from another source should inherit this class as the base class.
+ */
+class http_request_body
+{
+public:
+	/*! \brief Default Deconstructor
+	 *
+	 */
+	virtual ~http_request_body();
+	/*! \brief Return if the size of the body is known before sending
+	 *
+	 * @return true if size() can be used, false if the body has to be sent chunked
+	 */
+	virtual bool hasSize() = 0;
+	/*! \brief Return the size of the body
+	 *
+	 * @return the size of the body in bytes. Only valid if hasSize() returns true
+	 */
+	virtual boost::uint64_t size() = 0;
+	/*! \brief Read the next part of the body
+	 *
+	 * @param[in] data the buffer to copy the body into
+	 * @param[in] size the size of the buffer
+	 * @return the number of bytes copied into data, or 0 at the end of the body
+	 */
+	virtual size_t read(char *data, size_t size) = 0;
+	/*! \brief Restart the body from the beginning
+	 *
+	 * Called when a request has to be sent again, for example after a 307 redirect.
+	 *
+	 * @return a bool indicating if the body could be restarted
+	 */
+	virtual bool rewind() = 0;
+	/*! \brief get the body if it is already in memory
+	 *
+	 * Bodies that are held in memory return the whole body here, so it can be sent along with the headers without a copy.
+	 *
+	 * @return a buffer with the body, or a empty buffer if the body has to be read with read()
+	 */
+	virtual boost::asio::const_buffer memory();
+	/*! \brief get a file descriptor to send the body from
+	 *
+	 * Bodies that are read from a file return the file descriptor here, so the http_engine class can use sendfile() on plain connections.
+	 * The body is sent from the current file position for size() bytes.
+	 *
+	 * @return the file descriptor, or -1 if the body has to be read with read()
+	 */
+	virtual int fd();
+	/*! \brief Return if the body can be sent
+	 *
+	 * The http_engine class fails the transfer without sending the request if this returns false.
+	 *
+	 * @return false if the source of the body could not be opened. The base class always returns true
+	 */
+	virtual bool isOpen();
+	/*! \brief get the Error that ended the body
+	 *
+	 * A body with a known size that ends (read() returns 0) before size() bytes were read fails the transfer, with this error if it is set. A
+	 * chunked body that ends with this error set fails the transfer too.
+	 *
+	 * @return the error opening or reading the source of the body. The base class never has one
+	 */
+	virtual boost::system::error_code getError();
+};
+
+/*! \brief a Request Body held in Memory
+ *
+ */
+class http_request_body_string : public http_request_body
+{
+public:
+	/*! \brief Constructor
+	 *
+	 * @param[in] body the body to send
+	 */
+	http_request_body_string(const std::string &body);
+	bool hasSize();
+	boost::uint64_t size();
+	size_t read(char *data, size_t size);
+	bool rewind();
+	boost::asio::const_buffer memory();
+private:
+	std::string body;
+	size_t offset;
+};
+
+/*! \brief a Request Body read from a File
+ *
+ * The file is opened in the constructor and closed when the class is destroyed. On plain http connections the file is sent with sendfile()
+ * where the platform supports it, so the body never passes through user space.
+ */
+class http_request_body_file : public http_request_body
+{
+public:
+	/*! \brief Constructor
+	 *
+	 * @param[in] filename the file to send
+	 */
+	http_request_body_file(const std::string &filename);
+	~http_request_body_file();
+	/*! \brief Return if the file was opened successfully
+	 *
+	 * @return a bool indicating success or failure
+	 */
+	bool isOpen();
+	bool hasSize();
+	boost::uint64_t size();
+	size_t read(char *data, size_t size);
+	bool rewind();
+	int fd();
+	boost::system::error_code getError();
+private:
+	int file;
+	boost::uint64_t filesize;
+	boost::system::error_code error;
+};
+
+/*! \brief a Request Body produced by a Callback Function
+ *
+ * The generator function is called repeatedly to fill the send buffer until it returns 0. If the size is not passed to the constructor the body is sent chunked.
+ * A generator that sets the error when it returns 0 fails the transfer, and a chunked body is not ended, so the server does not take what was sent for the
+ * whole body.
+ */
+class http_request_body_generator : public http_request_body
+{
+public:
+	/*! \brief Typedef of the Generator Function
+	 *
+	 * The Generator Function copies up to size bytes into data, and returns the number of bytes copied, or 0 when the body is complete. If the
+	 * body can not be produced, it sets the error and returns 0.
+	 */
+	typedef boost::function<size_t (char *, size_t, boost::system::error_code &)> t_generatorFunc;
+	/*! \brief Typedef of the Rewind Function
+	 *
+	 * The Rewind Function restarts the generator from the beginning, and returns a bool indicating success.
+	 */
+	typedef boost::function<bool ()> t_rewindFunc;
+	/*! \brief Constructor for a body of unknown size, that will be sent chunked
+	 *
+	 * @param[in] func the generator function
+	 * @param[in] rewindfunc a optional function to restart the generator
+	 */
+	http_request_body_generator(t_generatorFunc func, t_rewindFunc rewindfunc = t_rewindFunc());
+	/*! \brief Constructor for a body of known size
+	 *
+	 * @param[in] func the generator function
+	 * @param[in] size the number of bytes the generator will produce
+	 * @param[in] rewindfunc a optional function to restart the generator
+	 */
+	http_request_body_generator(t_generatorFunc func, boost::uint64_t size, t_rewindFunc rewindfunc = t_rewindFunc());
+	bool hasSize();
+	boost::uint64_t size();
+	size_t read(char *data, size_t size);
+	bool rewind();
+	boost::system::error_code getError();
+private:
+	t_generatorFunc GeneratorFunction;
+	t_rewindFunc RewindFunction;
+	bool sized;
+	boost::uint64_t bodysize;
+	boost::system::error_code error;
+};
+
+/*! \brief Serialize a HTTP Request as a Scatter/Gather Buffer Sequence
+ *
+ * The http_request class holds the parts of a outgoing request (the request line, the header block and the body) as seperate buffers, so the
+ * http_engine class can hand them to the socket in a single write without first concatenating them into one string.
+ *
+ * The constant part of the header block (Host, Authorization, Accept and any custom headers set via http_response::setHeader) is cached against
+ * a key that identifies the origin and the headers it was rendered from. Repeated requests to the same origin reuse the cached block instead of rebuilding it.
+ */
+class http_request
+{
+public:
+	/*! \brief Default Constructor
+	 *
+	 */
+	http_request();
+	/*! \brief Reset the Request to prepare for a new transfer
+	 *
+	 * Clears the request line, the per request headers and the body. The cached header block is kept.
+	 */
+	void reset();
+	/*! \brief Drop the cached header block
+	 *
+	 * Forces the header block to be rebuilt on the next request, for example when the Proxy credentials change.
+	 */
+	void invalidate();
+	/*! \brief Check if the cached header block was rendered for a key
+	 *
+	 * @param[in] key the key identifying the origin and header generation
+	 * @return true if the cached header block can be reused for this key
+	 */
+	bool isCached(const std::string &key) const;
+	/*! \brief Check if the cached header block was rendered for a key
+	 *
+	 * @param[in] key the key identifying the origin and header generation
+	 * @param[in] keylen the length of key
+	 * @return true if the cached header block can be reused for this key
+	 */
+	bool isCached(const char *key, size_t keylen) const;
+	/*! \brief Store a rendered header block
+	 *
+	 * @param[in] key the key identifying the origin and header generation the block was rendered for
+	 * @param[in] block the header lines, each terminated with "\r\n"
+	 */
+	void setHeaderBlock(const std::string &key, const std::string &block);
+	/*! \brief Set the Request Line
+	 *
+	 * @param[in] method the HTTP Method, eg "GET"
+	 * @param[in] target the request target, eg "/index.html?a=b"
+	 * @param[in] version the HTTP Version, eg "HTTP/1.0"
+	 */
+	void setRequestLine(const std::string &method, const std::string &target, const std::string &version);
+	/*! \brief Set the Request Line
+	 *
+	 * @param[in] method the HTTP Method, eg "GET"
+	 * @param[in] target the request target, eg "/index.html?a=b"
+	 * @param[in] targetlen the length of target
+	 * @param[in] version the HTTP Version, eg "HTTP/1.0"
+	 */
+	void setRequestLine(const std::string &method, const char *target, size_t targetlen, const std::string &version);
+	/*! \brief Set the Body to send after the headers
+	 *
+	 * The body is not copied, so it must stay valid until the request is sent. A Content-Length header is added if the size of the body is known,
+	 * otherwise a chunked Transfer-Encoding header is added.
+	 *
+	 * @param[in] body a pointer to the body, or NULL to send no body
+	 */
+	void setBody(http_request_body *body);
+	/*! \brief Return if the body has to be sent chunked
+	 *
+	 * @return true if the body is sent with chunked Transfer-Encoding
+	 */
+	bool isChunked() const;
+	/*! \brief Return if the body has to be streamed after the buffers
+	 *
+	 * @return true if the body is not part of buffers() and has to be sent from the http_request_body after them
+	 */
+	bool isStreamed() const;
+	/*! \brief get the Request Line
+	 *
+	 * @return the request line including the trailing "\r\n"
+	 */
+	const std::string &getRequestLine() const;
+	/*! \brief get the cached Header Block
+	 *
+	 * @return the constant header lines
+	 */
+	const std::string &getHeaderBlock() const;
+	/*! \brief get the Buffer Sequence to write to the socket
+	 *
+	 * The buffers refer to the internal strings of this class, so they are only valid till the request is modified.
+	 *
+	 * @return the request line, header block, per request headers and the body (if it is held in memory) as a list of buffers
+	 */
+	std::vector<boost::asio::const_buffer> buffers() const;
+	/*! \brief get the total size of the Request
+	 *
+	 * @return the number of bytes that buffers() refers to
+	 */
+	size_t size() const;
+private:
+	std::string requestline;
+	std::string headerkey;
+	std::string headerblock;
+	std::string trailer;
+	http_request_body *body;
+	bool chunked;
+};
+
+}
+}
+
+#endif // HTTP_REQUEST_HPP
@@ -20,13 +20,22 @@
  *
  */
 
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/system/error_code.hpp>
 
 #include <map>
 #include <string>
-#include "http_response.hpp"
+#include <vector>
+#include "http_body.hpp"
+#include "http_digest.hpp"
+#include "http_file_writer.hpp"
+#include "http_headers.hpp"
 
 /** @file */
 
@@ -43,6 +52,15 @@ namespace anetd {
  * Unless specifically mentioned as ThreadSafe in the member function descriptions, you should not call any of these functions from a client application till the transfer is complete.
  *
  * Classes that need to implement additional features should inherit this class as the base class.
+ *
+ * The protected onHeaders(), onData(), completed() and onError() functions form a streaming interface that both transports (the http_engine and http2_session
+ * classes) drive: a class that overrides onData() is handed each slice of the body straight from the receive buffer, and so can process responses of any size
+ * with constant memory and no intermediate copies. The default onData() appends the slice to the body, and classes built on setBody() and flush() must
+ * override onData() to pass the slices on to their setBody().
+ *
+ * The progress, body size and status are atomics, and the URL, version and description are published as a immutable snapshot that is replaced whole
+ * when one of them changes, so the functions that read them never wait on the transport or take a lock. A application can poll the progress of
+ * hundreds of transfers without slowing down the threads receiving them.
  */
 class http_response
 {
@@ -63,6 +81,16 @@ public:
 	 *
 	 */
 	virtual void reset();
+	/*! \brief Clear everything the Response holds for its next User
+	 *
+	 *  Unlike reset(), which keeps what the application set up for the transfer, this also drops the headers set with setHeader(), the
+	 *  credentials set with setHTTPAuth() and all the digests, and turns off setDigestCheck(). Called by http_response_pool when a response
+	 *  comes back to the pool, so the next user of the object does not send the last ones headers or credentials.
+	 *
+	 *  If subclassing this function, call this base class, as well as clearing any settings your own class keeps across a reset().
+	 *
+	 */
+	virtual void recycle();
 	/*! \brief get the HTTP Version that the server sent us when responding to our request.
 	 *
 	 * 	Calling this function anytime during the transfer is ThreadSafe
@@ -75,6 +103,7 @@ public:
 	 * 	Returns either a HTTP Server status number, or a negative number indicating a internal library error.
 	 * 	the HTTP Server Status number is usually in the range of 200-299 for successful transfers and anything else can indicate a error
 	 * 	If the Library encounters a error (such as the connection times out) then the returned number will be negative.
+	 * 	Calling this function anytime during the transfer is ThreadSafe
 	 *
 	 * @return a int with the status number. Test for 200 for successful transfer.
 	 */
@@ -82,6 +111,7 @@ public:
 	/*! \brief get the Description String that the Server return.
 	 *
 	 *  The description string is usually contained after the status number in HTTP protocol and is a textual representation of the request status.
+	 * 	Calling this function anytime during the transfer is ThreadSafe
 	 *
 	 * @return a string with the description field.
 	 */
@@ -89,6 +119,7 @@ public:
 	/*! \brief get a Iterator to the head of a std::map of headers returned by the server
 	 *
 	 *  This function returns a Iterator to the start of a internal std::map that will allow a library to iterate over all headers that might have been returned by the HTTP Server or Web Site
+	 *  The map is a copy of the header table built on first use, so getHeaders() should be preferred.
 	 *
 	 * @return a std::map<std::string, std::string>::iterator to the start of the Map. The Key is the header name, and the value is the header value returned.
 	 */
@@ -104,11 +135,27 @@ public:
 	/*! \brief Return the value associated with a Header
 	 *
 	 *  This returns the value associated with a particular header whos name is passed as the first param. Returns empty if no such header exists
+	 *  The name is compared case-insensitively.
 	 *
 	 * @param[in] name The header value to return
 	 * @return a std::string containing the header value, or empty if no such header exists.
 	 */
 	virtual std::string getHeader(std::string Header);
+	/*! \brief Return the value associated with a interned Header
+	 *
+	 *  Faster than looking the header up by name.
+	 *
+	 * @param[in] id the id of the header, eg http_headers::Content_Type
+	 * @return a std::string containing the header value, or empty if no such header exists.
+	 */
+	std::string getHeader(http_headers::header_id id);
+	/*! \brief get the Table of Headers returned by the Server
+	 *
+	 *  The table can be iterated in the order the headers were received, and looked up by name (case-insensitive) or by interned id without copying.
+	 *
+	 * @return the header table
+	 */
+	const http_headers &getHeaders();
 	/*! \brief Return the size of the Body of the HTTP transfer.
 	 *
 	 *  Returns the size of the body (in bytes) returned as part of the HTTP transfer.
@@ -120,12 +167,22 @@ public:
 	virtual size_t getBodySize();
 	/*! \brief Return the Body of the HTTP transfer as a string
 	 *
-	 *  Returns the Body of the HTTP Transfer as a string.
+	 *  Returns the Body of the HTTP Transfer as a string. The body is stored in a chain of buffers (see getBodyBuffers()), which this function
+	 *  joins into a new string every time it is called.
 	 * 	Calling this function anytime during the transfer is ThreadSafe
 	 *
 	 * @return a string containing the body of the transfer
 	 */
 	virtual std::string getBody();
+	/*! \brief get the Body of the HTTP transfer without copying it
+	 *
+	 *  Returns the buffers the body is stored in, to hand them on without a copy (eg, to a gather write with http_body::iovecs()). When the
+	 *  server sent a Content-Length, the body is in a single buffer. The buffers are only valid till the response is reset, and must not be
+	 *  used while the transfer is running.
+	 *
+	 * @return the body
+	 */
+	const http_body &getBodyBuffers();
 	/*! \brief get the Current Progress of the Transfer
 	 *
 	 *  returns the size of the data downloaded so far. This can be used as a "progress" indicator for long running downloads if required.
@@ -167,6 +224,48 @@ public:
 	 * @param[in] url the URL as a sting
 	 */
 	virtual void setURL(std::string url);
+	/*! \brief Hash the Body as it arrives
+	 *
+	 * Attaches a http_digest that is updated with each slice of the body as the transport hands it over, whichever class stores it, so the
+	 * digest is ready when the transfer completes without reading the body back. The digest covers the body as it was sent, with any
+	 * content coding still applied. If the transfer is retried or redirected, the digest starts over with the new body.
+	 *
+	 * If a expected digest is given and the body does not match it, the transfer fails with http_digest_errc::mismatch (and onError() is called
+	 * instead of completed()).
+	 *
+	 * Adding a algorithm that is already attached replaces its expected digest.
+	 *
+	 * @param[in] alg the algorithm
+	 * @param[in] expected the expected digest in hex or base64, or empty to only compute it
+	 * @return false if expected is neither hex nor base64
+	 */
+	bool addDigest(http_digest::algorithm alg, const std::string &expected = "");
+	/*! \brief get the Digest of the Body
+	 *
+	 * @param[in] alg the algorithm, which must have been attached with addDigest() or setDigestCheck()
+	 * @return the digest in hex, or empty if the algorithm is not attached or the body has not been completed
+	 */
+	std::string getDigest(http_digest::algorithm alg);
+	/*! \brief remove all the Digests
+	 *
+	 */
+	void clearDigests();
+	/*! \brief Check the Body against the Digests sent by the Server
+	 *
+	 * When enabled, the body is checked against the digests in the Content-Digest, Repr-Digest and Digest headers and the Content-MD5 header
+	 * of the response, for each of the algorithms supported by http_digest. The algorithms the server sent are attached as if by addDigest()
+	 * when the body starts, so getDigest() returns them too. A body that does not match fails the transfer with http_digest_errc::mismatch.
+	 *
+	 * Repr-Digest and Digest describe the whole representation, so they are ignored for a 206 Partial Content response.
+	 *
+	 * @param[in] check true to check the digests sent by the server
+	 */
+	void setDigestCheck(bool check);
+	/*! \brief Typedef of the Resume Function
+	 *
+	 * Passed to http_response::ready(), to be called when the response is ready for the http_engine class to continue.
+	 */
+	typedef boost::function<void ()> t_resumeFunc;
 protected:
 	/*! \brief Set the Version of the HTTP Protocol used in the transfer
 	 *
@@ -198,8 +297,9 @@ protected:
 	virtual void setDescription(std::string Description);
 	/*! \brief Set a Header returned by the HTTP Server
 	 *
-	 * Used by the http_engine class only, this function is used to store Headers returned by the HTTP Server or Web Site. This includes cookies sent as well.
-	 * if you requrie some custom action on the data depending upon a header, then you should reimplement this function, but be sure to call this base class function as well.
+	 * This function is used to store Headers in the header table. This includes cookies sent as well.
+	 * The http_engine class parses the headers returned by the HTTP Server directly into the header table, without calling this function. If you require
+	 * some custom action on the data depending upon a header, inspect getHeaders() when the body starts arriving or in completed().
 	 *
 	 * @param[in] Name the name of the header
 	 * @param[in] Value the value to store
@@ -246,22 +346,110 @@ protected:
 
 	/*! \brief Signal that the Transfer has completed
 	 *
+	 * Part of the streaming interface: called once the whole body has been received, after the last onData(). A transfer that fails gets onError() instead.
 	 */
 	virtual void completed();
-	std::string body;
+	/*! \brief Called when the Headers of the Response have arrived
+	 *
+	 * Part of the streaming interface: called once per response, after the status, the headers and (if the server sent it) the body size are set, and before
+	 * the first onData(). Error statuses, which are completed without reading a body, get it too. If the transfer is retried, reset() is called before it
+	 * starts over, so a class can discard what it consumed there.
+	 *
+	 * The base class does nothing.
+	 */
+	virtual void onHeaders();
+	/*! \brief Called with each Slice of the Body as it arrives
+	 *
+	 * Part of the streaming interface: data points into the receive buffer of the transport and is only valid during the call. getProgress() already includes
+	 * the slice. flush() is called after the slices of each read.
+	 *
+	 * The base class appends the slice to the body, without going through setBody(). Classes that override this function do not get the body stored unless
+ * they call it.
+	 *
+	 * @param[in] data the slice of the body
+	 * @param[in] len the length of the slice
+	 */
+	virtual void onData(const char *data, size_t len);
+	/*! \brief Called when the Transfer has Failed
+	 *
+	 * Part of the streaming interface: called instead of completed(), just before the completion function, when the transfer fails for good (after any
+	 * retries), eg because the connection was lost part way through the body. Not called for HTTP error statuses, which are complete responses.
+	 *
+	 * The base class does nothing.
+	 *
+	 * @param[in] err the reason the transfer failed
+	 */
+	virtual void onError(const boost::system::error_code &err);
+	/*! \brief Check if the Response can accept more data
+	 *
+	 * Used by the http_engine class only, this function is called before each read from the socket, and after completed() before the transfer finishes.
+	 * Classes that process the body asynchronously can return false to pause the transfer, and then call resume (from any thread) once they are ready
+	 * for more data, or have finished processing the body. The resume function must be called exactly once after returning false.
+	 *
+	 * The base class always returns true.
+	 *
+	 * @param[in] resume the function to call when the transfer can continue
+	 * @return true if the transfer can continue straight away
+	 */
+	virtual bool ready(t_resumeFunc resume);
+	/*! \brief Fail the Transfer
+	 *
+	 * For classes that can not take the body, eg because a write to disk failed. The transport stops reading the body, and the transfer fails with
+	 * err: onError() is called instead of completed(), and the completion function gets err. Can be called from onData(), flush(), completed() or a
+	 * thread of the class' own. Only the first error is kept, and reset() clears it.
+	 * 	Calling this function anytime during the transfer is ThreadSafe
+	 *
+	 * @param[in] err the reason the transfer failed
+	 */
+	void fail(const boost::system::error_code &err);
+	http_body body;
 private:
 	friend class http_engine;
-	std::string version;
-	int status;
-	std::string description;
-	std::map<std::string, std::string> headers;
-	size_t body_size;
-	size_t progress;
+	friend class http2_session;
+	/* the transports hand the body over through here, so the progress is counted and the digests updated whatever onData() does with it */
+	void receive(const char *data, size_t len);
+	/* the transports call this instead of completed() once the body is in. Checks the digests, and only calls completed() if they match */
+	boost::system::error_code complete_body();
+	/* the error passed to fail(), checked by the transports after each read and before they finish */
+	boost::system::error_code failure();
+	struct digest_stage {
+		boost::shared_ptr<http_digest> digest;
+		std::string expected;
+		std::string result;
+		bool automatic;
+	};
+	void arm_digests();
+	bool server_digest(http_digest::algorithm alg, std::string &raw);
+	/* the strings a reader can ask for during the transfer. A snapshot is never changed once published, a setter copies it, changes the copy and
+	 * swaps it in, so a reader holding the old one is never disturbed */
+	struct snapshot {
+		snapshot() : version("HTTP/1.0"), description("OK") {}
+		std::string url;
+		std::string version;
+		std::string description;
+	};
+	boost::shared_ptr<const snapshot> load() const;
+	void publish(const boost::shared_ptr<const snapshot> &next);
+	boost::shared_ptr<const snapshot> current;
+	boost::atomic<int> status;
+	http_headers headers;
+	std::map<std::string, std::string> headermap;
+	bool headermapstale;
+	boost::atomic<size_t> body_size;
+	boost::atomic<size_t> progress;
 	std::map<std::string, std::string> cookies;
-	std::string url;
+	/* serialises the writers of the snapshot. Readers of the atomics and the snapshot never take it */
 	boost::mutex TLock;
+	/* guards the body, so getBody() can be called during the transfer. Only the transport and getBody() take it */
+	boost::mutex BLock;
+	void append_body(const char *data, size_t len);
 	std::map<std::string, std::string> sendheaders;
 	std::pair<std::string, std::string> httpauth;
+	long headergeneration;
+	std::vector<digest_stage> digests;
+	bool digestcheck;
+	bool digestsarmed;
+	boost::system::error_code bodyerror;
 
 };
 
@@ -270,16 +458,35 @@ class http_response_file : public http_response {
 public:
 	http_response_file();
 	void reset();
+	void recycle();
 	void setURL(std::string url);
+	/*! \brief set how the File is written
+	 *
+	 * Takes effect with the next file that is opened. See http_file_writer.
+	 *
+	 * @param[in] backend the backend, BACKEND_AUTO for the default backend
+	 */
+	void setBackend(http_file_writer::backend backend);
 protected:
-	void flush();
+	void onHeaders();
+	void onData(const char *data, size_t len);
 	void completed();
+	/*! \brief Remove the File of a failed Transfer
+	 *
+	 * The file is closed and removed, so a transfer that failed part way through the body (or whose body did not match its digest, see
+	 * http_response::addDigest()) does not leave a file that looks like a complete download.
+	 *
+	 * @param[in] err the reason the transfer failed
+	 */
+	void onError(const boost::system::error_code &err);
 private:
 	bool OpenFile();
 	bool CloseFile();
+	bool DiscardFile();
 	std::string filename;
 	boost::filesystem::path filepath;
-	boost::filesystem::ofstream file;
+	boost::scoped_ptr<http_file_writer> file;
+	http_file_writer::backend backend;
 	bool opened;
 };
 
@@ -0,0 +1,177 @@
+#ifndef HTTP_RETRY_HPP
+#define HTTP_RETRY_HPP
+/*
+ * Retry Policy for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/system/error_code.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <set>
+#include <string>
+
+/** @file */
+
+namespace DynamX {
+namespace anetd {
+
+/*! \brief Policy for Retrying failed Transfers
+ *
+ * When a http_engine class has a retry policy set (see http_engine::setRetryPolicy()), a transfer that fails in a way that is likely to be temporary
+ * is sent again after a backoff delay, instead of completing with the error. The policy classifies the failure:
+ *
+ * \li a connect failure (refused, unreachable, timed out) means the request was never sent, so it is retried for any method
+ * \li a connection reset, or the server closing the connection without a response, is retried for idempotent methods only (GET, HEAD, PUT, DELETE, OPTIONS and TRACE)
+ * \li a 502, 503 or 504 status (see setRetryStatus()) is retried for idempotent methods only
+ *
+ * The backoff doubles with every attempt, up to a maximum, and is randomised over the whole range ("full jitter"), so clients that failed at the same time do not retry
+ * at the same time. A Retry-After header sent by the server (in seconds or as a HTTP date) is honoured, and a transfer is not retried if the server asks for a longer delay than the maximum.
+ * The backoff runs on a timer of the transport IO Service, no thread is blocked.
+ *
+ * A budget caps the extra load during a outage: every transfer earns a fraction of a token, every retry costs a whole token, and a retry is only sent if a token is
+ * available. With the default budget of 0.1, retries add at most about 10% to the requests sent, however many transfers are failing.
+ *
+ * One policy should be shared by all http_engine classes talking to the same servers, so they share the budget. ThreadSafe.
+ */
+class http_retry_policy
+{
+public:
+	/*! \brief the Classes of Failure
+	 *
+	 */
+	enum retry_reason {
+		RETRY_NONE,	/**< the failure is permanent */
+		RETRY_CONNECT,	/**< the connection could not be made */
+		RETRY_RESET,	/**< the connection was lost before the response was received */
+		RETRY_STATUS	/**< the server returned a temporary error status */
+	};
+	/*! \brief Constructor
+	 *
+	 * @param[in] maxretries the maximum number of retries of a transfer
+	 * @param[in] basedelay the backoff before the first retry
+	 * @param[in] maxdelay the maximum backoff
+	 * @param[in] budget the number of retry tokens each transfer earns
+	 * @param[in] burst the maximum number of tokens that can be saved up
+	 */
+	explicit http_retry_policy(unsigned int maxretries = 3, boost::posix_time::time_duration basedelay = boost::posix_time::milliseconds(100),
+			boost::posix_time::time_duration maxdelay = boost::posix_time::seconds(10), double budget = 0.1, double burst = 10);
+	/*! \brief Default Deconstructor
+	 *
+	 */
+	virtual ~http_retry_policy();
+	/*! \brief set the maximum Number of Retries of a Transfer
+	 *
+	 * @param[in] maxretries the maximum number of retries
+	 */
+	void setMaxRetries(unsigned int maxretries);
+	/*! \brief set the Backoff Delays
+	 *
+	 * @param[in] basedelay the backoff before the first retry
+	 * @param[in] maxdelay the maximum backoff, and the longest Retry-After that is honoured
+	 */
+	void setBackoff(boost::posix_time::time_duration basedelay, boost::posix_time::time_duration maxdelay);
+	/*! \brief set the Retry Budget
+	 *
+	 * @param[in] budget the number of retry tokens each transfer earns
+	 * @param[in] burst the maximum number of tokens that can be saved up
+	 */
+	void setBudget(double budget, double burst);
+	/*! \brief set if a HTTP Status is retried
+	 *
+	 * 502, 503 and 504 are retried by default.
+	 *
+	 * @param[in] status the HTTP status
+	 * @param[in] retry true to retry transfers that fail with the status
+	 */
+	void setRetryStatus(int status, bool retry);
+	/*! \brief Classify a Failure
+	 *
+	 * Classes that need a different classification should inherit this class and reimplement this function.
+	 *
+	 * @param[in] err the error the transfer failed with, if any
+	 * @param[in] status the HTTP status of the response, or 0 if no response was received
+	 * @param[in] connected true if the connection to the server was made
+	 * @param[in] idempotent true if the request method is idempotent
+	 * @return the class of the failure
+	 */
+	virtual retry_reason classify(const boost::system::error_code &err, int status, bool connected, bool idempotent);
+	/*! \brief get the Backoff before a Retry
+	 *
+	 * @param[in] attempt the number of retries done so far
+	 * @param[in] retryafter the value of the Retry-After header, or empty
+	 * @return the delay, or a negative delay if the server asked for more than the maximum backoff
+	 */
+	virtual boost::posix_time::time_duration backoff(unsigned int attempt, const std::string &retryafter);
+	/*! \brief Count a Transfer
+	 *
+	 * Called by the http_engine class when a transfer starts. Adds to the budget.
+	 */
+	void request();
+	/*! \brief Decide if a failed Transfer is retried
+	 *
+	 * Called by the http_engine class when a transfer fails. Takes a token from the budget if the transfer is retried.
+	 *
+	 * @param[in] err the error the transfer failed with, if any
+	 * @param[in] status the HTTP status of the response, or 0 if no response was received
+	 * @param[in] connected true if the connection to the server was made
+	 * @param[in] idempotent true if the request method is idempotent
+	 * @param[in] attempt the number of retries done so far
+	 * @param[in] retryafter the value of the Retry-After header, or empty
+	 * @param[out] delay the backoff before the retry
+	 * @return the class of the failure if the transfer is retried, or RETRY_NONE
+	 */
+	retry_reason retry(const boost::system::error_code &err, int status, bool connected, bool idempotent, unsigned int attempt, const std::string &retryafter,
+			boost::posix_time::time_duration &delay);
+	/*! \brief get the Number of Transfers
+	 *
+	 * @return the number of transfers started
+	 */
+	boost::uint64_t getRequests();
+	/*! \brief get the Number of Retries
+	 *
+	 * @return the number of retries sent
+	 */
+	boost::uint64_t getRetries();
+	/*! \brief get the Number of Retries not sent due to the Budget
+	 *
+	 * @return the number of retries denied
+	 */
+	boost::uint64_t getDenied();
+private:
+	boost::mutex RLock;
+	unsigned int maxretries;
+	boost::posix_time::time_duration basedelay;
+	boost::posix_time::time_duration maxdelay;
+	double budget;
+	double burst;
+	double tokens;
+	std::set<int> statuses;
+	boost::random::mt19937 rng;
+	boost::uint64_t requests;
+	boost::uint64_t retries;
+	boost::uint64_t denied;
+};
+
+}
+}
+
+#endif // HTTP_RETRY_HPP
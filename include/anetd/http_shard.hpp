@@ -0,0 +1,191 @@
+#ifndef HTTP_SHARD_HPP
+#define HTTP_SHARD_HPP
+/*
+ * Thread per Core Sharded Client for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <boost/asio.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/smart_ptr/detail/atomic_count.hpp>
+#include <boost/thread.hpp>
+
+#include <string>
+#include <vector>
+
+#include "http_buffer_pool.hpp"
+#include "http_engine.hpp"
+#include "http_pool.hpp"
+#include "http_rate_limit.hpp"
+
+/** @file */
+
+namespace DynamX {
+namespace anetd {
+
+/*! \brief a Client that runs Transfers on one Thread per Core
+ *
+ * Splits the transfers over shards. Each shard has its own IO Service, run by one thread that is pinned to a CPU core, and its own
+ * http_engine_pool, http_buffer_pool and http_rate_limiter. A transfer is assigned to a shard when it is started and stays there: its socket, its
+ * completion handlers, the engine and the buffers it reads into are only ever touched by the thread of that shard. Nothing on the path of a
+ * transfer is shared with the other shards, so the cores do not bounce socket state, handlers or locks between each other.
+ *
+ * Transfers are assigned by a hash of the host name (the default), which sends all the transfers to a host to the engines of one shard, so the TLS
+ * sessions those engines keep for it are resumed, or round robin, which spreads a few busy hosts evenly.
+ *
+ * \code
+ *	http_sharded_client client;
+ *	http_response response;
+ *	response.setURL("http://www.example.com/");
+ *	client.fetch(&response, handler);
+ * \endcode
+ *
+ * fetch() and setRateLimiter() are ThreadSafe. The other functions should be called before the first transfer is started.
+ */
+class http_sharded_client
+{
+public:
+	/*! \brief how Transfers are assigned to Shards */
+	enum placement {
+		HOST_HASH,	/**< by a hash of the host name, so all the transfers to a host share a shard */
+		ROUND_ROBIN	/**< to each shard in turn */
+	};
+	/*! \brief Typedef of the Completion Handler
+	 *
+	 * Same as http_engine::t_completionFunc. The handler runs on the thread of the shard, and must not block.
+	 */
+	typedef http_engine::t_completionFunc t_completionFunc;
+	/*! \brief Constructor
+	 *
+	 * Starts the shard threads.
+	 *
+	 * @param[in] shards the number of shards. 0 uses one per CPU core the process may run on
+	 * @param[in] place how transfers are assigned to shards
+	 * @param[in] pin pin each shard thread to its own core. Ignored on platforms without thread affinity
+	 * @param[in] maxidle the maximum number of idle engines each shard keeps
+	 */
+	http_sharded_client(size_t shards = 0, placement place = HOST_HASH, bool pin = true, size_t maxidle = 64);
+	/*! \brief Destructor
+	 *
+	 * Waits for the transfers in progress to complete, and stops the shard threads.
+	 */
+	~http_sharded_client();
+	/*! \brief Start a Transfer
+	 *
+	 * Assigns the transfer to a shard, where it runs on a engine from the pool of the shard. The engine goes back to the pool after the handler
+	 * has been called. ThreadSafe
+	 *
+	 * @param[in] response the http_response class with the URL to fetch, which must stay valid till the handler is called
+	 * @param[in] handler the function to call when the transfer completes or fails
+	 * @return the shard the transfer runs on
+	 */
+	size_t fetch(http_response *response, t_completionFunc handler);
+	/*! \brief get the Shard a URL is assigned to
+	 *
+	 * With round robin placement, this is the shard the next transfer is assigned to.
+	 *
+	 * @param[in] url the URL
+	 * @return the shard
+	 */
+	size_t getShard(const std::string &url);
+	/*! \brief get the Number of Shards
+	 *
+	 * @return the number of shards
+	 */
+	size_t getShards();
+	/*! \brief get the CPU a Shard is pinned to
+	 *
+	 * @param[in] shard the shard
+	 * @return the CPU core, or -1 if the thread is not pinned
+	 */
+	int getCPU(size_t shard);
+	/*! \brief get the Number of Transfers running on a Shard
+	 *
+	 * @param[in] shard the shard
+	 * @return the transfers started and not yet completed
+	 */
+	size_t getActive(size_t shard);
+	/*! \brief get the IO Service of a Shard
+	 *
+	 * Applications can post their own work to the shard, eg to start a http2_session on it.
+	 *
+	 * @param[in] shard the shard
+	 * @return the IO Service
+	 */
+	boost::asio::io_service &getIOService(size_t shard);
+	/*! \brief get the Engine Pool of a Shard
+	 *
+	 * @param[in] shard the shard
+	 * @return the pool
+	 */
+	http_engine_pool &getEnginePool(size_t shard);
+	/*! \brief get the Buffer Pool of a Shard
+	 *
+	 * @param[in] shard the shard
+	 * @return the pool
+	 */
+	boost::shared_ptr<http_buffer_pool> getBufferPool(size_t shard);
+	/*! \brief set the Bandwidth Limiter
+	 *
+	 * By default each shard has a limiter of its own, which has no limits till they are set on it (see getRateLimiter()). Limits that must hold
+	 * across all the shards need a limiter shared by all of them, at the price of the shards taking its locks.
+	 *
+	 * The limiter is handed to each shard on its own thread, so transfers the shard has already started keep the limiter they started with.
+	 *
+	 * @param[in] limiter the limiter for all the shards. Passing a empty pointer restores the limiters of the shards
+	 */
+	void setRateLimiter(boost::shared_ptr<http_rate_limiter> limiter);
+	/*! \brief get the Bandwidth Limiter of a Shard
+	 *
+	 * @param[in] shard the shard
+	 * @return the limiter
+	 */
+	boost::shared_ptr<http_rate_limiter> getRateLimiter(size_t shard);
+private:
+	struct shard {
+		shard(size_t maxidle, int cpu);
+		boost::asio::io_service io;
+		boost::scoped_ptr<boost::asio::io_service::work> work;
+		boost::shared_ptr<http_buffer_pool> buffers;
+		boost::shared_ptr<http_rate_limiter> ownlimiter;
+		boost::shared_ptr<http_rate_limiter> limiter;
+		http_engine_pool engines;
+		boost::detail::atomic_count active;
+		int cpu;
+	};
+	static void run(shard *s);
+	static void dispatch(shard *s, http_response *response, t_completionFunc handler);
+	static void finished(shard *s, boost::shared_ptr<http_engine> engine, t_completionFunc handler, const boost::system::error_code &err, http_response *response);
+	static void release(boost::shared_ptr<http_engine> engine);
+	static void assign(shard *s, boost::shared_ptr<http_rate_limiter> limiter);
+	std::vector<boost::shared_ptr<shard> > shards;
+	/* the limiter passed to setRateLimiter(), for getRateLimiter(). The shards only read their own copy of it */
+	boost::shared_ptr<http_rate_limiter> sharedlimiter;
+	boost::mutex LLock;
+	boost::thread_group threads;
+	placement place;
+	boost::detail::atomic_count next;
+	http_sharded_client(const http_sharded_client &);
+	http_sharded_client &operator=(const http_sharded_client &);
+};
+
+}
+}
+
+#endif // HTTP_SHARD_HPP
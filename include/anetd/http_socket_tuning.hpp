@@ -0,0 +1,129 @@
+#ifndef HTTP_SOCKET_TUNING_HPP
+#define HTTP_SOCKET_TUNING_HPP
+/*
+ * Socket Tuning Profiles for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <map>
+#include <string>
+
+/** @file */
+
+namespace DynamX {
+namespace anetd {
+
+/*! \brief the Socket Options of a Connection
+ *
+ * A profile is applied by the http_engine class to every socket it creates, before connecting. Options the platform does not support are skipped,
+ * and a option the kernel refuses is logged and otherwise ignored, so a profile never fails a transfer.
+ *
+ * The default profile only sets TCP_NODELAY, so a small request is not held back by Nagle's algorithm waiting for the ACK of the previous segment.
+ */
+struct http_socket_profile {
+	/*! \brief Constructor
+	 *
+	 * Creates the default profile.
+	 */
+	http_socket_profile();
+	/*! \brief disable Nagle's algorithm (TCP_NODELAY) */
+	bool nodelay;
+	/*! \brief use TCP Fast Open (TCP_FASTOPEN_CONNECT, Linux 4.11). When the kernel has a Fast Open cookie of the server, the first write of the request is sent
+	 * in the SYN, saving a round trip. Otherwise the connection is made as usual, and the cookie is learned for the next one */
+	bool fastopen;
+	/*! \brief the receive buffer size (SO_RCVBUF) in bytes, or 0 to use the system default and autotuning. Larger buffers let a bulk download fill a long, fast path */
+	int recvbuffer;
+	/*! \brief the send buffer size (SO_SNDBUF) in bytes, or 0 to use the system default and autotuning */
+	int sendbuffer;
+	/*! \brief send TCP keepalive probes (SO_KEEPALIVE), so a dead peer is detected on a idle connection */
+	bool keepalive;
+	/*! \brief the idle time in seconds before the first keepalive probe (TCP_KEEPIDLE), or 0 for the system default */
+	int keepidle;
+	/*! \brief the time in seconds between keepalive probes (TCP_KEEPINTVL), or 0 for the system default */
+	int keepinterval;
+	/*! \brief the number of unanswered probes before the connection is dropped (TCP_KEEPCNT), or 0 for the system default */
+	int keepcount;
+	/*! \brief acknowledge received data at once instead of delaying the ACK (TCP_QUICKACK). The kernel clears this option by itself, so the http_engine class
+	 * sets it again before every read */
+	bool quickack;
+	/*! \brief Apply the Profile to a Socket
+	 *
+	 * @param[in] socket a open socket that is not connected yet
+	 */
+	void apply(boost::asio::ip::tcp::socket &socket) const;
+	/*! \brief set TCP_QUICKACK again
+	 *
+	 * Does nothing unless quickack is set.
+	 *
+	 * @param[in] socket the connected socket
+	 */
+	void applyQuickAck(boost::asio::ip::tcp::socket &socket) const;
+};
+
+/*! \brief Socket Tuning Profiles per Host
+ *
+ * Holds a default http_socket_profile, and profiles for hosts that need different settings, for example large buffers for a bulk download server
+ * on a long path, or keepalive for a server behind a NAT that drops idle connections. Hosts are matched by host name, case-insensitively. When the
+ * request goes through a proxy the profile of the proxy is used, as that is the host the socket connects to.
+ *
+ * Set on a http_engine class with http_engine::setSocketTuning(), and can be shared between http_engine classes. ThreadSafe.
+ */
+class http_socket_tuning
+{
+public:
+	/*! \brief Constructor
+	 *
+	 * @param[in] defaultprofile the profile of hosts without a profile of their own
+	 */
+	explicit http_socket_tuning(const http_socket_profile &defaultprofile = http_socket_profile());
+	/*! \brief set the Default Profile
+	 *
+	 * @param[in] profile the profile of hosts without a profile of their own
+	 */
+	void setDefault(const http_socket_profile &profile);
+	/*! \brief set the Profile of a Host
+	 *
+	 * @param[in] host the host name
+	 * @param[in] profile the profile
+	 */
+	void setProfile(const std::string &host, const http_socket_profile &profile);
+	/*! \brief remove the Profile of a Host
+	 *
+	 * @param[in] host the host name
+	 * @return false if the host had no profile
+	 */
+	bool removeProfile(const std::string &host);
+	/*! \brief get the Profile of a Host
+	 *
+	 * @param[in] host the host name
+	 * @return the profile of the host, or the default profile
+	 */
+	http_socket_profile getProfile(const std::string &host);
+private:
+	boost::mutex SLock;
+	http_socket_profile defaultprofile;
+	std::map<std::string, http_socket_profile> profiles;
+};
+
+}
+}
+
+#endif // HTTP_SOCKET_TUNING_HPP
@@ -0,0 +1,125 @@
+#ifndef HTTP_SPOOL_HPP
+#define HTTP_SPOOL_HPP
+/*
+ * Memory/Disk Spooling Response for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <string>
+#include "http_response.hpp"
+
+/** @file */
+
+namespace DynamX {
+namespace anetd {
+
+/*! \brief a http_response Class that keeps small Bodies in Memory and spills large ones to Disk
+ *
+ * The body is stored in memory till it grows past a threshold (8 MB by default), and is then moved to a temporary file, so a response of
+ * unexpected size can not run the process out of memory. A body the server announces as larger than the threshold (with Content-Length) goes
+ * straight to the file.
+ *
+ * The file is created with O_TMPFILE where the kernel and file system support it, so it has no name and disappears when it is closed, even if the
+ * process crashes. Elsewhere it is created with mkstemp() and unlinked straight away.
+ *
+ * Once the transfer has completed, getView() returns the body as one contiguous read-only mapping wherever it is stored: the memory is a
+ * anonymous mapping that is made read-only, and the file is mapped with mmap(), so consumers can treat both the same way and the kernel pages a
+ * large body in as it is read.
+ *
+ * The memory mapping takes address space for the whole threshold (or the Content-Length if it is smaller), but pages are only used as the body fills them.
+ */
+class http_response_spool : public http_response {
+public:
+	/*! \brief Constructor
+	 *
+	 * @param[in] threshold the largest body kept in memory, in bytes
+	 * @param[in] directory the directory the temporary file is created in. Empty uses $TMPDIR, or /tmp
+	 */
+	explicit http_response_spool(size_t threshold = 8 << 20, const std::string &directory = "");
+	/*! \brief Destructor
+	 *
+	 * Unmaps the body and closes the temporary file, which removes it.
+	 */
+	~http_response_spool();
+	void reset();
+	/*! \brief get the Body as a String
+	 *
+	 * Copies the body out of the view. Only valid once the transfer has completed.
+	 *
+	 * @return the body
+	 */
+	std::string getBody();
+	/*! \brief get the Body as a contiguous read-only View
+	 *
+	 * The view stays valid till the response is reset or destroyed. Writing to it crashes the process.
+	 *
+	 * @param[out] data the start of the body
+	 * @param[out] len the length of the body
+	 * @return false if the transfer has not completed, or the body could not be stored
+	 */
+	bool getView(const char *&data, size_t &len);
+	/*! \brief check if the Body was spilled to Disk
+	 *
+	 * @return true if the body is in the temporary file
+	 */
+	bool isSpilled();
+	/*! \brief check if the Body could not be stored
+	 *
+	 * The transfer fails too, with a io_error.
+	 *
+	 * @return true if memory could not be mapped or the temporary file could not be written (eg, the disk is full)
+	 */
+	bool hasFailed();
+	/*! \brief set the Threshold
+	 *
+	 * Takes effect with the next transfer.
+	 *
+	 * @param[in] threshold the largest body kept in memory, in bytes
+	 */
+	void setThreshold(size_t threshold);
+	/*! \brief get the Threshold
+	 *
+	 * @return the largest body kept in memory, in bytes
+	 */
+	size_t getThreshold();
+protected:
+	void onHeaders();
+	void onData(const char *data, size_t len);
+	void completed();
+private:
+	bool map(size_t size);
+	bool spill();
+	bool write(const char *data, size_t len);
+	void abandon();
+	void release();
+	size_t threshold;
+	std::string directory;
+	char *memory;
+	size_t mapped;
+	size_t length;
+	int fd;
+	const char *view;
+	size_t viewsize;
+	bool complete;
+	bool failed;
+};
+
+}
+}
+
+#endif // HTTP_SPOOL_HPP
@@ -116,6 +116,10 @@ void Log::SetLoggingState
 )
 {
 	currentlevel = _saveLevel;
+	if( s_instance && m_pImpl )
+	{
+		m_pImpl->SetLoggingState( _saveLevel );
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -126,7 +130,19 @@ LogLevel Log::GetLoggingState
 (
 )
 {
-	currentlevel;
+	return currentlevel;
+}
+
+//-----------------------------------------------------------------------------
+//	<Log::IsEnabled>
+//	Return a flag to indicate whether a message of a level would be written
+//-----------------------------------------------------------------------------
+bool Log::IsEnabled
+(
+		LogLevel _level
+)
+{
+	return s_instance && m_pImpl && _level <= currentlevel;
 }
 
 //-----------------------------------------------------------------------------
@@ -175,6 +191,7 @@ Log::Log
 {
 	if (NULL == m_pImpl)
 		m_pImpl = new LogImpl( _filename,_bConsoleOutput, _saveLevel);
+	currentlevel = _saveLevel;
 
 }
 
@@ -0,0 +1,483 @@
+/*
+ * HPACK Header Compression for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include "anetd/anetdConfig.h"
+#include <algorithm>
+#include <boost/thread/once.hpp>
+#include "anetd/http2_hpack.hpp"
+
+using namespace DynamX::anetd;
+
+namespace {
+
+struct hpack_entry {
+	const char *name;
+	const char *value;
+};
+
+/* RFC 7541 Appendix B, the code of every byte value and of EOS (256) */
+static const boost::uint32_t huffman_codes[257] = {
+	0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+	0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+	0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+	0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+	0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+	0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+	0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+	0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+	0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+	0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+	0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+	0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+	0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+	0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+	0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+	0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+	0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+	0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+	0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+	0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+	0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+	0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+	0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+	0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+	0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+	0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+	0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+	0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+	0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+	0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+	0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+	0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+	0x3fffffff
+};
+static const unsigned char huffman_lengths[257] = {
+	13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+	28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+	6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+	5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+	13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+	15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+	6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+	20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+	24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+	22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+	21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+	26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+	19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+	20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+	26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+	30
+};
+static const hpack_entry static_table[61] = {
+	{ ":authority", "" },
+	{ ":method", "GET" },
+	{ ":method", "POST" },
+	{ ":path", "/" },
+	{ ":path", "/index.html" },
+	{ ":scheme", "http" },
+	{ ":scheme", "https" },
+	{ ":status", "200" },
+	{ ":status", "204" },
+	{ ":status", "206" },
+	{ ":status", "304" },
+	{ ":status", "400" },
+	{ ":status", "404" },
+	{ ":status", "500" },
+	{ "accept-charset", "" },
+	{ "accept-encoding", "gzip, deflate" },
+	{ "accept-language", "" },
+	{ "accept-ranges", "" },
+	{ "accept", "" },
+	{ "access-control-allow-origin", "" },
+	{ "age", "" },
+	{ "allow", "" },
+	{ "authorization", "" },
+	{ "cache-control", "" },
+	{ "content-disposition", "" },
+	{ "content-encoding", "" },
+	{ "content-language", "" },
+	{ "content-length", "" },
+	{ "content-location", "" },
+	{ "content-range", "" },
+	{ "content-type", "" },
+	{ "cookie", "" },
+	{ "date", "" },
+	{ "etag", "" },
+	{ "expect", "" },
+	{ "expires", "" },
+	{ "from", "" },
+	{ "host", "" },
+	{ "if-match", "" },
+	{ "if-modified-since", "" },
+	{ "if-none-match", "" },
+	{ "if-range", "" },
+	{ "if-unmodified-since", "" },
+	{ "last-modified", "" },
+	{ "link", "" },
+	{ "location", "" },
+	{ "max-forwards", "" },
+	{ "proxy-authenticate", "" },
+	{ "proxy-authorization", "" },
+	{ "range", "" },
+	{ "referer", "" },
+	{ "refresh", "" },
+	{ "retry-after", "" },
+	{ "server", "" },
+	{ "set-cookie", "" },
+	{ "strict-transport-security", "" },
+	{ "transfer-encoding", "" },
+	{ "user-agent", "" },
+	{ "vary", "" },
+	{ "via", "" },
+	{ "www-authenticate", "" }
+};
+
+/* RFC 7541 Appendix A */
+static const size_t STATIC_ENTRIES = sizeof(static_table) / sizeof(static_table[0]);
+
+/* the Huffman code as a binary tree. A child >= 0 is the index of a inner node, a child < 0 is the leaf of the symbol -(child + 1),
+ * and 0 (the root can not be a child) marks a bit string that is not a code */
+static boost::int16_t huffman_tree[512][2];
+static boost::once_flag huffmanonce = BOOST_ONCE_INIT;
+
+static void build_huffman_tree() {
+	unsigned int nodes = 1;
+	for (unsigned int symbol = 0; symbol < 257; symbol++) {
+		unsigned int node = 0;
+		for (int bit = huffman_lengths[symbol] - 1; bit >= 0; bit--) {
+			unsigned int branch = (huffman_codes[symbol] >> bit) & 1;
+			if (bit == 0) {
+				huffman_tree[node][branch] = -static_cast<boost::int16_t>(symbol + 1);
+			} else {
+				if (huffman_tree[node][branch] == 0)
+					huffman_tree[node][branch] = nodes++;
+				node = huffman_tree[node][branch];
+			}
+		}
+	}
+}
+
+static bool sensitive(const std::string &name) {
+	return name == "authorization" || name == "proxy-authorization" || name == "cookie";
+}
+
+}
+
+namespace DynamX {
+namespace anetd {
+
+void http2_hpack_encode_integer(boost::uint64_t value, unsigned int prefix, unsigned char flags, std::string &out) {
+	boost::uint64_t max = (1u << prefix) - 1;
+	if (value < max) {
+		out += static_cast<char>(flags | value);
+		return;
+	}
+	out += static_cast<char>(flags | max);
+	value -= max;
+	while (value >= 128) {
+		out += static_cast<char>((value & 127) | 128);
+		value >>= 7;
+	}
+	out += static_cast<char>(value);
+}
+
+bool http2_hpack_decode_integer(const unsigned char *&position, const unsigned char *end, unsigned int prefix, boost::uint64_t &value) {
+	if (position >= end)
+		return false;
+	boost::uint64_t max = (1u << prefix) - 1;
+	value = *position++ & max;
+	if (value < max)
+		return true;
+	unsigned int shift = 0;
+	unsigned char byte;
+	do {
+		/* anything that needs more than 56 bits is a attack, not a header */
+		if (position >= end || shift > 56)
+			return false;
+		byte = *position++;
+		value += static_cast<boost::uint64_t>(byte & 127) << shift;
+		shift += 7;
+	} while (byte & 128);
+	return true;
+}
+
+size_t http2_huffman_length(const std::string &value) {
+	boost::uint64_t bits = 0;
+	for (std::string::const_iterator c = value.begin(); c != value.end(); ++c)
+		bits += huffman_lengths[static_cast<unsigned char>(*c)];
+	return static_cast<size_t>((bits + 7) / 8);
+}
+
+void http2_huffman_encode(const std::string &value, std::string &out) {
+	boost::uint64_t bits = 0;
+	unsigned int count = 0;
+	for (std::string::const_iterator c = value.begin(); c != value.end(); ++c) {
+		unsigned char symbol = static_cast<unsigned char>(*c);
+		bits = (bits << huffman_lengths[symbol]) | huffman_codes[symbol];
+		count += huffman_lengths[symbol];
+		while (count >= 8) {
+			count -= 8;
+			out += static_cast<char>(bits >> count);
+		}
+		bits &= (static_cast<boost::uint64_t>(1) << count) - 1;
+	}
+	/* the last byte is padded with the most significant bits of EOS, which are all ones */
+	if (count > 0)
+		out += static_cast<char>((bits << (8 - count)) | (0xff >> count));
+}
+
+bool http2_huffman_decode(const unsigned char *data, size_t len, std::string &out) {
+	boost::call_once(&build_huffman_tree, huffmanonce);
+	unsigned int node = 0;
+	unsigned int depth = 0;
+	bool ones = true;
+	for (size_t i = 0; i < len; i++) {
+		for (int bit = 7; bit >= 0; bit--) {
+			unsigned int branch = (data[i] >> bit) & 1;
+			boost::int16_t next = huffman_tree[node][branch];
+			if (next == 0)
+				return false;
+			if (next < 0) {
+				unsigned int symbol = -(next + 1);
+				/* EOS in a string is a decoding error */
+				if (symbol == 256)
+					return false;
+				out += static_cast<char>(symbol);
+				node = 0;
+				depth = 0;
+				ones = true;
+			} else {
+				node = next;
+				depth++;
+				ones = ones && branch;
+			}
+		}
+	}
+	/* padding longer than 7 bits, or not a prefix of EOS */
+	return depth < 8 && ones;
+}
+
+
+http2_hpack_table::http2_hpack_table(size_t mymaxsize) : size(0), maxsize(mymaxsize)
+{
+}
+
+size_t http2_hpack_table::entrySize(const std::string &name, const std::string &value) {
+	return name.length() + value.length() + 32;
+}
+
+void http2_hpack_table::add(const std::string &name, const std::string &value) {
+	size_t entrysize = entrySize(name, value);
+	if (entrysize > this->maxsize) {
+		this->evict(0);
+		return;
+	}
+	this->evict(this->maxsize - entrysize);
+	this->entries.push_front(http2_header(name, value));
+	this->size += entrysize;
+}
+
+void http2_hpack_table::setMaxSize(size_t mymaxsize) {
+	this->maxsize = mymaxsize;
+	this->evict(mymaxsize);
+}
+
+size_t http2_hpack_table::getMaxSize() const {
+	return this->maxsize;
+}
+
+size_t http2_hpack_table::getSize() const {
+	return this->size;
+}
+
+size_t http2_hpack_table::count() const {
+	return this->entries.size();
+}
+
+const http2_header &http2_hpack_table::get(size_t index) const {
+	return this->entries[index];
+}
+
+void http2_hpack_table::evict(size_t mymaxsize) {
+	while (this->size > mymaxsize && !this->entries.empty()) {
+		this->size -= entrySize(this->entries.back().first, this->entries.back().second);
+		this->entries.pop_back();
+	}
+}
+
+
+http2_hpack_encoder::http2_hpack_encoder(size_t maxsize) : table(maxsize), limit(maxsize), pendingsize(maxsize), sizechanged(false)
+{
+}
+
+void http2_hpack_encoder::setMaxTableSize(size_t maxsize) {
+	maxsize = std::min(maxsize, this->limit);
+	if (maxsize == this->table.getMaxSize())
+		return;
+	/* if the size goes down and back up before the next block, the peer has to see the smallest size too, as entries were evicted */
+	this->pendingsize = this->sizechanged ? std::min(this->pendingsize, maxsize) : std::min(this->table.getMaxSize(), maxsize);
+	this->sizechanged = true;
+	this->table.setMaxSize(maxsize);
+}
+
+const http2_hpack_table &http2_hpack_encoder::getTable() const {
+	return this->table;
+}
+
+void http2_hpack_encoder::encode(const http2_header_list &headers, std::string &block) {
+	if (this->sizechanged) {
+		if (this->pendingsize < this->table.getMaxSize())
+			http2_hpack_encode_integer(this->pendingsize, 5, 0x20, block);
+		http2_hpack_encode_integer(this->table.getMaxSize(), 5, 0x20, block);
+		this->sizechanged = false;
+	}
+	for (http2_header_list::const_iterator header = headers.begin(); header != headers.end(); ++header) {
+		size_t nameindex = 0;
+		size_t fullindex = 0;
+		for (size_t i = 0; i < STATIC_ENTRIES && !fullindex; i++) {
+			if (header->first != static_table[i].name)
+				continue;
+			if (!nameindex)
+				nameindex = i + 1;
+			if (header->second == static_table[i].value)
+				fullindex = i + 1;
+		}
+		for (size_t i = 0; i < this->table.count() && !fullindex; i++) {
+			const http2_header &entry = this->table.get(i);
+			if (header->first != entry.first)
+				continue;
+			if (!nameindex)
+				nameindex = STATIC_ENTRIES + 1 + i;
+			if (header->second == entry.second)
+				fullindex = STATIC_ENTRIES + 1 + i;
+		}
+		bool neverindex = sensitive(header->first);
+		if (fullindex && !neverindex) {
+			http2_hpack_encode_integer(fullindex, 7, 0x80, block);
+			continue;
+		}
+		bool index = !neverindex && http2_hpack_table::entrySize(header->first, header->second) <= this->table.getMaxSize() * 3 / 4;
+		if (index)
+			http2_hpack_encode_integer(nameindex, 6, 0x40, block);
+		else
+			http2_hpack_encode_integer(nameindex, 4, neverindex ? 0x10 : 0x00, block);
+		if (!nameindex)
+			this->encodeString(header->first, block);
+		this->encodeString(header->second, block);
+		if (index)
+			this->table.add(header->first, header->second);
+	}
+}
+
+void http2_hpack_encoder::encodeString(const std::string &value, std::string &block) {
+	size_t huffman = http2_huffman_length(value);
+	if (huffman < value.length()) {
+		http2_hpack_encode_integer(huffman, 7, 0x80, block);
+		http2_huffman_encode(value, block);
+	} else {
+		http2_hpack_encode_integer(value.length(), 7, 0x00, block);
+		block.append(value);
+	}
+}
+
+
+http2_hpack_decoder::http2_hpack_decoder(size_t maxsize) : table(maxsize), limit(maxsize)
+{
+}
+
+const http2_hpack_table &http2_hpack_decoder::getTable() const {
+	return this->table;
+}
+
+bool http2_hpack_decoder::lookup(size_t index, http2_header &header) const {
+	if (index == 0)
+		return false;
+	if (index <= STATIC_ENTRIES) {
+		header.first = static_table[index - 1].name;
+		header.second = static_table[index - 1].value;
+		return true;
+	}
+	if (index - STATIC_ENTRIES - 1 >= this->table.count())
+		return false;
+	header = this->table.get(index - STATIC_ENTRIES - 1);
+	return true;
+}
+
+bool http2_hpack_decoder::decodeString(const unsigned char *&position, const unsigned char *end, std::string &value) {
+	if (position >= end)
+		return false;
+	bool huffman = (*position & 0x80) != 0;
+	boost::uint64_t len;
+	if (!http2_hpack_decode_integer(position, end, 7, len) || len > static_cast<boost::uint64_t>(end - position))
+		return false;
+	value.clear();
+	if (huffman) {
+		if (!http2_huffman_decode(position, static_cast<size_t>(len), value))
+			return false;
+	} else {
+		value.assign(reinterpret_cast<const char *>(position), static_cast<size_t>(len));
+	}
+	position += len;
+	return true;
+}
+
+bool http2_hpack_decoder::decode(const char *data, size_t len, http2_header_list &headers) {
+	const unsigned char *position = reinterpret_cast<const unsigned char *>(data);
+	const unsigned char *end = position + len;
+	bool fields = false;
+	while (position < end) {
+		unsigned char first = *position;
+		boost::uint64_t index;
+		http2_header header;
+		if (first & 0x80) {
+			/* indexed field */
+			if (!http2_hpack_decode_integer(position, end, 7, index) || !this->lookup(static_cast<size_t>(index), header))
+				return false;
+		} else if ((first & 0xe0) == 0x20) {
+			/* dynamic table size update, only allowed before the first field of the block */
+			if (!http2_hpack_decode_integer(position, end, 5, index) || fields || index > this->limit)
+				return false;
+			this->table.setMaxSize(static_cast<size_t>(index));
+			continue;
+		} else {
+			/* literal field, with incremental indexing (01), without indexing (0000) or never indexed (0001) */
+			bool incremental = (first & 0x40) != 0;
+			if (!http2_hpack_decode_integer(position, end, incremental ? 6 : 4, index))
+				return false;
+			if (index) {
+				if (!this->lookup(static_cast<size_t>(index), header))
+					return false;
+			} else if (!this->decodeString(position, end, header.first)) {
+				return false;
+			}
+			if (!this->decodeString(position, end, header.second))
+				return false;
+			if (incremental)
+				this->table.add(header.first, header.second);
+		}
+		fields = true;
+		headers.push_back(header);
+	}
+	return true;
+}
+
+}
+}
@@ -0,0 +1,1208 @@
+/*
+ * HTTP/2 Transport for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include "anetd/anetdConfig.h"
+#include <cstring>
+#include <string>
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include "anetd/http2_session.hpp"
+#include "anetd/LogClass.hpp"
+
+using namespace DynamX::anetd;
+using namespace DynamX::Logging;
+
+/* defined in http_engine.cpp */
+std::string Base64Encode(std::string s);
+
+namespace {
+
+enum frame_type {
+	FRAME_DATA = 0x0,
+	FRAME_HEADERS = 0x1,
+	FRAME_PRIORITY = 0x2,
+	FRAME_RST_STREAM = 0x3,
+	FRAME_SETTINGS = 0x4,
+	FRAME_PUSH_PROMISE = 0x5,
+	FRAME_PING = 0x6,
+	FRAME_GOAWAY = 0x7,
+	FRAME_WINDOW_UPDATE = 0x8,
+	FRAME_CONTINUATION = 0x9
+};
+
+enum frame_flags {
+	FLAG_END_STREAM = 0x1,
+	FLAG_ACK = 0x1,
+	FLAG_END_HEADERS = 0x4,
+	FLAG_PADDED = 0x8,
+	FLAG_PRIORITY = 0x20
+};
+
+enum settings_id {
+	SETTINGS_HEADER_TABLE_SIZE = 0x1,
+	SETTINGS_ENABLE_PUSH = 0x2,
+	SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+	SETTINGS_INITIAL_WINDOW_SIZE = 0x4,
+	SETTINGS_MAX_FRAME_SIZE = 0x5
+};
+
+/* the frame size we advertise (the default, as we never raise SETTINGS_MAX_FRAME_SIZE) and the windows every connection and stream start with */
+const size_t MAX_FRAME = 16384;
+const boost::int64_t DEFAULT_WINDOW = 65535;
+const boost::int64_t MAX_WINDOW = 0x7fffffff;
+/* a header block spread over this many bytes of CONTINUATION frames is someone trying to exhaust our memory */
+const size_t MAX_HEADER_BLOCK = 1 << 20;
+const char PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+class http2_category_impl : public boost::system::error_category
+{
+public:
+	const char *name() const BOOST_SYSTEM_NOEXCEPT {
+		return "http2";
+	}
+	std::string message(int ev) const {
+		switch (ev) {
+		case http2_errc::no_error:
+			return "No error";
+		case http2_errc::protocol_error:
+			return "HTTP/2 protocol error";
+		case http2_errc::internal_error:
+			return "HTTP/2 internal error";
+		case http2_errc::flow_control_error:
+			return "HTTP/2 flow control error";
+		case http2_errc::settings_timeout:
+			return "HTTP/2 settings timeout";
+		case http2_errc::stream_closed:
+			return "HTTP/2 stream closed";
+		case http2_errc::frame_size_error:
+			return "HTTP/2 frame size error";
+		case http2_errc::refused_stream:
+			return "HTTP/2 stream refused";
+		case http2_errc::cancel:
+			return "HTTP/2 stream cancelled";
+		case http2_errc::compression_error:
+			return "HTTP/2 compression error";
+		case http2_errc::connect_error:
+			return "HTTP/2 connect error";
+		case http2_errc::enhance_your_calm:
+			return "HTTP/2 enhance your calm";
+		case http2_errc::inadequate_security:
+			return "HTTP/2 inadequate security";
+		case http2_errc::http_1_1_required:
+			return "HTTP/1.1 required";
+		}
+		return "Unknown HTTP/2 error";
+	}
+};
+
+boost::uint32_t get32(const char *data) {
+	const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+	return (static_cast<boost::uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+void put32(std::string &out, boost::uint32_t value) {
+	out += static_cast<char>(value >> 24);
+	out += static_cast<char>(value >> 16);
+	out += static_cast<char>(value >> 8);
+	out += static_cast<char>(value);
+}
+
+void put_setting(std::string &out, boost::uint16_t id, boost::uint32_t value) {
+	out += static_cast<char>(id >> 8);
+	out += static_cast<char>(id);
+	put32(out, value);
+}
+
+/* split a URL into the parts of a HTTP/2 request. The path keeps the query but not the fragment, and the authority leaves out the default port */
+bool parse_url(const std::string &url, std::string &scheme, std::string &host, std::string &port, std::string &authority, std::string &path) {
+	size_t position = url.find("://");
+	if (position == std::string::npos)
+		return false;
+	scheme = boost::algorithm::to_lower_copy(url.substr(0, position));
+	if (scheme != "http" && scheme != "https")
+		return false;
+	position += 3;
+	size_t end = url.find_first_of("/?#", position);
+	std::string hostport = url.substr(position, end == std::string::npos ? std::string::npos : end - position);
+	size_t at = hostport.rfind('@');
+	if (at != std::string::npos)
+		hostport.erase(0, at + 1);
+	size_t colon = std::string::npos;
+	if (!hostport.empty() && hostport[0] == '[') {
+		size_t bracket = hostport.find(']');
+		if (bracket == std::string::npos)
+			return false;
+		host = hostport.substr(1, bracket - 1);
+		if (bracket + 1 < hostport.length()) {
+			if (hostport[bracket + 1] != ':')
+				return false;
+			colon = bracket + 1;
+		}
+	} else {
+		colon = hostport.find(':');
+		host = hostport.substr(0, colon);
+	}
+	if (host.empty())
+		return false;
+	std::string defaultport = scheme == "https" ? "443" : "80";
+	port = colon == std::string::npos || colon + 1 == hostport.length() ? defaultport : hostport.substr(colon + 1);
+	if (port.find_first_not_of("0123456789") != std::string::npos)
+		return false;
+	authority = hostport.substr(0, colon == std::string::npos || port == defaultport ? colon : std::string::npos);
+	path = "/";
+	if (end != std::string::npos && url[end] != '#') {
+		path = url.substr(end, url.find('#', end) == std::string::npos ? std::string::npos : url.find('#', end) - end);
+		if (path[0] == '?')
+			path.insert(0, "/");
+	}
+	return true;
+}
+
+/* HTTP/2 has no reason phrase, so the common ones are filled in for getDescription() */
+std::string reason_phrase(int status) {
+	switch (status) {
+	case 200: return "OK";
+	case 201: return "Created";
+	case 202: return "Accepted";
+	case 204: return "No Content";
+	case 206: return "Partial Content";
+	case 301: return "Moved Permanently";
+	case 302: return "Found";
+	case 303: return "See Other";
+	case 304: return "Not Modified";
+	case 307: return "Temporary Redirect";
+	case 308: return "Permanent Redirect";
+	case 400: return "Bad Request";
+	case 401: return "Unauthorized";
+	case 403: return "Forbidden";
+	case 404: return "Not Found";
+	case 405: return "Method Not Allowed";
+	case 408: return "Request Timeout";
+	case 409: return "Conflict";
+	case 410: return "Gone";
+	case 416: return "Range Not Satisfiable";
+	case 429: return "Too Many Requests";
+	case 500: return "Internal Server Error";
+	case 501: return "Not Implemented";
+	case 502: return "Bad Gateway";
+	case 503: return "Service Unavailable";
+	case 504: return "Gateway Timeout";
+	}
+	return "";
+}
+
+}
+
+const boost::system::error_category &DynamX::anetd::http2_category() {
+	static http2_category_impl category;
+	return category;
+}
+
+boost::system::error_code DynamX::anetd::http2_errc::make_error_code(errors e) {
+	return boost::system::error_code(static_cast<int>(e), http2_category());
+}
+
+http2_session::http2_session(boost::asio::io_service *mytransport) :
+		transport(*mytransport), strand(*mytransport), resolver(*mytransport), socket(*mytransport), ratetimer(*mytransport), ctx(boost::asio::ssl::context::sslv23), state(IDLE),
+		generation(0), tls(false), nextstreamid(1), goaway(false), maxstreams(100), peerwindow(DEFAULT_WINDOW), peermaxframe(MAX_FRAME),
+		sendwindow(DEFAULT_WINDOW), recvwindow(DEFAULT_WINDOW), credit(0), streamwindow(1 << 20), connectionwindow(16 << 20), readbuffer(NULL), readclass(0),
+		readsize(0), readfill(0), writeactive(false), headerstream(0), headerend(false), activecount(0), queuedcount(0), connections(0)
+{
+	this->bufferpool = http_buffer_pool::getDefault();
+	this->ratelimiter = http_rate_limiter::getDefault();
+	/* HTTP/2 requires TLS 1.2 or later (RFC 7540 section 9.2) */
+	this->ctx.set_options(boost::asio::ssl::context::default_workarounds | boost::asio::ssl::context::no_sslv2 | boost::asio::ssl::context::no_sslv3
+			| boost::asio::ssl::context::no_tlsv1 | boost::asio::ssl::context::no_tlsv1_1);
+	this->ctx.set_verify_mode(boost::asio::ssl::context::verify_none);
+}
+
+http2_session::~http2_session()
+{
+	this->disconnect();
+}
+
+bool http2_session::start(http_response *response, t_completionFunc handler) {
+	return this->start(response, "GET", "", handler);
+}
+
+bool http2_session::start(http_response *response, const std::string &method, const std::string &body, t_completionFunc handler) {
+	t_stream s(new stream());
+	if (!parse_url(response->getURL(), s->scheme, s->host, s->port, s->authority, s->path)) {
+		LogError(boost::str(boost::format("Invalid HTTP/2 URL: %1%") % response->getURL()));
+		return false;
+	}
+	s->id = 0;
+	s->response = response;
+	s->handler = handler;
+	s->method = method;
+	s->body = body;
+	this->requeue(s);
+	this->strand.post(boost::bind(&http2_session::enqueue, this, s));
+	return true;
+}
+
+void http2_session::cancel(http_response *response) {
+	this->strand.post(boost::bind(&http2_session::do_cancel, this, response));
+}
+
+void http2_session::close() {
+	this->strand.post(boost::bind(&http2_session::do_close, this));
+}
+
+bool http2_session::setWindowSize(size_t mystreamwindow, size_t myconnectionwindow) {
+	if (mystreamwindow < static_cast<size_t>(DEFAULT_WINDOW) || mystreamwindow > static_cast<size_t>(MAX_WINDOW)
+			|| myconnectionwindow < static_cast<size_t>(DEFAULT_WINDOW) || myconnectionwindow > static_cast<size_t>(MAX_WINDOW))
+		return false;
+	this->streamwindow = mystreamwindow;
+	this->connectionwindow = myconnectionwindow;
+	return true;
+}
+
+bool http2_session::setSocketTuning(boost::shared_ptr<http_socket_tuning> tuning) {
+	this->sockettuning = tuning;
+	return true;
+}
+
+bool http2_session::setRateLimiter(boost::shared_ptr<http_rate_limiter> limiter) {
+	if (limiter)
+		this->ratelimiter = limiter;
+	else
+		this->ratelimiter = http_rate_limiter::getDefault();
+	return true;
+}
+
+size_t http2_session::getActiveStreams() {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->SLock);
+	return this->activecount;
+}
+
+size_t http2_session::getQueuedRequests() {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->SLock);
+	return this->queuedcount;
+}
+
+size_t http2_session::getConnections() {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->SLock);
+	return this->connections;
+}
+
+void http2_session::enqueue(t_stream s) {
+	if (this->scheme.empty()) {
+		this->scheme = s->scheme;
+		this->host = s->host;
+		this->port = s->port;
+		this->authority = s->authority;
+		this->tls = this->scheme == "https";
+	} else if (s->scheme != this->scheme || s->authority != this->authority) {
+		LogError(boost::str(boost::format("HTTP/2 Session for %1%://%2% can not fetch %3%") % this->scheme % this->authority % s->response->getURL()));
+		return this->complete(s, boost::system::errc::make_error_code(boost::system::errc::invalid_argument));
+	}
+	this->queue.push_back(s);
+	this->dispatch();
+}
+
+void http2_session::dispatch() {
+	if (this->state == IDLE && !this->queue.empty())
+		this->connect();
+	if (this->state == OPEN) {
+		while (!this->goaway && !this->queue.empty() && this->streams.size() < this->maxstreams) {
+			if (this->nextstreamid > static_cast<boost::uint32_t>(MAX_WINDOW)) {
+				/* out of stream ids, the remaining requests go on a new connection once these streams finish */
+				this->goaway = true;
+				break;
+			}
+			t_stream s = this->queue.front();
+			this->queue.pop_front();
+			this->open_stream(s);
+		}
+		if (this->goaway && this->streams.empty()) {
+			LogDebug(boost::str(boost::format("HTTP/2 Connection to %1% drained") % this->authority));
+			this->disconnect();
+			if (!this->queue.empty())
+				this->connect();
+		}
+		this->flush();
+	}
+	this->update_counts();
+}
+
+void http2_session::connect() {
+	this->state = CONNECTING;
+	this->generation++;
+	LogDebug(boost::str(boost::format("HTTP/2 Connecting to %1%://%2%") % this->scheme % this->authority));
+	boost::asio::ip::tcp::resolver::query query(boost::asio::ip::tcp::v4(), this->host, this->port);
+	this->resolver.async_resolve(query, this->strand.wrap(boost::bind(&http2_session::handle_resolve, this, this->generation,
+			boost::asio::placeholders::error, boost::asio::placeholders::iterator)));
+}
+
+void http2_session::handle_resolve(unsigned int mygeneration, const boost::system::error_code &err, boost::asio::ip::tcp::resolver::iterator endpoint) {
+	if (mygeneration != this->generation)
+		return;
+	if (err) {
+		LogError(boost::str(boost::format("Error Resolving %1%: %2%") % this->host % err.message()));
+		return this->connection_lost(err);
+	}
+	this->handle_connect(mygeneration, boost::asio::error::host_not_found, endpoint);
+}
+
+void http2_session::handle_connect(unsigned int mygeneration, const boost::system::error_code &err, boost::asio::ip::tcp::resolver::iterator endpoint) {
+	if (mygeneration != this->generation)
+		return;
+	if (!err) {
+		if (!this->tls)
+			return this->open();
+		SSL *ssl = this->sslsocket->native_handle();
+		/* h2 is the only protocol we offer, a server that can not speak it fails the handshake or selects nothing */
+		SSL_set_alpn_protos(ssl, reinterpret_cast<const unsigned char *>("\x02h2"), 3);
+		boost::system::error_code ec;
+		boost::asio::ip::address::from_string(this->host, ec);
+		if (ec)
+			SSL_set_tlsext_host_name(ssl, this->host.c_str());
+		this->sslsocket->async_handshake(boost::asio::ssl::stream_base::client,
+				this->strand.wrap(boost::bind(&http2_session::handle_handshake, this, mygeneration, boost::asio::placeholders::error)));
+		return;
+	}
+	if (endpoint == boost::asio::ip::tcp::resolver::iterator()) {
+		LogError(boost::str(boost::format("Error Connecting to %1%: %2%") % this->authority % err.message()));
+		return this->connection_lost(err);
+	}
+	boost::asio::ip::tcp::endpoint myendpoint = endpoint->endpoint();
+	++endpoint;
+	http_socket_profile profile = this->sockettuning ? this->sockettuning->getProfile(this->host) : http_socket_profile();
+	boost::system::error_code ec;
+	if (this->tls) {
+		/* a SSL stream can not be reused once it has been used for a handshake, so every connection gets a new one */
+		this->sslsocket.reset(new boost::asio::ssl::stream<boost::asio::ip::tcp::socket>(this->transport, this->ctx));
+		this->sslsocket->set_verify_mode(boost::asio::ssl::context::verify_none);
+		this->sslsocket->next_layer().open(myendpoint.protocol(), ec);
+		if (!ec)
+			profile.apply(this->sslsocket->next_layer());
+		this->sslsocket->lowest_layer().async_connect(myendpoint, this->strand.wrap(boost::bind(&http2_session::handle_connect, this, mygeneration,
+				boost::asio::placeholders::error, endpoint)));
+	} else {
+		if (this->socket.is_open())
+			this->socket.close(ec);
+		this->socket.open(myendpoint.protocol(), ec);
+		if (!ec)
+			profile.apply(this->socket);
+		this->socket.async_connect(myendpoint, this->strand.wrap(boost::bind(&http2_session::handle_connect, this, mygeneration,
+				boost::asio::placeholders::error, endpoint)));
+	}
+}
+
+void http2_session::handle_handshake(unsigned int mygeneration, const boost::system::error_code &err) {
+	if (mygeneration != this->generation)
+		return;
+	if (err) {
+		LogError(boost::str(boost::format("Error in TLS Handshake with %1%: %2%") % this->authority % err.message()));
+		return this->connection_lost(err);
+	}
+	const unsigned char *protocol = NULL;
+	unsigned int len = 0;
+	SSL_get0_alpn_selected(this->sslsocket->native_handle(), &protocol, &len);
+	if (len != 2 || memcmp(protocol, "h2", 2) != 0) {
+		LogError(boost::str(boost::format("%1% did not negotiate HTTP/2") % this->authority));
+		return this->connection_lost(http2_errc::make_error_code(http2_errc::http_1_1_required));
+	}
+	this->open();
+}
+
+void http2_session::open() {
+	LogDebug(boost::str(boost::format("HTTP/2 Connection to %1% open") % this->authority));
+	this->state = OPEN;
+	{
+		boost::interprocess::scoped_lock<boost::mutex> lock(this->SLock);
+		this->connections++;
+	}
+	/* the dynamic tables belong to the connection */
+	this->encoder.reset(new http2_hpack_encoder());
+	this->decoder.reset(new http2_hpack_decoder());
+	this->nextstreamid = 1;
+	this->goaway = false;
+	this->maxstreams = 100;
+	this->peerwindow = DEFAULT_WINDOW;
+	this->peermaxframe = MAX_FRAME;
+	this->sendwindow = DEFAULT_WINDOW;
+	this->recvwindow = this->connectionwindow;
+	this->credit = 0;
+	this->headerstream = 0;
+	this->readclass = http_buffer_pool::sizeClass(4 * MAX_FRAME);
+	this->readsize = http_buffer_pool::classSize(this->readclass);
+	this->readbuffer = this->bufferpool->acquire(this->readclass);
+	this->readfill = 0;
+
+	this->queued.assign(PREFACE, sizeof(PREFACE) - 1);
+	std::string settings;
+	put_setting(settings, SETTINGS_ENABLE_PUSH, 0);
+	put_setting(settings, SETTINGS_INITIAL_WINDOW_SIZE, this->streamwindow);
+	this->send_frame(FRAME_SETTINGS, 0, 0, settings.data(), settings.length());
+	/* the connection window can only be raised with a WINDOW_UPDATE */
+	if (this->connectionwindow > static_cast<size_t>(DEFAULT_WINDOW))
+		this->send_window_update(0, this->connectionwindow - DEFAULT_WINDOW);
+	this->start_read();
+	this->dispatch();
+}
+
+void http2_session::open_stream(t_stream s) {
+	s->id = this->nextstreamid;
+	this->nextstreamid += 2;
+	s->sendwindow = this->peerwindow;
+	s->recvwindow = this->streamwindow;
+
+	http_response *response = s->response;
+	http2_header_list headers;
+	headers.push_back(http2_header(":method", s->method));
+	headers.push_back(http2_header(":scheme", s->scheme));
+	headers.push_back(http2_header(":authority", s->authority));
+	headers.push_back(http2_header(":path", s->path));
+	bool accept = false;
+	for (std::map<std::string, std::string>::iterator header = response->sendheaders.begin(); header != response->sendheaders.end(); ++header) {
+		std::string name = boost::algorithm::to_lower_copy(header->first);
+		/* connection specific headers are not allowed in HTTP/2 (RFC 7540 section 8.1.2.2), and the authority replaces Host */
+		if (name == "connection" || name == "keep-alive" || name == "proxy-connection" || name == "transfer-encoding" || name == "upgrade"
+				|| name == "host" || (name == "te" && header->second != "trailers"))
+			continue;
+		if (name == "accept")
+			accept = true;
+		headers.push_back(http2_header(name, header->second));
+	}
+	if (response->httpauth.first.length() > 0)
+		headers.push_back(http2_header("authorization", "Basic " + Base64Encode(response->httpauth.first + ":" + response->httpauth.second)));
+	if (!accept)
+		headers.push_back(http2_header("accept", "*/*"));
+	if (!s->body.empty() || s->method == "POST" || s->method == "PUT")
+		headers.push_back(http2_header("content-length", boost::lexical_cast<std::string>(s->body.length())));
+
+	std::string block;
+	this->encoder->encode(headers, block);
+	bool endstream = s->body.empty();
+	size_t offset = 0;
+	do {
+		size_t len = std::min(block.length() - offset, this->peermaxframe);
+		boost::uint8_t flags = (offset + len == block.length() ? FLAG_END_HEADERS : 0) | (offset == 0 && endstream ? FLAG_END_STREAM : 0);
+		this->send_frame(offset == 0 ? FRAME_HEADERS : FRAME_CONTINUATION, flags, s->id, block.data() + offset, len);
+		offset += len;
+	} while (offset < block.length());
+	this->streams[s->id] = s;
+	LogDebug(boost::str(boost::format("HTTP/2 Stream %1%: %2% %3%") % s->id % s->method % response->getURL()));
+	this->send_body(s);
+}
+
+void http2_session::send_body(t_stream s) {
+	while (s->bodysent < s->body.length()) {
+		boost::int64_t window = std::min(s->sendwindow, this->sendwindow);
+		if (window <= 0)
+			return;
+		size_t len = std::min(std::min(s->body.length() - s->bodysent, static_cast<size_t>(window)), this->peermaxframe);
+		bool last = s->bodysent + len == s->body.length();
+		this->send_frame(FRAME_DATA, last ? FLAG_END_STREAM : 0, s->id, s->body.data() + s->bodysent, len);
+		s->bodysent += len;
+		s->sendwindow -= len;
+		this->sendwindow -= len;
+	}
+}
+
+void http2_session::send_frame(boost::uint8_t type, boost::uint8_t flags, boost::uint32_t streamid, const char *payload, size_t len) {
+	char header[9];
+	header[0] = static_cast<char>(len >> 16);
+	header[1] = static_cast<char>(len >> 8);
+	header[2] = static_cast<char>(len);
+	header[3] = static_cast<char>(type);
+	header[4] = static_cast<char>(flags);
+	header[5] = static_cast<char>((streamid >> 24) & 0x7f);
+	header[6] = static_cast<char>(streamid >> 16);
+	header[7] = static_cast<char>(streamid >> 8);
+	header[8] = static_cast<char>(streamid);
+	this->queued.append(header, sizeof(header));
+	if (len > 0)
+		this->queued.append(payload, len);
+}
+
+void http2_session::send_window_update(boost::uint32_t streamid, size_t increment) {
+	std::string payload;
+	put32(payload, increment & MAX_WINDOW);
+	this->send_frame(FRAME_WINDOW_UPDATE, 0, streamid, payload.data(), payload.length());
+}
+
+void http2_session::send_goaway(http2_errc::errors code) {
+	/* we never accept streams from the server, so the last stream we processed is always 0 */
+	std::string payload;
+	put32(payload, 0);
+	put32(payload, code);
+	this->send_frame(FRAME_GOAWAY, 0, 0, payload.data(), payload.length());
+}
+
+void http2_session::flush() {
+	if (this->writeactive || this->queued.empty() || (this->state != OPEN && this->state != CLOSING))
+		return;
+	/* frames queued while this write is in progress go out together with the next one */
+	this->writing.swap(this->queued);
+	this->queued.clear();
+	this->writeactive = true;
+	this->async_sockwrite(this->writing, boost::bind(&http2_session::handle_write, this, this->generation, boost::asio::placeholders::error));
+}
+
+void http2_session::handle_write(unsigned int mygeneration, const boost::system::error_code &err) {
+	if (mygeneration != this->generation)
+		return;
+	this->writeactive = false;
+	this->writing.clear();
+	if (err) {
+		LogError(boost::str(boost::format("Error Writing to %1%: %2%") % this->authority % err.message()));
+		return this->connection_lost(err);
+	}
+	if (this->state == CLOSING && this->queued.empty()) {
+		/* the GOAWAY has been sent */
+		this->disconnect();
+		return this->dispatch();
+	}
+	this->flush();
+}
+
+void http2_session::start_read() {
+	size_t size = this->readsize - this->readfill;
+	boost::posix_time::time_duration wait;
+	size_t allowed = this->ratelimiter->available(this->host, http_rate_limiter::RECEIVE, std::min(size, static_cast<size_t>(4096)), wait);
+	if (allowed == 0) {
+		/* the server runs out of window while we wait, so every stream slows down */
+		this->ratetimer.expires_from_now(wait);
+		this->ratetimer.async_wait(this->strand.wrap(boost::bind(&http2_session::handle_rate_timer, this, this->generation, boost::asio::placeholders::error)));
+		return;
+	}
+	this->async_sockread(this->readbuffer + this->readfill, std::min(size, allowed),
+			boost::bind(&http2_session::handle_read, this, this->generation, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+}
+
+void http2_session::handle_rate_timer(unsigned int mygeneration, const boost::system::error_code &err) {
+	if (err || mygeneration != this->generation || this->state == CLOSING)
+		return;
+	this->start_read();
+}
+
+void http2_session::handle_read(unsigned int mygeneration, const boost::system::error_code &err, size_t len) {
+	if (mygeneration != this->generation || this->state == CLOSING)
+		return;
+	if (err) {
+		if (this->streams.empty() && this->queue.empty()) {
+			/* the server closed a idle connection */
+			LogDebug(boost::str(boost::format("HTTP/2 Connection to %1% closed: %2%") % this->authority % err.message()));
+			this->disconnect();
+			return this->update_counts();
+		}
+		LogError(boost::str(boost::format("Error Reading from %1%: %2%") % this->authority % err.message()));
+		return this->connection_lost(err);
+	}
+	this->ratelimiter->consume(this->host, http_rate_limiter::RECEIVE, len);
+	this->readfill += len;
+	size_t position = 0;
+	while (this->readfill - position >= 9) {
+		const char *header = this->readbuffer + position;
+		const unsigned char *bytes = reinterpret_cast<const unsigned char *>(header);
+		size_t length = (bytes[0] << 16) | (bytes[1] << 8) | bytes[2];
+		if (length > MAX_FRAME) {
+			this->connection_error(http2_errc::frame_size_error);
+			return;
+		}
+		if (this->readfill - position < 9 + length)
+			break;
+		if (!this->handle_frame(bytes[3], bytes[4], get32(header + 5) & MAX_WINDOW, header + 9, length))
+			return;
+		position += 9 + length;
+	}
+	/* keep the start of a partial frame for the next read */
+	if (position > 0) {
+		memmove(this->readbuffer, this->readbuffer + position, this->readfill - position);
+		this->readfill -= position;
+	}
+	this->dispatch();
+	if (mygeneration == this->generation)
+		this->start_read();
+}
+
+bool http2_session::handle_frame(boost::uint8_t type, boost::uint8_t flags, boost::uint32_t streamid, const char *payload, size_t len) {
+	/* a header block must not be interrupted by any other frame (RFC 7540 section 6.2) */
+	if (this->headerstream != 0 && (type != FRAME_CONTINUATION || streamid != this->headerstream)) {
+		this->connection_error(http2_errc::protocol_error);
+		return false;
+	}
+	switch (type) {
+	case FRAME_DATA:
+		return this->handle_data(flags, streamid, payload, len);
+	case FRAME_HEADERS:
+		return this->handle_headers(flags, streamid, payload, len);
+	case FRAME_RST_STREAM: {
+		if (streamid == 0 || len != 4) {
+			this->connection_error(streamid == 0 ? http2_errc::protocol_error : http2_errc::frame_size_error);
+			return false;
+		}
+		t_stream s = this->find(streamid);
+		if (!s)
+			return true;
+		boost::uint32_t code = get32(payload);
+		this->streams.erase(streamid);
+		if (code == http2_errc::refused_stream && !s->headers) {
+			/* the server did not process the request, so it is safe to send it again */
+			LogDebug(boost::str(boost::format("HTTP/2 Stream %1% refused, retrying") % streamid));
+			this->requeue(s);
+			this->queue.push_front(s);
+		} else {
+			boost::system::error_code err(code, http2_category());
+			LogWarn(boost::str(boost::format("HTTP/2 Stream %1% reset by %2%: %3%") % streamid % this->authority % err.message()));
+			this->finish(s, err);
+		}
+		return true;
+	}
+	case FRAME_SETTINGS:
+		if (streamid != 0) {
+			this->connection_error(http2_errc::protocol_error);
+			return false;
+		}
+		return this->handle_settings(flags, payload, len);
+	case FRAME_PUSH_PROMISE:
+		/* we sent SETTINGS_ENABLE_PUSH = 0 */
+		this->connection_error(http2_errc::protocol_error);
+		return false;
+	case FRAME_PING:
+		if (streamid != 0 || len != 8) {
+			this->connection_error(streamid != 0 ? http2_errc::protocol_error : http2_errc::frame_size_error);
+			return false;
+		}
+		if (!(flags & FLAG_ACK))
+			this->send_frame(FRAME_PING, FLAG_ACK, 0, payload, len);
+		return true;
+	case FRAME_GOAWAY:
+		if (streamid != 0) {
+			this->connection_error(http2_errc::protocol_error);
+			return false;
+		}
+		return this->handle_goaway(payload, len);
+	case FRAME_WINDOW_UPDATE:
+		return this->handle_window_update(streamid, payload, len);
+	case FRAME_CONTINUATION:
+		if (this->headerstream == 0) {
+			this->connection_error(http2_errc::protocol_error);
+			return false;
+		}
+		if (this->headerblock.length() + len > MAX_HEADER_BLOCK) {
+			this->connection_error(http2_errc::enhance_your_calm);
+			return false;
+		}
+		this->headerblock.append(payload, len);
+		if (flags & FLAG_END_HEADERS)
+			return this->handle_header_block();
+		return true;
+	}
+	/* PRIORITY and unknown frame types are ignored */
+	return true;
+}
+
+bool http2_session::handle_data(boost::uint8_t flags, boost::uint32_t streamid, const char *payload, size_t len) {
+	if (streamid == 0) {
+		this->connection_error(http2_errc::protocol_error);
+		return false;
+	}
+	/* the whole frame, padding included, counts against the windows */
+	this->recvwindow -= len;
+	if (this->recvwindow < 0) {
+		this->connection_error(http2_errc::flow_control_error);
+		return false;
+	}
+	this->credit += len;
+	if (this->credit >= this->connectionwindow / 2) {
+		this->send_window_update(0, this->credit);
+		this->recvwindow += this->credit;
+		this->credit = 0;
+	}
+	const char *data = payload;
+	size_t datalen = len;
+	if (flags & FLAG_PADDED) {
+		if (len < 1 || static_cast<unsigned char>(payload[0]) >= len) {
+			this->connection_error(http2_errc::protocol_error);
+			return false;
+		}
+		data++;
+		datalen = len - 1 - static_cast<unsigned char>(payload[0]);
+	}
+	t_stream s = this->find(streamid);
+	/* data of a stream we reset, which only counts against the connection window */
+	if (!s)
+		return true;
+	if (!s->headers) {
+		this->reset_stream(s, http2_errc::protocol_error);
+		return true;
+	}
+	s->recvwindow -= len;
+	if (s->recvwindow < 0) {
+		this->reset_stream(s, http2_errc::flow_control_error);
+		return true;
+	}
+	s->credit += len;
+	if (datalen > 0) {
+		s->received += datalen;
+		s->response->receive(data, datalen);
+		s->response->flush();
+		/* a response that could not take the body does not want the rest of it */
+		boost::system::error_code failed = s->response->failure();
+		if (failed) {
+			std::string payload;
+			put32(payload, http2_errc::cancel);
+			this->send_frame(FRAME_RST_STREAM, 0, s->id, payload.data(), payload.length());
+			this->streams.erase(s->id);
+			this->finish(s, failed);
+			return true;
+		}
+	}
+	if (flags & FLAG_END_STREAM)
+		this->end_stream(s);
+	else
+		this->replenish(s);
+	return true;
+}
+
+bool http2_session::handle_headers(boost::uint8_t flags, boost::uint32_t streamid, const char *payload, size_t len) {
+	if (streamid == 0) {
+		this->connection_error(http2_errc::protocol_error);
+		return false;
+	}
+	const char *data = payload;
+	size_t datalen = len;
+	if (flags & FLAG_PADDED) {
+		if (datalen < 1 || static_cast<unsigned char>(data[0]) >= datalen) {
+			this->connection_error(http2_errc::protocol_error);
+			return false;
+		}
+		datalen -= 1 + static_cast<unsigned char>(data[0]);
+		data++;
+	}
+	if (flags & FLAG_PRIORITY) {
+		if (datalen < 5) {
+			this->connection_error(http2_errc::protocol_error);
+			return false;
+		}
+		data += 5;
+		datalen -= 5;
+	}
+	this->headerblock.assign(data, datalen);
+	this->headerstream = streamid;
+	this->headerend = (flags & FLAG_END_STREAM) != 0;
+	if (flags & FLAG_END_HEADERS)
+		return this->handle_header_block();
+	return true;
+}
+
+bool http2_session::handle_header_block() {
+	boost::uint32_t streamid = this->headerstream;
+	this->headerstream = 0;
+	/* every block is decoded, even for streams we reset, to keep the dynamic table in step with the server */
+	http2_header_list headers;
+	if (!this->decoder->decode(this->headerblock.data(), this->headerblock.length(), headers)) {
+		this->connection_error(http2_errc::compression_error);
+		return false;
+	}
+	this->headerblock.clear();
+	t_stream s = this->find(streamid);
+	if (!s)
+		return true;
+	http_response *response = s->response;
+	if (!s->headers) {
+		int status = 0;
+		for (http2_header_list::iterator header = headers.begin(); header != headers.end(); ++header) {
+			if (header->first == ":status") {
+				try {
+					status = boost::lexical_cast<int>(header->second);
+				} catch (boost::bad_lexical_cast &) {
+				}
+			}
+		}
+		if (status < 100 || status > 999) {
+			this->reset_stream(s, http2_errc::protocol_error);
+			return true;
+		}
+		/* informational responses are followed by the real one */
+		if (status < 200) {
+			if (this->headerend)
+				this->reset_stream(s, http2_errc::protocol_error);
+			return true;
+		}
+		response->headers.clear();
+		for (http2_header_list::iterator header = headers.begin(); header != headers.end(); ++header)
+			if (header->first[0] != ':')
+				response->headers.add(header->first, header->second);
+		response->headermapstale = true;
+		s->headers = true;
+		response->setVersion("HTTP/2.0");
+		response->setStatus(status);
+		response->setDescription(reason_phrase(status));
+		LogDebug(boost::str(boost::format("HTTP/2 Stream %1%: Status %2%") % streamid % status));
+		const char *length;
+		size_t len;
+		response->setBodySize(0);
+		if (response->headers.find(http_headers::Content_Length, length, len)) {
+			try {
+				response->setBodySize(boost::lexical_cast<size_t>(length, len));
+				s->haslength = true;
+			} catch (boost::bad_lexical_cast &) {
+				LogWarn(boost::str(boost::format("Invalid Content-Length: %1%") % std::string(length, len)));
+			}
+		}
+		response->onHeaders();
+	} else {
+		/* trailers, which must end the stream */
+		if (!this->headerend) {
+			this->reset_stream(s, http2_errc::protocol_error);
+			return true;
+		}
+		for (http2_header_list::iterator header = headers.begin(); header != headers.end(); ++header)
+			if (header->first[0] != ':')
+				response->headers.add(header->first, header->second);
+		response->headermapstale = true;
+	}
+	if (this->headerend)
+		this->end_stream(s);
+	return true;
+}
+
+bool http2_session::handle_settings(boost::uint8_t flags, const char *payload, size_t len) {
+	if (flags & FLAG_ACK) {
+		if (len != 0) {
+			this->connection_error(http2_errc::frame_size_error);
+			return false;
+		}
+		return true;
+	}
+	if (len % 6 != 0) {
+		this->connection_error(http2_errc::frame_size_error);
+		return false;
+	}
+	for (size_t position = 0; position < len; position += 6) {
+		const unsigned char *bytes = reinterpret_cast<const unsigned char *>(payload + position);
+		boost::uint16_t id = (bytes[0] << 8) | bytes[1];
+		boost::uint32_t value = get32(payload + position + 2);
+		switch (id) {
+		case SETTINGS_HEADER_TABLE_SIZE:
+			this->encoder->setMaxTableSize(value);
+			break;
+		case SETTINGS_MAX_CONCURRENT_STREAMS:
+			this->maxstreams = value;
+			break;
+		case SETTINGS_INITIAL_WINDOW_SIZE: {
+			if (value > static_cast<boost::uint32_t>(MAX_WINDOW)) {
+				this->connection_error(http2_errc::flow_control_error);
+				return false;
+			}
+			/* the change applies to the windows of the open streams too (RFC 7540 section 6.9.2) */
+			boost::int64_t delta = static_cast<boost::int64_t>(value) - this->peerwindow;
+			for (std::map<boost::uint32_t, t_stream>::iterator it = this->streams.begin(); it != this->streams.end(); ++it)
+				it->second->sendwindow += delta;
+			this->peerwindow = value;
+			break;
+		}
+		case SETTINGS_MAX_FRAME_SIZE:
+			if (value < MAX_FRAME || value > 0xffffff) {
+				this->connection_error(http2_errc::protocol_error);
+				return false;
+			}
+			this->peermaxframe = value;
+			break;
+		}
+	}
+	this->send_frame(FRAME_SETTINGS, FLAG_ACK, 0, NULL, 0);
+	for (std::map<boost::uint32_t, t_stream>::iterator it = this->streams.begin(); it != this->streams.end(); ++it)
+		this->send_body(it->second);
+	return true;
+}
+
+bool http2_session::handle_goaway(const char *payload, size_t len) {
+	if (len < 8) {
+		this->connection_error(http2_errc::frame_size_error);
+		return false;
+	}
+	boost::uint32_t last = get32(payload) & MAX_WINDOW;
+	boost::system::error_code err(get32(payload + 4), http2_category());
+	if (err)
+		LogWarn(boost::str(boost::format("HTTP/2 Connection to %1% going away: %2%") % this->authority % err.message()));
+	else
+		LogDebug(boost::str(boost::format("HTTP/2 Connection to %1% going away after stream %2%") % this->authority % last));
+	this->goaway = true;
+	/* the streams after the last one were not processed, and are sent again on a new connection once this one has drained */
+	std::deque<t_stream> retry;
+	for (std::map<boost::uint32_t, t_stream>::iterator it = this->streams.upper_bound(last); it != this->streams.end();) {
+		this->requeue(it->second);
+		retry.push_back(it->second);
+		this->streams.erase(it++);
+	}
+	this->queue.insert(this->queue.begin(), retry.begin(), retry.end());
+	return true;
+}
+
+bool http2_session::handle_window_update(boost::uint32_t streamid, const char *payload, size_t len) {
+	if (len != 4) {
+		this->connection_error(http2_errc::frame_size_error);
+		return false;
+	}
+	boost::uint32_t increment = get32(payload) & MAX_WINDOW;
+	if (streamid == 0) {
+		if (increment == 0) {
+			this->connection_error(http2_errc::protocol_error);
+			return false;
+		}
+		this->sendwindow += increment;
+		if (this->sendwindow > MAX_WINDOW) {
+			this->connection_error(http2_errc::flow_control_error);
+			return false;
+		}
+		for (std::map<boost::uint32_t, t_stream>::iterator it = this->streams.begin(); it != this->streams.end(); ++it)
+			this->send_body(it->second);
+		return true;
+	}
+	t_stream s = this->find(streamid);
+	if (!s)
+		return true;
+	if (increment == 0) {
+		this->reset_stream(s, http2_errc::protocol_error);
+		return true;
+	}
+	s->sendwindow += increment;
+	if (s->sendwindow > MAX_WINDOW) {
+		this->reset_stream(s, http2_errc::flow_control_error);
+		return true;
+	}
+	this->send_body(s);
+	return true;
+}
+
+void http2_session::replenish(t_stream s) {
+	if (s->paused)
+		return;
+	/* a response that can not take more data gets no WINDOW_UPDATE, so the server stops sending on this stream till it resumes */
+	if (!s->response->ready(boost::bind(&http2_session::schedule_resume, this, s))) {
+		s->paused = true;
+		return;
+	}
+	if (s->credit >= this->streamwindow / 2) {
+		this->send_window_update(s->id, s->credit);
+		s->recvwindow += s->credit;
+		s->credit = 0;
+	}
+}
+
+void http2_session::schedule_resume(t_stream s) {
+	this->strand.post(boost::bind(&http2_session::resume, this, s));
+}
+
+void http2_session::resume(t_stream s) {
+	s->paused = false;
+	if (this->find(s->id) != s)
+		return;
+	this->replenish(s);
+	this->flush();
+}
+
+void http2_session::end_stream(t_stream s) {
+	this->streams.erase(s->id);
+	if (!s->headers) {
+		this->finish(s, http2_errc::make_error_code(http2_errc::protocol_error));
+		return;
+	}
+	/* the server can answer before it has read the whole body (RFC 7540 section 8.1), then the rest is not needed */
+	if (s->bodysent < s->body.length()) {
+		std::string payload;
+		put32(payload, http2_errc::no_error);
+		this->send_frame(FRAME_RST_STREAM, 0, s->id, payload.data(), payload.length());
+	}
+	if (s->haslength && s->received != s->response->getBodySize()) {
+		LogError(boost::str(boost::format("HTTP/2 Stream %1%: received %2% bytes of %3%") % s->id % s->received % s->response->getBodySize()));
+		this->finish(s, http2_errc::make_error_code(http2_errc::protocol_error));
+		return;
+	}
+	if (!s->haslength)
+		s->response->setBodySize(s->received);
+	boost::system::error_code result = s->response->complete_body();
+	if (result) {
+		this->finish(s, result);
+		return;
+	}
+	if (s->response->ready(boost::bind(&http2_session::finish, this, s, boost::system::error_code())))
+		this->finish(s, boost::system::error_code());
+}
+
+void http2_session::reset_stream(t_stream s, http2_errc::errors code) {
+	LogWarn(boost::str(boost::format("HTTP/2 Stream %1%: resetting, %2%") % s->id % http2_errc::make_error_code(code).message()));
+	std::string payload;
+	put32(payload, code);
+	this->send_frame(FRAME_RST_STREAM, 0, s->id, payload.data(), payload.length());
+	this->streams.erase(s->id);
+	this->finish(s, http2_errc::make_error_code(code));
+}
+
+void http2_session::requeue(t_stream s) {
+	s->id = 0;
+	s->bodysent = 0;
+	s->sendwindow = 0;
+	s->recvwindow = 0;
+	s->credit = 0;
+	s->received = 0;
+	s->headers = false;
+	s->haslength = false;
+	s->paused = false;
+}
+
+void http2_session::connection_error(http2_errc::errors code) {
+	boost::system::error_code err = http2_errc::make_error_code(code);
+	LogError(boost::str(boost::format("HTTP/2 Connection Error with %1%: %2%") % this->authority % err.message()));
+	for (std::map<boost::uint32_t, t_stream>::iterator it = this->streams.begin(); it != this->streams.end(); ++it)
+		this->finish(it->second, err);
+	this->streams.clear();
+	this->goaway = true;
+	this->headerstream = 0;
+	/* tell the server why, and close the connection once the GOAWAY is written */
+	this->send_goaway(code);
+	this->state = CLOSING;
+	this->flush();
+	this->update_counts();
+}
+
+void http2_session::connection_lost(const boost::system::error_code &err) {
+	bool established = this->state == OPEN || this->state == CLOSING;
+	this->disconnect();
+	for (std::map<boost::uint32_t, t_stream>::iterator it = this->streams.begin(); it != this->streams.end(); ++it)
+		this->finish(it->second, err);
+	this->streams.clear();
+	/* if we could not connect at all, the queued requests would fail the same way */
+	if (!established) {
+		for (std::deque<t_stream>::iterator it = this->queue.begin(); it != this->queue.end(); ++it)
+			this->finish(*it, err);
+		this->queue.clear();
+	}
+	this->dispatch();
+}
+
+void http2_session::disconnect() {
+	/* the handlers of the operations still pending on the old connection see a different generation and do nothing */
+	this->generation++;
+	boost::system::error_code ec;
+	this->resolver.cancel();
+	this->ratetimer.cancel(ec);
+	if (this->socket.is_open())
+		this->socket.close(ec);
+	if (this->sslsocket && this->sslsocket->lowest_layer().is_open())
+		this->sslsocket->lowest_layer().close(ec);
+	if (this->readbuffer) {
+		this->bufferpool->release(this->readbuffer, this->readclass);
+		this->readbuffer = NULL;
+	}
+	this->readfill = 0;
+	this->writing.clear();
+	this->queued.clear();
+	this->writeactive = false;
+	this->headerblock.clear();
+	this->headerstream = 0;
+	this->state = IDLE;
+}
+
+void http2_session::finish(t_stream s, const boost::system::error_code &err) {
+	/* completion functions often start the next request, so they are never called while we are in the middle of processing a frame */
+	this->strand.post(boost::bind(&http2_session::complete, this, s, err));
+}
+
+void http2_session::complete(t_stream s, const boost::system::error_code &myerr) {
+	/* a response that processes the body asynchronously can fail after the stream ended */
+	boost::system::error_code err = myerr ? myerr : s->response->failure();
+	if (err) {
+		LogDebug(boost::str(boost::format("HTTP/2 Request for %1% failed: %2%") % s->response->getURL() % err.message()));
+		s->response->onError(err);
+	}
+	t_completionFunc handler;
+	handler.swap(s->handler);
+	this->update_counts();
+	if (handler)
+		handler(err, s->response);
+}
+
+void http2_session::do_cancel(http_response *response) {
+	for (std::deque<t_stream>::iterator it = this->queue.begin(); it != this->queue.end(); ++it) {
+		if ((*it)->response == response) {
+			t_stream s = *it;
+			this->queue.erase(it);
+			this->finish(s, boost::asio::error::operation_aborted);
+			return this->update_counts();
+		}
+	}
+	for (std::map<boost::uint32_t, t_stream>::iterator it = this->streams.begin(); it != this->streams.end(); ++it) {
+		if (it->second->response == response) {
+			t_stream s = it->second;
+			std::string payload;
+			put32(payload, http2_errc::cancel);
+			this->send_frame(FRAME_RST_STREAM, 0, s->id, payload.data(), payload.length());
+			this->streams.erase(it);
+			this->finish(s, boost::asio::error::operation_aborted);
+			/* the stream slot is free for a queued request */
+			return this->dispatch();
+		}
+	}
+}
+
+void http2_session::do_close() {
+	for (std::deque<t_stream>::iterator it = this->queue.begin(); it != this->queue.end(); ++it)
+		this->finish(*it, boost::asio::error::operation_aborted);
+	this->queue.clear();
+	for (std::map<boost::uint32_t, t_stream>::iterator it = this->streams.begin(); it != this->streams.end(); ++it)
+		this->finish(it->second, boost::asio::error::operation_aborted);
+	this->streams.clear();
+	if (this->state == OPEN) {
+		this->goaway = true;
+		this->send_goaway(http2_errc::no_error);
+		this->state = CLOSING;
+		this->flush();
+	} else if (this->state == CONNECTING) {
+		this->disconnect();
+	}
+	this->update_counts();
+}
+
+void http2_session::update_counts() {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->SLock);
+	this->activecount = this->streams.size();
+	this->queuedcount = this->queue.size();
+}
+
+http2_session::t_stream http2_session::find(boost::uint32_t streamid) {
+	std::map<boost::uint32_t, t_stream>::iterator it = this->streams.find(streamid);
+	if (it == this->streams.end())
+		return t_stream();
+	return it->second;
+}
+
+void http2_session::async_sockwrite(const std::string &data, t_ioFunc handler) {
+	if (this->tls)
+		boost::asio::async_write(*this->sslsocket, boost::asio::buffer(data), this->strand.wrap(handler));
+	else
+		boost::asio::async_write(this->socket, boost::asio::buffer(data), this->strand.wrap(handler));
+}
+
+void http2_session::async_sockread(char *data, size_t size, t_ioFunc handler) {
+	if (this->tls)
+		this->sslsocket->async_read_some(boost::asio::buffer(data, size), this->strand.wrap(handler));
+	else
+		this->socket.async_read_some(boost::asio::buffer(data, size), this->strand.wrap(handler));
+}
@@ -0,0 +1,97 @@
+/*
+ * Per Transfer Arena Allocator for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include "anetd/anetdConfig.h"
+#include <boost/cstdint.hpp>
+#include "anetd/http_arena.hpp"
+
+using namespace DynamX::anetd;
+
+/* the data of a block starts after its header, rounded up so any type can be placed at the start */
+static const size_t block_header = (sizeof(void *) * 2 + 15) & ~static_cast<size_t>(15);
+
+
+http_arena::http_arena(size_t size) :
+		head(NULL), current(NULL), ptr(NULL), end(NULL), blocksize(size), used(0), capacity(0)
+{
+}
+
+http_arena::~http_arena()
+{
+	while (this->head) {
+		block *next = this->head->next;
+		delete[] reinterpret_cast<char *>(this->head);
+		this->head = next;
+	}
+}
+
+char *http_arena::data(block *b) {
+	return reinterpret_cast<char *>(b) + block_header;
+}
+
+void *http_arena::allocate(size_t size, size_t align) {
+	while (true) {
+		if (this->ptr) {
+			char *aligned = reinterpret_cast<char *>((reinterpret_cast<boost::uintptr_t>(this->ptr) + align - 1) & ~static_cast<boost::uintptr_t>(align - 1));
+			if (aligned + size <= this->end) {
+				this->used += (aligned + size) - this->ptr;
+				this->ptr = aligned + size;
+				return aligned;
+			}
+		}
+		/* move on to the next block we kept from a earlier transfer, if it is big enough */
+		block *next = this->current ? this->current->next : this->head;
+		if (next && next->size >= size + align) {
+			this->current = next;
+			this->ptr = data(next);
+			this->end = this->ptr + next->size;
+			continue;
+		}
+		/* grow. The new block goes after the current one, so blocks that are too small for this request stay in the list */
+		size_t want = this->blocksize;
+		if (want < size + align)
+			want = size + align;
+		block *b = reinterpret_cast<block *>(new char[block_header + want]);
+		b->size = want;
+		b->next = next;
+		if (this->current)
+			this->current->next = b;
+		else
+			this->head = b;
+		this->capacity += want;
+		this->current = b;
+		this->ptr = data(b);
+		this->end = this->ptr + want;
+	}
+}
+
+void http_arena::release() {
+	this->current = this->head;
+	this->ptr = this->head ? data(this->head) : NULL;
+	this->end = this->head ? this->ptr + this->head->size : NULL;
+	this->used = 0;
+}
+
+size_t http_arena::getUsed() const {
+	return this->used;
+}
+
+size_t http_arena::getCapacity() const {
+	return this->capacity;
+}
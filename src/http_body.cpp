@@ -0,0 +1,144 @@
+/*
+ * Response Body Storage for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include "anetd/anetdConfig.h"
+#include <algorithm>
+#include <cstring>
+#include "anetd/http_body.hpp"
+
+using namespace DynamX::anetd;
+
+http_body::http_body(boost::shared_ptr<http_buffer_pool> mypool) : pool(mypool), length(0)
+{
+	if (!this->pool)
+		this->pool = http_buffer_pool::getDefault();
+}
+
+http_body::~http_body()
+{
+	this->clear();
+}
+
+void http_body::add(size_t capacity) {
+	block b;
+	b.used = 0;
+	if (capacity > http_buffer_pool::MAXSIZE) {
+		b.data = new char[capacity];
+		b.capacity = capacity;
+		b.sizeclass = -1;
+	} else {
+		unsigned int sizeclass = http_buffer_pool::sizeClass(capacity);
+		b.data = this->pool->acquire(sizeclass);
+		b.capacity = http_buffer_pool::classSize(sizeclass);
+		b.sizeclass = static_cast<int>(sizeclass);
+	}
+	this->chain.push_back(b);
+}
+
+void http_body::release(block &b) {
+	if (b.sizeclass < 0)
+		delete[] b.data;
+	else
+		this->pool->release(b.data, static_cast<unsigned int>(b.sizeclass));
+	b.data = NULL;
+}
+
+void http_body::reserve(size_t size) {
+	if (size <= this->length || size > MAXRESERVE)
+		return;
+	size_t free = this->chain.empty() ? 0 : this->chain.back().capacity - this->chain.back().used;
+	if (free >= size - this->length)
+		return;
+	/* append() only fills the last block, so the new block holds all of the rest. A empty block at the end is replaced rather than left unused */
+	if (!this->chain.empty() && this->chain.back().used == 0) {
+		this->release(this->chain.back());
+		this->chain.pop_back();
+	}
+	this->add(size - this->length);
+}
+
+void http_body::append(const char *data, size_t len) {
+	while (len > 0) {
+		if (this->chain.empty() || this->chain.back().used == this->chain.back().capacity) {
+			/* each block doubles the last, so the number of blocks grows with the log of the size */
+			size_t next = this->chain.empty() ? static_cast<size_t>(http_buffer_pool::MINSIZE) : std::min(this->chain.back().capacity * 2, static_cast<size_t>(http_buffer_pool::MAXSIZE));
+			this->add(std::max(next, std::min(len, static_cast<size_t>(http_buffer_pool::MAXSIZE))));
+		}
+		block &b = this->chain.back();
+		size_t part = std::min(len, b.capacity - b.used);
+		memcpy(b.data + b.used, data, part);
+		b.used += part;
+		this->length += part;
+		data += part;
+		len -= part;
+	}
+}
+
+void http_body::clear() {
+	for (std::vector<block>::iterator it = this->chain.begin(); it != this->chain.end(); ++it)
+		this->release(*it);
+	this->chain.clear();
+	this->length = 0;
+}
+
+size_t http_body::size() const {
+	return this->length;
+}
+
+bool http_body::empty() const {
+	return this->length == 0;
+}
+
+size_t http_body::count() const {
+	size_t blocks = 0;
+	for (std::vector<block>::const_iterator it = this->chain.begin(); it != this->chain.end(); ++it)
+		if (it->used > 0)
+			blocks++;
+	return blocks;
+}
+
+void http_body::buffers(std::vector<boost::asio::const_buffer> &out) const {
+	for (std::vector<block>::const_iterator it = this->chain.begin(); it != this->chain.end(); ++it)
+		if (it->used > 0)
+			out.push_back(boost::asio::const_buffer(it->data, it->used));
+}
+
+void http_body::iovecs(std::vector<struct iovec> &out) const {
+	for (std::vector<block>::const_iterator it = this->chain.begin(); it != this->chain.end(); ++it) {
+		if (it->used == 0)
+			continue;
+		struct iovec iov;
+		iov.iov_base = it->data;
+		iov.iov_len = it->used;
+		out.push_back(iov);
+	}
+}
+
+std::string http_body::str() const {
+	std::string out;
+	this->copy(out);
+	return out;
+}
+
+void http_body::copy(std::string &out) const {
+	out.clear();
+	out.reserve(this->length);
+	for (std::vector<block>::const_iterator it = this->chain.begin(); it != this->chain.end(); ++it)
+		out.append(it->data, it->used);
+}
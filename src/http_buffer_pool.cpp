@@ -0,0 +1,118 @@
+/*
+ * Receive Buffer Pool for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include "anetd/anetdConfig.h"
+#include <boost/interprocess/sync/scoped_lock.hpp>
+#include <boost/thread/once.hpp>
+#include "anetd/http_buffer_pool.hpp"
+
+using namespace DynamX::anetd;
+
+http_buffer_pool::http_buffer_pool(size_t mymaxidle) : maxidle(mymaxidle), idle(0), hits(0), misses(0)
+{
+}
+
+http_buffer_pool::~http_buffer_pool()
+{
+	for (unsigned int i = 0; i < CLASSES; i++)
+		for (std::vector<char *>::iterator buffer = this->freelist[i].begin(); buffer != this->freelist[i].end(); ++buffer)
+			delete[] *buffer;
+}
+
+static boost::shared_ptr<http_buffer_pool> defaultpool;
+static boost::once_flag defaultonce = BOOST_ONCE_INIT;
+
+static void create_default() {
+	defaultpool.reset(new http_buffer_pool());
+}
+
+boost::shared_ptr<http_buffer_pool> http_buffer_pool::getDefault() {
+	boost::call_once(&create_default, defaultonce);
+	return defaultpool;
+}
+
+unsigned int http_buffer_pool::sizeClass(size_t size) {
+	unsigned int sizeclass = 0;
+	while (sizeclass < CLASSES - 1 && classSize(sizeclass) < size)
+		sizeclass++;
+	return sizeclass;
+}
+
+size_t http_buffer_pool::classSize(unsigned int sizeclass) {
+	return static_cast<size_t>(MINSIZE) << sizeclass;
+}
+
+char *http_buffer_pool::acquire(unsigned int sizeclass) {
+	{
+		boost::interprocess::scoped_lock<boost::mutex> lock(this->BLock);
+		if (!this->freelist[sizeclass].empty()) {
+			char *buffer = this->freelist[sizeclass].back();
+			this->freelist[sizeclass].pop_back();
+			this->idle -= classSize(sizeclass);
+			this->hits++;
+			return buffer;
+		}
+		this->misses++;
+	}
+	return new char[classSize(sizeclass)];
+}
+
+void http_buffer_pool::release(char *buffer, unsigned int sizeclass) {
+	{
+		boost::interprocess::scoped_lock<boost::mutex> lock(this->BLock);
+		if (this->idle + classSize(sizeclass) <= this->maxidle) {
+			this->freelist[sizeclass].push_back(buffer);
+			this->idle += classSize(sizeclass);
+			return;
+		}
+	}
+	delete[] buffer;
+}
+
+void http_buffer_pool::setMaxIdle(size_t mymaxidle) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->BLock);
+	this->maxidle = mymaxidle;
+	this->trim();
+}
+
+void http_buffer_pool::trim() {
+	/* free the largest buffers first, they are the least likely to be needed again */
+	for (unsigned int i = CLASSES; i-- > 0 && this->idle > this->maxidle;) {
+		while (!this->freelist[i].empty() && this->idle > this->maxidle) {
+			delete[] this->freelist[i].back();
+			this->freelist[i].pop_back();
+			this->idle -= classSize(i);
+		}
+	}
+}
+
+size_t http_buffer_pool::getIdle() {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->BLock);
+	return this->idle;
+}
+
+boost::uint64_t http_buffer_pool::getHits() {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->BLock);
+	return this->hits;
+}
+
+boost::uint64_t http_buffer_pool::getMisses() {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->BLock);
+	return this->misses;
+}
@@ -0,0 +1,211 @@
+/*
+ * Request Coalescing for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include "anetd/anetdConfig.h"
+#include <algorithm>
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread.hpp>
+#include "anetd/http_coalesce.hpp"
+#include "anetd/LogClass.hpp"
+
+using namespace DynamX::anetd;
+using namespace DynamX::Logging;
+
+namespace {
+
+/* header names are case-insensitive, name is already lower case */
+bool header_value(const http_coalescer::t_headers &headers, const std::string &name, std::string &value) {
+	for (http_coalescer::t_headers::const_iterator it = headers.begin(); it != headers.end(); ++it) {
+		if (boost::algorithm::to_lower_copy(it->first) != name)
+			continue;
+		value = it->second;
+		return true;
+	}
+	return false;
+}
+
+bool same_header(const http_coalescer::t_headers &a, const http_coalescer::t_headers &b, const std::string &name) {
+	std::string va, vb;
+	bool ina = header_value(a, name, va);
+	bool inb = header_value(b, name, vb);
+	return ina == inb && va == vb;
+}
+
+}
+
+http_coalescer::coalescer_state::coalescer_state(boost::asio::io_service *myio, size_t maxidle) : io(myio), engines(myio, myio, maxidle),
+		requests(0), coalesced(0), resent(0)
+{
+}
+
+http_coalescer::http_coalescer(boost::asio::io_service *io, size_t maxidle) : state(new coalescer_state(io, maxidle))
+{
+}
+
+bool http_coalescer::fetch(const std::string &url, t_sharedFunc handler, const t_headers &headers, const std::string &method) {
+	waiter w;
+	w.handler = handler;
+	w.headers = headers;
+	return submit(this->state, url, w, method);
+}
+
+http_coalescer::t_future http_coalescer::fetch(const std::string &url, const t_headers &headers, const std::string &method) {
+	boost::shared_ptr<boost::promise<boost::shared_ptr<http_response> > > promise(new boost::promise<boost::shared_ptr<http_response> >());
+	t_future future(promise->get_future());
+	waiter w;
+	w.handler = boost::bind(&http_coalescer::resolve, promise, _1, _2);
+	w.headers = headers;
+	submit(this->state, url, w, method);
+	return future;
+}
+
+bool http_coalescer::submit(boost::shared_ptr<coalescer_state> state, const std::string &url, const waiter &w, const std::string &method) {
+	bool coalesce = method == "GET" || method == "HEAD";
+	boost::shared_ptr<flight> f = boost::make_shared<flight>();
+	{
+		boost::interprocess::scoped_lock<boost::mutex> lock(state->CLock);
+		state->requests++;
+		if (coalesce) {
+			/* every header the caller set can change the response (credentials, cookies, conditionals...), so all of them are in the key
+			 * but the ones the application said do not matter */
+			std::vector<std::pair<std::string, std::string> > keyed;
+			for (t_headers::const_iterator it = w.headers.begin(); it != w.headers.end(); ++it) {
+				std::string name = boost::algorithm::to_lower_copy(it->first);
+				if (state->ignored.find(name) == state->ignored.end())
+					keyed.push_back(std::make_pair(name, it->second));
+			}
+			std::sort(keyed.begin(), keyed.end());
+			f->key = method + " " + url;
+			for (std::vector<std::pair<std::string, std::string> >::iterator it = keyed.begin(); it != keyed.end(); ++it)
+				f->key += "\n" + it->first + ": " + it->second;
+			std::map<std::string, boost::shared_ptr<flight> >::iterator it = state->flights.find(f->key);
+			if (it != state->flights.end()) {
+				it->second->waiters.push_back(w);
+				state->coalesced++;
+				LogDebug(boost::str(boost::format("Coalescing %1% %2% with the transfer in flight (%3% waiting)") % method % url % it->second->waiters.size()));
+				return true;
+			}
+			state->flights[f->key] = f;
+		}
+		f->url = url;
+		f->method = method;
+		f->headers = w.headers;
+		f->waiters.push_back(w);
+	}
+	boost::shared_ptr<http_response> response = boost::make_shared<http_response>();
+	response->setURL(url);
+	for (t_headers::const_iterator it = w.headers.begin(); it != w.headers.end(); ++it)
+		response->setHeader(it->first, it->second);
+	boost::shared_ptr<http_engine> engine = state->engines.acquire();
+	engine->setMethod(method);
+	engine->start(response.get(), boost::bind(&http_coalescer::finished, state, f, engine, response, _1));
+	return false;
+}
+
+void http_coalescer::finished(boost::shared_ptr<coalescer_state> state, boost::shared_ptr<flight> f, boost::shared_ptr<http_engine> engine,
+		boost::shared_ptr<http_response> response, const boost::system::error_code &err) {
+	{
+		/* once out of the table nobody can attach, so the waiters can be walked without the lock */
+		boost::interprocess::scoped_lock<boost::mutex> lock(state->CLock);
+		std::map<std::string, boost::shared_ptr<flight> >::iterator it = state->flights.find(f->key);
+		if (it != state->flights.end() && it->second == f)
+			state->flights.erase(it);
+	}
+	/* the headers the server says the response depends on. Only the ignored headers can differ between the requests */
+	std::vector<std::string> varies;
+	bool varyall = false;
+	std::string vary;
+	if (!err && f->waiters.size() > 1 && response->getHeaders().get(http_headers::Vary, vary)) {
+		std::string::size_type start = 0;
+		while (start <= vary.size()) {
+			std::string::size_type end = vary.find(',', start);
+			if (end == std::string::npos)
+				end = vary.size();
+			std::string name = boost::algorithm::to_lower_copy(boost::algorithm::trim_copy(vary.substr(start, end - start)));
+			start = end + 1;
+			if (name == "*")
+				varyall = true;
+			else if (!name.empty())
+				varies.push_back(name);
+		}
+	}
+	for (std::vector<waiter>::iterator w = f->waiters.begin(); w != f->waiters.end(); ++w) {
+		bool differs = w != f->waiters.begin() && varyall && w->headers != f->headers;
+		for (std::vector<std::string>::iterator name = varies.begin(); !differs && w != f->waiters.begin() && name != varies.end(); ++name)
+			differs = !same_header(w->headers, f->headers, *name);
+		if (differs) {
+			{
+				boost::interprocess::scoped_lock<boost::mutex> lock(state->CLock);
+				state->resent++;
+			}
+			LogDebug(boost::str(boost::format("Response of %1% varies on %2%, sending a coalesced request again") % f->url % vary));
+			submit(state, f->url, *w, f->method);
+			continue;
+		}
+		if (w->handler)
+			w->handler(err, response);
+	}
+	/* the engine is still unwinding, so it goes back to the pool from a handler of its own */
+	state->io->post(boost::bind(&http_coalescer::release, engine));
+}
+
+void http_coalescer::release(boost::shared_ptr<http_engine>) {
+	/* the engine returns to the pool when the last copy of the pointer goes */
+}
+
+void http_coalescer::resolve(boost::shared_ptr<boost::promise<boost::shared_ptr<http_response> > > promise, const boost::system::error_code &err,
+		boost::shared_ptr<http_response> response) {
+	if (err)
+		promise->set_exception(boost::copy_exception(boost::system::system_error(err)));
+	else
+		promise->set_value(response);
+}
+
+void http_coalescer::setIgnoredHeaders(const std::vector<std::string> &headers) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->state->CLock);
+	this->state->ignored.clear();
+	for (std::vector<std::string>::const_iterator it = headers.begin(); it != headers.end(); ++it)
+		this->state->ignored.insert(boost::algorithm::to_lower_copy(*it));
+}
+
+size_t http_coalescer::getInFlight() {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->state->CLock);
+	return this->state->flights.size();
+}
+
+boost::uint64_t http_coalescer::getRequests() {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->state->CLock);
+	return this->state->requests;
+}
+
+boost::uint64_t http_coalescer::getCoalesced() {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->state->CLock);
+	return this->state->coalesced;
+}
+
+boost::uint64_t http_coalescer::getResent() {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->state->CLock);
+	return this->state->resent;
+}
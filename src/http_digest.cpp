@@ -0,0 +1,299 @@
+/*
+ * Body Digests for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include "anetd/anetdConfig.h"
+#include <cstring>
+#include <boost/cstdint.hpp>
+#include <boost/thread/once.hpp>
+#include <openssl/evp.h>
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <nmmintrin.h>
+#define ANETD_HAVE_SSE42_CRC 1
+#endif
+#include "anetd/http_digest.hpp"
+
+using namespace DynamX::anetd;
+
+namespace {
+
+class http_digest_category_impl : public boost::system::error_category
+{
+public:
+	const char *name() const BOOST_SYSTEM_NOEXCEPT {
+		return "http_digest";
+	}
+	std::string message(int ev) const {
+		switch (ev) {
+		case http_digest_errc::mismatch:
+			return "Body digest mismatch";
+		}
+		return "Unknown digest error";
+	}
+};
+
+/* OpenSSL does the work for the cryptographic hashes */
+class evp_digest : public http_digest
+{
+public:
+	evp_digest(algorithm myalg, const EVP_MD *mymd) : alg(myalg), md(mymd) {
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+		this->ctx = EVP_MD_CTX_new();
+#else
+		this->ctx = EVP_MD_CTX_create();
+#endif
+		this->restart();
+	}
+	~evp_digest() {
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+		EVP_MD_CTX_free(this->ctx);
+#else
+		EVP_MD_CTX_destroy(this->ctx);
+#endif
+	}
+	void update(const char *data, size_t len) {
+		if (len > 0)
+			EVP_DigestUpdate(this->ctx, data, len);
+	}
+	std::string final() {
+		unsigned char raw[EVP_MAX_MD_SIZE];
+		unsigned int len = 0;
+		EVP_DigestFinal_ex(this->ctx, raw, &len);
+		/* leave the context ready for more, like the other digests */
+		this->restart();
+		return std::string(reinterpret_cast<char *>(raw), len);
+	}
+	void restart() {
+		EVP_DigestInit_ex(this->ctx, this->md, NULL);
+	}
+	algorithm getAlgorithm() const {
+		return this->alg;
+	}
+private:
+	algorithm alg;
+	const EVP_MD *md;
+	EVP_MD_CTX *ctx;
+};
+
+/* CRC-32C, the reflected Castagnoli polynomial */
+const boost::uint32_t CRC32C_POLY = 0x82f63b78;
+boost::uint32_t crctable[8][256];
+boost::once_flag crconce = BOOST_ONCE_INIT;
+bool crchardware = false;
+
+void crc_init() {
+	for (unsigned int i = 0; i < 256; i++) {
+		boost::uint32_t crc = i;
+		for (int k = 0; k < 8; k++)
+			crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+		crctable[0][i] = crc;
+	}
+	/* the tables for eight bytes at a time */
+	for (unsigned int i = 0; i < 256; i++)
+		for (int t = 1; t < 8; t++)
+			crctable[t][i] = (crctable[t - 1][i] >> 8) ^ crctable[0][crctable[t - 1][i] & 0xff];
+#ifdef ANETD_HAVE_SSE42_CRC
+	__builtin_cpu_init();
+	crchardware = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+boost::uint32_t crc_software(boost::uint32_t crc, const unsigned char *p, size_t len) {
+	while (len > 0 && (reinterpret_cast<size_t>(p) & 7) != 0) {
+		crc = crctable[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+		len--;
+	}
+	while (len >= 8) {
+		/* byte by byte, so it does not matter which way round the machine stores words */
+		boost::uint32_t lo = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<boost::uint32_t>(p[3]) << 24));
+		crc = crctable[7][lo & 0xff] ^ crctable[6][(lo >> 8) & 0xff] ^ crctable[5][(lo >> 16) & 0xff] ^ crctable[4][lo >> 24] ^
+			crctable[3][p[4]] ^ crctable[2][p[5]] ^ crctable[1][p[6]] ^ crctable[0][p[7]];
+		p += 8;
+		len -= 8;
+	}
+	while (len-- > 0)
+		crc = crctable[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+#ifdef ANETD_HAVE_SSE42_CRC
+__attribute__((target("sse4.2")))
+boost::uint32_t crc_hardware(boost::uint32_t crc, const unsigned char *p, size_t len) {
+	while (len > 0 && (reinterpret_cast<size_t>(p) & 7) != 0) {
+		crc = _mm_crc32_u8(crc, *p++);
+		len--;
+	}
+	boost::uint64_t crc64 = crc;
+	while (len >= 8) {
+		boost::uint64_t word;
+		memcpy(&word, p, sizeof(word));
+		crc64 = _mm_crc32_u64(crc64, word);
+		p += 8;
+		len -= 8;
+	}
+	crc = static_cast<boost::uint32_t>(crc64);
+	while (len-- > 0)
+		crc = _mm_crc32_u8(crc, *p++);
+	return crc;
+}
+#endif
+
+class crc32c_digest : public http_digest
+{
+public:
+	crc32c_digest() : crc(0xffffffff) {
+		boost::call_once(&crc_init, crconce);
+	}
+	void update(const char *data, size_t len) {
+		const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+#ifdef ANETD_HAVE_SSE42_CRC
+		if (crchardware) {
+			this->crc = crc_hardware(this->crc, p, len);
+			return;
+		}
+#endif
+		this->crc = crc_software(this->crc, p, len);
+	}
+	std::string final() {
+		boost::uint32_t value = ~this->crc;
+		this->restart();
+		char raw[4] = { static_cast<char>(value >> 24), static_cast<char>(value >> 16), static_cast<char>(value >> 8), static_cast<char>(value) };
+		return std::string(raw, sizeof(raw));
+	}
+	void restart() {
+		this->crc = 0xffffffff;
+	}
+	algorithm getAlgorithm() const {
+		return CRC32C;
+	}
+private:
+	boost::uint32_t crc;
+};
+
+int unhex(char c) {
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+int unbase64(char c) {
+	if (c >= 'A' && c <= 'Z')
+		return c - 'A';
+	if (c >= 'a' && c <= 'z')
+		return c - 'a' + 26;
+	if (c >= '0' && c <= '9')
+		return c - '0' + 52;
+	if (c == '+' || c == '-')
+		return 62;
+	if (c == '/' || c == '_')
+		return 63;
+	return -1;
+}
+
+}
+
+const boost::system::error_category &DynamX::anetd::http_digest_category() {
+	static http_digest_category_impl category;
+	return category;
+}
+
+boost::system::error_code DynamX::anetd::http_digest_errc::make_error_code(errors e) {
+	return boost::system::error_code(static_cast<int>(e), http_digest_category());
+}
+
+http_digest *http_digest::create(algorithm alg) {
+	switch (alg) {
+	case SHA256:
+		return new evp_digest(alg, EVP_sha256());
+	case MD5:
+		return new evp_digest(alg, EVP_md5());
+	case CRC32C:
+		return new crc32c_digest();
+	}
+	return NULL;
+}
+
+http_digest::~http_digest()
+{
+}
+
+const char *http_digest::getName(algorithm alg) {
+	switch (alg) {
+	case SHA256:
+		return "sha-256";
+	case MD5:
+		return "md5";
+	case CRC32C:
+		return "crc32c";
+	}
+	return "";
+}
+
+std::string http_digest::toHex(const std::string &raw) {
+	static const char digits[] = "0123456789abcdef";
+	std::string hex;
+	hex.reserve(raw.size() * 2);
+	for (std::string::const_iterator it = raw.begin(); it != raw.end(); ++it) {
+		unsigned char c = static_cast<unsigned char>(*it);
+		hex += digits[c >> 4];
+		hex += digits[c & 0xf];
+	}
+	return hex;
+}
+
+bool http_digest::fromHex(const std::string &hex, std::string &raw) {
+	raw.clear();
+	if (hex.size() % 2 != 0)
+		return false;
+	raw.reserve(hex.size() / 2);
+	for (size_t i = 0; i < hex.size(); i += 2) {
+		int hi = unhex(hex[i]);
+		int lo = unhex(hex[i + 1]);
+		if (hi < 0 || lo < 0)
+			return false;
+		raw += static_cast<char>((hi << 4) | lo);
+	}
+	return true;
+}
+
+bool http_digest::fromBase64(const std::string &base64, std::string &raw) {
+	raw.clear();
+	boost::uint32_t bits = 0;
+	int count = 0;
+	size_t i = 0;
+	for (; i < base64.size() && base64[i] != '='; i++) {
+		int v = unbase64(base64[i]);
+		if (v < 0)
+			return false;
+		bits = (bits << 6) | v;
+		count += 6;
+		if (count >= 8) {
+			count -= 8;
+			raw += static_cast<char>((bits >> count) & 0xff);
+		}
+	}
+	/* only padding may follow, and a single leftover character is not a byte */
+	for (; i < base64.size(); i++)
+		if (base64[i] != '=')
+			return false;
+	return count < 6 && !raw.empty();
+}
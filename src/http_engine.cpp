@@ -18,6 +18,13 @@
  *
  */
 #include "anetd/anetdConfig.h"
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
 #include <string>
 #include <boost/algorithm/string/case_conv.hpp>
 #include <boost/algorithm/string.hpp>
@@ -26,6 +33,7 @@
 #include <boost/archive/iterators/transform_width.hpp>
 #include <boost/archive/iterators/insert_linebreaks.hpp>
 #include <boost/archive/iterators/remove_whitespace.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
 #include "anetd/http_engine.hpp"
 #include "anetd/LogClass.hpp"
 
@@ -43,28 +51,85 @@ std::string Base64Encode(std::string s) {
 	return base64;
 }
 
-std::string get_env(std::string const& name) {
-	char* var = getenv(name.c_str());
-	//getenv can return NULL, std::string(NULL) throws
-	if (var)
-		return var;
-	else
-		return "";
+#if BOOST_VERSION > 104700
+http_engine::http_engine(boost::asio::io_service *postback) :
+		io(), transport(this->io), strand(this->io), resolver(this->io), socket(this->io), ctx(boost::asio::ssl::context::sslv23), hedgetimer(this->io), retrytimer(this->io), ratetimer(this->io) {
+#else
+	http_engine::http_engine(boost::asio::io_service *postback) : io(), transport(this->io), strand(this->io), resolver(this->io), socket(this->io), ctx(this->io, boost::asio::ssl::context::sslv23), hedgetimer(this->io), retrytimer(this->io), ratetimer(this->io) {
+#endif
+	this->response = NULL;
+	this->hedgeprimary = NULL;
+	this->hedgewinner = NULL;
+	this->hedgegeneration = 0;
+	this->hedgerunning = 0;
+	this->hedged = false;
+	this->hedgeresultset = false;
+	this->firstbyte = false;
+	this->retryattempt = 0;
+	this->cancelrequested = false;
+	this->proxyresolver = http_proxy_resolver::getDefault();
+	this->proxyserver = NULL;
+	this->bufferpool = http_buffer_pool::getDefault();
+	this->ratelimiter = http_rate_limiter::getDefault();
+	this->transferlimit[http_rate_limiter::RECEIVE].reset(new http_token_bucket());
+	this->transferlimit[http_rate_limiter::SEND].reset(new http_token_bucket());
+	this->requestsent = 0;
+	this->recvbuffer = NULL;
+	this->recvclass = 0;
+	this->recvsize = 0;
+	this->lastread = 0;
+	this->fullreads = 0;
+	this->shortreads = 0;
+	this->reset();
+	this->postbackio = postback;
+	this->defaultexecutor.reset(new http_executor_postback(postback));
+	this->executor = this->defaultexecutor;
 }
 
 #if BOOST_VERSION > 104700
-http_engine::http_engine(boost::asio::io_service *postback) :
-		io(), socket(this->io), ctx(boost::asio::ssl::context::sslv23), sslsocket(
-				this->io, ctx) {
+http_engine::http_engine(boost::asio::io_service *postback, boost::asio::io_service *mytransport) :
+		io(), transport(*mytransport), strand(*mytransport), resolver(*mytransport), socket(*mytransport), ctx(boost::asio::ssl::context::sslv23), hedgetimer(*mytransport), retrytimer(*mytransport), ratetimer(*mytransport) {
 #else
-	http_engine::http_engine(boost::asio::io_service *postback) : io(), socket(this->io), ctx(this->io, boost::asio::ssl::context::sslv23), sslsocket(this->io, ctx) {
+	http_engine::http_engine(boost::asio::io_service *postback, boost::asio::io_service *mytransport) : io(), transport(*mytransport), strand(*mytransport), resolver(*mytransport), socket(*mytransport), ctx(*mytransport, boost::asio::ssl::context::sslv23), hedgetimer(*mytransport), retrytimer(*mytransport), ratetimer(*mytransport) {
 #endif
-	this->response = new http_response();
+	this->response = NULL;
+	this->hedgeprimary = NULL;
+	this->hedgewinner = NULL;
+	this->hedgegeneration = 0;
+	this->hedgerunning = 0;
+	this->hedged = false;
+	this->hedgeresultset = false;
+	this->firstbyte = false;
+	this->retryattempt = 0;
+	this->cancelrequested = false;
+	this->proxyresolver = http_proxy_resolver::getDefault();
+	this->proxyserver = NULL;
+	this->bufferpool = http_buffer_pool::getDefault();
+	this->ratelimiter = http_rate_limiter::getDefault();
+	this->transferlimit[http_rate_limiter::RECEIVE].reset(new http_token_bucket());
+	this->transferlimit[http_rate_limiter::SEND].reset(new http_token_bucket());
+	this->requestsent = 0;
+	this->recvbuffer = NULL;
+	this->recvclass = 0;
+	this->recvsize = 0;
+	this->lastread = 0;
+	this->fullreads = 0;
+	this->shortreads = 0;
 	this->reset();
 	this->postbackio = postback;
+	this->defaultexecutor.reset(new http_executor_postback(postback));
+	this->executor = this->defaultexecutor;
 }
 
 http_engine::~http_engine() {
+	/* the transfer thread uses this class till its IO Service runs out of work */
+	if (this->transferthread.joinable()) {
+		this->cancel();
+		this->transferthread.join();
+	}
+	for (std::map<std::string, SSL_SESSION *>::iterator session = this->sslsessions.begin(); session != this->sslsessions.end(); ++session)
+		SSL_SESSION_free(session->second);
+	this->release_buffer();
 }
 
 void http_engine::clear() {
@@ -73,8 +138,11 @@ void http_engine::clear() {
 	this->url = "";
 	this->version = "";
 	this->host = "";
+	this->hostname = "";
 	this->arguments.clear();
+	this->body.reset();
 	this->http_proxy = NONE;
+	this->proxyserver = NULL;
 	this->http_type = PLAIN_HTTP;
 }
 
@@ -83,235 +151,202 @@ void http_engine::reset() {
 	this->method = "GET";
 	this->url = "/";
 	this->host = "";
+	this->hostname = "";
 	this->version = "HTTP/1.0";
 	this->arguments.clear();
-	this->response->reset();
+	this->body.reset();
+	if (this->response)
+		this->response->reset();
 	this->http_proxy = NONE;
+	this->proxyserver = NULL;
 	this->http_type = PLAIN_HTTP;
 	this->redirtimes = 0;
+	this->connected = false;
+	this->cancelled = false;
+	this->parser_state = ANETD_VERSION;
+	this->bodyreceived = 0;
+	this->chunkremaining = 0;
+	this->bodysent = 0;
+	this->bodydone = false;
+}
+
+void http_engine::recycle() {
+	/* a engine goes back to its pool once its transfer is done, but the private transfer thread may still be unwinding */
+	if (this->transferthread.joinable())
+		this->transferthread.join();
+	/* the response belongs to the previous user, so it is not reset */
+	this->response = NULL;
+	this->CallbackFunction.clear();
+	this->CompletionFunction.clear();
+	this->executor = this->defaultexecutor;
+	this->hedgepolicy.reset();
+	this->retrypolicy.reset();
+	this->proxyauth.first.clear();
+	this->proxyauth.second.clear();
+	this->proxyresolver = http_proxy_resolver::getDefault();
+	this->sockettuning.reset();
+	this->ratelimiter = http_rate_limiter::getDefault();
+	/* the hedge of the last transfer has stopped by now, but still shares the buckets. Only a bucket something else still holds is replaced */
+	if (this->hedgeengine) {
+		this->hedgeengine->transferlimit[http_rate_limiter::RECEIVE].reset();
+		this->hedgeengine->transferlimit[http_rate_limiter::SEND].reset();
+	}
+	for (int dir = http_rate_limiter::RECEIVE; dir <= http_rate_limiter::SEND; dir++) {
+		if (this->transferlimit[dir].unique())
+			this->transferlimit[dir]->reset();
+		else
+			this->transferlimit[dir].reset(new http_token_bucket());
+	}
+	this->Status = boost::unique_future<http_response *>();
+	this->reset();
 }
 
-size_t http_engine::socksend(std::string data) {
+void http_engine::async_sockwrite(const std::vector<boost::asio::const_buffer> &data, t_ioFunc handler) {
 	switch (this->http_type) {
 	case PLAIN_HTTP:
-		return this->socket.send(
-				boost::asio::buffer(data.c_str(), data.length()));
+		boost::asio::async_write(this->socket, data, this->strand.wrap(handler));
 		break;
 	case SSL_HTTPS:
-		return this->sslsocket.write_some(
-				boost::asio::buffer(data.c_str(), data.length()));
+		boost::asio::async_write(*this->sslsocket, data, this->strand.wrap(handler));
 		break;
 	}
-	return -1;
 }
 
-size_t http_engine::sockget(char *data, size_t size) {
+void http_engine::async_sockread(char *data, size_t size, t_ioFunc handler) {
 	switch (this->http_type) {
 	case PLAIN_HTTP:
-		return this->socket.read_some(boost::asio::buffer(data, size));
+		this->socket.async_read_some(boost::asio::buffer(data, size), this->strand.wrap(handler));
 		break;
-	case SSL_HTTPS: {
-		boost::system::error_code es;
-		size_t retsize;
-		retsize = this->sslsocket.read_some(boost::asio::buffer(data, size),
-				es);
-		if (es.category()
-				== boost::asio::error::get_ssl_category() && es.value() != ERR_PACK(ERR_LIB_SSL, 0, SSL_R_SHORT_READ)) {
-			return retsize;
-		}
-		if (retsize == 0) {
-			throw boost::system::system_error(boost::asio::error::eof);
-		}
-		return retsize;
-	}
+	case SSL_HTTPS:
+		this->sslsocket->async_read_some(boost::asio::buffer(data, size), this->strand.wrap(handler));
 		break;
 	}
-	return -1;
 }
 
-bool http_engine::send() {
+bool http_engine::is_eof(const boost::system::error_code &err) {
+	if (err == boost::asio::error::eof)
+		return true;
+	/* servers that close the connection without a SSL close_notify */
+#if BOOST_VERSION >= 106200
+	if (err == boost::asio::ssl::error::stream_truncated)
+		return true;
+#else
+	if (err.category() == boost::asio::error::get_ssl_category() && err.value() == ERR_PACK(ERR_LIB_SSL, 0, SSL_R_SHORT_READ))
+		return true;
+#endif
+	return false;
+}
+
+void http_engine::start(http_response *myresponse, t_completionFunc handler) {
+	this->response = myresponse;
+	this->CompletionFunction = handler;
+	this->retryattempt = 0;
+	{
+		boost::interprocess::scoped_lock<boost::mutex> lock(this->HLock);
+		this->cancelrequested = false;
+	}
+	if (this->retrypolicy)
+		this->retrypolicy->request();
+	this->begin();
+}
+
+void http_engine::begin() {
+	this->connected = false;
+	this->cancelled = false;
+	this->firstbyte = false;
+	this->starttime = boost::posix_time::microsec_clock::universal_time();
+	{
+		boost::interprocess::scoped_lock<boost::mutex> lock(this->HLock);
+		this->hedgegeneration++;
+		this->hedgewinner = NULL;
+		this->hedgerunning = 1;
+		this->hedged = false;
+		this->hedgeresultset = false;
+	}
+	this->strand.post(boost::bind(&http_engine::async_send, this));
+}
+
+void http_engine::async_send() {
 
-	// Parse the URL.
-	std::vector < std::string > url_parts;
-	std::string myurl(this->response->getURL());
-	boost::regex url_expression(
+	if (this->cancelled)
+		return this->finish(boost::asio::error::operation_aborted);
+	if (this->body && !this->body->isOpen()) {
+		LogError(boost::str(boost::format("Request Body can not be sent: %1%") % this->body->getError().message()));
+		return this->finish(boost::system::errc::make_error_code(boost::system::errc::invalid_argument));
+	}
+
+	// Parse the URL. Everything we only need while setting up the request lives in the transfers arena
+	typedef boost::match_results<const char *, http_arena_allocator<boost::sub_match<const char *> > > t_arena_match;
+	http_arena_allocator<char> alloc(&this->arena);
+	/* compiled once, matching with a const regex is ThreadSafe */
+	static const boost::regex url_expression(
 	// protocol            host               port
 			"^(\?:([^:/\?#]+)://)\?(\\w+[^/\?#:]*)(\?::(\\d+))\?"
 			// path                file       parameters
 					"(/\?(\?:[^\?#/]*/)*)\?([^\?#]*)\?(\\\?(.*))\?");
-	boost::regex_split(std::back_inserter(url_parts), myurl,
-			url_expression);
-	std::string host = url_parts[1];
-	std::string port = url_parts[2];
+	http_arena_string myurl(alloc);
+	myurl.assign(this->response->getURL().c_str());
+	t_arena_match url_parts(alloc);
+	if (!boost::regex_search(myurl.c_str(), myurl.c_str() + myurl.length(), url_parts, url_expression)) {
+		LogError(std::string("Invalid URL: ").append(myurl.c_str()));
+		return this->finish(boost::system::errc::make_error_code(boost::system::errc::invalid_argument));
+	}
+	http_arena_string protocol(url_parts[1].first, url_parts[1].second, alloc);
+	http_arena_string hostname(url_parts[2].first, url_parts[2].second, alloc);
+	http_arena_string host(hostname);
+	http_arena_string port(url_parts[3].first, url_parts[3].second, alloc);
 
-	this->url = url_parts[3] + url_parts[4];
+	this->url.assign(url_parts[4].first, url_parts[4].second).append(url_parts[5].first, url_parts[5].second);
 
 	// Add the 'Host' header to the request. Not doing this is treated as bad request by many servers.
 
 	// Use the empty path if no path is specified.
 	if (this->url.empty())
 		this->url = "/";
-	boost::algorithm::to_lower (url_parts[0]);
-	/* check for Proxy Server */
-	if (url_parts[0] == "http") {
+	boost::algorithm::to_lower (protocol);
+	if (protocol == "http") {
 		this->http_type = PLAIN_HTTP;
 		if (port.empty())
 			port = "80";
-		this->host = url_parts[0] + "://" + url_parts[1] + ":"
-				+ (url_parts[2].empty() ? "80" : url_parts[2]);
-
-		this->targeturl = url_parts[1] + ":" + port;
-
-		this->response->sendheaders["Host"] = host;
-
-		std::string proxy = get_env("http_proxy");
-		if (proxy != "") {
-			std::vector < std::string > proxy_parts;
-			boost::regex proxy_expression(
-			// protocol            host               port
-					"^(\?:([^:/\?#]+)://)\?(\\w+[^/\?#:]*)(\?::(\\d+))\?");
-			boost::regex_split(std::back_inserter(proxy_parts), proxy,
-					proxy_expression);
-			LogDebug(boost::str(boost::format("Connecting Via HTTP Proxy at: %1%://%2%:%3%") % proxy_parts[0] % proxy_parts[1] % proxy_parts[2]));
-			host = proxy_parts[1];
-			port = proxy_parts[2];
-			this->http_proxy = HTTP_PROXY;
-		}
-	} else if (url_parts[0] == "https") {
+	} else if (protocol == "https") {
 		this->http_type = SSL_HTTPS;
 		if (port.empty())
 			port = "443";
-		char *data = new char[1024];
-		this->host = url_parts[0] + "://" + url_parts[1] + ":"
-				+ (url_parts[2].empty() ? "443" : url_parts[2]);
-
-		this->targeturl = url_parts[1] + ":" + port;
-
-		this->response->sendheaders["Host"] = host;
-
-		std::string proxy = get_env("https_proxy");
-		if (proxy != "") {
-			std::vector < std::string > proxy_parts;
-			boost::regex proxy_expression(
-			// protocol            host               port
-					"^(\?:([^:/\?#]+)://)\?(\\w+[^/\?#:]*)(\?::(\\d+))\?");
-			boost::regex_split(std::back_inserter(proxy_parts), proxy,
-					proxy_expression);
-			LogDebug(boost::str(boost::format("Connecting Via HTTPS Proxy at: %1%://%2%:%3%") % proxy_parts[0] % proxy_parts[1] % proxy_parts[2]));
-
-			host = proxy_parts[1];
-			port = proxy_parts[2];
-			this->http_proxy = HTTP_PROXY;
-		}
 	}
+	this->host.assign(protocol.c_str()).append("://").append(hostname.c_str()).append(":").append(port.c_str());
+	this->targeturl.assign(hostname.c_str()).append(":").append(port.c_str());
+	this->hostname.assign(hostname.c_str());
 
-	// Resolve the hostname.
-	boost::asio::io_service io_service;
-	boost::asio::ip::tcp::resolver resolver(io_service);
-	boost::asio::ip::tcp::resolver::query query(boost::asio::ip::tcp::v4(),
-			host, port);
-	boost::asio::ip::tcp::resolver::iterator iterator;
-	try {
-		iterator = resolver.resolve(query);
-	} catch (boost::system::system_error&) {
-		throw connection_exception();
-	}
-
-	// Try to connect to the server using one of the endpoints.
-	bool connected = false;
-	for (iterator; iterator != boost::asio::ip::tcp::resolver::iterator();
-			++iterator) {
-		boost::asio::ip::tcp::endpoint endpoint = iterator->endpoint();
-		try {
-			switch (this->http_type) {
-			case PLAIN_HTTP:
-				this->socket.connect(endpoint);
-				break;
-			case SSL_HTTPS:
-#if BOOST_VERSION > 104700
-				this->sslsocket.set_verify_mode(
-						boost::asio::ssl::context::verify_none);
-				this->sslsocket.set_verify_callback(
-						boost::bind(&http_engine::verify_callback, this, _1,
-								_2));
-#else
-				this->ctx.set_verify_mode(boost::asio::ssl::context::verify_none);
-				//this->sslsocket.set_verify_callback(boost::bind(&http_engine::verify_callback, this, _1, _2));
-#endif
-				this->sslsocket.lowest_layer().connect(endpoint);
-				/* if we are connecting through a proxy.... */
-				if (this->http_proxy == HTTP_PROXY) {
-					/* send our Proxy Headers */
-					std::string proxycmd = "CONNECT " + this->targeturl + " "
-							+ this->version + "\r\n";
-					if (this->proxyauth.first.length() > 0)
-						proxycmd += "Proxy-Authorization: Basic "
-								+ Base64Encode(
-										this->proxyauth.first + ":"
-												+ this->proxyauth.second)
-								+ "\r\n";
-					proxycmd += "\r\n";
-					LogDebug(std::string("Proxy Command: ").append(proxycmd));
-					this->sslsocket.next_layer().send(
-							boost::asio::buffer(proxycmd.c_str(),
-									proxycmd.length()));
-					char *data = new char[1024];
-					while (this->sslsocket.next_layer().read_some(
-							boost::asio::buffer(data, 1024))) {
-						std::string proxyresponse(data);
-						//typedef  split_vector;
-						std::vector < std::string > SplitResponse;
-						boost::is_equal testequal;
-						boost::algorithm::split(SplitResponse, proxyresponse,
-								boost::algorithm::is_space(),
-								boost::algorithm::token_compress_on);
-						//boost::algorithm::split(SplitResponse, proxyresponse, testequal(" "));
-						if (SplitResponse[1] == "200") {
-							break;
-						} else {
-							throw;
-						}
-					}
-				}
-				this->sslsocket.handshake(
-						boost::asio::ssl::stream_base::client);
-
-				break;
-			}
-			connected = true;
-			break;
-		} catch (boost::system::system_error& ec) {
-			LogError(boost::str(boost::format("Error Connecting to %1%: %2%") % this->url % ec.what()));
-		}
+	/* check for Proxy Server. Plain requests are sent to the proxy, https requests are tunneled through it with CONNECT */
+	this->proxyserver = this->proxyresolver->resolve(std::string(protocol.c_str(), protocol.length()), hostname.c_str(), hostname.length());
+	this->http_proxy = NONE;
+	if (this->proxyserver) {
+		LogDebug(boost::str(boost::format("Connecting Via %1% Proxy at: %2%:%3%") % protocol.c_str() % this->proxyserver->host % this->proxyserver->port));
+		host.assign(this->proxyserver->host.c_str(), this->proxyserver->host.length());
+		port.assign(this->proxyserver->port.c_str(), this->proxyserver->port.length());
+		this->http_proxy = (this->http_type == SSL_HTTPS) ? HTTPS_PROXY : HTTP_PROXY;
 	}
-	// Check if the connection is successful.
-	if (!connected)
-		throw connection_exception();
-
-
 
-
-	this->response->headers["Content-Length"] = boost::lexical_cast<std::string>(body.length());
-
-	std::string request;
+	http_arena_string target(alloc);
 	switch (this->http_proxy) {
 	case NONE:
-		request = this->method + ' ' + this->url;
+	case HTTPS_PROXY:
+		/* inside a CONNECT tunnel the request goes to the origin server */
+		target.assign(this->url.c_str(), this->url.length());
 		break;
 	case HTTP_PROXY:
-	case HTTPS_PROXY:
-		request = this->method + ' ' + this->host + this->url;
+		target.assign(this->host.c_str(), this->host.length()).append(this->url.c_str(), this->url.length());
 		break;
 	}
-	if (url_parts[5].length() > 0) {
-	    request += url_parts[5];
+	if (url_parts[6].matched) {
+	    target.append(url_parts[6].first, url_parts[6].second);
 	}
 
 	if (arguments.begin() != arguments.end()) {
-		if (url_parts[5].length() > 0) {
-		    request += '&';
+		if (url_parts[6].matched) {
+		    target += '&';
 		} else {
-    		    request += '?';
+    		    target += '?';
                 }
 
 		bool first = true;
@@ -323,37 +358,328 @@ bool http_engine::send() {
 			for (std::vector<std::string>::iterator value = values.begin();
 					value != values.end(); ++value) {
 				if (!first)
-					request += '&';
+					target += '&';
 				else
 					first = false;
-				request += argument->first + '=' + *value;
+				target.append(argument->first.c_str()).append(1, '=').append(value->c_str());
+			}
+		}
+	}
+	this->request.reset();
+	this->request.setBody(this->body.get());
+	/* chunked uploads need a HTTP/1.1 request line */
+	this->request.setRequestLine(this->method, target.c_str(), target.length(), this->request.isChunked() ? "HTTP/1.1" : this->version);
+	/* the header block only changes with the origin, the proxy mode or the headers/credentials set on the response */
+	char generation[32];
+	snprintf(generation, sizeof(generation), "%ld", this->response->headergeneration);
+	http_arena_string headerkey(alloc);
+	headerkey.append(this->host.c_str(), this->host.length()).append(this->http_proxy == HTTP_PROXY ? "|proxy|" : "|direct|").append(generation);
+	if (!this->request.isCached(headerkey.c_str(), headerkey.length()))
+		this->request.setHeaderBlock(std::string(headerkey.c_str(), headerkey.length()), this->headerblock(std::string(hostname.c_str(), hostname.length())));
+
+	/* idempotent requests that are slow to respond get hedged */
+	if (this->hedgepolicy && !this->hedgeprimary && !this->body && (this->method == "GET" || this->method == "HEAD")) {
+		boost::interprocess::scoped_lock<boost::mutex> lock(this->HLock);
+		if (!this->hedgewinner && !this->hedged) {
+			this->hedgepolicy->request();
+			boost::posix_time::time_duration delay = this->hedgepolicy->getDelay(this->host);
+			if (delay > boost::posix_time::time_duration()) {
+				this->hedgetimer.expires_from_now(delay);
+				this->hedgetimer.async_wait(this->strand.wrap(boost::bind(&http_engine::handle_hedge_timer, this, boost::asio::placeholders::error, this->hedgegeneration)));
 			}
 		}
 	}
-	request += ' ' + this->version + "\r\n";
+
+	this->socketprofile = this->sockettuning ? this->sockettuning->getProfile(std::string(host.c_str(), host.length())) : http_socket_profile();
+
+	// Resolve the hostname.
+	boost::asio::ip::tcp::resolver::query query(boost::asio::ip::tcp::v4(),
+			std::string(host.c_str(), host.length()), std::string(port.c_str(), port.length()));
+	this->resolver.async_resolve(query,
+			this->strand.wrap(boost::bind(&http_engine::handle_resolve, this, boost::asio::placeholders::error, boost::asio::placeholders::iterator)));
+}
+
+std::string http_engine::headerblock(const std::string &hostname) {
+	std::string block;
+	block.reserve(256);
+	block.append("Host: ").append(hostname).append("\r\n");
 	/* send the headers if needed */
 	for (std::map<std::string, std::string>::iterator header =
 			this->response->sendheaders.begin(); header != this->response->sendheaders.end(); ++header)
-		request += header->first + ": " + header->second + "\r\n";
+		block.append(header->first).append(": ").append(header->second).append("\r\n");
 	/* if we have a username, password stored, send that */
 	if (this->response->httpauth.first.length() > 0)
-		request += "Authorization: Basic "
-				+ Base64Encode(
-						this->response->httpauth.first + ":" + this->response->httpauth.second)
-				+ "\r\n";
-	if ((this->http_proxy == HTTP_PROXY)
-			&& (this->proxyauth.first.length() > 0))
-		request += "Proxy-Authorization: Basic "
-				+ Base64Encode(
-						this->proxyauth.first + ":" + this->proxyauth.second)
-				+ "\r\n";
-
-        request += "Accept: */*\r\n";
-        request += "Connection: close\r\n";
-	request += "\r\n\r\n" + this->body;
-	LogDebug(std::string("Sending: ").append(request));
-	this->socksend(request);
-	return this->receive();
+		block.append("Authorization: Basic ").append(
+				Base64Encode(this->response->httpauth.first + ":" + this->response->httpauth.second)).append("\r\n");
+	if (this->http_proxy == HTTP_PROXY)
+		block.append(this->proxyauthorization());
+	block.append("Accept: */*\r\n");
+	block.append("Connection: close\r\n");
+	return block;
+}
+
+std::string http_engine::proxyauthorization() {
+	/* credentials set on the engine win over credentials in the proxy URL */
+	const std::pair<std::string, std::string> &auth = (this->proxyauth.first.length() > 0 || !this->proxyserver) ? this->proxyauth : this->proxyserver->auth;
+	if (auth.first.length() == 0)
+		return std::string();
+	return "Proxy-Authorization: Basic " + Base64Encode(auth.first + ":" + auth.second) + "\r\n";
+}
+
+void http_engine::handle_resolve(const boost::system::error_code &err, boost::asio::ip::tcp::resolver::iterator endpoint) {
+	if (this->cancelled)
+		return this->finish(boost::asio::error::operation_aborted);
+	if (err) {
+		LogError(boost::str(boost::format("Error Resolving %1%: %2%") % this->host % err.message()));
+		return this->finish(err);
+	}
+	this->handle_connect(boost::asio::error::host_not_found, endpoint);
+}
+
+void http_engine::handle_connect(const boost::system::error_code &err, boost::asio::ip::tcp::resolver::iterator endpoint) {
+	if (this->cancelled)
+		return this->finish(boost::asio::error::operation_aborted);
+	if (!err) {
+		this->connected = true;
+		switch (this->http_type) {
+		case PLAIN_HTTP:
+			return this->send_request();
+		case SSL_HTTPS:
+			/* if we are connecting through a proxy.... */
+			if (this->http_proxy == HTTPS_PROXY) {
+				/* send our Proxy Headers */
+				this->proxycmd = "CONNECT " + this->targeturl + " "
+						+ this->version + "\r\n";
+				this->proxycmd += "Host: " + this->targeturl + "\r\n";
+				this->proxycmd += this->proxyauthorization();
+				this->proxycmd += "\r\n";
+				LogDebug(std::string("Proxy Command: ").append(this->proxycmd));
+				boost::asio::async_write(this->sslsocket->next_layer(), boost::asio::buffer(this->proxycmd),
+						this->strand.wrap(boost::bind(&http_engine::handle_proxy_connect, this, boost::asio::placeholders::error)));
+				return;
+			}
+			this->handle_proxy_response(boost::system::error_code());
+			return;
+		}
+	}
+	// Try to connect to the server using the next endpoint.
+	if (endpoint == boost::asio::ip::tcp::resolver::iterator()) {
+		// none of the endpoints accepted the connection
+		return this->finish(err);
+	}
+	boost::asio::ip::tcp::endpoint myendpoint = endpoint->endpoint();
+	++endpoint;
+	switch (this->http_type) {
+	case PLAIN_HTTP:
+		if (this->socket.is_open()) {
+			boost::system::error_code ec;
+			this->socket.close(ec);
+		}
+		this->tune_socket(this->socket, myendpoint);
+		this->socket.async_connect(myendpoint,
+				this->strand.wrap(boost::bind(&http_engine::handle_connect, this, boost::asio::placeholders::error, endpoint)));
+		break;
+	case SSL_HTTPS:
+		/* a SSL stream can not be reused once it has been used for a handshake, so every connection gets a new one */
+		this->sslsocket.reset(new boost::asio::ssl::stream<boost::asio::ip::tcp::socket>(this->transport, this->ctx));
+#if BOOST_VERSION > 104700
+		this->sslsocket->set_verify_mode(
+				boost::asio::ssl::context::verify_none);
+		this->sslsocket->set_verify_callback(
+				boost::bind(&http_engine::verify_callback, this, _1,
+						_2));
+#else
+		this->ctx.set_verify_mode(boost::asio::ssl::context::verify_none);
+		//this->sslsocket->set_verify_callback(boost::bind(&http_engine::verify_callback, this, _1, _2));
+#endif
+		this->tune_socket(this->sslsocket->next_layer(), myendpoint);
+		this->sslsocket->lowest_layer().async_connect(myendpoint,
+				this->strand.wrap(boost::bind(&http_engine::handle_connect, this, boost::asio::placeholders::error, endpoint)));
+		break;
+	}
+	if (err != boost::asio::error::host_not_found)
+		LogError(boost::str(boost::format("Error Connecting to %1%: %2%") % this->url % err.message()));
+}
+
+void http_engine::tune_socket(boost::asio::ip::tcp::socket &mysocket, const boost::asio::ip::tcp::endpoint &myendpoint) {
+	/* the socket is opened before connecting, so the options that affect the handshake can be set */
+	boost::system::error_code ec;
+	mysocket.open(myendpoint.protocol(), ec);
+	if (!ec)
+		this->socketprofile.apply(mysocket);
+}
+
+void http_engine::handle_proxy_connect(const boost::system::error_code &err) {
+	if (err || this->cancelled)
+		return this->finish(err ? err : boost::asio::error::operation_aborted);
+	this->proxyresponse.consume(this->proxyresponse.size());
+	boost::asio::async_read_until(this->sslsocket->next_layer(), this->proxyresponse, "\r\n\r\n",
+			this->strand.wrap(boost::bind(&http_engine::handle_proxy_response, this, boost::asio::placeholders::error)));
+}
+
+void http_engine::handle_proxy_response(const boost::system::error_code &err) {
+	if (err || this->cancelled)
+		return this->finish(err ? err : boost::asio::error::operation_aborted);
+	if (this->http_proxy == HTTPS_PROXY) {
+		std::istream proxystream(&this->proxyresponse);
+		std::string proxyversion;
+		std::string proxystatus;
+		proxystream >> proxyversion >> proxystatus;
+		if (proxystatus != "200") {
+			LogError(boost::str(boost::format("Proxy Refused CONNECT to %1%: %2%") % this->targeturl % proxystatus));
+			return this->finish(boost::asio::error::connection_refused);
+		}
+	}
+#if BOOST_VERSION > 104700
+	/* resume the TLS session of the last connection to the same server, which saves a round trip and the key exchange */
+	std::map<std::string, SSL_SESSION *>::iterator session = this->sslsessions.find(this->targeturl);
+	if (session != this->sslsessions.end())
+		SSL_set_session(this->sslsocket->native_handle(), session->second);
+#endif
+	this->sslsocket->async_handshake(boost::asio::ssl::stream_base::client,
+			this->strand.wrap(boost::bind(&http_engine::handle_handshake, this, boost::asio::placeholders::error)));
+}
+
+void http_engine::handle_handshake(const boost::system::error_code &err) {
+	if (this->cancelled)
+		return this->finish(boost::asio::error::operation_aborted);
+	if (err) {
+		LogError(boost::str(boost::format("Error Connecting to %1%: %2%") % this->url % err.message()));
+		return this->finish(err);
+	}
+	this->send_request();
+}
+
+void http_engine::send_request() {
+	LogDebug(std::string("Sending: ").append(this->request.getRequestLine()).append(this->request.getHeaderBlock()));
+	this->requestsent = 0;
+	this->write_request();
+}
+
+void http_engine::write_request() {
+	size_t size = this->request.size() - this->requestsent;
+	if (!this->throttle(http_rate_limiter::SEND, size, boost::bind(&http_engine::write_request, this)))
+		return;
+	std::vector<boost::asio::const_buffer> bufs = this->request.buffers();
+	if (this->requestsent > 0 || size < this->request.size()) {
+		/* a limited transfer sends the request (and a body held in memory) in pieces */
+		std::vector<boost::asio::const_buffer> piece;
+		size_t skip = this->requestsent;
+		for (std::vector<boost::asio::const_buffer>::iterator buf = bufs.begin(); buf != bufs.end() && size > 0; ++buf) {
+			size_t len = boost::asio::buffer_size(*buf);
+			if (skip >= len) {
+				skip -= len;
+				continue;
+			}
+			boost::asio::const_buffer part = *buf + skip;
+			skip = 0;
+			piece.push_back(boost::asio::buffer(part, size));
+			size -= std::min(size, boost::asio::buffer_size(part));
+		}
+		bufs.swap(piece);
+	}
+	this->async_sockwrite(bufs,
+			boost::bind(&http_engine::handle_write_request, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+}
+
+void http_engine::handle_write_request(const boost::system::error_code &err, size_t len) {
+	if (err || this->cancelled)
+		return this->finish(err ? err : boost::asio::error::operation_aborted);
+	this->account(http_rate_limiter::SEND, len);
+	this->requestsent += len;
+	if (this->requestsent < this->request.size())
+		return this->write_request();
+	if (this->request.isStreamed()) {
+		this->bodydone = false;
+		this->bodysent = 0;
+		return this->send_body();
+	}
+	this->start_read();
+}
+
+void http_engine::send_body() {
+#ifdef __linux__
+	/* plain connections can send file bodies straight from the page cache */
+	if (this->http_type == PLAIN_HTTP && this->body->fd() >= 0 && !this->request.isChunked()) {
+		if (!this->socket.non_blocking())
+			this->socket.non_blocking(true);
+		boost::uint64_t remaining = this->body->size() - this->bodysent;
+		while (remaining > 0) {
+			size_t size = std::min<boost::uint64_t>(remaining, 0x7ffff000);
+			if (!this->throttle(http_rate_limiter::SEND, size, boost::bind(&http_engine::send_body, this)))
+				return;
+			ssize_t len = ::sendfile(this->socket.native_handle(), this->body->fd(), NULL, size);
+			if (len < 0) {
+				if (errno == EINTR)
+					continue;
+				if (errno == EAGAIN || errno == EWOULDBLOCK) {
+					/* wait till the socket can take more */
+					this->socket.async_write_some(boost::asio::null_buffers(),
+							this->strand.wrap(boost::bind(&http_engine::handle_write_body, this, boost::asio::placeholders::error, 0)));
+					return;
+				}
+				return this->finish(boost::system::error_code(errno, boost::system::system_category()));
+			}
+			if (len == 0)
+				return this->body_ended(remaining);
+			remaining -= len;
+			this->bodysent += len;
+			this->account(http_rate_limiter::SEND, len);
+		}
+		return this->start_read();
+	}
+#endif
+	if (this->bodydone)
+		return this->start_read();
+	size_t size = 65536;
+	/* never send more than the Content-Length we announced */
+	if (!this->request.isChunked())
+		size = std::min<boost::uint64_t>(size, this->body->size() - this->bodysent);
+	if (size > 0 && !this->throttle(http_rate_limiter::SEND, size, boost::bind(&http_engine::send_body, this)))
+		return;
+	this->sendbuffer.resize(65536);
+	size_t len = size > 0 ? this->body->read(&this->sendbuffer[0], size) : 0;
+	this->bodysent += len;
+	std::vector<boost::asio::const_buffer> bufs;
+	if (len == 0) {
+		this->bodydone = true;
+		if (!this->request.isChunked()) {
+			if (this->bodysent < this->body->size())
+				return this->body_ended(this->body->size() - this->bodysent);
+			return this->start_read();
+		}
+		/* the last chunk tells the server the body is complete, which it is not if the body could not be read */
+		boost::system::error_code err = this->body->getError();
+		if (err) {
+			LogError(boost::str(boost::format("Request Body could not be read: %1%") % err.message()));
+			return this->finish(err);
+		}
+		bufs.push_back(boost::asio::buffer("0\r\n\r\n", 5));
+	} else {
+		if (this->request.isChunked()) {
+			this->chunkheader = boost::str(boost::format("%x\r\n") % len);
+			bufs.push_back(boost::asio::buffer(this->chunkheader));
+		}
+		bufs.push_back(boost::asio::buffer(&this->sendbuffer[0], len));
+		if (this->request.isChunked())
+			bufs.push_back(boost::asio::buffer("\r\n", 2));
+	}
+	this->async_sockwrite(bufs,
+			boost::bind(&http_engine::handle_write_body, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+}
+
+void http_engine::body_ended(boost::uint64_t remaining) {
+	/* the server is waiting for the rest of the Content-Length, and would never answer */
+	boost::system::error_code err = this->body->getError();
+	LogError(boost::str(boost::format("Request Body ended %1% bytes early%2%") % remaining % (err ? ": " + err.message() : std::string())));
+	this->finish(err ? err : boost::system::errc::make_error_code(boost::system::errc::io_error));
+}
+
+void http_engine::handle_write_body(const boost::system::error_code &err, size_t len) {
+	if (err || this->cancelled)
+		return this->finish(err ? err : boost::asio::error::operation_aborted);
+	this->account(http_rate_limiter::SEND, len);
+	this->send_body();
 }
 
 #if BOOST_VERSION > 104700
@@ -368,164 +694,433 @@ bool http_engine::verify_callback(bool preverified,
 
 }
 #endif
-bool http_engine::receive() {
-
-	http_response_parser_state parser_state = ANETD_VERSION;
-
-	size_t buffer_size = 2048;
-	char* buffer = new char[buffer_size];
-	std::string version = "";
-	int status;
-	std::string description = "";
-	std::map<std::string, std::string> tempheaders;
-	std::string temp;
-	std::string tempkey;
-	std::string tempvalue;
-	std::string Location;
-
-	try {
-		do {
-			int bytes_read = this->sockget(buffer, buffer_size);
-			char* position = buffer;
-			do {
-				switch (parser_state) {
-				case ANETD_VERSION:
-					if (*position != ' ')
-						version += *position++;
-					else {
-						position++;
-						parser_state = ANETD_STATUS;
-						temp = "";
-					}
-					break;
-				case ANETD_STATUS:
-					if (*position != ' ')
-						temp += *position++;
-					else {
-						status = boost::lexical_cast<int>(temp);
-						position++;
-						parser_state = ANETD_DESCRIPTION;
-					}
-					break;
-				case ANETD_DESCRIPTION:
-					if (*position == '\r')
-						position++;
-					else if (*position != '\n')
-						description += *position++;
-					else {
-						position++;
-						parser_state = ANETD_HEADER_KEY;
-					}
+
+void http_engine::start_read() {
+	bool lost = false;
+	this->parser_state = ANETD_VERSION;
+	this->rversion = "";
+	this->rstatus = 0;
+	this->rdescription = "";
+	this->temp = "";
+	{
+		/* headers are parsed straight into the responses header table. Once the other request of a hedged pair has claimed the
+		 * response it is not ours to clear */
+		http_engine *primary = this->hedgeprimary ? this->hedgeprimary : this;
+		boost::interprocess::scoped_lock<boost::mutex> lock(primary->HLock);
+		if (primary->hedgewinner && primary->hedgewinner != this)
+			lost = true;
+		else {
+			this->response->headers.clear();
+			this->response->headermapstale = true;
+		}
+	}
+	if (lost)
+		return this->finish(boost::asio::error::operation_aborted);
+	this->bodyreceived = 0;
+	this->chunkremaining = 0;
+	/* a redirect keeps the buffer the previous response grew to */
+	if (!this->recvbuffer) {
+		this->recvclass = 0;
+		this->recvsize = http_buffer_pool::classSize(this->recvclass);
+		this->recvbuffer = this->bufferpool->acquire(this->recvclass);
+		this->fullreads = 0;
+		this->shortreads = 0;
+	}
+	this->throttled_read();
+}
+
+void http_engine::throttled_read() {
+	/* a limited transfer reads no more than its tokens, and leaves the rest in the socket, which slows the server down */
+	size_t size = this->recvsize;
+	if (!this->throttle(http_rate_limiter::RECEIVE, size, boost::bind(&http_engine::throttled_read, this)))
+		return;
+	this->async_sockread(this->recvbuffer, size,
+			boost::bind(&http_engine::handle_read, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+}
+
+bool http_engine::throttle(http_rate_limiter::direction dir, size_t &size, http_response::t_resumeFunc next) {
+	/* reads and writes are not made smaller than this, so a slow transfer does not turn into lots of tiny system calls */
+	size_t need = std::min(size, static_cast<size_t>(4096));
+	boost::posix_time::time_duration transferwait, sharedwait;
+	size_t allowed = this->transferlimit[dir]->available(need, transferwait);
+	size_t shared = this->ratelimiter->available(this->hostname, dir, need, sharedwait);
+	if (allowed > 0 && shared > 0) {
+		size = std::min(size, std::min(allowed, shared));
+		return true;
+	}
+	boost::posix_time::time_duration wait = allowed == 0 ? transferwait : sharedwait;
+	if (allowed == 0 && shared == 0 && sharedwait > wait)
+		wait = sharedwait;
+	this->ratetimer.expires_from_now(wait);
+	this->ratetimer.async_wait(this->strand.wrap(boost::bind(&http_engine::handle_rate_timer, this, boost::asio::placeholders::error, next)));
+	return false;
+}
+
+void http_engine::handle_rate_timer(const boost::system::error_code &err, http_response::t_resumeFunc next) {
+	if (err || this->cancelled)
+		return this->finish(boost::asio::error::operation_aborted);
+	next();
+}
+
+void http_engine::account(http_rate_limiter::direction dir, size_t bytes) {
+	if (bytes == 0)
+		return;
+	this->transferlimit[dir]->consume(bytes);
+	this->ratelimiter->consume(this->hostname, dir, bytes);
+}
+
+void http_engine::handle_read(const boost::system::error_code &err, size_t len) {
+	if (this->cancelled)
+		return this->finish(boost::asio::error::operation_aborted);
+	if (!err && len > 0 && !this->firstbyte) {
+		this->firstbyte = true;
+		/* the other request of a hedged pair got here first */
+		if (!this->hedge_claim())
+			return this->finish(boost::asio::error::operation_aborted);
+	}
+	if (err) {
+		if (this->is_eof(err)) {
+			/* a chunked body ends with a empty chunk, so a close before it means the body was cut short */
+			if (this->parser_state >= ANETD_CHUNK_SIZE && this->parser_state <= ANETD_CHUNK_TRAILER)
+				return this->finish(err);
+			/* neither is a close before the headers ended. Before the first byte the response of a hedged pair may also belong
+			 * to the other request */
+			if (!this->firstbyte || this->parser_state < ANETD_BODY)
+				return this->finish(err);
+			/* and a close before the Content-Length */
+			size_t bodysize = this->response->getBodySize();
+			if (bodysize > 0 && this->bodyreceived < bodysize) {
+				LogError(boost::str(boost::format("Connection closed after %1% bytes of a %2% byte Body") % this->bodyreceived % bodysize));
+				return this->finish(err);
+			}
+			this->response->setBodySize(this->bodyreceived);
+			boost::system::error_code result = this->response->complete_body();
+			if (result)
+				return this->finish(result);
+			return this->wait_response(boost::bind(&http_engine::body_done, this));
+		}
+		return this->finish(err);
+	}
+	this->account(http_rate_limiter::RECEIVE, len);
+	if (this->socketprofile.quickack)
+		this->socketprofile.applyQuickAck(this->http_type == SSL_HTTPS ? this->sslsocket->next_layer() : this->socket);
+	this->lastread = len;
+	switch (this->parse(this->recvbuffer, len)) {
+	case PARSE_MORE:
+		this->wait_response(boost::bind(&http_engine::read_more, this));
+		break;
+	case PARSE_REDIRECT:
+		this->disconnect();
+		this->async_send();
+		break;
+	case PARSE_DONE:
+		this->wait_response(boost::bind(&http_engine::body_done, this));
+		break;
+	case PARSE_FAILED:
+		this->finish(this->bodyresult);
+		break;
+	}
+}
+
+void http_engine::read_more() {
+	if (this->cancelled)
+		return this->finish(boost::asio::error::operation_aborted);
+	/* a response that processes the body asynchronously can fail while we wait for it */
+	boost::system::error_code failed = this->response->failure();
+	if (failed)
+		return this->finish(failed);
+	this->size_buffer();
+	this->throttled_read();
+}
+
+void http_engine::body_done() {
+	this->finish(this->response->failure());
+}
+
+void http_engine::size_buffer() {
+	/* reads that keep filling the buffer mean more data is waiting in the socket, so the buffer doubles to take it in fewer reads. A
+	 * response that trickles in gets a smaller buffer back, so idle streams do not hold on to large buffers */
+	unsigned int sizeclass = this->recvclass;
+	if (this->lastread == this->recvsize) {
+		this->shortreads = 0;
+		if (++this->fullreads >= 2 && sizeclass < http_buffer_pool::CLASSES - 1)
+			sizeclass++;
+	} else if (this->lastread < this->recvsize / 8) {
+		this->fullreads = 0;
+		if (++this->shortreads >= 4 && sizeclass > 0)
+			sizeclass--;
+	} else {
+		this->fullreads = 0;
+		this->shortreads = 0;
+	}
+	if (sizeclass == this->recvclass)
+		return;
+	this->bufferpool->release(this->recvbuffer, this->recvclass);
+	this->recvclass = sizeclass;
+	this->recvsize = http_buffer_pool::classSize(sizeclass);
+	this->recvbuffer = this->bufferpool->acquire(sizeclass);
+	this->fullreads = 0;
+	this->shortreads = 0;
+}
+
+void http_engine::release_buffer() {
+	if (!this->recvbuffer)
+		return;
+	this->bufferpool->release(this->recvbuffer, this->recvclass);
+	this->recvbuffer = NULL;
+}
+
+void http_engine::wait_response(http_response::t_resumeFunc next) {
+	/* a response that processes the body asynchronously can hold the transfer (and so the socket) till it catches up. There
+	 * is no outstanding operation while we wait, so keep the transport IO Service from running out of work */
+	boost::shared_ptr<boost::asio::io_service::work> work(new boost::asio::io_service::work(this->transport));
+	if (this->response->ready(boost::bind(&http_engine::resume, this, next, work)))
+		next();
+}
+
+void http_engine::resume(http_response::t_resumeFunc next, boost::shared_ptr<boost::asio::io_service::work>) {
+	this->strand.post(next);
+}
+
+http_engine::parse_result http_engine::parse(const char *buffer, size_t bytes_read) {
+	const char *position = buffer;
+	const char *end = buffer + bytes_read;
+	while (position < end) {
+		switch (this->parser_state) {
+		case ANETD_VERSION:
+			if (*position != ' ')
+				this->rversion += *position++;
+			else {
+				position++;
+				this->parser_state = ANETD_STATUS;
+				this->temp = "";
+			}
+			break;
+		case ANETD_STATUS:
+			if (*position != ' ')
+				this->temp += *position++;
+			else {
+				this->rstatus = boost::lexical_cast<int>(this->temp);
+				position++;
+				this->parser_state = ANETD_DESCRIPTION;
+			}
+			break;
+		case ANETD_DESCRIPTION:
+			if (*position == '\r')
+				position++;
+			else if (*position != '\n')
+				this->rdescription += *position++;
+			else {
+				position++;
+				this->parser_state = ANETD_HEADER_KEY;
+			}
+			break;
+		case ANETD_HEADER_KEY:
+			if (*position == '\r')
+				position++;
+			else if (*position == '\n') {
+				position++;
+				if (this->response->headers.isParsing()) {
+					/* a header line without a ':' */
+					this->response->headers.discard();
 					break;
-				case ANETD_HEADER_KEY:
-					if (*position == '\r')
-						position++;
-					else if (*position == '\n') {
-						position++;
-						if (!this->parse_status(status)) {
-							LogDebug(boost::str(boost::format("Server Returned Fatal Status Code: %1%") % status));
-							this->response->setStatus(status);
-							this->response->setDescription(description);
-							this->response->completed();
-							return false;
-						}
-						/* if Status is in the 300 range... its a redirect */
-						if (status >= 300 && status < 400) {
-								/* Redirect Limit */
-								if (this->redirtimes++ > 5) {
-									this->disconnect();
-									LogFatal(boost::str(boost::format("Redirection Failure. Redirected too many times: %1%") % this->redirtimes));
-									this->response->setStatus(status);
-									this->response->setDescription(description);
-									this->response->completed();
-									return false;
-								}
-							    std::map<std::string, std::string>::iterator iter = tempheaders.find("Location");
-							    if (iter != tempheaders.end()) {
-							    	url = iter->second;
-
-									LogDebug(boost::str(boost::format("Redirecting (%1%) to %2%") % status % url));
-									this->response->setURL(url);
-									this->disconnect();
-									return true;
-								} else {
-									LogFatal(boost::str(boost::format("Redirection Failure ( %1% ). No Location Specified") % status));
-									this->response->setStatus(status);
-									this->response->setDescription(description);
-									this->response->completed();
-									return false;
-								}
-						}
-						/* if we get here, setup the the response object */
-						this->response->setVersion(version);
+				}
+				parse_result result = this->parse_headers();
+				if (result != PARSE_MORE)
+					return result;
+			} else {
+				/* hand the name to the header table in one piece, up to the ':' or the end of the buffer */
+				const char *start = position;
+				while (position < end && *position != ':' && *position != '\r' && *position != '\n')
+					position++;
+				this->response->headers.appendName(start, position - start);
+				if (position < end && *position == ':') {
+					position++;
+					this->parser_state = ANETD_HEADER_VALUE;
+				}
+			}
+			break;
+		case ANETD_HEADER_VALUE: {
+			const char *start = position;
+			while (position < end && *position != '\r' && *position != '\n')
+				position++;
+			this->response->headers.appendValue(start, position - start);
+			if (position < end) {
+				if (*position++ == '\n') {
+					http_headers &headers = this->response->headers;
+					headers.commit();
+					LogDebug(boost::str(boost::format(" Header key: %1% value: %2%") % headers.getName(headers.size() - 1) % headers.getValue(headers.size() - 1)));
+					this->parser_state = ANETD_HEADER_KEY;
+				}
+			}
+			break;
+		}
+		case ANETD_BODY: {
+			/* hand the rest of the buffer (up to Content-Length) to the response in one go */
+			size_t len = end - position;
+			size_t bodysize = this->response->getBodySize();
+			if (bodysize > 0 && len > bodysize - this->bodyreceived)
+				len = bodysize - this->bodyreceived;
+			this->response->receive(position, len);
+			position += len;
+			this->bodyreceived += len;
+			if (bodysize > 0 && this->bodyreceived == bodysize)
+				this->parser_state = ANETD_OK;
+			break;
+		}
+		case ANETD_CHUNK_SIZE:
+			/* the size in hex, maybe followed by extensions we ignore */
+			if (*position == '\r') {
+				position++;
+			} else if (*position != '\n') {
+				this->temp += *position++;
+			} else {
+				position++;
+				std::string size = boost::algorithm::trim_copy(this->temp.substr(0, this->temp.find(';')));
+				char *last = NULL;
+				bool valid = !size.empty() && isxdigit(static_cast<unsigned char>(size[0]));
+				this->chunkremaining = valid ? strtoul(size.c_str(), &last, 16) : 0;
+				if (!valid || *last != '\0') {
+					LogError(boost::str(boost::format("Invalid Chunk Size: %1%") % this->temp));
+					this->response->flush();
+					this->bodyresult = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+					return PARSE_FAILED;
+				}
+				this->temp = "";
+				this->parser_state = this->chunkremaining > 0 ? ANETD_CHUNK_DATA : ANETD_CHUNK_TRAILER;
+			}
+			break;
+		case ANETD_CHUNK_DATA: {
+			size_t len = std::min(static_cast<size_t>(end - position), this->chunkremaining);
+			this->response->receive(position, len);
+			position += len;
+			this->bodyreceived += len;
+			this->chunkremaining -= len;
+			if (this->chunkremaining == 0)
+				this->parser_state = ANETD_CHUNK_END;
+			break;
+		}
+		case ANETD_CHUNK_END:
+			/* the CRLF after the data of a chunk */
+			if (*position == '\r') {
+				position++;
+			} else if (*position++ == '\n') {
+				this->parser_state = ANETD_CHUNK_SIZE;
+			} else {
+				LogError("Chunk not terminated by a CRLF");
+				this->response->flush();
+				this->bodyresult = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+				return PARSE_FAILED;
+			}
+			break;
+		case ANETD_CHUNK_TRAILER:
+			/* trailer fields are skipped, the body ends at the empty line */
+			if (*position == '\r') {
+				position++;
+			} else if (*position != '\n') {
+				this->temp += *position++;
+			} else {
+				position++;
+				if (this->temp.empty()) {
+					this->response->setBodySize(this->bodyreceived);
+					this->parser_state = ANETD_OK;
+				}
+				this->temp = "";
+			}
+			break;
+		case ANETD_OK:
+			position = end;
+			break;
+		}
+	}
+	this->response->flush();
+	/* a response that could not take the body, eg because the disk is full, fails the transfer */
+	this->bodyresult = this->response->failure();
+	if (this->bodyresult)
+		return PARSE_FAILED;
+	if (this->parser_state == ANETD_OK) {
+		this->bodyresult = this->response->complete_body();
+		return this->bodyresult ? PARSE_FAILED : PARSE_DONE;
+	}
+	return PARSE_MORE;
+}
+
+http_engine::parse_result http_engine::parse_headers() {
+	int status = this->rstatus;
+	if (!this->parse_status(status)) {
+		LogDebug(boost::str(boost::format("Server Returned Fatal Status Code: %1%") % status));
+		this->response->setStatus(status);
+		this->response->setDescription(this->rdescription);
+		this->response->onHeaders();
+		this->response->completed();
+		return PARSE_DONE;
+	}
+	/* if Status is in the 300 range... its a redirect */
+	if (status >= 300 && status < 400) {
+			/* Redirect Limit */
+			if (this->redirtimes++ > 5) {
+				this->disconnect();
+				LogFatal(boost::str(boost::format("Redirection Failure. Redirected too many times: %1%") % this->redirtimes));
+				this->response->setStatus(status);
+				this->response->setDescription(this->rdescription);
+				this->response->onHeaders();
+				this->response->completed();
+				return PARSE_DONE;
+			}
+		    if (this->response->headers.get(http_headers::Location, url)) {
+				/* 307/308 resend the same request, the others turn it into a GET without a body */
+				if (status == 307 || status == 308) {
+					if (this->body && !this->body->rewind()) {
+						LogFatal(boost::str(boost::format("Redirection Failure ( %1% ). Request Body can not be resent") % status));
 						this->response->setStatus(status);
-						this->response->setDescription(description);
-						/* send the headers if needed */
-						for (std::map<std::string, std::string>::iterator headersiter =
-								tempheaders.begin(); headersiter != tempheaders.end(); ++headersiter) {
-							this->response->setHeaders(headersiter->first, headersiter->second);
-							if (headersiter->first == "Content-Length") {
-								this->response->setBodySize(boost::lexical_cast<int>(headersiter->second));
-							}
-						}
-					    std::map<std::string, std::string>::iterator iter = tempheaders.find("Content-Length");
-					    if (iter != tempheaders.end()) {
-					    	parser_state = 	(this->response->getBodySize() == 0) ? ANETD_OK : ANETD_BODY;
-					    } else {
-					    	this->response->setBodySize(0);
-					    	parser_state = ANETD_BODY;
-					    }
-					} else if (*position == ':')
-						position++;
-					else if (*position != ' ')
-						tempkey += *position++;
-					else {
-						position++;
-						tempvalue = "";
-						parser_state = ANETD_HEADER_VALUE;
-					}
-					break;
-				case ANETD_HEADER_VALUE:
-					if (*position == '\r')
-						position++;
-					else if (*position != '\n')
-						tempvalue += *position++;
-					else {
-						position++;
-						LogDebug(boost::str(boost::format(" Header key: %1% value: %2%") % tempkey % tempvalue));
-						tempheaders.insert(std::pair<std::string, std::string>(tempkey, tempvalue));
-						tempkey = "";
-						parser_state = ANETD_HEADER_KEY;
+						this->response->setDescription(this->rdescription);
+						this->response->onHeaders();
+						this->response->completed();
+						return PARSE_DONE;
 					}
-					break;
-				case ANETD_BODY:
-					/* Ok, parse the status */
-					this->response->setBody(*position++);
-					if (this->response->getBody().length()
-							== this->response->getBodySize())
-						parser_state = ANETD_OK;
-					break;
-				case ANETD_OK:
-					position = buffer + bytes_read;
-					break;
+				} else if (this->method != "HEAD") {
+					this->method = "GET";
+					this->body.reset();
 				}
-			} while (position < buffer + bytes_read);
-			this->response->flush();
-		} while (parser_state != ANETD_OK);
-		this->response->completed();
-	} catch (boost::system::system_error& e) {
-		if (e.code() == boost::asio::error::eof) {
-			this->response->setBodySize(this->response->getBody().length());
-		} else {
-			delete buffer;
-			throw;
+
+				LogDebug(boost::str(boost::format("Redirecting (%1%) to %2%") % status % url));
+				this->response->setURL(url);
+				return PARSE_REDIRECT;
+			} else {
+				LogFatal(boost::str(boost::format("Redirection Failure ( %1% ). No Location Specified") % status));
+				this->response->setStatus(status);
+				this->response->setDescription(this->rdescription);
+				this->response->onHeaders();
+				this->response->completed();
+				return PARSE_DONE;
+			}
+	}
+	/* if we get here, setup the the response object */
+	this->response->setVersion(this->rversion);
+	this->response->setStatus(status);
+	this->response->setDescription(this->rdescription);
+	const char *length;
+	size_t len;
+	this->parser_state = ANETD_BODY;
+	this->response->setBodySize(0);
+	std::string encoding;
+	if (this->response->headers.get(http_headers::Transfer_Encoding, encoding)
+			&& boost::algorithm::iends_with(boost::algorithm::trim_copy(encoding), "chunked")) {
+		/* a HTTP/1.1 server can send any response to our chunked uploads chunked. The Content-Length, if any, does not count */
+		this->parser_state = ANETD_CHUNK_SIZE;
+		this->temp = "";
+	} else if (this->response->headers.find(http_headers::Content_Length, length, len)) {
+		try {
+			this->response->setBodySize(boost::lexical_cast<size_t>(length, len));
+			if (this->response->getBodySize() == 0)
+				this->parser_state = ANETD_OK;
+		} catch (boost::bad_lexical_cast &) {
+			/* read the body till the server closes the connection */
+			LogWarn(boost::str(boost::format("Invalid Content-Length: %1%") % std::string(length, len)));
 		}
-	} catch (...) {
-		delete buffer;
-		throw;
 	}
-	delete buffer;
-	return false;
+	this->response->onHeaders();
+	return PARSE_MORE;
 }
 
 bool http_engine::parse_status(int status) {
@@ -538,10 +1133,9 @@ bool http_engine::parse_status(int status) {
 	} else if (status >= 400 && status < 500) {
 		/* some sort of client error */
 		return false;
-	} else if (status >= 500) {
-		/* a server error */
-		return false;
 	}
+	/* a server error */
+	return false;
 }
 
 
@@ -558,16 +1152,11 @@ void http_engine::disconnect() {
 		}
 		break;
 	case SSL_HTTPS:
-		if (this->sslsocket.lowest_layer().is_open()) {
+		/* the response is delimited by Content-Length or the server closing the connection, so we do not
+		 * wait for a SSL close_notify here, as that would block the transport thread */
+		if (this->sslsocket && this->sslsocket->lowest_layer().is_open()) {
 			try {
-				boost::system::error_code se;
-				if (this->sslsocket.shutdown(se)) {
-					if (se.category()
-							== boost::asio::error::get_ssl_category() && se.value() != ERR_PACK(ERR_LIB_SSL, 0, SSL_R_SHORT_READ)) {
-						throw se;
-					}
-				}
-				this->sslsocket.lowest_layer().close();
+				this->sslsocket->lowest_layer().close();
 			} catch (boost::system::system_error& ec) {
 				LogWarn(boost::str(boost::format("Shutdown error: %1%") % ec.what()));
 
@@ -577,72 +1166,268 @@ void http_engine::disconnect() {
 	}
 }
 
-http_response *http_engine::connect() {
+void http_engine::save_session() {
+#if BOOST_VERSION > 104700
+	if (this->http_type != SSL_HTTPS || !this->sslsocket || !SSL_is_init_finished(this->sslsocket->native_handle()))
+		return;
+	/* the connection is closed without a close_notify, which would otherwise mark the session as not resumable */
+	SSL_set_shutdown(this->sslsocket->native_handle(), SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+	SSL_SESSION *session = SSL_get1_session(this->sslsocket->native_handle());
+	if (!session)
+		return;
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+	if (!SSL_SESSION_is_resumable(session)) {
+		SSL_SESSION_free(session);
+		return;
+	}
+#endif
+	std::map<std::string, SSL_SESSION *>::iterator old = this->sslsessions.find(this->targeturl);
+	if (old != this->sslsessions.end()) {
+		SSL_SESSION_free(old->second);
+		old->second = session;
+		return;
+	}
+	/* a engine talks to a handful of servers, so a small cache is enough */
+	if (this->sslsessions.size() >= 16) {
+		SSL_SESSION_free(this->sslsessions.begin()->second);
+		this->sslsessions.erase(this->sslsessions.begin());
+	}
+	this->sslsessions[this->targeturl] = session;
+#endif
+}
+
+void http_engine::finish(const boost::system::error_code &err) {
+	if (!err)
+		this->save_session();
+	this->disconnect();
+	/* drop everything the transfer kept in its arena, the blocks are reused by the next transfer */
+	this->arena.release();
+	this->release_buffer();
+	/* a hedged transfer completes once both of its requests have stopped */
+	http_engine *primary = this->hedgeprimary ? this->hedgeprimary : this;
+	boost::system::error_code result;
+	if (primary->hedge_settle(this, err, result))
+		primary->deliver(result);
+}
+
+void http_engine::deliver(const boost::system::error_code &err) {
+	if (this->schedule_retry(err))
+		return;
+	this->complete(err);
+}
 
-	//http_engine request(this->response,this->io_service);
-	while (this->send() == true) { }
-	LogDebug(boost::str(boost::format("Response: %1%") %this->response->getStatus()));
+void http_engine::complete(const boost::system::error_code &err) {
+	t_completionFunc handler;
+	handler.swap(this->CompletionFunction);
+	if (err) {
+		LogDebug(boost::str(boost::format("Transfer Failed: %1%") % err.message()));
+		this->response->onError(err);
+	} else
+		LogDebug(boost::str(boost::format("Response: %1%") %this->response->getStatus()));
+	if (handler)
+		handler(err, this->response);
+}
 
-	//LogTrace() << "Body: " << this->response->getBody();
-	this->postbackio->post(
-			boost::bind(&http_engine::callback, this, this->response));
-	return this->response;
-#if 0
-	int redirtimes = 0;
-	this->send(url);
-	while ((this->send(url) && (this->response->getStatus() < 200)
-			|| (this->response->getStatus() >= 300))) {
-		// Send the HTTP request and receive the this->response.
-		this->send(url);
-		if ((this->response->getStatus() >= 300)
-				&& (this->response->getStatus() < 400)) {
-			/* Redirect */
-			if (redirtimes++ > 5) {
-				this->disconnect();
-				LogCritical()
-						<< "Redirection Failure. Redirected too many times";
-				return this->response;
-			}
-			std::string Location = this->response->getHeader("Location");
-			if (Location != "") {
-				LogTrace() << "Redirecting (" << this->response->getStatus()
-						<< ") to " << Location;
-				url = Location;
-				this->reset();
-			} else {
-				LogCritical() << "Redirection Failure ("
-						<< this->response->getStatus()
-						<< "). No Location Specified";
-				return this->response;
-			}
-		} else if ((this->response->getStatus() >= 400)
-				&& (this->response->getStatus() < 500)) {
-			LogCritical() << "Not Found (" << this->response->getStatus()
-					<< ") Error";
-			this->disconnect();
-			return this->response;
-		} else if ((this->response->getStatus() >= 500)
-				&& (this->response->getStatus() < 600)) {
-			LogCritical() << "Server Error (" << this->response->getStatus()
-					<< ") Error";
-			this->disconnect();
-			return this->response;
-		}
+void http_engine::cancel() {
+	this->strand.post(boost::bind(&http_engine::do_cancel, this));
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->HLock);
+	this->cancelrequested = true;
+	if (this->hedged && this->hedgeengine)
+		this->hedgeengine->abort();
+}
+void http_engine::abort() {
+	this->strand.post(boost::bind(&http_engine::do_cancel, this));
+}
+
+void http_engine::do_cancel() {
+	boost::system::error_code ec;
+	this->cancelled = true;
+	this->resolver.cancel();
+	this->retrytimer.cancel(ec);
+	this->ratetimer.cancel(ec);
+	if (this->socket.is_open())
+		this->socket.close(ec);
+	if (this->sslsocket && this->sslsocket->lowest_layer().is_open())
+		this->sslsocket->lowest_layer().close(ec);
+}
+
+void http_engine::transfer_done(boost::shared_ptr<boost::promise<http_response *> > promise, const boost::system::error_code &err, http_response *res) {
+	if (err) {
+		/* keep the exceptions the blocking implementation used to throw */
+		if (!this->connected)
+			promise->set_exception(boost::copy_exception(connection_exception()));
+		else
+			promise->set_exception(boost::copy_exception(boost::system::system_error(err)));
+		return;
 	}
-#endif
+	//LogTrace() << "Body: " << this->response->getBody();
+	this->executor->complete(boost::bind(&http_engine::callback, this, _1), res);
+	promise->set_value(res);
+}
 
+void http_engine::run() {
+	this->io.reset();
+	this->io.run();
 }
 
 bool http_engine::Starttransfer(http_response *myresponse) {
-	this->response = myresponse;
-	boost::packaged_task<http_response *> TransferStatus(
-			boost::bind(&http_engine::connect, this));
-	this->Status = TransferStatus.get_future();
-	boost::thread t(boost::move(TransferStatus));
+	boost::shared_ptr<boost::promise<http_response *> > TransferStatus(new boost::promise<http_response *>());
+	this->Status = TransferStatus->get_future();
+	this->start(myresponse, boost::bind(&http_engine::transfer_done, this, TransferStatus, _1, _2));
+	/* with our private IO Service, the transfer gets its own thread. Otherwise it runs on the transport threads */
+	if (&this->transport == &this->io) {
+		if (this->transferthread.joinable())
+			this->transferthread.join();
+		this->transferthread = boost::thread(boost::bind(&http_engine::run, this));
+	}
 	return true;
 }
 bool http_engine::setCallback(t_callbackFunc func) {
 	this->CallbackFunction = func;
+	return true;
+}
+
+bool http_engine::setHedgePolicy(boost::shared_ptr<http_hedge_policy> policy) {
+	this->hedgepolicy = policy;
+	return true;
+}
+void http_engine::handle_hedge_timer(const boost::system::error_code &err, unsigned int generation) {
+	if (err)
+		return;
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->HLock);
+	if (generation != this->hedgegeneration || this->hedgewinner || this->hedged || this->hedgerunning == 0 || this->cancelled)
+		return;
+	if (!this->hedgepolicy->acquire()) {
+		LogDebug(boost::str(boost::format("Not hedging %1%, the hedge budget is used up") % this->host));
+		return;
+	}
+	this->hedged = true;
+	this->hedgerunning++;
+	if (!this->hedgeengine) {
+		this->hedgeengine.reset(new http_engine(this->postbackio, &this->transport));
+		this->hedgeengine->hedgeprimary = this;
+		this->hedgeresponse.reset(new http_response());
+	}
+	/* the hedge sends the same request, into a response of its own till it wins */
+	http_engine *hedge = this->hedgeengine.get();
+	hedge->response = NULL;
+	hedge->reset();
+	hedge->method = this->method;
+	hedge->version = this->version;
+	hedge->arguments = this->arguments;
+	hedge->proxyauth = this->proxyauth;
+	hedge->proxyresolver = this->proxyresolver;
+	hedge->sockettuning = this->sockettuning;
+	hedge->setBufferPool(this->bufferpool);
+	/* the limits of the transfer cover both of its requests */
+	hedge->ratelimiter = this->ratelimiter;
+	hedge->transferlimit[http_rate_limiter::RECEIVE] = this->transferlimit[http_rate_limiter::RECEIVE];
+	hedge->transferlimit[http_rate_limiter::SEND] = this->transferlimit[http_rate_limiter::SEND];
+	this->hedgeresponse->reset();
+	this->hedgeresponse->setURL(this->response->getURL());
+	this->hedgeresponse->sendheaders = this->response->sendheaders;
+	this->hedgeresponse->httpauth = this->response->httpauth;
+	this->hedgeresponse->headergeneration = this->response->headergeneration;
+	LogDebug(boost::str(boost::format("No response from %1% yet, sending a hedged request") % this->host));
+	hedge->start(this->hedgeresponse.get(), t_completionFunc());
+}
+bool http_engine::hedge_claim() {
+	http_engine *primary = this->hedgeprimary ? this->hedgeprimary : this;
+	http_engine *loser = NULL;
+	{
+		boost::interprocess::scoped_lock<boost::mutex> lock(primary->HLock);
+		if (primary->hedgewinner)
+			return primary->hedgewinner == this;
+		primary->hedgewinner = this;
+		primary->hedgetimer.cancel();
+		if (primary->hedged)
+			loser = (this == primary) ? primary->hedgeengine.get() : primary;
+		if (this != primary) {
+			/* nothing has been written to the response of the transfer yet, so the hedge takes it over */
+			this->response = primary->response;
+			this->response->headers.clear();
+			this->response->headermapstale = true;
+		}
+	}
+	if (primary->hedgepolicy)
+		primary->hedgepolicy->record(this->host, boost::posix_time::microsec_clock::universal_time() - primary->starttime, this != primary);
+	if (loser) {
+		LogDebug(boost::str(boost::format("%1% request to %2% responded first, cancelling the other") % (this == primary ? "Original" : "Hedged") % this->host));
+		loser->abort();
+	}
+	return true;
+}
+bool http_engine::hedge_settle(http_engine *engine, const boost::system::error_code &err, boost::system::error_code &result) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->HLock);
+	/* the winners result counts. Without a winner, the original requests error is preferred over the hedges */
+	if (engine == this->hedgewinner || (!this->hedgewinner && (engine == this || !this->hedgeresultset))) {
+		this->hedgeresult = err;
+		this->hedgeresultset = true;
+	}
+	if (--this->hedgerunning > 0)
+		return false;
+	this->hedgetimer.cancel();
+	result = this->hedgeresult;
+	return true;
+}
+bool http_engine::setRetryPolicy(boost::shared_ptr<http_retry_policy> policy) {
+	this->retrypolicy = policy;
+	return true;
+}
+bool http_engine::schedule_retry(const boost::system::error_code &err) {
+	if (!this->retrypolicy)
+		return false;
+	{
+		/* the loser of a hedged pair is cancelled too, so only a cancel by the application counts here */
+		boost::interprocess::scoped_lock<boost::mutex> lock(this->HLock);
+		if (this->cancelrequested)
+			return false;
+	}
+	int status = err ? 0 : this->response->getStatus();
+	std::string retryafter;
+	if (!err)
+		this->response->headers.get(http_headers::Retry_After, retryafter);
+	bool idempotent = this->method == "GET" || this->method == "HEAD" || this->method == "PUT" || this->method == "DELETE"
+			|| this->method == "OPTIONS" || this->method == "TRACE";
+	if (this->retrypolicy->classify(err, status, this->connected, idempotent) == http_retry_policy::RETRY_NONE)
+		return false;
+	if (this->body && !this->body->rewind()) {
+		LogDebug(boost::str(boost::format("Not retrying %1%, the Request Body can not be resent") % this->host));
+		return false;
+	}
+	boost::posix_time::time_duration delay;
+	http_retry_policy::retry_reason reason = this->retrypolicy->retry(err, status, this->connected, idempotent, this->retryattempt, retryafter, delay);
+	if (reason == http_retry_policy::RETRY_NONE) {
+		LogDebug(boost::str(boost::format("Not retrying %1% after %2% attempts") % this->host % (this->retryattempt + 1)));
+		return false;
+	}
+	this->retryattempt++;
+	LogDebug(boost::str(boost::format("Retrying %1% (%2%) in %3%ms, attempt %4%") % this->host % (err ? err.message() : boost::lexical_cast<std::string>(status))
+			% delay.total_milliseconds() % (this->retryattempt + 1)));
+	this->retrytimer.expires_from_now(delay);
+	this->retrytimer.async_wait(this->strand.wrap(boost::bind(&http_engine::handle_retry_timer, this, boost::asio::placeholders::error)));
+	return true;
+}
+void http_engine::handle_retry_timer(const boost::system::error_code &err) {
+	bool stop;
+	{
+		boost::interprocess::scoped_lock<boost::mutex> lock(this->HLock);
+		stop = this->cancelrequested;
+	}
+	if (err || stop)
+		return this->complete(boost::asio::error::operation_aborted);
+	/* start over with a clean response, on the URL we got to (after any redirects) */
+	std::string url = this->response->getURL();
+	this->response->reset();
+	this->response->setURL(url);
+	this->begin();
+}
+bool http_engine::setCompletionExecutor(boost::shared_ptr<http_completion_executor> myexecutor) {
+	if (myexecutor)
+		this->executor = myexecutor;
+	else
+		this->executor = this->defaultexecutor;
+	return true;
 }
 
 void http_engine::callback(http_response *res) {
@@ -652,6 +1437,59 @@ void http_engine::callback(http_response *res) {
 bool http_engine::setProxyAuth(std::string username, std::string password) {
 	this->proxyauth.first = username;
 	this->proxyauth.second = password;
+	this->request.invalidate();
+	return true;
+}
+
+bool http_engine::setProxyResolver(boost::shared_ptr<http_proxy_resolver> resolver) {
+	if (resolver)
+		this->proxyresolver = resolver;
+	else
+		this->proxyresolver = http_proxy_resolver::getDefault();
+	this->request.invalidate();
+	return true;
+}
+
+bool http_engine::setSocketTuning(boost::shared_ptr<http_socket_tuning> tuning) {
+	this->sockettuning = tuning;
+	return true;
+}
+
+bool http_engine::setRateLimiter(boost::shared_ptr<http_rate_limiter> limiter) {
+	if (limiter)
+		this->ratelimiter = limiter;
+	else
+		this->ratelimiter = http_rate_limiter::getDefault();
+	return true;
+}
+
+bool http_engine::setRateLimit(http_rate_limiter::direction dir, boost::uint64_t rate, size_t burst) {
+	this->transferlimit[dir]->setRate(rate, burst);
+	return true;
+}
+
+bool http_engine::setBufferPool(boost::shared_ptr<http_buffer_pool> pool) {
+	/* the buffer held goes back to the pool it came from */
+	this->release_buffer();
+	if (pool)
+		this->bufferpool = pool;
+	else
+		this->bufferpool = http_buffer_pool::getDefault();
+	return true;
+}
+
+bool http_engine::setMethod(std::string mymethod) {
+	this->method = mymethod;
+	return true;
+}
+
+bool http_engine::setBody(std::string mybody) {
+	this->body.reset(new http_request_body_string(mybody));
+	return true;
+}
+
+bool http_engine::setBody(boost::shared_ptr<http_request_body> mybody) {
+	this->body = mybody;
 	return true;
 }
 
@@ -0,0 +1,123 @@
+/*
+ * Completion Executors for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include "anetd/anetdConfig.h"
+#include <boost/bind.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+#include "anetd/http_executor.hpp"
+
+using namespace DynamX::anetd;
+
+
+http_completion_executor::~http_completion_executor()
+{
+}
+
+
+void http_executor_inline::complete(t_callbackFunc func, http_response *res) {
+	func(res);
+}
+
+
+http_executor_postback::http_executor_postback(boost::asio::io_service *myio) : io(myio)
+{
+}
+
+void http_executor_postback::complete(t_callbackFunc func, http_response *res) {
+	this->io->post(boost::bind(func, res));
+}
+
+
+http_executor_strand::http_executor_strand(boost::asio::io_service *io) : strand(*io)
+{
+}
+
+void http_executor_strand::complete(t_callbackFunc func, http_response *res) {
+	this->strand.post(boost::bind(func, res));
+}
+
+boost::asio::io_service::strand &http_executor_strand::getStrand() {
+	return this->strand;
+}
+
+
+http_executor_pool::http_executor_pool(size_t count) : work(new boost::asio::io_service::work(this->io))
+{
+	if (count == 0)
+		count = 1;
+	for (size_t i = 0; i < count; i++)
+		this->threads.create_thread(boost::bind(static_cast<size_t (boost::asio::io_service::*)()>(&boost::asio::io_service::run), &this->io));
+}
+
+http_executor_pool::~http_executor_pool()
+{
+	this->work.reset();
+	this->threads.join_all();
+}
+
+void http_executor_pool::complete(t_callbackFunc func, http_response *res) {
+	this->io.post(boost::bind(func, res));
+}
+
+
+http_executor_batch::http_executor_batch(boost::asio::io_service *myio, t_batchFunc func, size_t max) :
+		io(myio), BatchFunction(func), maxbatch(max), scheduled(false)
+{
+}
+
+void http_executor_batch::complete(t_callbackFunc func, http_response *res) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->QLock);
+	this->queue.push_back(std::make_pair(func, res));
+	/* only the first completion after a drain needs to wake up the IO Service */
+	if (!this->scheduled) {
+		this->scheduled = true;
+		this->io->post(boost::bind(&http_executor_batch::drain, this));
+	}
+}
+
+void http_executor_batch::drain() {
+	/* with several threads running the IO Service two drains can run at once, so each one delivers from vectors of its own */
+	std::vector<std::pair<t_callbackFunc, http_response *> > delivering;
+	{
+		boost::interprocess::scoped_lock<boost::mutex> lock(this->QLock);
+		if (this->maxbatch == 0 || this->queue.size() <= this->maxbatch) {
+			/* the queue carries on with the capacity a earlier batch grew to, so steady state batches do not allocate */
+			delivering.swap(this->queue);
+			this->queue.swap(this->spare);
+			this->scheduled = false;
+		} else {
+			delivering.assign(this->queue.begin(), this->queue.begin() + this->maxbatch);
+			this->queue.erase(this->queue.begin(), this->queue.begin() + this->maxbatch);
+			this->io->post(boost::bind(&http_executor_batch::drain, this));
+		}
+	}
+	std::vector<http_response *> batch;
+	batch.reserve(delivering.size());
+	for (std::vector<std::pair<t_callbackFunc, http_response *> >::iterator it = delivering.begin(); it != delivering.end(); ++it) {
+		if (it->first)
+			it->first(it->second);
+		batch.push_back(it->second);
+	}
+	if (this->BatchFunction && !batch.empty())
+		this->BatchFunction(batch);
+	delivering.clear();
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->QLock);
+	if (delivering.capacity() > this->spare.capacity())
+		this->spare.swap(delivering);
+}
@@ -0,0 +1,457 @@
+/*
+ * File Writers for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include "anetd/anetdConfig.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#ifdef HAVE_LINUX_IO_URING_H
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#endif
+#include "anetd/http_file_writer.hpp"
+#include "anetd/LogClass.hpp"
+
+using namespace DynamX::anetd;
+using namespace DynamX::Logging;
+
+namespace {
+
+class http_file_writer_posix : public http_file_writer
+{
+public:
+	http_file_writer_posix() : fd(-1), fill(0), failed(false) {}
+	~http_file_writer_posix() {
+		this->close();
+	}
+	bool open(const std::string &path) {
+		this->close();
+		this->failed = false;
+		this->fill = 0;
+		this->fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+		return this->fd >= 0;
+	}
+	/* the body is collected in a buffer, like the io_uring writer does, so small blocks do not cost a system call each. Blocks at least as
+	 * large as the buffer are written straight from the callers memory */
+	bool write(const char *data, size_t len) {
+		if (this->fd < 0 || this->failed)
+			return false;
+		if (this->fill + len > BUFFERSIZE && !this->flush())
+			return false;
+		if (len >= BUFFERSIZE)
+			return this->writeall(data, len);
+		if (this->buffer.empty())
+			this->buffer.resize(BUFFERSIZE);
+		memcpy(&this->buffer[this->fill], data, len);
+		this->fill += len;
+		return true;
+	}
+	bool close() {
+		if (this->fd < 0)
+			return !this->failed;
+		if (!this->failed)
+			this->flush();
+		if (::close(this->fd) != 0)
+			this->failed = true;
+		this->fd = -1;
+		this->fill = 0;
+		return !this->failed;
+	}
+	bool isOpen() const {
+		return this->fd >= 0;
+	}
+	backend getBackend() const {
+		return BACKEND_POSIX;
+	}
+private:
+	static const size_t BUFFERSIZE = 65536;
+	bool flush() {
+		size_t len = this->fill;
+		this->fill = 0;
+		return len == 0 || this->writeall(&this->buffer[0], len);
+	}
+	bool writeall(const char *data, size_t len) {
+		while (len > 0) {
+			ssize_t done = ::write(this->fd, data, len);
+			if (done < 0 && errno == EINTR)
+				continue;
+			if (done <= 0) {
+				LogWarn(std::string("Error writing file: ").append(strerror(errno)));
+				this->failed = true;
+				return false;
+			}
+			data += done;
+			len -= done;
+		}
+		return true;
+	}
+	int fd;
+	/* allocated on the first write, and kept for the next files written through this writer */
+	std::vector<char> buffer;
+	size_t fill;
+	bool failed;
+};
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+static int uring_setup(unsigned int entries, struct io_uring_params *params) {
+	return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int ringfd, unsigned int submit, unsigned int complete, unsigned int flags) {
+	return syscall(__NR_io_uring_enter, ringfd, submit, complete, flags, NULL, 0);
+}
+
+static int uring_register(int ringfd, unsigned int opcode, void *arg, unsigned int nargs) {
+	return syscall(__NR_io_uring_register, ringfd, opcode, arg, nargs);
+}
+
+/* the kernel needs IORING_OP_WRITE (Linux 5.6) for the fallback when buffers can not be registered, and IORING_REGISTER_PROBE arrived in the same release */
+static bool probe_uring() {
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	int ringfd = uring_setup(2, &params);
+	if (ringfd < 0)
+		return false;
+	size_t probesize = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+	struct io_uring_probe *probe = static_cast<struct io_uring_probe *>(calloc(1, probesize));
+	bool supported = probe && uring_register(ringfd, IORING_REGISTER_PROBE, probe, 256) == 0 && probe->last_op >= IORING_OP_WRITE
+			&& (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED) && (probe->ops[IORING_OP_WRITE_FIXED].flags & IO_URING_OP_SUPPORTED);
+	free(probe);
+	::close(ringfd);
+	return supported;
+}
+
+class http_file_writer_uring : public http_file_writer
+{
+public:
+	http_file_writer_uring() : ringfd(-1), fd(-1), sqring(MAP_FAILED), cqring(MAP_FAILED), sqes(static_cast<struct io_uring_sqe *>(MAP_FAILED)),
+			buffers(static_cast<char *>(MAP_FAILED)), sqringsize(0), cqringsize(0), sqessize(0), current(-1), offset(0), queued(0), inflight(0),
+			fixed(false), failed(false), broken(false), direct(false) {
+		for (int i = 0; i < BUFFERS; i++) {
+			this->busy[i] = false;
+			this->fill[i] = 0;
+			this->written[i] = 0;
+			this->bufferoffset[i] = 0;
+		}
+	}
+	~http_file_writer_uring() {
+		this->close();
+		if (this->buffers != MAP_FAILED)
+			munmap(this->buffers, BUFFERS * BUFFERSIZE);
+		if (this->sqes != MAP_FAILED)
+			munmap(this->sqes, this->sqessize);
+		if (this->cqring != MAP_FAILED && this->cqring != this->sqring)
+			munmap(this->cqring, this->cqringsize);
+		if (this->sqring != MAP_FAILED)
+			munmap(this->sqring, this->sqringsize);
+		if (this->ringfd >= 0)
+			::close(this->ringfd);
+	}
+	bool open(const std::string &path) {
+		this->close();
+		/* the ring and its buffers are set up on the first open, and kept for the next files written through this writer */
+		if (this->broken)
+			this->direct = true;
+		if (this->ringfd < 0 && !this->direct && !this->setup()) {
+			LogWarn("Could not set up io_uring, writing the file with POSIX writes");
+			this->direct = true;
+		}
+		if (this->direct)
+			return this->fallback.open(path);
+		this->failed = false;
+		this->offset = 0;
+		this->fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+		return this->fd >= 0;
+	}
+	bool write(const char *data, size_t len) {
+		if (this->direct)
+			return this->fallback.write(data, len);
+		if (this->fd < 0 || this->failed)
+			return false;
+		while (len > 0) {
+			if (this->current < 0) {
+				this->current = this->acquire();
+				if (this->current < 0)
+					return false;
+				this->bufferoffset[this->current] = this->offset;
+			}
+			size_t copy = std::min(len, BUFFERSIZE - this->fill[this->current]);
+			memcpy(this->buffers + this->current * BUFFERSIZE + this->fill[this->current], data, copy);
+			this->fill[this->current] += copy;
+			this->offset += copy;
+			data += copy;
+			len -= copy;
+			if (this->fill[this->current] == BUFFERSIZE) {
+				this->queue(this->current);
+				this->current = -1;
+			}
+		}
+		return true;
+	}
+	bool close() {
+		if (this->direct)
+			return this->fallback.close();
+		if (this->fd < 0)
+			return !this->failed;
+		if (this->current >= 0 && this->fill[this->current] > 0)
+			this->queue(this->current);
+		this->current = -1;
+		while (this->inflight > 0)
+			if (!this->submit(1))
+				break;
+		if (::close(this->fd) != 0)
+			this->failed = true;
+		this->fd = -1;
+		return !this->failed;
+	}
+	bool isOpen() const {
+		return this->direct ? this->fallback.isOpen() : this->fd >= 0;
+	}
+	backend getBackend() const {
+		return this->direct ? BACKEND_POSIX : BACKEND_URING;
+	}
+private:
+	enum { BUFFERS = 4, ENTRIES = 8 };
+	static const size_t BUFFERSIZE = 65536;
+	bool setup() {
+		struct io_uring_params params;
+		memset(&params, 0, sizeof(params));
+		this->ringfd = uring_setup(ENTRIES, &params);
+		if (this->ringfd < 0)
+			return false;
+		this->sqringsize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+		this->cqringsize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+		if (params.features & IORING_FEAT_SINGLE_MMAP)
+			this->sqringsize = this->cqringsize = std::max(this->sqringsize, this->cqringsize);
+		this->sqring = mmap(NULL, this->sqringsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->ringfd, IORING_OFF_SQ_RING);
+		if (this->sqring == MAP_FAILED)
+			return false;
+		if (params.features & IORING_FEAT_SINGLE_MMAP)
+			this->cqring = this->sqring;
+		else
+			this->cqring = mmap(NULL, this->cqringsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->ringfd, IORING_OFF_CQ_RING);
+		if (this->cqring == MAP_FAILED)
+			return false;
+		this->sqessize = params.sq_entries * sizeof(struct io_uring_sqe);
+		this->sqes = static_cast<struct io_uring_sqe *>(mmap(NULL, this->sqessize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->ringfd, IORING_OFF_SQES));
+		if (this->sqes == MAP_FAILED)
+			return false;
+		char *sq = static_cast<char *>(this->sqring);
+		char *cq = static_cast<char *>(this->cqring);
+		this->sqtail = reinterpret_cast<unsigned int *>(sq + params.sq_off.tail);
+		this->sqmask = *reinterpret_cast<unsigned int *>(sq + params.sq_off.ring_mask);
+		this->sqarray = reinterpret_cast<unsigned int *>(sq + params.sq_off.array);
+		this->cqhead = reinterpret_cast<unsigned int *>(cq + params.cq_off.head);
+		this->cqtail = reinterpret_cast<unsigned int *>(cq + params.cq_off.tail);
+		this->cqmask = *reinterpret_cast<unsigned int *>(cq + params.cq_off.ring_mask);
+		this->cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+		this->buffers = static_cast<char *>(mmap(NULL, BUFFERS * BUFFERSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+		if (this->buffers == MAP_FAILED)
+			return false;
+		/* registered buffers are pinned once, instead of on every write. They count against RLIMIT_MEMLOCK on older kernels, so plain writes are used if that fails */
+		struct iovec iov[BUFFERS];
+		for (int i = 0; i < BUFFERS; i++) {
+			iov[i].iov_base = this->buffers + i * BUFFERSIZE;
+			iov[i].iov_len = BUFFERSIZE;
+		}
+		this->fixed = uring_register(this->ringfd, IORING_REGISTER_BUFFERS, iov, BUFFERS) == 0;
+		if (!this->fixed)
+			LogDebug(std::string("Could not register io_uring buffers: ").append(strerror(errno)));
+		return true;
+	}
+	/* get a free buffer, waiting for a write to complete if they are all in flight */
+	int acquire() {
+		while (true) {
+			for (int i = 0; i < BUFFERS; i++)
+				if (!this->busy[i]) {
+					this->fill[i] = 0;
+					this->written[i] = 0;
+					return i;
+				}
+			if (!this->submit(1))
+				return -1;
+		}
+	}
+	/* queue the unwritten part of a buffer. Each buffer has at most one write in flight, so the submission queue can not overflow */
+	void queue(int buffer) {
+		unsigned int tail = *this->sqtail;
+		unsigned int index = tail & this->sqmask;
+		struct io_uring_sqe *sqe = &this->sqes[index];
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = this->fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+		sqe->fd = this->fd;
+		sqe->addr = reinterpret_cast<boost::uint64_t>(this->buffers + buffer * BUFFERSIZE + this->written[buffer]);
+		sqe->len = this->fill[buffer] - this->written[buffer];
+		sqe->off = this->bufferoffset[buffer] + this->written[buffer];
+		sqe->buf_index = this->fixed ? buffer : 0;
+		sqe->user_data = buffer;
+		this->sqarray[index] = index;
+		__atomic_store_n(this->sqtail, tail + 1, __ATOMIC_RELEASE);
+		this->busy[buffer] = true;
+		this->queued++;
+		this->inflight++;
+	}
+	/* submit the queued writes and wait for at least wait of them to complete, in one system call */
+	bool submit(unsigned int wait) {
+		int ret;
+		do {
+			ret = uring_enter(this->ringfd, this->queued, wait, wait ? IORING_ENTER_GETEVENTS : 0);
+		} while (ret < 0 && errno == EINTR);
+		if (ret < 0) {
+			LogWarn(std::string("Error submitting io_uring writes: ").append(strerror(errno)));
+			/* the state of the ring is unknown now, so it is not used again */
+			this->failed = true;
+			this->broken = true;
+			return false;
+		}
+		this->queued -= ret;
+		this->reap();
+		return true;
+	}
+	void reap() {
+		unsigned int head = *this->cqhead;
+		unsigned int tail = __atomic_load_n(this->cqtail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++) {
+			struct io_uring_cqe *cqe = &this->cqes[head & this->cqmask];
+			int buffer = static_cast<int>(cqe->user_data);
+			int res = cqe->res;
+			this->inflight--;
+			this->busy[buffer] = false;
+			if (res == -EINTR || res == -EAGAIN) {
+				this->queue(buffer);
+				continue;
+			}
+			if (res <= 0) {
+				if (!this->failed)
+					LogWarn(std::string("Error writing file: ").append(res < 0 ? strerror(-res) : "no progress"));
+				this->failed = true;
+				continue;
+			}
+			/* a short write is sent again for the rest of the buffer */
+			this->written[buffer] += res;
+			if (this->written[buffer] < this->fill[buffer] && !this->failed)
+				this->queue(buffer);
+		}
+		__atomic_store_n(this->cqhead, head, __ATOMIC_RELEASE);
+	}
+	int ringfd;
+	int fd;
+	void *sqring;
+	void *cqring;
+	struct io_uring_sqe *sqes;
+	char *buffers;
+	size_t sqringsize;
+	size_t cqringsize;
+	size_t sqessize;
+	unsigned int *sqtail;
+	unsigned int sqmask;
+	unsigned int *sqarray;
+	unsigned int *cqhead;
+	unsigned int *cqtail;
+	unsigned int cqmask;
+	struct io_uring_cqe *cqes;
+	bool busy[BUFFERS];
+	size_t fill[BUFFERS];
+	size_t written[BUFFERS];
+	boost::uint64_t bufferoffset[BUFFERS];
+	int current;
+	boost::uint64_t offset;
+	unsigned int queued;
+	unsigned int inflight;
+	bool fixed;
+	bool failed;
+	bool broken;
+	bool direct;
+	http_file_writer_posix fallback;
+};
+
+#endif
+
+}
+
+static boost::once_flag probeonce = BOOST_ONCE_INIT;
+static bool uringsupported = false;
+
+static void probe() {
+#ifdef HAVE_LINUX_IO_URING_H
+	uringsupported = probe_uring();
+#endif
+	LogDebug(std::string("io_uring file writes ").append(uringsupported ? "supported" : "not supported"));
+}
+
+static boost::mutex defaultlock;
+static bool defaultset = false;
+static http_file_writer::backend defaultbackend = http_file_writer::BACKEND_AUTO;
+
+bool http_file_writer::hasUring() {
+	boost::call_once(&probe, probeonce);
+	return uringsupported;
+}
+
+void http_file_writer::setDefaultBackend(backend mybackend) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(defaultlock);
+	defaultbackend = mybackend;
+	defaultset = true;
+}
+
+http_file_writer::backend http_file_writer::getDefaultBackend() {
+	backend mybackend;
+	{
+		boost::interprocess::scoped_lock<boost::mutex> lock(defaultlock);
+		if (!defaultset) {
+			const char *env = getenv("ANETD_IO_BACKEND");
+			if (env && strcmp(env, "posix") == 0)
+				defaultbackend = BACKEND_POSIX;
+			else if (env && strcmp(env, "uring") == 0)
+				defaultbackend = BACKEND_URING;
+			defaultset = true;
+		}
+		mybackend = defaultbackend;
+	}
+	if (mybackend == BACKEND_POSIX)
+		return BACKEND_POSIX;
+	return hasUring() ? BACKEND_URING : BACKEND_POSIX;
+}
+
+http_file_writer *http_file_writer::create(backend mybackend) {
+	if (mybackend == BACKEND_AUTO)
+		mybackend = getDefaultBackend();
+#ifdef HAVE_LINUX_IO_URING_H
+	if (mybackend == BACKEND_URING && hasUring())
+		return new http_file_writer_uring();
+#endif
+	return new http_file_writer_posix();
+}
+
+http_file_writer::~http_file_writer()
+{
+}
@@ -0,0 +1,241 @@
+/*
+ * HTTP Header Table for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include "anetd/anetdConfig.h"
+#include <cstring>
+#include "anetd/http_headers.hpp"
+
+using namespace DynamX::anetd;
+
+/* Names of the interned headers, in header_id order */
+static const char *const header_names[http_headers::Max_Header_Id] = {
+	"",
+	"Accept",
+	"Accept-Encoding",
+	"Accept-Ranges",
+	"Age",
+	"Allow",
+	"Alt-Svc",
+	"Authorization",
+	"Cache-Control",
+	"Connection",
+	"Content-Disposition",
+	"Content-Encoding",
+	"Content-Language",
+	"Content-Length",
+	"Content-Location",
+	"Content-MD5",
+	"Content-Range",
+	"Content-Type",
+	"Cookie",
+	"Date",
+	"Digest",
+	"ETag",
+	"Expires",
+	"Host",
+	"Keep-Alive",
+	"Last-Modified",
+	"Link",
+	"Location",
+	"Pragma",
+	"Proxy-Authenticate",
+	"Proxy-Authorization",
+	"Proxy-Connection",
+	"Retry-After",
+	"Server",
+	"Set-Cookie",
+	"Strict-Transport-Security",
+	"Trailer",
+	"Transfer-Encoding",
+	"Upgrade",
+	"User-Agent",
+	"Vary",
+	"Via",
+	"WWW-Authenticate",
+	"X-Powered-By",
+};
+
+/* Perfect hash of the lower cased names above:
+ *   (len * 3 + name[0] * 2 + name[len - 1] * 18 + name[len / 2]) % 128
+ * Each slot holds the header_id hashing to it, or 0. The multipliers were found by a exhaustive search, so if a name
+ * is added to the list, the search has to be rerun and this table regenerated */
+static const unsigned char header_slots[128] = {
+	 0,  0,  0,  9,  0,  0, 37,  0, 43,  0,  0, 38,  0, 34,  7, 15,
+	 0, 39,  2,  0,  0,  0,  0,  0, 29, 11,  0,  5,  0, 42, 14,  0,
+	27,  0,  0, 35, 10,  0,  0,  0,  0,  0,  0, 28,  3,  0,  0,  0,
+	41,  0,  0,  0,  0,  0, 32,  0,  0,  0, 31,  0,  0, 30,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  4,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0, 26,  0,  0,  0,  0, 18, 22,  0,
+	 0,  1, 19,  0,  0,  0,  0, 20,  8,  0, 36,  0, 40, 13,  0, 24,
+	 0,  0, 33,  0,  0, 21, 25, 23, 17,  0,  6, 16, 12,  0,  0,  0,
+};
+
+static inline unsigned char ascii_lower(unsigned char c) {
+	return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static bool ascii_iequals(const char *a, const char *b, size_t len) {
+	for (size_t i = 0; i < len; i++)
+		if (ascii_lower(a[i]) != ascii_lower(b[i]))
+			return false;
+	return true;
+}
+
+static inline bool is_space(char c) {
+	return c == ' ' || c == '\t';
+}
+
+
+http_headers::http_headers()
+{
+	/* enough for a typical response, so most responses never grow the table */
+	this->entries.reserve(16);
+	this->arena.reserve(1024);
+	this->begin();
+}
+
+void http_headers::clear() {
+	this->entries.clear();
+	this->arena.clear();
+	this->begin();
+}
+
+http_headers::header_id http_headers::lookup(const char *name, size_t len) {
+	if (len == 0)
+		return Unknown;
+	unsigned int hash = len * 3 + ascii_lower(name[0]) * 2 + ascii_lower(name[len - 1]) * 18 + ascii_lower(name[len / 2]);
+	unsigned char id = header_slots[hash % 128];
+	if (id == 0)
+		return Unknown;
+	const char *candidate = header_names[id];
+	if (strlen(candidate) != len || !ascii_iequals(candidate, name, len))
+		return Unknown;
+	return static_cast<header_id>(id);
+}
+
+const char *http_headers::name(header_id id) {
+	if (static_cast<int>(id) < 0 || id >= Max_Header_Id)
+		return "";
+	return header_names[id];
+}
+
+void http_headers::add(const std::string &name, const std::string &value) {
+	this->begin();
+	this->appendName(name.data(), name.length());
+	this->appendValue(value.data(), value.length());
+	this->commit();
+}
+
+void http_headers::begin() {
+	this->pending.id = Unknown;
+	this->pending.name = this->arena.length();
+	this->pending.namelen = 0;
+	this->pending.value = this->arena.length();
+	this->pending.valuelen = 0;
+}
+
+void http_headers::appendName(const char *data, size_t len) {
+	this->arena.append(data, len);
+	this->pending.namelen += len;
+	this->pending.value = this->arena.length();
+}
+
+void http_headers::appendValue(const char *data, size_t len) {
+	if (this->pending.valuelen == 0)
+		while (len > 0 && is_space(*data)) {
+			data++;
+			len--;
+		}
+	this->arena.append(data, len);
+	this->pending.valuelen += len;
+}
+
+void http_headers::discard() {
+	this->arena.resize(this->pending.name);
+	this->begin();
+}
+
+bool http_headers::isParsing() const {
+	return this->pending.namelen > 0;
+}
+
+void http_headers::commit() {
+	while (this->pending.valuelen > 0 && is_space(this->arena[this->pending.value + this->pending.valuelen - 1]))
+		this->pending.valuelen--;
+	this->pending.id = lookup(this->arena.data() + this->pending.name, this->pending.namelen);
+	this->entries.push_back(this->pending);
+	this->begin();
+}
+
+size_t http_headers::size() const {
+	return this->entries.size();
+}
+
+http_headers::header_id http_headers::getId(size_t index) const {
+	return static_cast<header_id>(this->entries[index].id);
+}
+
+std::string http_headers::getName(size_t index) const {
+	const entry &e = this->entries[index];
+	return this->arena.substr(e.name, e.namelen);
+}
+
+std::string http_headers::getValue(size_t index) const {
+	const entry &e = this->entries[index];
+	return this->arena.substr(e.value, e.valuelen);
+}
+
+bool http_headers::find(header_id id, const char *&value, size_t &len) const {
+	for (std::vector<entry>::const_iterator it = this->entries.begin(); it != this->entries.end(); ++it) {
+		if (it->id == id) {
+			value = this->arena.data() + it->value;
+			len = it->valuelen;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool http_headers::get(header_id id, std::string &value) const {
+	const char *data;
+	size_t len;
+	if (!this->find(id, data, len))
+		return false;
+	value.assign(data, len);
+	return true;
+}
+
+bool http_headers::get(const std::string &name, std::string &value) const {
+	header_id id = lookup(name.data(), name.length());
+	if (id != Unknown)
+		return this->get(id, value);
+	for (std::vector<entry>::const_iterator it = this->entries.begin(); it != this->entries.end(); ++it) {
+		if (it->id == Unknown && it->namelen == name.length() && ascii_iequals(this->arena.data() + it->name, name.data(), name.length())) {
+			value.assign(this->arena, it->value, it->valuelen);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool http_headers::has(header_id id) const {
+	const char *data;
+	size_t len;
+	return this->find(id, data, len);
+}
@@ -0,0 +1,138 @@
+/*
+ * Hedged Request Policy for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include "anetd/anetdConfig.h"
+#include <algorithm>
+#include <vector>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+#include "anetd/http_hedge.hpp"
+
+using namespace DynamX::anetd;
+
+
+http_hedge_policy::http_hedge_policy(boost::posix_time::time_duration mydelay, double mybudget, double myburst) :
+		delay(mydelay), percentile(0), minsamples(20), window(128), budget(mybudget), burst(myburst), tokens(myburst), maxhosts(1024),
+		requests(0), hedges(0), hedgewins(0), denied(0)
+{
+}
+
+void http_hedge_policy::setDelay(boost::posix_time::time_duration mydelay) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->HLock);
+	this->delay = mydelay;
+}
+
+void http_hedge_policy::setPercentile(double mypercentile, size_t mysamples, size_t mywindow) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->HLock);
+	this->percentile = std::min(std::max(mypercentile, 0.0), 100.0);
+	this->minsamples = std::max<size_t>(mysamples, 1);
+	this->window = std::max(mywindow, this->minsamples);
+}
+
+void http_hedge_policy::setMaxHosts(size_t mymaxhosts) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->HLock);
+	this->maxhosts = std::max<size_t>(mymaxhosts, 1);
+	this->prune();
+}
+
+void http_hedge_policy::prune() {
+	while (this->samples.size() > this->maxhosts) {
+		this->samples.erase(this->recent.back());
+		this->recent.pop_back();
+	}
+}
+
+void http_hedge_policy::setBudget(double mybudget, double myburst) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->HLock);
+	this->budget = mybudget;
+	this->burst = myburst;
+	this->tokens = std::min(this->tokens, myburst);
+}
+
+boost::posix_time::time_duration http_hedge_policy::getDelay(const std::string &host) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->HLock);
+	if (this->percentile > 0) {
+		std::map<std::string, host_samples>::iterator it = this->samples.find(host);
+		if (it != this->samples.end() && it->second.latencies.size() >= this->minsamples) {
+			/* the window is small, so a copy and nth_element is cheap enough to do per request */
+			std::vector<boost::int64_t> sorted(it->second.latencies.begin(), it->second.latencies.end());
+			size_t rank = static_cast<size_t>(this->percentile / 100.0 * (sorted.size() - 1) + 0.5);
+			std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+			return boost::posix_time::microseconds(sorted[rank]);
+		}
+	}
+	return this->delay;
+}
+
+void http_hedge_policy::request() {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->HLock);
+	this->requests++;
+	this->tokens = std::min(this->tokens + this->budget, this->burst);
+}
+
+bool http_hedge_policy::acquire() {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->HLock);
+	if (this->tokens < 1) {
+		this->denied++;
+		return false;
+	}
+	this->tokens -= 1;
+	this->hedges++;
+	return true;
+}
+
+void http_hedge_policy::record(const std::string &host, boost::posix_time::time_duration latency, bool hedgewon) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->HLock);
+	if (hedgewon)
+		this->hedgewins++;
+	if (this->percentile <= 0)
+		return;
+	std::map<std::string, host_samples>::iterator it = this->samples.find(host);
+	if (it == this->samples.end()) {
+		it = this->samples.insert(std::make_pair(host, host_samples())).first;
+		this->recent.push_front(host);
+		it->second.recent = this->recent.begin();
+	} else if (it->second.recent != this->recent.begin()) {
+		this->recent.splice(this->recent.begin(), this->recent, it->second.recent);
+	}
+	std::deque<boost::int64_t> &hostsamples = it->second.latencies;
+	hostsamples.push_back(latency.total_microseconds());
+	while (hostsamples.size() > this->window)
+		hostsamples.pop_front();
+	this->prune();
+}
+
+boost::uint64_t http_hedge_policy::getRequests() {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->HLock);
+	return this->requests;
+}
+
+boost::uint64_t http_hedge_policy::getHedges() {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->HLock);
+	return this->hedges;
+}
+
+boost::uint64_t http_hedge_policy::getHedgeWins() {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->HLock);
+	return this->hedgewins;
+}
+
+boost::uint64_t http_hedge_policy::getDenied() {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->HLock);
+	return this->denied;
+}
@@ -0,0 +1,265 @@
+/*
+ * Post-Processing Pipeline for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include "anetd/anetdConfig.h"
+#include <exception>
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+#include "anetd/http_pipeline.hpp"
+#include "anetd/LogClass.hpp"
+
+using namespace DynamX::anetd;
+using namespace DynamX::Logging;
+
+
+http_pipeline_pool::http_pipeline_pool(size_t count) : next(0), pending(0), stopping(false)
+{
+	if (count == 0)
+		count = boost::thread::hardware_concurrency();
+	if (count == 0)
+		count = 1;
+	for (size_t i = 0; i < count; i++)
+		this->workers.push_back(boost::shared_ptr<worker>(new worker()));
+	for (size_t i = 0; i < count; i++)
+		this->threads.create_thread(boost::bind(&http_pipeline_pool::run, this, i));
+}
+
+http_pipeline_pool::~http_pipeline_pool()
+{
+	{
+		boost::interprocess::scoped_lock<boost::mutex> lock(this->WLock);
+		this->stopping = true;
+	}
+	this->wakeup.notify_all();
+	this->threads.join_all();
+}
+
+size_t http_pipeline_pool::getThreads() {
+	return this->workers.size();
+}
+
+void http_pipeline_pool::submit(t_taskFunc task) {
+	worker &w = *this->workers[static_cast<size_t>(++this->next) % this->workers.size()];
+	{
+		boost::interprocess::scoped_lock<boost::mutex> lock(w.QLock);
+		w.tasks.push_back(task);
+	}
+	{
+		boost::interprocess::scoped_lock<boost::mutex> lock(this->WLock);
+		this->pending++;
+	}
+	this->wakeup.notify_one();
+}
+
+bool http_pipeline_pool::take(size_t id, t_taskFunc &task) {
+	/* our own queue first, newest task first as its data is most likely still in cache */
+	{
+		worker &w = *this->workers[id];
+		boost::interprocess::scoped_lock<boost::mutex> lock(w.QLock);
+		if (!w.tasks.empty()) {
+			task.swap(w.tasks.back());
+			w.tasks.pop_back();
+			return true;
+		}
+	}
+	/* then steal the oldest task from the other threads */
+	for (size_t i = 1; i < this->workers.size(); i++) {
+		worker &w = *this->workers[(id + i) % this->workers.size()];
+		boost::interprocess::scoped_lock<boost::mutex> lock(w.QLock);
+		if (!w.tasks.empty()) {
+			task.swap(w.tasks.front());
+			w.tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void http_pipeline_pool::run(size_t id) {
+	t_taskFunc task;
+	while (true) {
+		{
+			boost::mutex::scoped_lock lock(this->WLock);
+			while (this->pending == 0 && !this->stopping)
+				this->wakeup.wait(lock);
+			if (this->pending == 0)
+				return;
+			/* reserve a task. It was queued before pending was raised, so one of the queues holds it */
+			this->pending--;
+		}
+		while (!this->take(id, task))
+			boost::this_thread::yield();
+		task();
+		task.clear();
+	}
+}
+
+
+http_response_pipeline::http_response_pipeline(boost::shared_ptr<http_pipeline_pool> mypool, size_t max) :
+		http_response(), pool(mypool), buffered(0), maxbuffered(max), received(0), running(false), last(false), done(false), failed(false)
+{
+}
+
+http_response_pipeline::~http_response_pipeline()
+{
+	boost::mutex::scoped_lock lock(this->PLock);
+	while (this->running)
+		this->idle.wait(lock);
+}
+
+void http_response_pipeline::addStage(t_stageFunc stage) {
+	this->stages.push_back(stage);
+}
+
+void http_response_pipeline::reset() {
+	{
+		boost::mutex::scoped_lock lock(this->PLock);
+		while (this->running)
+			this->idle.wait(lock);
+		this->chunks.clear();
+		this->buffered = 0;
+		this->received = 0;
+		this->last = false;
+		this->done = false;
+		this->failed = false;
+		this->ResumeFunction.clear();
+	}
+	http_response::reset();
+}
+
+size_t http_response_pipeline::getProgress() {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->PLock);
+	return this->received;
+}
+
+void http_response_pipeline::schedule() {
+	/* called with PLock held. Only one task per transfer keeps the chunks in order */
+	if (this->running)
+		return;
+	this->running = true;
+	this->pool->submit(boost::bind(&http_response_pipeline::process, this));
+}
+
+void http_response_pipeline::setBody(std::string mybod) {
+	if (mybod.empty())
+		return;
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->PLock);
+	this->buffered += mybod.length();
+	this->received += mybod.length();
+	this->chunks.push_back(std::string());
+	this->chunks.back().swap(mybod);
+	this->schedule();
+}
+
+void http_response_pipeline::setBody(char c) {
+	this->setBody(std::string(1, c));
+}
+
+void http_response_pipeline::onData(const char *data, size_t len) {
+	/* the base class would store the slice in the body, it has to go through the stages first */
+	this->setBody(std::string(data, len));
+}
+
+void http_response_pipeline::completed() {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->PLock);
+	this->last = true;
+	this->schedule();
+}
+
+bool http_response_pipeline::ready(t_resumeFunc resume) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->PLock);
+	/* a failed stage fails the transfer, there is no point in waiting for the rest of the body to drain */
+	if (this->failed)
+		return true;
+	if (this->last) {
+		/* the transfer finishes once the stages have seen the end of the body */
+		if (this->done)
+			return true;
+	} else if (this->buffered < this->maxbuffered || this->chunks.empty()) {
+		return true;
+	}
+	this->ResumeFunction = resume;
+	return false;
+}
+
+void http_response_pipeline::process() {
+	std::string data;
+	bool lastchunk = false;
+	while (true) {
+		t_resumeFunc resume;
+		bool skip;
+		{
+			boost::interprocess::scoped_lock<boost::mutex> lock(this->PLock);
+			skip = this->failed;
+			if (!this->chunks.empty()) {
+				data.swap(this->chunks.front());
+				this->chunks.pop_front();
+				this->buffered -= data.length();
+				/* restart the socket once we are down to half the limit, so it does not stop and start on every chunk */
+				if (this->ResumeFunction && !this->last && this->buffered <= this->maxbuffered / 2)
+					resume.swap(this->ResumeFunction);
+			} else if (this->last && !this->done) {
+				lastchunk = true;
+			} else {
+				this->running = false;
+				this->idle.notify_all();
+				return;
+			}
+		}
+		if (resume) {
+			resume();
+			resume.clear();
+		}
+		/* once a stage has failed the rest of the body is dropped, as the stages after it would only see part of it */
+		for (std::vector<t_stageFunc>::iterator it = this->stages.begin(); it != this->stages.end() && !skip; ++it) {
+			try {
+				(*it)(data, lastchunk);
+			} catch (std::exception &e) {
+				LogError(boost::str(boost::format("Pipeline Stage Failed: %1%") % e.what()));
+				this->fail(boost::system::errc::make_error_code(boost::system::errc::bad_message));
+				boost::interprocess::scoped_lock<boost::mutex> lock(this->PLock);
+				this->failed = true;
+				skip = true;
+				resume.swap(this->ResumeFunction);
+			}
+		}
+		if (!data.empty() && !skip)
+			http_response::setBody(data);
+		data.clear();
+		/* the engine may be waiting for the stages to catch up, wake it so it sees the failure */
+		if (resume) {
+			resume();
+			resume.clear();
+		}
+		if (lastchunk) {
+			if (!skip)
+				http_response::completed();
+			{
+				boost::interprocess::scoped_lock<boost::mutex> lock(this->PLock);
+				this->done = true;
+				resume.swap(this->ResumeFunction);
+			}
+			if (resume)
+				resume();
+			lastchunk = false;
+		}
+	}
+}
@@ -0,0 +1,43 @@
+/*
+ * Object Pools for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include "anetd/anetdConfig.h"
+#include <boost/bind.hpp>
+#include "anetd/http_engine.hpp"
+#include "anetd/http_pool.hpp"
+
+using namespace DynamX::anetd;
+
+
+http_engine_pool::http_engine_pool(boost::asio::io_service *postback, boost::asio::io_service *transport, size_t maxidle,
+		boost::shared_ptr<http_buffer_pool> buffers) :
+		http_pool<http_engine>(maxidle, boost::bind(&http_engine_pool::create, postback, transport, buffers), &http_engine_pool::recycle)
+{
+}
+
+http_engine *http_engine_pool::create(boost::asio::io_service *postback, boost::asio::io_service *transport, boost::shared_ptr<http_buffer_pool> buffers) {
+	http_engine *engine = transport ? new http_engine(postback, transport) : new http_engine(postback);
+	if (buffers)
+		engine->setBufferPool(buffers);
+	return engine;
+}
+
+void http_engine_pool::recycle(http_engine *engine) {
+	engine->recycle();
+}
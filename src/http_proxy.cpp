@@ -0,0 +1,290 @@
+/*
+ * Proxy Resolver for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include "anetd/anetdConfig.h"
+#include <arpa/inet.h>
+#include <cstdlib>
+#include <cstring>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include "anetd/http_proxy.hpp"
+#include "anetd/LogClass.hpp"
+
+using namespace DynamX::anetd;
+using namespace DynamX::Logging;
+
+static inline char ascii_lower(char c) {
+	return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+/* FNV-1a of the lower cased name, so domains can be looked up without building a string */
+static std::size_t domain_hash(const char *name, size_t len) {
+	boost::uint32_t hash = 2166136261U;
+	for (size_t i = 0; i < len; i++) {
+		hash ^= static_cast<unsigned char>(ascii_lower(name[i]));
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+/* parses a IPv4 or IPv6 address into 16 bytes. IPv4 addresses use the first 4 */
+static bool parse_address(const char *name, size_t len, unsigned char *address, bool &v6) {
+	char buf[64];
+	if (len == 0 || len >= sizeof(buf))
+		return false;
+	memcpy(buf, name, len);
+	buf[len] = '\0';
+	memset(address, 0, 16);
+	if (inet_pton(AF_INET, buf, address) == 1) {
+		v6 = false;
+		return true;
+	}
+	if (inet_pton(AF_INET6, buf, address) == 1) {
+		v6 = true;
+		return true;
+	}
+	return false;
+}
+
+static std::string get_env(const char *name) {
+	const char *var = getenv(name);
+	if (var)
+		return var;
+	return "";
+}
+
+static std::string percent_decode(const std::string &value) {
+	std::string result;
+	for (size_t i = 0; i < value.length(); i++) {
+		if (value[i] == '%' && i + 2 < value.length()) {
+			char hex[3] = { value[i + 1], value[i + 2], '\0' };
+			char *end;
+			long c = strtol(hex, &end, 16);
+			if (*end == '\0') {
+				result += static_cast<char>(c);
+				i += 2;
+				continue;
+			}
+		}
+		result += value[i];
+	}
+	return result;
+}
+
+
+http_proxy_resolver::http_proxy_resolver() : hashttp(false), hashttps(false), excludeall(false)
+{
+}
+
+boost::shared_ptr<http_proxy_resolver> http_proxy_resolver::fromEnvironment() {
+	boost::shared_ptr<http_proxy_resolver> resolver(new http_proxy_resolver());
+	std::string value = get_env("http_proxy");
+	if (value.empty())
+		value = get_env("HTTP_PROXY");
+	if (!value.empty() && !resolver->setProxy("http", value))
+		LogWarn(std::string("Invalid http_proxy: ").append(value));
+	value = get_env("https_proxy");
+	if (value.empty())
+		value = get_env("HTTPS_PROXY");
+	if (!value.empty() && !resolver->setProxy("https", value))
+		LogWarn(std::string("Invalid https_proxy: ").append(value));
+	value = get_env("no_proxy");
+	if (value.empty())
+		value = get_env("NO_PROXY");
+	resolver->setNoProxy(value);
+	return resolver;
+}
+
+static boost::shared_ptr<http_proxy_resolver> defaultresolver;
+static boost::once_flag defaultonce = BOOST_ONCE_INIT;
+
+static void create_default() {
+	defaultresolver = http_proxy_resolver::fromEnvironment();
+}
+
+boost::shared_ptr<http_proxy_resolver> http_proxy_resolver::getDefault() {
+	boost::call_once(&create_default, defaultonce);
+	return defaultresolver;
+}
+
+bool http_proxy_resolver::parseProxy(const std::string &url, proxy &result) {
+	/* [protocol://][user[:password]@]host[:port][/] */
+	size_t start = url.find("://");
+	start = (start == std::string::npos) ? 0 : start + 3;
+	size_t end = url.find('/', start);
+	if (end == std::string::npos)
+		end = url.length();
+	size_t at = url.rfind('@', end);
+	if (at != std::string::npos && at >= start) {
+		std::string userinfo = url.substr(start, at - start);
+		size_t colon = userinfo.find(':');
+		result.auth.first = percent_decode(userinfo.substr(0, colon));
+		result.auth.second = colon == std::string::npos ? "" : percent_decode(userinfo.substr(colon + 1));
+		start = at + 1;
+	}
+	size_t colon = url.rfind(':', end);
+	if (colon != std::string::npos && colon >= start && url.find(']', colon) == std::string::npos) {
+		result.host = url.substr(start, colon - start);
+		result.port = url.substr(colon + 1, end - colon - 1);
+	} else {
+		result.host = url.substr(start, end - start);
+		result.port = "80";
+	}
+	if (result.host.length() > 2 && result.host[0] == '[' && result.host[result.host.length() - 1] == ']')
+		result.host = result.host.substr(1, result.host.length() - 2);
+	return !result.host.empty() && !result.port.empty() && result.port.find_first_not_of("0123456789") == std::string::npos;
+}
+
+bool http_proxy_resolver::setProxy(const std::string &protocol, const std::string &url) {
+	proxy result;
+	bool valid = url.empty() || this->parseProxy(url, result);
+	if (protocol == "http") {
+		this->hashttp = valid && !url.empty();
+		this->httpproxy = result;
+	} else if (protocol == "https") {
+		this->hashttps = valid && !url.empty();
+		this->httpsproxy = result;
+	} else {
+		return false;
+	}
+	return valid;
+}
+
+void http_proxy_resolver::setNoProxy(const std::string &list) {
+	this->excludeall = false;
+	this->domains.clear();
+	this->networks.clear();
+	size_t pos = 0;
+	while (pos < list.length()) {
+		size_t end = list.find_first_of(", \t", pos);
+		if (end == std::string::npos)
+			end = list.length();
+		if (end > pos && !this->addNoProxy(list.substr(pos, end - pos)))
+			LogWarn(std::string("Invalid no_proxy entry: ").append(list.substr(pos, end - pos)));
+		pos = end + 1;
+	}
+}
+
+bool http_proxy_resolver::addNoProxy(const std::string &myentry) {
+	std::string entry(myentry);
+	if (entry == "*") {
+		this->excludeall = true;
+		return true;
+	}
+	if (entry.length() > 2 && entry[0] == '[') {
+		size_t close = entry.find(']');
+		if (close == std::string::npos)
+			return false;
+		entry = entry.substr(1, close - 1);
+	}
+	network net;
+	size_t slash = entry.find('/');
+	if (slash != std::string::npos) {
+		char *end;
+		long prefix = strtol(entry.c_str() + slash + 1, &end, 10);
+		if (*end != '\0' || !parse_address(entry.data(), slash, net.address, net.v6) || prefix < 0 || prefix > (net.v6 ? 128 : 32))
+			return false;
+		net.prefix = prefix;
+		this->networks.push_back(net);
+		return true;
+	}
+	if (parse_address(entry.data(), entry.length(), net.address, net.v6)) {
+		net.prefix = net.v6 ? 128 : 32;
+		this->networks.push_back(net);
+		return true;
+	}
+	/* a domain, with the leading "*." or "." and a port dropped */
+	if (entry.compare(0, 2, "*.") == 0)
+		entry.erase(0, 2);
+	else if (entry.compare(0, 1, ".") == 0)
+		entry.erase(0, 1);
+	size_t colon = entry.find(':');
+	if (colon != std::string::npos)
+		entry.erase(colon);
+	while (!entry.empty() && entry[entry.length() - 1] == '.')
+		entry.erase(entry.length() - 1);
+	if (entry.empty())
+		return false;
+	for (size_t i = 0; i < entry.length(); i++)
+		entry[i] = ascii_lower(entry[i]);
+	this->domains.insert(std::make_pair(domain_hash(entry.data(), entry.length()), entry));
+	return true;
+}
+
+bool http_proxy_resolver::isExcluded(const char *hostname, size_t len) const {
+	if (this->excludeall)
+		return true;
+	while (len > 0 && hostname[len - 1] == '.')
+		len--;
+	if (len == 0)
+		return false;
+	if (!this->networks.empty()) {
+		unsigned char address[16];
+		bool v6;
+		if (parse_address(hostname, len, address, v6)) {
+			for (std::vector<network>::const_iterator it = this->networks.begin(); it != this->networks.end(); ++it) {
+				if (it->v6 != v6)
+					continue;
+				unsigned int bytes = it->prefix / 8;
+				unsigned int bits = it->prefix % 8;
+				if (memcmp(address, it->address, bytes) != 0)
+					continue;
+				if (bits && ((address[bytes] ^ it->address[bytes]) & (0xff << (8 - bits))))
+					continue;
+				return true;
+			}
+			return false;
+		}
+	}
+	if (this->domains.empty())
+		return false;
+	/* look up the host name, then each parent domain */
+	size_t pos = 0;
+	while (pos < len) {
+		const char *suffix = hostname + pos;
+		size_t suffixlen = len - pos;
+		typedef boost::unordered_multimap<std::size_t, std::string>::const_iterator t_domainit;
+		std::pair<t_domainit, t_domainit> range = this->domains.equal_range(domain_hash(suffix, suffixlen));
+		for (t_domainit it = range.first; it != range.second; ++it) {
+			if (it->second.length() != suffixlen)
+				continue;
+			size_t i = 0;
+			while (i < suffixlen && ascii_lower(suffix[i]) == it->second[i])
+				i++;
+			if (i == suffixlen)
+				return true;
+		}
+		const char *dot = static_cast<const char *>(memchr(suffix, '.', suffixlen));
+		if (!dot)
+			break;
+		pos = dot - hostname + 1;
+	}
+	return false;
+}
+
+const http_proxy_resolver::proxy *http_proxy_resolver::resolve(const std::string &protocol, const char *hostname, size_t len) const {
+	const proxy *result = NULL;
+	if (this->hashttp && protocol == "http")
+		result = &this->httpproxy;
+	else if (this->hashttps && protocol == "https")
+		result = &this->httpsproxy;
+	if (!result || this->isExcluded(hostname, len))
+		return NULL;
+	return result;
+}
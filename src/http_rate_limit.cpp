@@ -0,0 +1,188 @@
+/*
+ * Bandwidth Limits for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include "anetd/anetdConfig.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+#include <boost/thread/once.hpp>
+#include "anetd/http_rate_limit.hpp"
+
+using namespace DynamX::anetd;
+
+http_token_bucket::http_token_bucket(boost::uint64_t myrate, size_t myburst) : rate(0), burst(MINBURST), tokens(0), consumed(0)
+{
+	this->setRate(myrate, myburst);
+}
+
+void http_token_bucket::setRate(boost::uint64_t myrate, size_t myburst) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->BLock);
+	boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+	/* the tokens gathered so far were earned at the old rate. A bucket that was unlimited starts out full */
+	bool unlimited = this->rate == 0;
+	if (!unlimited)
+		this->refill(now);
+	this->rate = myrate;
+	this->burst = myburst > 0 ? myburst : std::max(static_cast<size_t>(myrate / 8), static_cast<size_t>(MINBURST));
+	this->tokens = unlimited ? this->burst : std::min(this->tokens, static_cast<double>(this->burst));
+	this->last = now;
+}
+
+void http_token_bucket::reset() {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->BLock);
+	this->rate = 0;
+	this->burst = MINBURST;
+	this->tokens = 0;
+	this->consumed = 0;
+}
+
+boost::uint64_t http_token_bucket::getRate() {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->BLock);
+	return this->rate;
+}
+
+size_t http_token_bucket::getBurst() {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->BLock);
+	return this->burst;
+}
+
+void http_token_bucket::refill(const boost::posix_time::ptime &now) {
+	boost::int64_t elapsed = (now - this->last).total_microseconds();
+	if (elapsed <= 0)
+		return;
+	this->tokens = std::min(this->tokens + static_cast<double>(elapsed) * this->rate / 1e6, static_cast<double>(this->burst));
+	this->last = now;
+}
+
+size_t http_token_bucket::available(size_t need, boost::posix_time::time_duration &wait) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->BLock);
+	if (this->rate == 0)
+		return std::numeric_limits<size_t>::max();
+	this->refill(boost::posix_time::microsec_clock::universal_time());
+	/* a bucket smaller than the read would never fill up enough */
+	need = std::max(std::min(need, this->burst), static_cast<size_t>(1));
+	if (this->tokens >= need)
+		return static_cast<size_t>(this->tokens);
+	double ms = std::ceil((need - this->tokens) * 1000 / this->rate);
+	wait = boost::posix_time::milliseconds(static_cast<long>(std::min(std::max(ms, 1.0), static_cast<double>(MAXWAIT))));
+	return 0;
+}
+
+void http_token_bucket::consume(size_t bytes) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->BLock);
+	this->consumed += bytes;
+	if (this->rate == 0)
+		return;
+	this->refill(boost::posix_time::microsec_clock::universal_time());
+	this->tokens -= bytes;
+}
+
+boost::uint64_t http_token_bucket::getConsumed() {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->BLock);
+	return this->consumed;
+}
+
+
+http_rate_limiter::http_rate_limiter()
+{
+}
+
+static boost::shared_ptr<http_rate_limiter> defaultlimiter;
+static boost::once_flag defaultonce = BOOST_ONCE_INIT;
+
+static void create_default() {
+	defaultlimiter.reset(new http_rate_limiter());
+}
+
+boost::shared_ptr<http_rate_limiter> http_rate_limiter::getDefault() {
+	boost::call_once(&create_default, defaultonce);
+	return defaultlimiter;
+}
+
+void http_rate_limiter::setRate(direction dir, boost::uint64_t rate, size_t burst) {
+	this->global[dir].setRate(rate, burst);
+}
+
+boost::uint64_t http_rate_limiter::getRate(direction dir) {
+	return this->global[dir].getRate();
+}
+
+void http_rate_limiter::setHostRate(const std::string &host, direction dir, boost::uint64_t rate, size_t burst) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->RLock);
+	/* the transfers in progress hold on to the bucket, so a existing one is changed rather than replaced */
+	boost::shared_ptr<http_token_bucket> &bucket = this->hosts[dir][boost::algorithm::to_lower_copy(host)];
+	if (bucket)
+		bucket->setRate(rate, burst);
+	else
+		bucket.reset(new http_token_bucket(rate, burst));
+}
+
+boost::uint64_t http_rate_limiter::getHostRate(const std::string &host, direction dir) {
+	boost::shared_ptr<http_token_bucket> bucket = this->getHost(host, dir);
+	return bucket ? bucket->getRate() : 0;
+}
+
+bool http_rate_limiter::removeHost(const std::string &host) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->RLock);
+	bool found = false;
+	for (unsigned int dir = RECEIVE; dir <= SEND; dir++) {
+		std::map<std::string, boost::shared_ptr<http_token_bucket> >::iterator it = this->hosts[dir].find(boost::algorithm::to_lower_copy(host));
+		if (it == this->hosts[dir].end())
+			continue;
+		/* lift the limit for the transfers that still hold the bucket */
+		it->second->setRate(0);
+		this->hosts[dir].erase(it);
+		found = true;
+	}
+	return found;
+}
+
+boost::shared_ptr<http_token_bucket> http_rate_limiter::getHost(const std::string &host, direction dir) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->RLock);
+	if (this->hosts[dir].empty())
+		return boost::shared_ptr<http_token_bucket>();
+	std::map<std::string, boost::shared_ptr<http_token_bucket> >::iterator it = this->hosts[dir].find(boost::algorithm::to_lower_copy(host));
+	if (it == this->hosts[dir].end())
+		return boost::shared_ptr<http_token_bucket>();
+	return it->second;
+}
+
+size_t http_rate_limiter::available(const std::string &host, direction dir, size_t need, boost::posix_time::time_duration &wait) {
+	boost::posix_time::time_duration globalwait, hostwait;
+	size_t allowed = this->global[dir].available(need, globalwait);
+	boost::shared_ptr<http_token_bucket> bucket = this->getHost(host, dir);
+	size_t hostallowed = bucket ? bucket->available(need, hostwait) : std::numeric_limits<size_t>::max();
+	/* wait for the bucket that takes longest to fill */
+	wait = boost::posix_time::time_duration();
+	if (allowed == 0)
+		wait = globalwait;
+	if (hostallowed == 0 && hostwait > wait)
+		wait = hostwait;
+	return std::min(allowed, hostallowed);
+}
+
+void http_rate_limiter::consume(const std::string &host, direction dir, size_t bytes) {
+	this->global[dir].consume(bytes);
+	boost::shared_ptr<http_token_bucket> bucket = this->getHost(host, dir);
+	if (bucket)
+		bucket->consume(bytes);
+}
@@ -0,0 +1,268 @@
+/*
+ * HTTP Request Serializer for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include "anetd/anetdConfig.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <boost/lexical_cast.hpp>
+#include "anetd/http_request.hpp"
+#include "anetd/LogClass.hpp"
+
+using namespace DynamX::anetd;
+using namespace DynamX::Logging;
+
+
+http_request_body::~http_request_body()
+{
+}
+
+boost::asio::const_buffer http_request_body::memory() {
+	return boost::asio::const_buffer();
+}
+
+int http_request_body::fd() {
+	return -1;
+}
+
+bool http_request_body::isOpen() {
+	return true;
+}
+
+boost::system::error_code http_request_body::getError() {
+	return boost::system::error_code();
+}
+
+
+http_request_body_string::http_request_body_string(const std::string &mybody) : body(mybody), offset(0)
+{
+}
+
+bool http_request_body_string::hasSize() {
+	return true;
+}
+
+boost::uint64_t http_request_body_string::size() {
+	return this->body.length();
+}
+
+size_t http_request_body_string::read(char *data, size_t size) {
+	size_t len = std::min(size, this->body.length() - this->offset);
+	memcpy(data, this->body.data() + this->offset, len);
+	this->offset += len;
+	return len;
+}
+
+bool http_request_body_string::rewind() {
+	this->offset = 0;
+	return true;
+}
+
+boost::asio::const_buffer http_request_body_string::memory() {
+	return boost::asio::buffer(this->body);
+}
+
+
+http_request_body_file::http_request_body_file(const std::string &filename) : file(-1), filesize(0)
+{
+	struct stat st;
+	this->file = ::open(filename.c_str(), O_RDONLY);
+	if (this->file < 0) {
+		this->error = boost::system::error_code(errno, boost::system::system_category());
+		LogWarn(std::string("Could Not Open File: ").append(filename).append(": ").append(this->error.message()));
+		return;
+	}
+	if (::fstat(this->file, &st) == 0)
+		this->filesize = st.st_size;
+}
+
+http_request_body_file::~http_request_body_file()
+{
+	if (this->file >= 0)
+		::close(this->file);
+}
+
+bool http_request_body_file::isOpen() {
+	return this->file >= 0;
+}
+
+bool http_request_body_file::hasSize() {
+	return true;
+}
+
+boost::uint64_t http_request_body_file::size() {
+	return this->filesize;
+}
+
+size_t http_request_body_file::read(char *data, size_t size) {
+	if (this->file < 0)
+		return 0;
+	ssize_t len;
+	do {
+		len = ::read(this->file, data, size);
+	} while (len < 0 && errno == EINTR);
+	if (len < 0) {
+		this->error = boost::system::error_code(errno, boost::system::system_category());
+		return 0;
+	}
+	return len;
+}
+
+bool http_request_body_file::rewind() {
+	if (this->file < 0)
+		return false;
+	return ::lseek(this->file, 0, SEEK_SET) == 0;
+}
+
+int http_request_body_file::fd() {
+	return this->file;
+}
+
+boost::system::error_code http_request_body_file::getError() {
+	return this->error;
+}
+
+
+http_request_body_generator::http_request_body_generator(t_generatorFunc func, t_rewindFunc rewindfunc) :
+		GeneratorFunction(func), RewindFunction(rewindfunc), sized(false), bodysize(0)
+{
+}
+
+http_request_body_generator::http_request_body_generator(t_generatorFunc func, boost::uint64_t size, t_rewindFunc rewindfunc) :
+		GeneratorFunction(func), RewindFunction(rewindfunc), sized(true), bodysize(size)
+{
+}
+
+bool http_request_body_generator::hasSize() {
+	return this->sized;
+}
+
+boost::uint64_t http_request_body_generator::size() {
+	return this->bodysize;
+}
+
+size_t http_request_body_generator::read(char *data, size_t size) {
+	if (this->error)
+		return 0;
+	return this->GeneratorFunction(data, size, this->error);
+}
+
+bool http_request_body_generator::rewind() {
+	if (!this->RewindFunction)
+		return false;
+	this->error.clear();
+	return this->RewindFunction();
+}
+
+boost::system::error_code http_request_body_generator::getError() {
+	return this->error;
+}
+
+
+http_request::http_request() : body(NULL), chunked(false)
+{
+}
+
+void http_request::reset() {
+	this->requestline.clear();
+	this->trailer.clear();
+	this->body = NULL;
+	this->chunked = false;
+}
+
+void http_request::invalidate() {
+	this->headerkey.clear();
+	this->headerblock.clear();
+}
+
+bool http_request::isCached(const std::string &key) const {
+	return this->isCached(key.data(), key.length());
+}
+
+bool http_request::isCached(const char *key, size_t keylen) const {
+	return !this->headerkey.empty() && this->headerkey.compare(0, std::string::npos, key, keylen) == 0;
+}
+
+void http_request::setHeaderBlock(const std::string &key, const std::string &block) {
+	this->headerkey = key;
+	this->headerblock = block;
+}
+
+void http_request::setRequestLine(const std::string &method, const std::string &target, const std::string &version) {
+	this->setRequestLine(method, target.data(), target.length(), version);
+}
+
+void http_request::setRequestLine(const std::string &method, const char *target, size_t targetlen, const std::string &version) {
+	this->requestline.clear();
+	this->requestline.reserve(method.length() + targetlen + version.length() + 4);
+	this->requestline.append(method).append(1, ' ').append(target, targetlen).append(1, ' ').append(version).append("\r\n");
+}
+
+void http_request::setBody(http_request_body *mybody) {
+	this->body = mybody;
+	this->chunked = false;
+	this->trailer.clear();
+	if (this->body) {
+		if (this->body->hasSize()) {
+			this->trailer.append("Content-Length: ").append(boost::lexical_cast<std::string>(this->body->size())).append("\r\n");
+		} else {
+			this->trailer.append("Transfer-Encoding: chunked\r\n");
+			this->chunked = true;
+		}
+	}
+	this->trailer.append("\r\n");
+}
+
+bool http_request::isChunked() const {
+	return this->chunked;
+}
+
+bool http_request::isStreamed() const {
+	return this->body && boost::asio::buffer_size(this->body->memory()) == 0 && (this->chunked || this->body->size() > 0);
+}
+
+const std::string &http_request::getRequestLine() const {
+	return this->requestline;
+}
+
+const std::string &http_request::getHeaderBlock() const {
+	return this->headerblock;
+}
+
+std::vector<boost::asio::const_buffer> http_request::buffers() const {
+	std::vector<boost::asio::const_buffer> bufs;
+	bufs.reserve(4);
+	bufs.push_back(boost::asio::buffer(this->requestline));
+	bufs.push_back(boost::asio::buffer(this->headerblock));
+	bufs.push_back(boost::asio::buffer(this->trailer));
+	if (this->body && boost::asio::buffer_size(this->body->memory()) > 0)
+		bufs.push_back(this->body->memory());
+	return bufs;
+}
+
+size_t http_request::size() const {
+	size_t len = this->requestline.length() + this->headerblock.length() + this->trailer.length();
+	if (this->body)
+		len += boost::asio::buffer_size(this->body->memory());
+	return len;
+}
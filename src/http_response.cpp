@@ -18,9 +18,13 @@
  *
  */
 #include "anetd/anetdConfig.h"
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/trim.hpp>
 #include <boost/interprocess/sync/scoped_lock.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
 #include <boost/regex.hpp>
+#include <boost/smart_ptr/detail/atomic_count.hpp>
 #include "anetd/http_engine.hpp"
 #include "anetd/http_response.hpp"
 #include "anetd/LogClass.hpp"
@@ -29,9 +33,13 @@
 using namespace DynamX::anetd;
 using namespace DynamX::Logging;
 
+/* every change to the headers or credentials we send gets a process wide unique generation, so
+ * the http_engine can tell when its cached header block is stale */
+static boost::detail::atomic_count headergenerations(0);
 
-http_response::http_response(): body_size(0)
+http_response::http_response(): status(0), body_size(0), progress(0), digestcheck(false), digestsarmed(false)
 {
+	this->headergeneration = ++headergenerations;
 	this->reset();
 }
 
@@ -42,128 +50,363 @@ http_response::~http_response()
 
 void http_response::reset()
 {
-	boost::interprocess::scoped_lock<boost::mutex>(this->TLock);
-	this->version = "HTTP/1.0";
-	this->status = 0;
-	this->description = "OK";
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->TLock);
+	/* the initial snapshot is shared by every reset response, so a reset does not allocate */
+	static const boost::shared_ptr<const snapshot> initial = boost::make_shared<snapshot>();
+	this->publish(initial);
+	this->status.store(0, boost::memory_order_release);
+	/* the body blocks go back to the buffer pool and the header table keeps its capacity, so a reused response does not allocate again */
 	this->headers.clear();
-	this->body_size = 0;
-	this->body = "";
-	this->progress = 0;
-	this->url = "";
+	this->headermapstale = true;
+	this->body_size.store(0, boost::memory_order_release);
+	{
+		boost::interprocess::scoped_lock<boost::mutex> bodylock(this->BLock);
+		this->body.clear();
+	}
+	this->progress.store(0, boost::memory_order_release);
+	/* the digests stay attached, like the headers we send, but the ones taken from the last response go with it */
+	std::vector<digest_stage>::iterator it = this->digests.begin();
+	while (it != this->digests.end()) {
+		if (it->automatic) {
+			it = this->digests.erase(it);
+			continue;
+		}
+		it->digest->restart();
+		it->result.clear();
+		++it;
+	}
+	this->digestsarmed = false;
+	this->bodyerror.clear();
+}
+
+void http_response::recycle()
+{
+	/* a pooled response goes to someone else next, so the headers, credentials and digests they did not set go too */
+	this->sendheaders.clear();
+	this->httpauth.first.clear();
+	this->httpauth.second.clear();
+	this->headergeneration = ++headergenerations;
+	this->clearDigests();
+	this->digestcheck = false;
+	this->cookies.clear();
+	this->reset();
 }
 
+boost::shared_ptr<const http_response::snapshot> http_response::load() const {
+	return boost::atomic_load(&this->current);
+}
+
+void http_response::publish(const boost::shared_ptr<const snapshot> &next) {
+	boost::atomic_store(&this->current, next);
+}
 
 void http_response::setVersion(std::string ver) {
-    this->version = ver;
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->TLock);
+	boost::shared_ptr<snapshot> next = boost::make_shared<snapshot>(*this->load());
+	next->version.swap(ver);
+	this->publish(next);
 }
 
 std::string http_response::getVersion() {
-    return this->version;
+	return this->load()->version;
 }
 
 void http_response::setStatus(int stat) {
-    this->status = stat;
+	this->status.store(stat, boost::memory_order_release);
 }
 
 int http_response::getStatus() {
-    return this->status;
+	return this->status.load(boost::memory_order_acquire);
 }
 
 void http_response::setDescription(std::string desc) {
-    this->description = desc;
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->TLock);
+	boost::shared_ptr<snapshot> next = boost::make_shared<snapshot>(*this->load());
+	next->description.swap(desc);
+	this->publish(next);
 }
 std::string http_response::getDescription() {
-    return this->description;
+	return this->load()->description;
 }
 
 void http_response::setHeaders(std::string key, std::string val) {
-    this->headers.insert(std::pair<std::string, std::string>(key, val));
+    this->headers.add(key, val);
+    this->headermapstale = true;
 }
 
 std::map<std::string, std::string>::iterator http_response::getHeadersBegin() {
-    return this->headers.begin();
+    if (this->headermapstale) {
+        /* the first header of a name wins, like the lookup functions */
+        this->headermap.clear();
+        for (size_t i = 0; i < this->headers.size(); i++)
+            this->headermap.insert(std::pair<std::string, std::string>(this->headers.getName(i), this->headers.getValue(i)));
+        this->headermapstale = false;
+    }
+    return this->headermap.begin();
 }
 
 std::map<std::string, std::string>::iterator http_response::getHeadersEnd() {
-    return this->headers.end();
+    if (this->headermapstale)
+        this->getHeadersBegin();
+    return this->headermap.end();
 }
 std::string http_response::getHeader(std::string key) {
-    std::map<std::string, std::string>::iterator iter = this->headers.find(key);
-    if (iter != this->headers.end())
-        return iter->second;
-    return "";
+    std::string value;
+    this->headers.get(key, value);
+    return value;
+}
+
+std::string http_response::getHeader(http_headers::header_id id) {
+    std::string value;
+    this->headers.get(id, value);
+    return value;
+}
+
+const http_headers &http_response::getHeaders() {
+    return this->headers;
 }
 
 void http_response::setBodySize(size_t size) {
-	boost::interprocess::scoped_lock<boost::mutex>(this->TLock);
-    this->body_size = size;
+	this->body_size.store(size, boost::memory_order_release);
 }
 
 size_t http_response::getBodySize() {
-	boost::interprocess::scoped_lock<boost::mutex>(this->TLock);
-	return this->body_size;
+	return this->body_size.load(boost::memory_order_acquire);
 }
 
 void http_response::setBody(std::string mybod) {
-	boost::interprocess::scoped_lock<boost::mutex>(this->TLock);
-	this->body += mybod;
-	this->progress += mybod.length();
+	this->append_body(mybod.data(), mybod.length());
 }
 
 void http_response::setBody(char c) {
-	boost::interprocess::scoped_lock<boost::mutex>(this->TLock);
-	this->body += c;
-	this->progress++;
+	this->append_body(&c, 1);
+}
+
+void http_response::append_body(const char *data, size_t len) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->BLock);
+	/* the first part of a body of known size sets aside room for all of it, so it is stored in one buffer */
+	if (this->body.empty())
+		this->body.reserve(this->getBodySize());
+	this->body.append(data, len);
+}
+
+void http_response::receive(const char *data, size_t len) {
+	/* only the transport adds to the progress, a reader just needs to see whole values */
+	this->progress.fetch_add(len, boost::memory_order_release);
+	if (!this->digestsarmed)
+		this->arm_digests();
+	for (std::vector<digest_stage>::iterator it = this->digests.begin(); it != this->digests.end(); ++it)
+		it->digest->update(data, len);
+	this->onData(data, len);
+}
+
+boost::system::error_code http_response::complete_body() {
+	boost::system::error_code failed = this->failure();
+	if (failed)
+		return failed;
+	if (!this->digestsarmed)
+		this->arm_digests();
+	bool matched = true;
+	for (std::vector<digest_stage>::iterator it = this->digests.begin(); it != this->digests.end(); ++it) {
+		it->result = it->digest->final();
+		std::string sent;
+		if (!it->automatic && this->digestcheck && this->server_digest(it->digest->getAlgorithm(), sent) && sent != it->result) {
+			LogError(boost::str(boost::format("Body of %1% does not match the %2% digest sent by the server: expected %3%, got %4%") % this->getURL()
+					% http_digest::getName(it->digest->getAlgorithm()) % http_digest::toHex(sent) % http_digest::toHex(it->result)));
+			matched = false;
+		}
+		if (!it->expected.empty() && it->expected != it->result) {
+			LogError(boost::str(boost::format("Body of %1% does not match the %2% digest: expected %3%, got %4%") % this->getURL()
+					% http_digest::getName(it->digest->getAlgorithm()) % http_digest::toHex(it->expected) % http_digest::toHex(it->result)));
+			matched = false;
+		}
+	}
+	if (!matched)
+		return http_digest_errc::make_error_code(http_digest_errc::mismatch);
+	this->completed();
+	/* completed() can still fail the transfer, eg when the file does not close */
+	return this->failure();
+}
+
+void http_response::fail(const boost::system::error_code &err) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->TLock);
+	if (!this->bodyerror)
+		this->bodyerror = err;
+}
+
+boost::system::error_code http_response::failure() {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->TLock);
+	return this->bodyerror;
+}
+
+void http_response::arm_digests() {
+	this->digestsarmed = true;
+	if (!this->digestcheck)
+		return;
+	/* the headers are in by the time the first slice of the body arrives, so attach the algorithms the server sent a digest for */
+	static const http_digest::algorithm algorithms[] = { http_digest::SHA256, http_digest::MD5, http_digest::CRC32C };
+	for (size_t i = 0; i < sizeof(algorithms) / sizeof(algorithms[0]); i++) {
+		std::string sent;
+		if (!this->server_digest(algorithms[i], sent))
+			continue;
+		bool attached = false;
+		for (std::vector<digest_stage>::iterator it = this->digests.begin(); it != this->digests.end(); ++it)
+			attached |= it->digest->getAlgorithm() == algorithms[i];
+		if (attached)
+			continue;
+		digest_stage stage;
+		stage.digest.reset(http_digest::create(algorithms[i]));
+		stage.expected = sent;
+		stage.automatic = true;
+		this->digests.push_back(stage);
+	}
+}
+
+bool http_response::server_digest(http_digest::algorithm alg, std::string &raw) {
+	std::string value;
+	/* Content-Digest (RFC 9530) covers the content as sent, Repr-Digest and Digest (RFC 3230) the whole representation */
+	const char *fields[] = { "Content-Digest", "Repr-Digest", "Digest" };
+	size_t count = this->getStatus() == 206 ? 1 : 3;
+	for (size_t f = 0; f < count; f++) {
+		if (!this->headers.get(fields[f], value))
+			continue;
+		/* a list of algorithm=value, the values being base64, wrapped in colons for the RFC 9530 headers */
+		std::string::size_type start = 0;
+		while (start <= value.size()) {
+			std::string::size_type end = value.find(',', start);
+			if (end == std::string::npos)
+				end = value.size();
+			std::string item = value.substr(start, end - start);
+			start = end + 1;
+			std::string::size_type eq = item.find('=');
+			if (eq == std::string::npos)
+				continue;
+			std::string name = boost::algorithm::to_lower_copy(boost::algorithm::trim_copy(item.substr(0, eq)));
+			if (name != http_digest::getName(alg) && !(alg == http_digest::SHA256 && name == "sha256"))
+				continue;
+			std::string encoded = boost::algorithm::trim_copy(item.substr(eq + 1));
+			std::string::size_type params = encoded.find(';');
+			if (params != std::string::npos)
+				encoded = boost::algorithm::trim_copy(encoded.substr(0, params));
+			if (encoded.size() >= 2 && encoded[0] == ':' && encoded[encoded.size() - 1] == ':')
+				encoded = encoded.substr(1, encoded.size() - 2);
+			if (http_digest::fromBase64(encoded, raw))
+				return true;
+			LogWarn(boost::str(boost::format("Ignoring a invalid %1% digest in the %2% header: %3%") % name % fields[f] % encoded));
+		}
+	}
+	if (alg == http_digest::MD5 && this->headers.get(http_headers::Content_MD5, value) && http_digest::fromBase64(boost::algorithm::trim_copy(value), raw))
+		return true;
+	return false;
+}
+
+bool http_response::addDigest(http_digest::algorithm alg, const std::string &expected) {
+	std::string raw;
+	if (!expected.empty() && !http_digest::fromHex(expected, raw) && !http_digest::fromBase64(expected, raw))
+		return false;
+	for (std::vector<digest_stage>::iterator it = this->digests.begin(); it != this->digests.end(); ++it) {
+		if (it->digest->getAlgorithm() != alg)
+			continue;
+		it->expected = raw;
+		it->automatic = false;
+		return true;
+	}
+	digest_stage stage;
+	stage.digest.reset(http_digest::create(alg));
+	stage.expected = raw;
+	stage.automatic = false;
+	this->digests.push_back(stage);
+	return true;
+}
+
+std::string http_response::getDigest(http_digest::algorithm alg) {
+	for (std::vector<digest_stage>::iterator it = this->digests.begin(); it != this->digests.end(); ++it)
+		if (it->digest->getAlgorithm() == alg)
+			return http_digest::toHex(it->result);
+	return "";
+}
+
+void http_response::clearDigests() {
+	this->digests.clear();
+}
+
+void http_response::setDigestCheck(bool check) {
+	this->digestcheck = check;
 }
 std::string http_response::getBody() {
-	boost::interprocess::scoped_lock<boost::mutex>(this->TLock);
-	return this->body;
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->BLock);
+	return this->body.str();
 
 }
+const http_body &http_response::getBodyBuffers() {
+	return this->body;
+}
 size_t http_response::getProgress() {
-	boost::interprocess::scoped_lock<boost::mutex>(this->TLock);
-	return this->progress;
+	return this->progress.load(boost::memory_order_acquire);
 }
 void http_response::flush() {
 	/* nothing in the base class */
 }
 void http_response::completed() {
 
+}
+void http_response::onHeaders() {
+	/* nothing in the base class */
+}
+void http_response::onData(const char *data, size_t len) {
+	/* straight from the receive buffer into the body, without a string for each slice */
+	this->append_body(data, len);
+}
+void http_response::onError(const boost::system::error_code &) {
+	/* nothing in the base class */
+}
+bool http_response::ready(t_resumeFunc) {
+	return true;
 }
 std::string http_response::getURL() {
-	boost::interprocess::scoped_lock<boost::mutex>(this->TLock);
-	return this->url;
+	return this->load()->url;
 }
 void http_response::setURL(std::string url) {
-	boost::interprocess::scoped_lock<boost::mutex>(this->TLock);
-	this->url = url;
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->TLock);
+	boost::shared_ptr<snapshot> next = boost::make_shared<snapshot>(*this->load());
+	next->url.swap(url);
+	this->publish(next);
 }
 
 bool http_response::setHeader(std::string name, std::string value) {
-	if (this->sendheaders.find(name) == this->sendheaders.end())
-		return false;
-	std::pair<std::map<std::string, std::string>::iterator, bool> ret =
-			this->sendheaders.insert(
-					std::pair<std::string, std::string>(name, value));
-	return ret.second;
+	this->sendheaders[name] = value;
+	this->headergeneration = ++headergenerations;
+	return true;
 }
 bool http_response::setHTTPAuth(std::string username, std::string password) {
 	this->httpauth.first = username;
 	this->httpauth.second = password;
+	this->headergeneration = ++headergenerations;
 	return true;
 }
 
 
-http_response_file::http_response_file() : http_response() {
+http_response_file::http_response_file() : http_response(), backend(http_file_writer::BACKEND_AUTO), opened(false) {
 	this->reset();
 }
 
+void http_response_file::setBackend(http_file_writer::backend mybackend) {
+	this->backend = mybackend;
+	/* the writer is created again by the next OpenFile() */
+	if (!this->opened)
+		this->file.reset();
+}
+
 void http_response_file::reset() {
+	/* a file still open here belongs to a transfer that did not complete, eg one that is being retried */
+	this->DiscardFile();
 	this->filename = "";
-	this->CloseFile();
 	http_response::reset();
-	std::cout << "Reset" << std::endl;
+}
+
+void http_response_file::recycle() {
+	this->backend = http_file_writer::BACKEND_AUTO;
+	http_response::recycle();
 }
 
 void http_response_file::setURL(std::string url) {
@@ -185,13 +428,23 @@ void http_response_file::setURL(std::string url) {
 	//this->CloseFile();
 }
 
-void http_response_file::flush() {
+void http_response_file::onHeaders() {
+	/* a successful response gets its file even if it has no body. Error statuses do not leave files behind */
+	int status = this->getStatus();
+	if (status >= 200 && status < 300 && !this->OpenFile())
+		this->fail(boost::system::errc::make_error_code(boost::system::errc::io_error));
+}
+
+void http_response_file::onData(const char *data, size_t len) {
+	/* written straight from the receive buffer, the body is never stored */
 	if (!this->OpenFile()) {
+		this->fail(boost::system::errc::make_error_code(boost::system::errc::io_error));
 		return;
 	}
-	this->file << this->getBody();
-	this->file.flush();
-	this->body.clear();
+	if (!this->file->write(data, len)) {
+		LogWarn(std::string("Error writing file: ").append(this->filepath.string()));
+		this->fail(boost::system::errc::make_error_code(boost::system::errc::io_error));
+	}
 }
 
 bool http_response_file::OpenFile() {
@@ -203,15 +456,9 @@ bool http_response_file::OpenFile() {
 		this->filepath = this->filename + "." + boost::lexical_cast<std::string>(static_cast<int>(i));
 		i++;
 	}
-	this->file.clear(std::iostream::goodbit);
-	this->file.exceptions ( std::ifstream::failbit | std::ifstream::badbit );
-	try {
-//		this->file.open(this->filepath, std::ios_base::binary | std::ios_base::in | std::ios_base::out | std::ios_base::trunc | std::ios_base::app);
-		this->file.open(this->filepath);
-	} catch (std::ios_base::failure e) {
-	    LogWarn(std::string("Exception opening/reading file: ").append(e.what()));
-	}
-	if (this->file.is_open()) {
+	if (!this->file)
+		this->file.reset(http_file_writer::create(this->backend));
+	if (this->file->open(this->filepath.string())) {
 		this->opened = true;
 		return true;
 	}
@@ -222,12 +469,38 @@ bool http_response_file::CloseFile() {
 	this->opened = false;
 	this->filepath.clear();
 	this->filename = "";
-	if (this->file.is_open()) this->file.close();
+	if (this->file && this->file->isOpen() && !this->file->close()) {
+		LogWarn("Error writing file");
+		return false;
+	}
+	return true;
+}
+
+bool http_response_file::DiscardFile() {
+	if (!this->opened)
+		return false;
+	boost::filesystem::path path = this->filepath;
+	this->CloseFile();
+	boost::system::error_code err;
+	boost::filesystem::remove(path, err);
+	LogWarn(std::string("Removed Incomplete File: ").append(path.string()));
 	return true;
 }
 
 void http_response_file::completed() {
+	/* the last writes only fail when the file is closed. The file stays marked open, so onError() removes it */
+	if (this->opened && this->file && this->file->isOpen() && !this->file->close()) {
+		LogWarn(std::string("Error writing file: ").append(this->filepath.string()));
+		this->fail(boost::system::errc::make_error_code(boost::system::errc::io_error));
+		return;
+	}
 	this->CloseFile();
 	http_response::completed();
 }
 
+void http_response_file::onError(const boost::system::error_code &err) {
+	/* a partial or corrupt download must not look like a complete one */
+	this->DiscardFile();
+	http_response::onError(err);
+}
+
@@ -0,0 +1,192 @@
+/*
+ * Retry Policy for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include "anetd/anetdConfig.h"
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <boost/asio/error.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include "anetd/http_retry.hpp"
+
+using namespace DynamX::anetd;
+
+/* parses a Retry-After value, either delta-seconds or a IMF-fixdate (eg, "Wed, 21 Oct 2015 07:28:00 GMT"). Returns false if it can not be parsed */
+static bool parse_retry_after(const std::string &value, boost::posix_time::time_duration &delay) {
+	static const char *const months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+	if (value.empty())
+		return false;
+	if (value.find_first_not_of("0123456789") == std::string::npos) {
+		if (value.length() > 9)
+			return false;
+		delay = boost::posix_time::seconds(atol(value.c_str()));
+		return true;
+	}
+	int day, year, hour, minute, second;
+	char month[4];
+	if (sscanf(value.c_str(), "%*3s, %2d %3s %4d %2d:%2d:%2d", &day, month, &year, &hour, &minute, &second) != 6)
+		return false;
+	for (int i = 0; i < 12; i++) {
+		if (strcmp(month, months[i]) == 0) {
+			try {
+				boost::posix_time::ptime when(boost::gregorian::date(year, i + 1, day),
+						boost::posix_time::hours(hour) + boost::posix_time::minutes(minute) + boost::posix_time::seconds(second));
+				delay = when - boost::posix_time::second_clock::universal_time();
+				if (delay.is_negative())
+					delay = boost::posix_time::time_duration();
+				return true;
+			} catch (std::exception &) {
+				return false;
+			}
+		}
+	}
+	return false;
+}
+
+
+http_retry_policy::http_retry_policy(unsigned int mymaxretries, boost::posix_time::time_duration mybasedelay, boost::posix_time::time_duration mymaxdelay, double mybudget, double myburst) :
+		maxretries(mymaxretries), basedelay(mybasedelay), maxdelay(mymaxdelay), budget(mybudget), burst(myburst), tokens(myburst),
+		rng(static_cast<boost::uint32_t>(boost::posix_time::microsec_clock::universal_time().time_of_day().total_microseconds() ^ getpid())),
+		requests(0), retries(0), denied(0)
+{
+	this->statuses.insert(502);
+	this->statuses.insert(503);
+	this->statuses.insert(504);
+}
+
+http_retry_policy::~http_retry_policy()
+{
+}
+
+void http_retry_policy::setMaxRetries(unsigned int mymaxretries) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->RLock);
+	this->maxretries = mymaxretries;
+}
+
+void http_retry_policy::setBackoff(boost::posix_time::time_duration mybasedelay, boost::posix_time::time_duration mymaxdelay) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->RLock);
+	this->basedelay = mybasedelay;
+	this->maxdelay = mymaxdelay;
+}
+
+void http_retry_policy::setBudget(double mybudget, double myburst) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->RLock);
+	this->budget = mybudget;
+	this->burst = myburst;
+	this->tokens = std::min(this->tokens, myburst);
+}
+
+void http_retry_policy::setRetryStatus(int status, bool retry) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->RLock);
+	if (retry)
+		this->statuses.insert(status);
+	else
+		this->statuses.erase(status);
+}
+
+http_retry_policy::retry_reason http_retry_policy::classify(const boost::system::error_code &err, int status, bool connected, bool idempotent) {
+	if (err) {
+		/* cancelled by the application, or a URL or host name that will not get any better */
+		if (err == boost::asio::error::operation_aborted || err == boost::system::errc::invalid_argument
+				|| err == boost::asio::error::host_not_found || err == boost::asio::error::service_not_found)
+			return RETRY_NONE;
+		/* the request was never sent, so it is safe to send it again whatever the method */
+		if (!connected)
+			return RETRY_CONNECT;
+		if (idempotent && (err == boost::asio::error::connection_reset || err == boost::asio::error::connection_aborted
+				|| err == boost::asio::error::broken_pipe || err == boost::asio::error::eof || err == boost::asio::error::timed_out))
+			return RETRY_RESET;
+		return RETRY_NONE;
+	}
+	if (!idempotent)
+		return RETRY_NONE;
+	/* the server closed the connection without sending a status line */
+	if (status == 0)
+		return RETRY_RESET;
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->RLock);
+	if (this->statuses.count(status))
+		return RETRY_STATUS;
+	return RETRY_NONE;
+}
+
+boost::posix_time::time_duration http_retry_policy::backoff(unsigned int attempt, const std::string &retryafter) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->RLock);
+	boost::posix_time::time_duration serverdelay;
+	if (parse_retry_after(retryafter, serverdelay)) {
+		if (serverdelay > this->maxdelay)
+			return boost::posix_time::microseconds(-1);
+		/* a little jitter on top, so clients told the same time do not all come back at once */
+		boost::random::uniform_int_distribution<boost::int64_t> jitter(0, std::max<boost::int64_t>(this->basedelay.total_microseconds(), 0));
+		return serverdelay + boost::posix_time::microseconds(jitter(this->rng));
+	}
+	/* full jitter: anywhere between nothing and the exponential backoff */
+	boost::int64_t ceiling = this->basedelay.total_microseconds();
+	for (unsigned int i = 0; i < attempt && ceiling < this->maxdelay.total_microseconds(); i++)
+		ceiling *= 2;
+	ceiling = std::max<boost::int64_t>(std::min(ceiling, this->maxdelay.total_microseconds()), 0);
+	boost::random::uniform_int_distribution<boost::int64_t> jitter(0, ceiling);
+	return boost::posix_time::microseconds(jitter(this->rng));
+}
+
+void http_retry_policy::request() {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->RLock);
+	this->requests++;
+	this->tokens = std::min(this->tokens + this->budget, this->burst);
+}
+
+http_retry_policy::retry_reason http_retry_policy::retry(const boost::system::error_code &err, int status, bool connected, bool idempotent, unsigned int attempt,
+		const std::string &retryafter, boost::posix_time::time_duration &delay) {
+	{
+		boost::interprocess::scoped_lock<boost::mutex> lock(this->RLock);
+		if (attempt >= this->maxretries)
+			return RETRY_NONE;
+	}
+	retry_reason reason = this->classify(err, status, connected, idempotent);
+	if (reason == RETRY_NONE)
+		return RETRY_NONE;
+	delay = this->backoff(attempt, retryafter);
+	if (delay.is_negative())
+		return RETRY_NONE;
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->RLock);
+	if (this->tokens < 1) {
+		this->denied++;
+		return RETRY_NONE;
+	}
+	this->tokens -= 1;
+	this->retries++;
+	return reason;
+}
+
+boost::uint64_t http_retry_policy::getRequests() {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->RLock);
+	return this->requests;
+}
+
+boost::uint64_t http_retry_policy::getRetries() {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->RLock);
+	return this->retries;
+}
+
+boost::uint64_t http_retry_policy::getDenied() {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->RLock);
+	return this->denied;
+}
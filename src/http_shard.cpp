@@ -0,0 +1,190 @@
+/*
+ * Thread per Core Sharded Client for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include "anetd/anetdConfig.h"
+#if defined(HAVE_PTHREAD_SETAFFINITY_NP) || defined(HAVE_SCHED_GETAFFINITY)
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include <cstring>
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+#include "anetd/http_shard.hpp"
+#include "anetd/LogClass.hpp"
+
+using namespace DynamX::anetd;
+using namespace DynamX::Logging;
+
+
+http_sharded_client::shard::shard(size_t maxidle, int mycpu) :
+		work(new boost::asio::io_service::work(this->io)), buffers(new http_buffer_pool()), ownlimiter(new http_rate_limiter()), limiter(ownlimiter),
+		engines(&this->io, &this->io, maxidle, buffers), active(0), cpu(mycpu)
+{
+}
+
+http_sharded_client::http_sharded_client(size_t count, placement myplace, bool pin, size_t maxidle) : place(myplace), next(0)
+{
+	/* the cores the process may run on, which can be fewer than the machine has (eg, in a container or under taskset) */
+	std::vector<int> cpus;
+#ifdef HAVE_SCHED_GETAFFINITY
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+			if (CPU_ISSET(cpu, &allowed))
+				cpus.push_back(cpu);
+#endif
+	if (count == 0)
+		count = cpus.empty() ? boost::thread::hardware_concurrency() : cpus.size();
+	if (count == 0)
+		count = 1;
+	for (size_t i = 0; i < count; i++) {
+		int cpu = -1;
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+		if (pin && !cpus.empty())
+			cpu = cpus[i % cpus.size()];
+#else
+		(void)pin;
+#endif
+		boost::shared_ptr<shard> s(new shard(maxidle, cpu));
+		boost::thread *thread = this->threads.create_thread(boost::bind(&http_sharded_client::run, s.get()));
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+		if (cpu >= 0) {
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(cpu, &set);
+			int err = pthread_setaffinity_np(thread->native_handle(), sizeof(set), &set);
+			if (err != 0) {
+				LogWarn(boost::str(boost::format("Could not pin Shard %1% to CPU %2%: %3%") % i % cpu % strerror(err)));
+				s->cpu = -1;
+			}
+		}
+#else
+		(void)thread;
+#endif
+		this->shards.push_back(s);
+	}
+	LogDebug(boost::str(boost::format("Started %1% Shards") % count));
+}
+
+http_sharded_client::~http_sharded_client()
+{
+	/* the shard threads run till the transfers in progress, and the engines they release, are done */
+	for (std::vector<boost::shared_ptr<shard> >::iterator it = this->shards.begin(); it != this->shards.end(); ++it)
+		(*it)->work.reset();
+	this->threads.join_all();
+}
+
+void http_sharded_client::run(shard *s) {
+	s->io.run();
+}
+
+size_t http_sharded_client::getShard(const std::string &url) {
+	if (this->place == ROUND_ROBIN)
+		return static_cast<size_t>(static_cast<long>(this->next)) % this->shards.size();
+	std::string::size_type start = url.find("://");
+	start = (start == std::string::npos) ? 0 : start + 3;
+	std::string::size_type end = url.find_first_of("/?#", start);
+	if (end == std::string::npos)
+		end = url.length();
+	std::string::size_type user = url.rfind('@', end);
+	if (user != std::string::npos && user >= start)
+		start = user + 1;
+	std::string::size_type port = url.find(':', start);
+	if (port != std::string::npos && port < end)
+		end = port;
+	/* the same host always hashes to the same shard, so the TLS sessions its engines keep for the host get used */
+	return boost::hash<std::string>()(boost::algorithm::to_lower_copy(url.substr(start, end - start))) % this->shards.size();
+}
+
+size_t http_sharded_client::fetch(http_response *response, t_completionFunc handler) {
+	size_t index;
+	if (this->place == ROUND_ROBIN)
+		index = static_cast<size_t>(++this->next - 1) % this->shards.size();
+	else
+		index = this->getShard(response->getURL());
+	shard *s = this->shards[index].get();
+	++s->active;
+	/* the engine is taken from the pool on the shard thread, so the pool is only ever used by that thread */
+	s->io.post(boost::bind(&http_sharded_client::dispatch, s, response, handler));
+	return index;
+}
+
+void http_sharded_client::dispatch(shard *s, http_response *response, t_completionFunc handler) {
+	boost::shared_ptr<http_engine> engine = s->engines.acquire();
+	engine->setRateLimiter(s->limiter);
+	engine->start(response, boost::bind(&http_sharded_client::finished, s, engine, handler, _1, _2));
+}
+
+void http_sharded_client::finished(shard *s, boost::shared_ptr<http_engine> engine, t_completionFunc handler, const boost::system::error_code &err,
+		http_response *response) {
+	if (handler)
+		handler(err, response);
+	--s->active;
+	/* the engine is still unwinding, so it goes back to the pool from a handler of its own */
+	s->io.post(boost::bind(&http_sharded_client::release, engine));
+}
+
+void http_sharded_client::release(boost::shared_ptr<http_engine>) {
+	/* the engine returns to the pool when the last copy of the pointer goes */
+}
+
+size_t http_sharded_client::getShards() {
+	return this->shards.size();
+}
+
+int http_sharded_client::getCPU(size_t index) {
+	return this->shards.at(index)->cpu;
+}
+
+size_t http_sharded_client::getActive(size_t index) {
+	return static_cast<size_t>(static_cast<long>(this->shards.at(index)->active));
+}
+
+boost::asio::io_service &http_sharded_client::getIOService(size_t index) {
+	return this->shards.at(index)->io;
+}
+
+http_engine_pool &http_sharded_client::getEnginePool(size_t index) {
+	return this->shards.at(index)->engines;
+}
+
+boost::shared_ptr<http_buffer_pool> http_sharded_client::getBufferPool(size_t index) {
+	return this->shards.at(index)->buffers;
+}
+
+void http_sharded_client::setRateLimiter(boost::shared_ptr<http_rate_limiter> limiter) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->LLock);
+	this->sharedlimiter = limiter;
+	/* dispatch() reads the limiter of a shard on the shard thread, so it is only ever changed there too */
+	for (std::vector<boost::shared_ptr<shard> >::iterator it = this->shards.begin(); it != this->shards.end(); ++it)
+		(*it)->io.post(boost::bind(&http_sharded_client::assign, it->get(), limiter ? limiter : (*it)->ownlimiter));
+}
+
+void http_sharded_client::assign(shard *s, boost::shared_ptr<http_rate_limiter> limiter) {
+	s->limiter = limiter;
+}
+
+boost::shared_ptr<http_rate_limiter> http_sharded_client::getRateLimiter(size_t index) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->LLock);
+	return this->sharedlimiter ? this->sharedlimiter : this->shards.at(index)->ownlimiter;
+}
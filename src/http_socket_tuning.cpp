@@ -0,0 +1,119 @@
+/*
+ * Socket Tuning Profiles for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include "anetd/anetdConfig.h"
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/asio/socket_base.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include "anetd/http_socket_tuning.hpp"
+#include "anetd/LogClass.hpp"
+
+using namespace DynamX::anetd;
+using namespace DynamX::Logging;
+
+template <typename Option>
+static void set_option(boost::asio::ip::tcp::socket &socket, const Option &option, const char *name) {
+	boost::system::error_code ec;
+	socket.set_option(option, ec);
+	if (ec)
+		LogDebug(boost::str(boost::format("Could not set %1%: %2%") % name % ec.message()));
+}
+
+template <int Level, int Name>
+static void set_integer(boost::asio::ip::tcp::socket &socket, int value, const char *name) {
+	set_option(socket, boost::asio::detail::socket_option::integer<Level, Name>(value), name);
+}
+
+
+http_socket_profile::http_socket_profile() :
+		nodelay(true), fastopen(false), recvbuffer(0), sendbuffer(0), keepalive(false), keepidle(0), keepinterval(0), keepcount(0), quickack(false)
+{
+}
+
+void http_socket_profile::apply(boost::asio::ip::tcp::socket &socket) const {
+	if (this->nodelay)
+		set_option(socket, boost::asio::ip::tcp::no_delay(true), "TCP_NODELAY");
+	/* the buffer sizes must be set before connecting, as the window scale is agreed on in the handshake */
+	if (this->recvbuffer > 0)
+		set_option(socket, boost::asio::socket_base::receive_buffer_size(this->recvbuffer), "SO_RCVBUF");
+	if (this->sendbuffer > 0)
+		set_option(socket, boost::asio::socket_base::send_buffer_size(this->sendbuffer), "SO_SNDBUF");
+	if (this->keepalive) {
+		set_option(socket, boost::asio::socket_base::keep_alive(true), "SO_KEEPALIVE");
+#ifdef TCP_KEEPIDLE
+		if (this->keepidle > 0)
+			set_integer<IPPROTO_TCP, TCP_KEEPIDLE>(socket, this->keepidle, "TCP_KEEPIDLE");
+#endif
+#ifdef TCP_KEEPINTVL
+		if (this->keepinterval > 0)
+			set_integer<IPPROTO_TCP, TCP_KEEPINTVL>(socket, this->keepinterval, "TCP_KEEPINTVL");
+#endif
+#ifdef TCP_KEEPCNT
+		if (this->keepcount > 0)
+			set_integer<IPPROTO_TCP, TCP_KEEPCNT>(socket, this->keepcount, "TCP_KEEPCNT");
+#endif
+	}
+#ifdef TCP_FASTOPEN_CONNECT
+	/* connect() returns at once, and the SYN goes out with the first write */
+	if (this->fastopen)
+		set_integer<IPPROTO_TCP, TCP_FASTOPEN_CONNECT>(socket, 1, "TCP_FASTOPEN_CONNECT");
+#endif
+	this->applyQuickAck(socket);
+}
+
+void http_socket_profile::applyQuickAck(boost::asio::ip::tcp::socket &socket) const {
+#ifdef TCP_QUICKACK
+	if (this->quickack)
+		set_integer<IPPROTO_TCP, TCP_QUICKACK>(socket, 1, "TCP_QUICKACK");
+#endif
+}
+
+
+http_socket_tuning::http_socket_tuning(const http_socket_profile &profile) : defaultprofile(profile)
+{
+}
+
+void http_socket_tuning::setDefault(const http_socket_profile &profile) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->SLock);
+	this->defaultprofile = profile;
+}
+
+void http_socket_tuning::setProfile(const std::string &host, const http_socket_profile &profile) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->SLock);
+	this->profiles[boost::algorithm::to_lower_copy(host)] = profile;
+}
+
+bool http_socket_tuning::removeProfile(const std::string &host) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->SLock);
+	return this->profiles.erase(boost::algorithm::to_lower_copy(host)) > 0;
+}
+
+http_socket_profile http_socket_tuning::getProfile(const std::string &host) {
+	boost::interprocess::scoped_lock<boost::mutex> lock(this->SLock);
+	if (this->profiles.empty())
+		return this->defaultprofile;
+	std::map<std::string, http_socket_profile>::const_iterator profile = this->profiles.find(boost::algorithm::to_lower_copy(host));
+	if (profile == this->profiles.end())
+		return this->defaultprofile;
+	return profile->second;
+}
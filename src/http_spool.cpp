@@ -0,0 +1,228 @@
+/*
+ * Memory/Disk Spooling Response for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#include "anetd/anetdConfig.h"
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include "anetd/http_spool.hpp"
+#include "anetd/LogClass.hpp"
+
+using namespace DynamX::anetd;
+using namespace DynamX::Logging;
+
+http_response_spool::http_response_spool(size_t mythreshold, const std::string &mydirectory) : http_response(), threshold(mythreshold),
+		directory(mydirectory), memory(NULL), mapped(0), length(0), fd(-1), view(NULL), viewsize(0), complete(false), failed(false)
+{
+	if (this->directory.empty()) {
+		const char *tmpdir = getenv("TMPDIR");
+		this->directory = (tmpdir && *tmpdir) ? tmpdir : "/tmp";
+	}
+}
+
+http_response_spool::~http_response_spool()
+{
+	this->release();
+}
+
+void http_response_spool::release() {
+	if (this->view && this->view != this->memory)
+		munmap(const_cast<char *>(this->view), this->viewsize);
+	if (this->memory)
+		munmap(this->memory, this->mapped);
+	if (this->fd >= 0)
+		::close(this->fd);
+	this->memory = NULL;
+	this->mapped = 0;
+	this->length = 0;
+	this->fd = -1;
+	this->view = NULL;
+	this->viewsize = 0;
+	this->complete = false;
+	this->failed = false;
+}
+
+void http_response_spool::reset() {
+	this->release();
+	http_response::reset();
+}
+
+bool http_response_spool::map(size_t size) {
+	/* only address space is taken here, pages are allocated as the body is written into them */
+	void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (addr == MAP_FAILED) {
+		LogWarn(boost::str(boost::format("Could not map %1% bytes for the Body: %2%") % size % strerror(errno)));
+		return false;
+	}
+	this->memory = static_cast<char *>(addr);
+	this->mapped = size;
+	return true;
+}
+
+bool http_response_spool::spill() {
+#ifdef O_TMPFILE
+	this->fd = ::open(this->directory.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+#endif
+	if (this->fd < 0) {
+		/* no O_TMPFILE on this kernel or file system, so the file gets a name just long enough to unlink it */
+		std::string path = this->directory + "/anetd-spool-XXXXXX";
+		std::vector<char> name(path.begin(), path.end());
+		name.push_back('\0');
+		this->fd = mkstemp(&name[0]);
+		if (this->fd >= 0) {
+			unlink(&name[0]);
+			fcntl(this->fd, F_SETFD, FD_CLOEXEC);
+		}
+	}
+	if (this->fd < 0) {
+		LogError(boost::str(boost::format("Could not create a Temporary File in %1%: %2%") % this->directory % strerror(errno)));
+		return false;
+	}
+	LogDebug(boost::str(boost::format("Spilling the Body of %1% to Disk after %2% bytes") % this->getURL() % this->length));
+	if (this->memory) {
+		size_t held = this->length;
+		this->length = 0;
+		bool ok = this->write(this->memory, held);
+		munmap(this->memory, this->mapped);
+		this->memory = NULL;
+		this->mapped = 0;
+		return ok;
+	}
+	return true;
+}
+
+bool http_response_spool::write(const char *data, size_t len) {
+	while (len > 0) {
+		ssize_t written = ::write(this->fd, data, len);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			LogError(boost::str(boost::format("Error writing the Body of %1% to Disk: %2%") % this->getURL() % strerror(errno)));
+			return false;
+		}
+		data += written;
+		len -= written;
+		this->length += written;
+	}
+	return true;
+}
+
+void http_response_spool::onHeaders() {
+	size_t size = this->getBodySize();
+	/* a body announced as too large goes straight to disk, one of known size only takes the address space it needs */
+	if (size > this->threshold) {
+		if (!this->spill())
+			this->abandon();
+	} else if (size > 0 && !this->map(size))
+		this->abandon();
+}
+
+void http_response_spool::onData(const char *data, size_t len) {
+	if (this->failed)
+		return;
+	if (this->fd < 0) {
+		if (!this->memory && !this->map(this->threshold)) {
+			this->abandon();
+			return;
+		}
+		if (this->length + len <= this->mapped) {
+			memcpy(this->memory + this->length, data, len);
+			this->length += len;
+			return;
+		}
+		if (!this->spill()) {
+			this->abandon();
+			return;
+		}
+	}
+	if (!this->write(data, len))
+		this->abandon();
+}
+
+void http_response_spool::abandon() {
+	/* a body that could not be stored fails the transfer, like one that does not match its digest */
+	this->failed = true;
+	this->fail(boost::system::errc::make_error_code(boost::system::errc::io_error));
+}
+
+void http_response_spool::completed() {
+	this->complete = true;
+	if (this->failed || this->length == 0) {
+		http_response::completed();
+		return;
+	}
+	if (this->fd < 0) {
+		/* the memory becomes the view, read-only so it can be handed out like the file mapping */
+		mprotect(this->memory, this->mapped, PROT_READ);
+		this->view = this->memory;
+		this->viewsize = this->length;
+	} else {
+		void *addr = mmap(NULL, this->length, PROT_READ, MAP_SHARED, this->fd, 0);
+		if (addr == MAP_FAILED) {
+			LogError(boost::str(boost::format("Could not map the Body of %1%: %2%") % this->getURL() % strerror(errno)));
+			this->abandon();
+		} else {
+			madvise(addr, this->length, MADV_SEQUENTIAL);
+			this->view = static_cast<const char *>(addr);
+			this->viewsize = this->length;
+		}
+	}
+	http_response::completed();
+}
+
+bool http_response_spool::getView(const char *&data, size_t &len) {
+	if (!this->complete || this->failed)
+		return false;
+	data = this->view;
+	len = this->viewsize;
+	return true;
+}
+
+std::string http_response_spool::getBody() {
+	const char *data;
+	size_t len;
+	if (!this->getView(data, len) || len == 0)
+		return std::string();
+	return std::string(data, len);
+}
+
+bool http_response_spool::isSpilled() {
+	return this->fd >= 0;
+}
+
+bool http_response_spool::hasFailed() {
+	return this->failed;
+}
+
+void http_response_spool::setThreshold(size_t mythreshold) {
+	this->threshold = mythreshold;
+}
+
+size_t http_response_spool::getThreshold() {
+	return this->threshold;
+}
@@ -0,0 +1,195 @@
+/*
+ * Coroutine Interface Tests for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * test-awaitable - runs transfers with co_await through http_client against a HTTP/1.1 server on the loopback interface, with the IO Service
+ * run by several threads.
+ *
+ * Checks that concurrent transfers complete with the right body, that a refused connection throws, and that a cancel() from a thread of
+ * its own aborts a transfer that is waiting for the server.
+ */
+
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <utility>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include "anetd/anetd.hpp"
+#include "anetd/http_awaitable.hpp"
+#include "anetd/LogClass.hpp"
+
+using namespace DynamX::anetd;
+using namespace DynamX::Logging;
+using boost::asio::ip::tcp;
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl; failures++; } } while (0)
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT) && (BOOST_VERSION >= 107000)
+
+static const int TRANSFERS = 32;
+
+/* answers GET /hello at once and GET /slow after 1.5 seconds. Each connection is served by its own thread with blocking IO */
+class awaitable_test_server
+{
+public:
+	awaitable_test_server() : acceptor(io, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0)), stopping(false)
+	{
+		this->acceptthread = boost::thread(boost::bind(&awaitable_test_server::run, this));
+	}
+	~awaitable_test_server() {
+		/* a connection of our own wakes up the blocking accept */
+		this->stopping = true;
+		boost::system::error_code ignored;
+		tcp::socket wakeup(this->io);
+		wakeup.connect(this->acceptor.local_endpoint(), ignored);
+		this->acceptthread.join();
+		this->connections.join_all();
+	}
+	std::string base() {
+		return "http://127.0.0.1:" + boost::lexical_cast<std::string>(this->acceptor.local_endpoint().port());
+	}
+private:
+	void run() {
+		while (true) {
+			boost::shared_ptr<tcp::socket> socket(new tcp::socket(this->io));
+			boost::system::error_code err;
+			this->acceptor.accept(*socket, err);
+			if (this->stopping)
+				return;
+			if (!err)
+				this->connections.create_thread(boost::bind(&awaitable_test_server::serve, this, socket));
+		}
+	}
+	void serve(boost::shared_ptr<tcp::socket> socket) {
+		try {
+			boost::asio::streambuf request;
+			boost::asio::read_until(*socket, request, "\r\n\r\n");
+			std::istream stream(&request);
+			std::string method, path;
+			stream >> method >> path;
+			if (path == "/slow")
+				boost::this_thread::sleep(boost::posix_time::milliseconds(1500));
+			std::string response = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\nConnection: close\r\n\r\nhello";
+			boost::asio::write(*socket, boost::asio::buffer(response));
+		} catch (std::exception &e) {
+			/* the client gave up on this connection */
+		}
+	}
+	boost::asio::io_service io;
+	tcp::acceptor acceptor;
+	boost::thread acceptthread;
+	boost::thread_group connections;
+	std::atomic<bool> stopping;
+};
+
+static boost::asio::awaitable<void> fetch_hello(http_client &client, std::string url, std::atomic<int> &good) {
+	http_response response;
+	http_response *res = co_await client.fetch(url, response);
+	if (res == &response && res->getStatus() == 200 && res->getBody() == "hello")
+		good++;
+}
+
+static boost::asio::awaitable<void> fetch_error(http_client &client, boost::shared_ptr<http_engine> engine, std::string url,
+		boost::system::error_code &result, boost::posix_time::time_duration &elapsed) {
+	http_response response;
+	response.setURL(url);
+	boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+	try {
+		co_await client.fetch(engine, response);
+	} catch (boost::system::system_error &e) {
+		result = e.code();
+	}
+	elapsed = boost::posix_time::microsec_clock::universal_time() - start;
+}
+
+/* runs the io_service on four threads till it runs out of work */
+static void run(boost::asio::io_service &io) {
+	io.reset();
+	boost::thread_group threads;
+	for (int i = 0; i < 4; i++)
+		threads.create_thread(boost::bind(&boost::asio::io_service::run, &io));
+	threads.join_all();
+}
+
+static void cancel_later(boost::shared_ptr<http_engine> engine) {
+	boost::this_thread::sleep(boost::posix_time::milliseconds(300));
+	engine->cancel();
+}
+
+static void test_awaitable() {
+	awaitable_test_server server;
+	boost::asio::io_service io;
+	http_client client(io);
+
+	/* concurrent transfers on a IO Service run by several threads */
+	std::atomic<int> good(0);
+	for (int i = 0; i < TRANSFERS; i++)
+		boost::asio::co_spawn(io, fetch_hello(client, server.base() + "/hello", good), boost::asio::detached);
+	run(io);
+	CHECK(good == TRANSFERS);
+
+	/* a connection that is refused throws */
+	boost::system::error_code refused;
+	boost::posix_time::time_duration elapsed;
+	tcp::acceptor closed(io, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+	std::string closedurl = "http://127.0.0.1:" + boost::lexical_cast<std::string>(closed.local_endpoint().port()) + "/";
+	closed.close();
+	boost::asio::co_spawn(io, fetch_error(client, boost::shared_ptr<http_engine>(new http_engine(&io, &io)), closedurl, refused, elapsed),
+			boost::asio::detached);
+	run(io);
+	CHECK(refused);
+
+	/* a cancel from another thread aborts a transfer waiting for the server */
+	boost::shared_ptr<http_engine> engine(new http_engine(&io, &io));
+	boost::system::error_code cancelled;
+	boost::asio::co_spawn(io, fetch_error(client, engine, server.base() + "/slow", cancelled, elapsed), boost::asio::detached);
+	boost::thread canceller(boost::bind(&cancel_later, engine));
+	run(io);
+	canceller.join();
+	CHECK(cancelled == boost::asio::error::operation_aborted);
+	CHECK(elapsed < boost::posix_time::milliseconds(1000));
+}
+
+#else
+
+static void test_awaitable() {
+	std::cerr << "co_await is not available, nothing to test" << std::endl;
+}
+
+#endif
+
+int
+main (int, char *[])
+{
+	Log::Create("", true, LogLevel_None);
+	test_awaitable();
+	if (failures)
+		std::cerr << failures << " checks failed" << std::endl;
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,144 @@
+/*
+ * Header Table Tests for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * test-headers - checks that every interned header name hashes to its own id in any case, and that names close to a interned one (a letter
+ * changed, added or dropped) are not taken for it. The expected id of a near miss is found by comparing it with every interned name, so a
+ * change to the name list or the perfect hash that leaves a name out, or lets two names share a slot, fails here.
+ */
+
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "anetd/http_headers.hpp"
+
+using namespace DynamX::anetd;
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl; failures++; } } while (0)
+
+static std::string to_lower(std::string s) {
+	for (std::string::iterator it = s.begin(); it != s.end(); ++it)
+		if (*it >= 'A' && *it <= 'Z')
+			*it += 'a' - 'A';
+	return s;
+}
+
+static std::string to_upper(std::string s) {
+	for (std::string::iterator it = s.begin(); it != s.end(); ++it)
+		if (*it >= 'a' && *it <= 'z')
+			*it -= 'a' - 'A';
+	return s;
+}
+
+/* the id a name should have, by a plain search of the interned names */
+static http_headers::header_id expected(const std::string &name) {
+	for (int id = http_headers::Unknown + 1; id < http_headers::Max_Header_Id; id++)
+		if (to_lower(name) == to_lower(http_headers::name(static_cast<http_headers::header_id>(id))))
+			return static_cast<http_headers::header_id>(id);
+	return http_headers::Unknown;
+}
+
+static http_headers::header_id lookup(const std::string &name) {
+	return http_headers::lookup(name.data(), name.length());
+}
+
+static void check_miss(const std::string &name) {
+	if (lookup(name) != expected(name)) {
+		std::cerr << "\"" << name << "\" looked up as " << lookup(name) << ", expected " << expected(name) << std::endl;
+		failures++;
+	}
+}
+
+static void test_interned() {
+	for (int i = http_headers::Unknown + 1; i < http_headers::Max_Header_Id; i++) {
+		http_headers::header_id id = static_cast<http_headers::header_id>(i);
+		std::string name = http_headers::name(id);
+		CHECK(!name.empty());
+		CHECK(lookup(name) == id);
+		CHECK(lookup(to_lower(name)) == id);
+		CHECK(lookup(to_upper(name)) == id);
+		if (lookup(name) != id)
+			std::cerr << "\"" << name << "\" looked up as " << lookup(name) << ", expected " << id << std::endl;
+	}
+	/* a few by their enum, so the name list can not drift out of step with it */
+	CHECK(strcmp(http_headers::name(http_headers::Accept), "Accept") == 0);
+	CHECK(strcmp(http_headers::name(http_headers::Content_Length), "Content-Length") == 0);
+	CHECK(strcmp(http_headers::name(http_headers::Content_MD5), "Content-MD5") == 0);
+	CHECK(strcmp(http_headers::name(http_headers::Set_Cookie), "Set-Cookie") == 0);
+	CHECK(strcmp(http_headers::name(http_headers::X_Powered_By), "X-Powered-By") == 0);
+	CHECK(strcmp(http_headers::name(http_headers::Unknown), "") == 0);
+	CHECK(strcmp(http_headers::name(http_headers::Max_Header_Id), "") == 0);
+}
+
+static void test_near_misses() {
+	for (int i = http_headers::Unknown + 1; i < http_headers::Max_Header_Id; i++) {
+		std::string name = http_headers::name(static_cast<http_headers::header_id>(i));
+		check_miss(name + "x");
+		check_miss("x" + name);
+		check_miss(name.substr(0, name.length() - 1));
+		check_miss(name.substr(1));
+		/* each letter in turn changed to the next one, which keeps the length and so also changes the letters the hash reads */
+		for (size_t pos = 0; pos < name.length(); pos++) {
+			std::string changed(name);
+			changed[pos] = (changed[pos] == 'z' || changed[pos] == 'Z') ? 'a' : changed[pos] + 1;
+			check_miss(changed);
+		}
+	}
+	static const char *misses[] = { "", "-", "Content-", "Content_Length", "ContentLength", "Content-Length ", " Content-Length", "Set-Cookie2",
+			"X-Powered", "Cookies", "Hosts", "Etags", "Accept-Charset", "Content-SHA256", "Transfer-Encodings", "Proxy-Authentication-Info" };
+	for (size_t i = 0; i < sizeof(misses) / sizeof(misses[0]); i++) {
+		CHECK(lookup(misses[i]) == http_headers::Unknown);
+		check_miss(misses[i]);
+	}
+}
+
+static void test_table() {
+	http_headers headers;
+	headers.add("content-length", "42");
+	headers.add("X-Custom", " value ");
+	headers.add("Set-Cookie", "a=1");
+	headers.add("SET-COOKIE", "b=2");
+	CHECK(headers.size() == 4);
+	CHECK(headers.getId(0) == http_headers::Content_Length);
+	CHECK(headers.getId(1) == http_headers::Unknown);
+	CHECK(headers.getId(2) == http_headers::Set_Cookie);
+	CHECK(headers.getId(3) == http_headers::Set_Cookie);
+	std::string value;
+	CHECK(headers.get(http_headers::Content_Length, value) && value == "42");
+	CHECK(headers.get("CONTENT-LENGTH", value) && value == "42");
+	CHECK(headers.get("x-custom", value) && value == "value");
+	CHECK(headers.get(http_headers::Set_Cookie, value) && value == "a=1");
+	CHECK(!headers.has(http_headers::Host));
+	CHECK(!headers.get("X-Custo", value));
+}
+
+int
+main (int, char *[])
+{
+	test_interned();
+	test_near_misses();
+	test_table();
+	if (failures)
+		std::cerr << failures << " checks failed" << std::endl;
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,226 @@
+/*
+ * Request Hedging Tests for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * test-hedge - runs hedged requests against a HTTP/1.1 server on the loopback interface that answers the first connection for a
+ * path only after 1.5 seconds, and checks the hedge policy's per-host latency samples.
+ *
+ * With a 200ms hedge delay the second connection answers a hedged GET after about 200ms. Once the budget is used up the request waits
+ * out the 1.5 seconds, and a cancel() aborts both connections of a hedged request.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include "anetd/anetd.hpp"
+#include "anetd/LogClass.hpp"
+
+using namespace DynamX::anetd;
+using namespace DynamX::Logging;
+using boost::asio::ip::tcp;
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl; failures++; } } while (0)
+
+static const boost::posix_time::time_duration STALL = boost::posix_time::milliseconds(1500);
+
+/* answers GET /slowfirst/<key> after STALL on the first connection for the key and at once after that, and GET /slow/<key> after STALL
+ * on every connection. Each connection is served by its own thread with blocking IO */
+class hedge_test_server
+{
+public:
+	hedge_test_server() : acceptor(io, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0)), stopping(false)
+	{
+		this->acceptthread = boost::thread(boost::bind(&hedge_test_server::run, this));
+	}
+	~hedge_test_server() {
+		/* a connection of our own wakes up the blocking accept */
+		this->stopping = true;
+		boost::system::error_code ignored;
+		tcp::socket wakeup(this->io);
+		wakeup.connect(this->acceptor.local_endpoint(), ignored);
+		this->acceptthread.join();
+		this->connections.join_all();
+	}
+	std::string base() {
+		return "http://127.0.0.1:" + boost::lexical_cast<std::string>(this->acceptor.local_endpoint().port());
+	}
+	size_t getConnections(const std::string &key) {
+		boost::mutex::scoped_lock lock(this->CLock);
+		return this->counts[key];
+	}
+private:
+	void run() {
+		while (true) {
+			boost::shared_ptr<tcp::socket> socket(new tcp::socket(this->io));
+			boost::system::error_code err;
+			this->acceptor.accept(*socket, err);
+			if (this->stopping)
+				return;
+			if (!err)
+				this->connections.create_thread(boost::bind(&hedge_test_server::serve, this, socket));
+		}
+	}
+	void serve(boost::shared_ptr<tcp::socket> socket) {
+		try {
+			boost::asio::streambuf request;
+			boost::asio::read_until(*socket, request, "\r\n\r\n");
+			std::istream stream(&request);
+			std::string method, path;
+			stream >> method >> path;
+			std::string::size_type slash = path.find('/', 1);
+			std::string kind = path.substr(0, slash);
+			std::string key = slash == std::string::npos ? std::string() : path.substr(slash + 1);
+			size_t seen;
+			{
+				boost::mutex::scoped_lock lock(this->CLock);
+				seen = this->counts[key]++;
+			}
+			if (kind == "/slow" || (kind == "/slowfirst" && seen == 0))
+				boost::this_thread::sleep(STALL);
+			std::string response = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\nConnection: close\r\n\r\nhello";
+			boost::asio::write(*socket, boost::asio::buffer(response));
+		} catch (std::exception &e) {
+			/* the client gave up on this connection */
+		}
+	}
+	boost::asio::io_service io;
+	tcp::acceptor acceptor;
+	boost::thread acceptthread;
+	boost::thread_group connections;
+	boost::mutex CLock;
+	std::map<std::string, size_t> counts;
+	volatile bool stopping;
+};
+
+struct fetch_result {
+	boost::system::error_code err;
+	int status;
+	std::string body;
+	boost::posix_time::time_duration elapsed;
+};
+
+static void fetched(fetch_result &result, boost::asio::deadline_timer &canceltimer, boost::posix_time::ptime start, const boost::system::error_code &err,
+		http_response *response) {
+	canceltimer.cancel();
+	result.err = err;
+	result.status = response->getStatus();
+	result.body = response->getBody();
+	result.elapsed = boost::posix_time::microsec_clock::universal_time() - start;
+}
+
+static void cancel_fetch(http_engine &engine, const boost::system::error_code &err) {
+	if (!err)
+		engine.cancel();
+}
+
+/* runs one request to completion, cancelling it after cancelafter if that is set */
+static fetch_result fetch(boost::asio::io_service &io, http_engine &engine, const std::string &url,
+		boost::posix_time::time_duration cancelafter = boost::posix_time::time_duration(boost::posix_time::not_a_date_time)) {
+	fetch_result result;
+	http_response response;
+	response.setURL(url);
+	boost::asio::deadline_timer canceltimer(io);
+	if (!cancelafter.is_special()) {
+		canceltimer.expires_from_now(cancelafter);
+		canceltimer.async_wait(boost::bind(&cancel_fetch, boost::ref(engine), boost::asio::placeholders::error));
+	}
+	engine.start(&response, boost::bind(&fetched, boost::ref(result), boost::ref(canceltimer), boost::posix_time::microsec_clock::universal_time(), _1, _2));
+	io.reset();
+	io.run();
+	return result;
+}
+
+static void test_hedging() {
+	hedge_test_server server;
+	boost::asio::io_service io;
+	http_engine engine(&io, &io);
+	boost::shared_ptr<http_hedge_policy> policy(new http_hedge_policy(boost::posix_time::milliseconds(200)));
+	CHECK(engine.setHedgePolicy(policy));
+
+	/* the hedge answers while the first connection stalls */
+	fetch_result hedged = fetch(io, engine, server.base() + "/slowfirst/a");
+	CHECK(!hedged.err && hedged.status == 200 && hedged.body == "hello");
+	CHECK(hedged.elapsed >= boost::posix_time::milliseconds(200));
+	CHECK(hedged.elapsed < boost::posix_time::milliseconds(1000));
+	CHECK(server.getConnections("a") == 2);
+	CHECK(policy->getHedges() == 1);
+	CHECK(policy->getHedgeWins() == 1);
+
+	/* without budget the request is not hedged, and waits out the stall */
+	policy->setBudget(0, 0);
+	fetch_result denied = fetch(io, engine, server.base() + "/slowfirst/b");
+	CHECK(!denied.err && denied.status == 200 && denied.body == "hello");
+	CHECK(denied.elapsed >= STALL);
+	CHECK(server.getConnections("b") == 1);
+	CHECK(policy->getDenied() == 1);
+	CHECK(policy->getHedges() == 1);
+
+	/* a cancel stops the request and its hedge */
+	policy->setBudget(1, 10);
+	fetch_result cancelled = fetch(io, engine, server.base() + "/slow/c", boost::posix_time::milliseconds(500));
+	CHECK(cancelled.err == boost::asio::error::operation_aborted);
+	CHECK(cancelled.elapsed < boost::posix_time::milliseconds(1000));
+	CHECK(server.getConnections("c") == 2);
+	CHECK(policy->getHedges() == 2);
+}
+
+/* the per-host samples are capped, dropping the host recorded least recently */
+static void test_sample_hosts() {
+	http_hedge_policy policy(boost::posix_time::milliseconds(50));
+	policy.setPercentile(50, 2, 8);
+	policy.setMaxHosts(2);
+	for (int i = 0; i < 4; i++) {
+		policy.record("http://a", boost::posix_time::milliseconds(10), false);
+		policy.record("http://b", boost::posix_time::milliseconds(20), false);
+	}
+	CHECK(policy.getDelay("http://a") == boost::posix_time::milliseconds(10));
+	CHECK(policy.getDelay("http://b") == boost::posix_time::milliseconds(20));
+	policy.record("http://a", boost::posix_time::milliseconds(10), false);
+	for (int i = 0; i < 4; i++)
+		policy.record("http://c", boost::posix_time::milliseconds(30), false);
+	CHECK(policy.getDelay("http://a") == boost::posix_time::milliseconds(10));
+	CHECK(policy.getDelay("http://b") == boost::posix_time::milliseconds(50));
+	CHECK(policy.getDelay("http://c") == boost::posix_time::milliseconds(30));
+	policy.setMaxHosts(1);
+	CHECK(policy.getDelay("http://a") == boost::posix_time::milliseconds(50));
+	CHECK(policy.getDelay("http://c") == boost::posix_time::milliseconds(30));
+}
+
+int
+main (int, char *[])
+{
+	Log::Create("", true, LogLevel_None);
+	test_hedging();
+	test_sample_hosts();
+	if (failures)
+		std::cerr << failures << " checks failed" << std::endl;
+	return failures ? 1 : 0;
+}
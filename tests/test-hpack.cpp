@@ -0,0 +1,305 @@
+/*
+ * HPACK Tests for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * test-hpack - checks the HPACK integer and Huffman coding, and the encoder and decoder with their dynamic tables, against the examples
+ * of RFC 7541 Appendix C and by round trips of generated header lists.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <boost/cstdint.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "anetd/http2_hpack.hpp"
+
+using namespace DynamX::anetd;
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl; failures++; } } while (0)
+
+static std::string unhex(const char *hex) {
+	std::string out;
+	int high = -1;
+	for (const char *c = hex; *c; c++) {
+		if (*c == ' ')
+			continue;
+		int nibble = (*c >= 'a') ? *c - 'a' + 10 : *c - '0';
+		if (high < 0) {
+			high = nibble;
+		} else {
+			out += static_cast<char>((high << 4) | nibble);
+			high = -1;
+		}
+	}
+	return out;
+}
+
+/* a small deterministic generator, so a failure can be reproduced */
+static boost::uint32_t seed = 12345;
+static boost::uint32_t next_random() {
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 8) & 0xffffff;
+}
+
+static void test_integers() {
+	/* RFC 7541 C.1 */
+	std::string out;
+	http2_hpack_encode_integer(10, 5, 0, out);
+	CHECK(out == unhex("0a"));
+	out.clear();
+	http2_hpack_encode_integer(1337, 5, 0, out);
+	CHECK(out == unhex("1f9a0a"));
+	out.clear();
+	http2_hpack_encode_integer(42, 8, 0, out);
+	CHECK(out == unhex("2a"));
+
+	/* every prefix, around the prefix limit and every continuation byte boundary */
+	static const boost::uint64_t values[] = { 0, 1, 6, 7, 8, 30, 31, 32, 126, 127, 128, 254, 255, 256, 16510, 16511, 16512, 2097278, 0xffffffffULL };
+	for (unsigned int prefix = 1; prefix <= 8; prefix++) {
+		for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+			unsigned char flags = prefix < 8 ? static_cast<unsigned char>(0xff << prefix) : 0;
+			std::string encoded;
+			http2_hpack_encode_integer(values[i], prefix, flags, encoded);
+			CHECK((static_cast<unsigned char>(encoded[0]) & flags) == flags);
+			const unsigned char *position = reinterpret_cast<const unsigned char *>(encoded.data());
+			const unsigned char *end = position + encoded.length();
+			boost::uint64_t value = 0;
+			CHECK(http2_hpack_decode_integer(position, end, prefix, value));
+			CHECK(value == values[i]);
+			CHECK(position == end);
+			/* every shorter encoding is truncated */
+			for (size_t len = 0; len < encoded.length(); len++) {
+				position = reinterpret_cast<const unsigned char *>(encoded.data());
+				CHECK(!http2_hpack_decode_integer(position, position + len, prefix, value));
+			}
+		}
+	}
+
+	/* a integer that does not fit 64 bits */
+	std::string huge = unhex("1fffffffffffffffffffffff7f");
+	const unsigned char *position = reinterpret_cast<const unsigned char *>(huge.data());
+	boost::uint64_t value = 0;
+	CHECK(!http2_hpack_decode_integer(position, position + huge.length(), 5, value));
+}
+
+static void test_huffman() {
+	/* RFC 7541 C.4 and C.6 */
+	static const char *examples[][2] = {
+		{ "www.example.com", "f1e3c2e5f23a6ba0ab90f4ff" },
+		{ "no-cache", "a8eb10649cbf" },
+		{ "custom-key", "25a849e95ba97d7f" },
+		{ "custom-value", "25a849e95bb8e8b4bf" },
+		{ "302", "6402" },
+		{ "private", "aec3771a4b" },
+		{ "Mon, 21 Oct 2013 20:13:21 GMT", "d07abe941054d444a8200595040b8166e082a62d1bff" },
+		{ "https://www.example.com", "9d29ad171863c78f0b97c8e9ae82ae43d3" }
+	};
+	for (size_t i = 0; i < sizeof(examples) / sizeof(examples[0]); i++) {
+		std::string coded = unhex(examples[i][1]);
+		std::string out;
+		http2_huffman_encode(examples[i][0], out);
+		CHECK(out == coded);
+		CHECK(http2_huffman_length(examples[i][0]) == coded.length());
+		std::string decoded;
+		CHECK(http2_huffman_decode(reinterpret_cast<const unsigned char *>(coded.data()), coded.length(), decoded));
+		CHECK(decoded == examples[i][0]);
+	}
+
+	/* every byte value, including those with the 30 bit codes */
+	std::string all;
+	for (int c = 0; c < 256; c++)
+		all += static_cast<char>(c);
+	for (int round = 0; round < 200; round++) {
+		std::string value = round == 0 ? all : std::string();
+		size_t len = next_random() % 64;
+		for (size_t i = 0; i < len; i++)
+			value += static_cast<char>(round % 2 ? next_random() % 256 : 'a' + next_random() % 26);
+		std::string coded;
+		http2_huffman_encode(value, coded);
+		CHECK(coded.length() == http2_huffman_length(value));
+		std::string decoded;
+		CHECK(http2_huffman_decode(reinterpret_cast<const unsigned char *>(coded.data()), coded.length(), decoded));
+		CHECK(decoded == value);
+	}
+
+	/* padding must be the most significant bits of EOS, and shorter than a byte (RFC 7541 section 5.2) */
+	std::string decoded;
+	std::string padded = unhex("1f");
+	CHECK(http2_huffman_decode(reinterpret_cast<const unsigned char *>(padded.data()), padded.length(), decoded));
+	CHECK(decoded == "a");
+	std::string zeropad = unhex("18");
+	CHECK(!http2_huffman_decode(reinterpret_cast<const unsigned char *>(zeropad.data()), zeropad.length(), decoded));
+	std::string longpad = unhex("1fff");
+	CHECK(!http2_huffman_decode(reinterpret_cast<const unsigned char *>(longpad.data()), longpad.length(), decoded));
+	std::string eos = unhex("ffffffff");
+	CHECK(!http2_huffman_decode(reinterpret_cast<const unsigned char *>(eos.data()), eos.length(), decoded));
+}
+
+static http2_header_list make_list(const char *(*fields)[2], size_t count) {
+	http2_header_list headers;
+	for (size_t i = 0; i < count; i++)
+		headers.push_back(http2_header(fields[i][0], fields[i][1]));
+	return headers;
+}
+
+/* decodes the blocks of a RFC 7541 example one after the other, checking the headers and the size of the dynamic table after each. The
+ * headers are encoded again too, which must give the same table, and the same bytes if exact is set (the encoder may pick a literal
+ * where the example uses Huffman coding that is not shorter) */
+static void check_example(size_t tablesize, const char **blocks, const char *(**fields)[2], const size_t *counts, const size_t *sizes, size_t n,
+		bool exact) {
+	http2_hpack_decoder decoder(tablesize);
+	http2_hpack_encoder encoder(tablesize);
+	http2_hpack_decoder redecoder(tablesize);
+	for (size_t i = 0; i < n; i++) {
+		std::string block = unhex(blocks[i]);
+		http2_header_list expected = make_list(fields[i], counts[i]);
+		http2_header_list headers;
+		CHECK(decoder.decode(block.data(), block.length(), headers));
+		CHECK(headers == expected);
+		CHECK(decoder.getTable().getSize() == sizes[i]);
+		std::string out;
+		encoder.encode(expected, out);
+		CHECK(!exact || out == block);
+		CHECK(encoder.getTable().getSize() == sizes[i]);
+		http2_header_list reencoded;
+		CHECK(redecoder.decode(out.data(), out.length(), reencoded));
+		CHECK(reencoded == expected);
+	}
+}
+
+static void test_examples() {
+	static const char *request1[][2] = {
+		{ ":method", "GET" }, { ":scheme", "http" }, { ":path", "/" }, { ":authority", "www.example.com" }
+	};
+	static const char *request2[][2] = {
+		{ ":method", "GET" }, { ":scheme", "http" }, { ":path", "/" }, { ":authority", "www.example.com" }, { "cache-control", "no-cache" }
+	};
+	static const char *request3[][2] = {
+		{ ":method", "GET" }, { ":scheme", "https" }, { ":path", "/index.html" }, { ":authority", "www.example.com" }, { "custom-key", "custom-value" }
+	};
+	const char *(*requests[])[2] = { request1, request2, request3 };
+	static const size_t requestcounts[] = { 4, 5, 5 };
+	static const size_t requestsizes[] = { 57, 110, 164 };
+
+	/* C.3, without Huffman coding */
+	static const char *plain[] = {
+		"8286 8441 0f77 7777 2e65 7861 6d70 6c65 2e63 6f6d",
+		"8286 84be 5808 6e6f 2d63 6163 6865",
+		"8287 85bf 400a 6375 7374 6f6d 2d6b 6579 0c63 7573 746f 6d2d 7661 6c75 65"
+	};
+	check_example(4096, plain, requests, requestcounts, requestsizes, 3, false);
+
+	/* C.4, with Huffman coding, which is what our encoder produces */
+	static const char *huffman[] = {
+		"8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff",
+		"8286 84be 5886 a8eb 1064 9cbf",
+		"8287 85bf 4088 25a8 49e9 5ba9 7d7f 8925 a849 e95b b8e8 b4bf"
+	};
+	check_example(4096, huffman, requests, requestcounts, requestsizes, 3, true);
+
+	/* C.6, responses with a 256 byte table, where every block evicts entries */
+	static const char *response1[][2] = {
+		{ ":status", "302" }, { "cache-control", "private" }, { "date", "Mon, 21 Oct 2013 20:13:21 GMT" }, { "location", "https://www.example.com" }
+	};
+	static const char *response2[][2] = {
+		{ ":status", "307" }, { "cache-control", "private" }, { "date", "Mon, 21 Oct 2013 20:13:21 GMT" }, { "location", "https://www.example.com" }
+	};
+	static const char *response3[][2] = {
+		{ ":status", "200" }, { "cache-control", "private" }, { "date", "Mon, 21 Oct 2013 20:13:22 GMT" }, { "location", "https://www.example.com" },
+		{ "content-encoding", "gzip" }, { "set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1" }
+	};
+	const char *(*responses[])[2] = { response1, response2, response3 };
+	static const size_t responsecounts[] = { 4, 4, 6 };
+	static const size_t responsesizes[] = { 222, 222, 215 };
+	static const char *evicting[] = {
+		"4882 6402 5885 aec3 771a 4b61 96d0 7abe 9410 54d4 44a8 2005 9504 0b81 66e0 82a6 2d1b ff6e 919d 29ad 1718 63c7 8f0b 97c8 e9ae 82ae 43d3",
+		"4883 640e ffc1 c0bf",
+		"88c1 6196 d07a be94 1054 d444 a820 0595 040b 8166 e084 a62d 1bff c05a 839b d9ab 77ad 94e7 821d d7f2 e6c7 b335 dfdf cd5b 3960 d5af 2708"
+		" 7f36 72c1 ab27 0fb5 291f 9587 3160 65c0 03ed 4ee5 b106 3d50 07"
+	};
+	check_example(256, evicting, responses, responsecounts, responsesizes, 3, false);
+}
+
+/* encodes generated header lists and decodes them again, with a few names and values repeating so the dynamic table is used and evicts */
+static void test_round_trips() {
+	static const char *names[] = { "accept", "user-agent", "x-request-id", "cookie", "authorization", "x-custom", "content-type", "etag" };
+	http2_hpack_encoder encoder(4096);
+	http2_hpack_decoder decoder(4096);
+	for (int round = 0; round < 500; round++) {
+		/* the peer lowering and raising the table size, signalled at the start of the next block */
+		if (round == 100)
+			encoder.setMaxTableSize(0);
+		else if (round == 150)
+			encoder.setMaxTableSize(1024);
+		else if (round == 300)
+			encoder.setMaxTableSize(4096);
+		http2_header_list headers;
+		headers.push_back(http2_header(":method", round % 3 ? "GET" : "POST"));
+		headers.push_back(http2_header(":path", "/item/" + boost::lexical_cast<std::string>(next_random() % 50)));
+		size_t count = next_random() % 8;
+		for (size_t i = 0; i < count; i++) {
+			std::string value(next_random() % 3 == 0 ? next_random() % 400 : next_random() % 20, 'v');
+			for (size_t c = 0; c < value.length(); c++)
+				value[c] = static_cast<char>(' ' + next_random() % 95);
+			headers.push_back(http2_header(names[next_random() % (sizeof(names) / sizeof(names[0]))], value));
+		}
+		std::string block;
+		encoder.encode(headers, block);
+		http2_header_list decoded;
+		CHECK(decoder.decode(block.data(), block.length(), decoded));
+		CHECK(decoded == headers);
+		/* both ends must agree on the dynamic table after every block */
+		CHECK(decoder.getTable().count() == encoder.getTable().count());
+		CHECK(decoder.getTable().getSize() == encoder.getTable().getSize());
+		CHECK(encoder.getTable().getSize() <= encoder.getTable().getMaxSize());
+		for (size_t i = 0; i < decoder.getTable().count() && i < encoder.getTable().count(); i++)
+			CHECK(decoder.getTable().get(i) == encoder.getTable().get(i));
+		if (round >= 100 && round < 150)
+			CHECK(encoder.getTable().count() == 0);
+		/* credentials are never indexed */
+		for (size_t i = 0; i < encoder.getTable().count(); i++)
+			CHECK(encoder.getTable().get(i).first != "cookie" && encoder.getTable().get(i).first != "authorization");
+	}
+
+	/* malformed blocks: a index past the dynamic table, a table size above the limit, a truncated literal */
+	static const char *malformed[] = { "be", "3fe21f", "4088 25a8 49e9" };
+	for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++) {
+		http2_hpack_decoder fresh(4096);
+		std::string block = unhex(malformed[i]);
+		http2_header_list headers;
+		CHECK(!fresh.decode(block.data(), block.length(), headers));
+	}
+}
+
+int
+main (int, char *[])
+{
+	test_integers();
+	test_huffman();
+	test_examples();
+	test_round_trips();
+	if (failures)
+		std::cerr << failures << " checks failed" << std::endl;
+	return failures ? 1 : 0;
+}
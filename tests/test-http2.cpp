@@ -0,0 +1,371 @@
+/*
+ * HTTP/2 Transport Tests for libanetd
+ * Copyright (C) 2012 Justin Hammond
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * test-http2 - runs http2_session against a h2c server on the loopback interface that works at the frame level, so the test can check
+ * what goes over the wire and does not need a HTTP/2 server installed.
+ *
+ * The client uses 64 KB windows, and sends a request whose headers need CONTINUATION frames and whose body needs the server's
+ * WINDOW_UPDATEs. The server answers with header blocks split over CONTINUATION frames, and with bodies that only fit the client's
+ * windows if the client sends WINDOW_UPDATEs. Both ends check that the other never sends past a window.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+
+#include "anetd/http2_session.hpp"
+#include "anetd/LogClass.hpp"
+
+using namespace DynamX::anetd;
+using namespace DynamX::Logging;
+using boost::asio::ip::tcp;
+
+static boost::mutex CheckLock;
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { boost::mutex::scoped_lock checklock(CheckLock); std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl; failures++; } } while (0)
+
+enum {
+	FRAME_DATA = 0x0,
+	FRAME_HEADERS = 0x1,
+	FRAME_SETTINGS = 0x4,
+	FRAME_GOAWAY = 0x7,
+	FRAME_WINDOW_UPDATE = 0x8,
+	FRAME_CONTINUATION = 0x9,
+	FLAG_END_STREAM = 0x1,
+	FLAG_ACK = 0x1,
+	FLAG_END_HEADERS = 0x4,
+	SETTINGS_INITIAL_WINDOW_SIZE = 0x4
+};
+
+static const char PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+static const boost::int64_t DEFAULT_WINDOW = 65535;
+static const size_t MAX_FRAME = 16384;
+
+static const size_t BIG_SIZE = 300000;
+static const size_t POST_SIZE = 200000;
+static const size_t LARGE_HEADER = 30000;
+static const size_t PADDING_HEADER = 40000;
+
+static std::string pattern(size_t len, unsigned int salt) {
+	std::string data(len, '\0');
+	for (size_t i = 0; i < len; i++)
+		data[i] = static_cast<char>((i * 7 + salt) % 251);
+	return data;
+}
+
+static boost::uint32_t get32(const unsigned char *data) {
+	return (static_cast<boost::uint32_t>(data[0]) << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+}
+
+/* a single connection h2c server, run on its own thread with blocking IO */
+class h2_test_server
+{
+public:
+	h2_test_server() : continuations(0), windowupdates(0), windowviolations(0), responses(0), acceptor(io, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0)),
+			socket(io), sendwindow(DEFAULT_WINDOW), peerinitial(DEFAULT_WINDOW), recvwindow(DEFAULT_WINDOW), headerstream(0), headerend(false)
+	{
+	}
+	unsigned short port() {
+		return this->acceptor.local_endpoint().port();
+	}
+	void run() {
+		try {
+			this->acceptor.accept(this->socket);
+			char preface[sizeof(PREFACE) - 1];
+			boost::asio::read(this->socket, boost::asio::buffer(preface, sizeof(preface)));
+			CHECK(std::string(preface, sizeof(preface)) == std::string(PREFACE, sizeof(PREFACE) - 1));
+			this->send_frame(FRAME_SETTINGS, 0, 0, std::string());
+			/* the client closes the connection with a GOAWAY once the test is done */
+			while (this->read_frame())
+				this->send_responses();
+		} catch (std::exception &e) {
+			/* the client closed the connection */
+		}
+	}
+	void stop() {
+		boost::system::error_code ignored;
+		this->socket.shutdown(tcp::socket::shutdown_both, ignored);
+	}
+	size_t continuations;
+	size_t windowupdates;
+	size_t windowviolations;
+	size_t responses;
+private:
+	struct stream {
+		stream() : sendwindow(0), recvwindow(DEFAULT_WINDOW), credit(0), ended(false), sent(0), responding(false) {}
+		http2_header_list headers;
+		std::string body;
+		boost::int64_t sendwindow;
+		boost::int64_t recvwindow;
+		size_t credit;
+		bool ended;
+		std::string response;
+		size_t sent;
+		bool responding;
+	};
+	void send_frame(boost::uint8_t type, boost::uint8_t flags, boost::uint32_t streamid, const std::string &payload) {
+		unsigned char header[9] = {
+			static_cast<unsigned char>(payload.length() >> 16), static_cast<unsigned char>(payload.length() >> 8),
+			static_cast<unsigned char>(payload.length()), type, flags, static_cast<unsigned char>(streamid >> 24),
+			static_cast<unsigned char>(streamid >> 16), static_cast<unsigned char>(streamid >> 8), static_cast<unsigned char>(streamid)
+		};
+		boost::asio::write(this->socket, boost::asio::buffer(header, sizeof(header)));
+		if (!payload.empty())
+			boost::asio::write(this->socket, boost::asio::buffer(payload));
+	}
+	void send_window_update(boost::uint32_t streamid, boost::uint32_t increment) {
+		std::string payload;
+		for (int shift = 24; shift >= 0; shift -= 8)
+			payload += static_cast<char>(increment >> shift);
+		this->send_frame(FRAME_WINDOW_UPDATE, 0, streamid, payload);
+	}
+	bool read_frame() {
+		unsigned char header[9];
+		boost::asio::read(this->socket, boost::asio::buffer(header, sizeof(header)));
+		size_t len = (header[0] << 16) | (header[1] << 8) | header[2];
+		boost::uint8_t type = header[3];
+		boost::uint8_t flags = header[4];
+		boost::uint32_t streamid = get32(header + 5) & 0x7fffffff;
+		CHECK(len <= MAX_FRAME);
+		std::string payload(len, '\0');
+		if (len > 0)
+			boost::asio::read(this->socket, boost::asio::buffer(&payload[0], len));
+		/* a header block must not be interrupted by any other frame */
+		CHECK(this->headerblock.empty() || type == FRAME_CONTINUATION);
+		switch (type) {
+		case FRAME_SETTINGS:
+			if (flags & FLAG_ACK)
+				break;
+			for (size_t position = 0; position + 6 <= len; position += 6) {
+				const unsigned char *setting = reinterpret_cast<const unsigned char *>(payload.data()) + position;
+				if (((setting[0] << 8) | setting[1]) == SETTINGS_INITIAL_WINDOW_SIZE)
+					this->peerinitial = get32(setting + 2);
+			}
+			this->send_frame(FRAME_SETTINGS, FLAG_ACK, 0, std::string());
+			break;
+		case FRAME_HEADERS:
+		case FRAME_CONTINUATION:
+			if (type == FRAME_CONTINUATION) {
+				this->continuations++;
+				CHECK(!this->headerblock.empty() && streamid == this->headerstream);
+			} else {
+				this->headerstream = streamid;
+				this->headerend = (flags & FLAG_END_STREAM) != 0;
+				this->headerblock.clear();
+			}
+			this->headerblock.append(payload);
+			if (flags & FLAG_END_HEADERS) {
+				stream &s = this->streams[streamid];
+				s.sendwindow = this->peerinitial;
+				CHECK(this->decoder.decode(this->headerblock.data(), this->headerblock.length(), s.headers));
+				s.ended = this->headerend;
+				this->headerblock.clear();
+				if (s.ended)
+					this->respond(streamid, s);
+			}
+			break;
+		case FRAME_DATA: {
+			CHECK(this->streams.count(streamid) == 1);
+			stream &s = this->streams[streamid];
+			this->recvwindow -= len;
+			s.recvwindow -= len;
+			if (this->recvwindow < 0 || s.recvwindow < 0)
+				this->windowviolations++;
+			s.body.append(payload);
+			s.credit += len;
+			/* the windows are only opened again once half is used, so a client that ignores them overruns */
+			if (s.credit >= DEFAULT_WINDOW / 2) {
+				this->send_window_update(0, s.credit);
+				this->recvwindow += s.credit;
+				if (!(flags & FLAG_END_STREAM)) {
+					this->send_window_update(streamid, s.credit);
+					s.recvwindow += s.credit;
+				}
+				s.credit = 0;
+			}
+			if (flags & FLAG_END_STREAM) {
+				s.ended = true;
+				this->respond(streamid, s);
+			}
+			break;
+		}
+		case FRAME_WINDOW_UPDATE: {
+			CHECK(len == 4);
+			boost::uint32_t increment = get32(reinterpret_cast<const unsigned char *>(payload.data())) & 0x7fffffff;
+			CHECK(increment > 0);
+			this->windowupdates++;
+			if (streamid == 0)
+				this->sendwindow += increment;
+			else if (this->streams.count(streamid))
+				this->streams[streamid].sendwindow += increment;
+			break;
+		}
+		case FRAME_GOAWAY:
+			return false;
+		}
+		return true;
+	}
+	void respond(boost::uint32_t streamid, stream &s) {
+		std::map<std::string, std::string> headers;
+		for (http2_header_list::iterator header = s.headers.begin(); header != s.headers.end(); ++header)
+			headers[header->first] = header->second;
+		CHECK(headers[":scheme"] == "http");
+		CHECK(headers[":authority"] == "127.0.0.1:" + boost::lexical_cast<std::string>(this->port()));
+		if (headers[":path"] == "/big") {
+			CHECK(headers[":method"] == "GET");
+			s.response = pattern(BIG_SIZE, 1);
+		} else if (headers[":path"] == "/echo") {
+			CHECK(headers[":method"] == "POST");
+			CHECK(headers["content-length"] == boost::lexical_cast<std::string>(POST_SIZE));
+			CHECK(headers["x-large"] == std::string(LARGE_HEADER, 'h'));
+			s.response = s.body;
+		} else {
+			CHECK(headers[":path"] == "/empty");
+		}
+		/* a header block much larger than a frame, sent in small pieces so it takes several CONTINUATION frames */
+		http2_header_list response;
+		response.push_back(http2_header(":status", "200"));
+		response.push_back(http2_header("content-length", boost::lexical_cast<std::string>(s.response.length())));
+		response.push_back(http2_header("x-padding", std::string(PADDING_HEADER, 'p')));
+		response.push_back(http2_header("x-path", headers[":path"]));
+		std::string block;
+		this->encoder.encode(response, block);
+		for (size_t offset = 0; offset < block.length(); offset += 5000) {
+			size_t len = std::min<size_t>(5000, block.length() - offset);
+			boost::uint8_t flags = (offset + len == block.length() ? FLAG_END_HEADERS : 0) | (offset == 0 && s.response.empty() ? FLAG_END_STREAM : 0);
+			this->send_frame(offset == 0 ? FRAME_HEADERS : FRAME_CONTINUATION, flags, streamid, block.substr(offset, len));
+		}
+		s.responding = !s.response.empty();
+		if (!s.responding)
+			this->responses++;
+	}
+	/* sends as much of the response bodies as the client's windows allow */
+	void send_responses() {
+		for (std::map<boost::uint32_t, stream>::iterator it = this->streams.begin(); it != this->streams.end(); ++it) {
+			stream &s = it->second;
+			while (s.responding) {
+				boost::int64_t window = std::min(s.sendwindow, this->sendwindow);
+				if (window <= 0)
+					break;
+				size_t len = std::min(std::min(s.response.length() - s.sent, static_cast<size_t>(window)), MAX_FRAME);
+				bool last = s.sent + len == s.response.length();
+				this->send_frame(FRAME_DATA, last ? FLAG_END_STREAM : 0, it->first, s.response.substr(s.sent, len));
+				s.sent += len;
+				s.sendwindow -= len;
+				this->sendwindow -= len;
+				if (last) {
+					s.responding = false;
+					this->responses++;
+				}
+			}
+		}
+	}
+	boost::asio::io_service io;
+	tcp::acceptor acceptor;
+	tcp::socket socket;
+	http2_hpack_encoder encoder;
+	http2_hpack_decoder decoder;
+	std::map<boost::uint32_t, stream> streams;
+	boost::int64_t sendwindow;
+	boost::int64_t peerinitial;
+	boost::int64_t recvwindow;
+	std::string headerblock;
+	boost::uint32_t headerstream;
+	bool headerend;
+};
+
+static boost::mutex DoneLock;
+static int pending = 0;
+
+static void done(const std::string &expected, const boost::system::error_code &err, http_response *response) {
+	CHECK(!err);
+	CHECK(response->getStatus() == 200);
+	CHECK(response->getBody() == expected);
+	CHECK(response->getHeader("x-padding") == std::string(PADDING_HEADER, 'p'));
+	if (err)
+		std::cerr << response->getURL() << ": " << err.message() << std::endl;
+	boost::mutex::scoped_lock lock(DoneLock);
+	pending--;
+}
+
+int
+main (int, char *[])
+{
+	Log::Create("", true, LogLevel_Error);
+	h2_test_server server;
+	boost::thread serverthread(boost::bind(&h2_test_server::run, &server));
+	std::string base = "http://127.0.0.1:" + boost::lexical_cast<std::string>(server.port());
+
+	boost::asio::io_service io;
+	http2_session session(&io);
+	CHECK(session.setWindowSize(DEFAULT_WINDOW, DEFAULT_WINDOW));
+	http_response big, echo, empty;
+	big.setURL(base + "/big");
+	echo.setURL(base + "/echo");
+	echo.setHeader("x-large", std::string(LARGE_HEADER, 'h'));
+	empty.setURL(base + "/empty");
+	pending = 3;
+	std::string body = pattern(POST_SIZE, 2);
+	session.start(&big, boost::bind(&done, pattern(BIG_SIZE, 1), _1, _2));
+	session.start(&echo, "POST", body, boost::bind(&done, body, _1, _2));
+	session.start(&empty, boost::bind(&done, std::string(), _1, _2));
+	boost::thread_group threads;
+	for (int i = 0; i < 2; i++)
+		threads.create_thread(boost::bind(&boost::asio::io_service::run, &io));
+
+	boost::posix_time::ptime deadline = boost::posix_time::microsec_clock::universal_time() + boost::posix_time::seconds(30);
+	while (true) {
+		{
+			boost::mutex::scoped_lock lock(DoneLock);
+			if (pending == 0)
+				break;
+		}
+		if (boost::posix_time::microsec_clock::universal_time() > deadline) {
+			std::cerr << "timed out with " << pending << " requests outstanding" << std::endl;
+			return 1;
+		}
+		boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+	}
+	session.close();
+	serverthread.timed_join(boost::posix_time::seconds(10));
+	server.stop();
+	io.stop();
+	threads.join_all();
+
+	CHECK(session.getConnections() == 1);
+	/* the request headers need one CONTINUATION frame, and the bodies both ways need WINDOW_UPDATEs */
+	CHECK(server.continuations >= 1);
+	CHECK(server.windowupdates >= 2);
+	CHECK(server.windowviolations == 0);
+	CHECK(server.responses == 3);
+	if (failures)
+		std::cerr << failures << " checks failed" << std::endl;
+	return failures ? 1 : 0;
+}